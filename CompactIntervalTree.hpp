@@ -0,0 +1,552 @@
+/**
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * \file  CompactIntervalTree.hpp
+ * \brief A frozen version of IntervalTree that keeps the coordinates of its
+ *        intervals compressed. It has the same nodes as FlatIntervalTree, in
+ *        breadth-first order, over one pool of intervals, but the pool's
+ *        coordinates are cut into blocks of BLOCK_SIZE intervals, and each
+ *        block keeps its starts and ends relative to the smallest of them
+ *        (frame-of-reference encoding), in the fewest bytes (1, 2, 4 or 8)
+ *        that hold the largest difference. Breadth-first order puts the
+ *        nodes of each level side by side in coordinate order, so a block
+ *        spans little more than its intervals do, and for dense annotations
+ *        most blocks need only 1 or 2 bytes per coordinate, instead of the
+ *        3 x sizeof(R) bytes per interval FlatIntervalTree keeps. The
+ *        intervals themselves are kept once, in start order; alongside their
+ *        coordinates, each block keeps, for the nodes it covers, the order of
+ *        their intervals by end, packed just as narrowly. A query decodes
+ *        the nodes it visits a block at a time into fixed buffers, with loops
+ *        the compiler vectorises, and scans them with the kernels in
+ *        IntervalTreeSimd.hpp; as in IntervalTree, a point query walks a
+ *        node's starts up, or its ends down, and stops at the first interval
+ *        that misses. Coordinates must be integers.
+ *
+ * \authors Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef COMPACTINTERVALTREE_HPP_
+#define COMPACTINTERVALTREE_HPP_
+
+// stl includes
+#include <vector>
+#include <string>
+#include <sstream>
+#include <limits>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <stdint.h>
+
+// local includes
+#include "IntervalTree.hpp"
+#include "FlatIntervalTree.hpp"
+#include "IntervalTreeSimd.hpp"
+
+
+/******************************************************************************
+ * Class definitions and prototypes
+ *****************************************************************************/
+
+/**
+ * \brief One block of a CompactIntervalTree's coordinates. The starts of its
+ *        intervals, then their ends, less <base>, are packed <width> bytes
+ *        each from byte <at> of the tree's coordinate store. After them, for
+ *        each position p of the block, the index (within its node) of the
+ *        interval with the (p - offset)th smallest end in the node starting
+ *        at offset is packed <orderWidth> bytes wide.
+ */
+template <class R>
+struct CompactIntervalTreeBlock {
+  R base;
+  uint64_t at;
+  uint32_t width;
+  uint32_t orderWidth;
+};
+
+/**
+ * \brief Read-only interval tree with compressed coordinates
+ */
+template <class T, class R, class GetStart = R (*)(const T&),
+          class GetEnd = R (*)(const T&)>
+class CompactIntervalTree {
+  static_assert(std::is_integral<R>::value,
+                "CompactIntervalTree needs integer coordinates");
+
+ public:
+  typedef IntervalTree<T, R, GetStart, GetEnd> Tree;
+  typedef FlatIntervalTreeNode<R> Node;
+  typedef CompactIntervalTreeBlock<R> Block;
+
+  CompactIntervalTree();
+  template <class Stats, class Endpoints>
+  explicit CompactIntervalTree(
+      const IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> &t);
+  CompactIntervalTree(const std::vector<T> &intervals, GetStart getStart,
+                      GetEnd getEnd, const bool openEnded = false);
+  CompactIntervalTree(const std::vector<T> &intervals, GetStart getStart,
+                      GetEnd getEnd,
+                      const IntervalEndpointConvention endpoints);
+
+  // inspectors
+  const std::vector<T> intersectingPoint(const R point) const;
+  const std::vector<T> intersectingInterval(const R start, const R end) const;
+  const std::vector<T> squash() const { return this->intervals; }
+  const int size() const { return this->intervals.size(); }
+  IntervalEndpointConvention endpointConvention() const {
+    return this->endpoints;
+  }
+  const std::string toString() const;
+  size_t coordinateBytes() const;
+
+  // constants
+  static const bool OPEN_ENDED = true;
+  // the number of intervals whose coordinates share a base and a width
+  static const size_t BLOCK_SIZE = 128;
+
+ private:
+  typedef typename std::make_unsigned<R>::type Delta;
+
+  // the packed columns of a block
+  enum Column { STARTS, ENDS, ORDER };
+
+  template <class Stats, class Endpoints>
+  void compress(const IntervalTree<T, R, GetStart, GetEnd, Stats,
+                                   Endpoints> &t);
+  void pack(const size_t first, const size_t n,
+            const std::vector<uint32_t> &order);
+  size_t chunk(const size_t i, const size_t last) const {
+    return std::min(last, (i / BLOCK_SIZE + 1) * BLOCK_SIZE) - i;
+  }
+  template <class U>
+  void decode(const Column c, const size_t i, const size_t k, U *out) const;
+  R decode(const Column c, const size_t i) const;
+  template <class Endpoints>
+  void collectPoint(const R point, const Endpoints &conv,
+                    std::vector<T> &res) const;
+
+  std::vector<Node> nodes;
+  std::vector<T> intervals;
+  std::vector<Block> blocks;
+  // the packed coordinates of every block
+  std::vector<unsigned char> store;
+  typename IntervalAccessorHolder<GetStart>::type getStart;
+  typename IntervalAccessorHolder<GetEnd>::type getEnd;
+  IntervalEndpointConvention endpoints;
+};
+
+
+/******************************************************************************
+ * CompactIntervalTree class implementation
+ *****************************************************************************/
+
+template <class T, class R, class GetStart, class GetEnd>
+const size_t CompactIntervalTree<T, R, GetStart, GetEnd>::BLOCK_SIZE;
+
+/**
+ * \brief default constructor; gives an empty tree
+ */
+template <class T, class R, class GetStart, class GetEnd>
+CompactIntervalTree<T, R, GetStart, GetEnd>::CompactIntervalTree()
+    : getStart(), getEnd(), endpoints(INTERVAL_CLOSED) {;}
+
+/**
+ * \brief Build a CompactIntervalTree by freezing an existing IntervalTree.
+ *        The resulting tree has exactly the same shape as <t>, and the same
+ *        endpoint convention, whichever Endpoints policy <t> has.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+template <class Stats, class Endpoints>
+CompactIntervalTree<T, R, GetStart, GetEnd>::CompactIntervalTree(
+    const IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> &t)
+    : getStart(t.getStart), getEnd(t.getEnd),
+      endpoints(t.endpointConvention()) {
+  this->compress(t);
+}
+
+/**
+ * \brief Build a CompactIntervalTree directly from a set of intervals.
+ * \param intervals list of intervals, doesn't need to be sorted in any way.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+CompactIntervalTree<T, R, GetStart, GetEnd>::CompactIntervalTree(
+    const std::vector<T> &intervals, GetStart getStart, GetEnd getEnd,
+    const bool openEnded)
+    : getStart(getStart), getEnd(getEnd),
+      endpoints(intervalEndpointConvention(openEnded)) {
+  this->compress(Tree(intervals, getStart, getEnd, openEnded));
+}
+
+/**
+ * \brief Build a CompactIntervalTree from a set of intervals that are read
+ *        with the endpoint convention <endpoints>; e.g. INTERVAL_OPEN for
+ *        (s, e), which an open-ended flag can't ask for.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+CompactIntervalTree<T, R, GetStart, GetEnd>::CompactIntervalTree(
+    const std::vector<T> &intervals, GetStart getStart, GetEnd getEnd,
+    const IntervalEndpointConvention endpoints)
+    : getStart(getStart), getEnd(getEnd), endpoints(endpoints) {
+  this->compress(Tree(intervals, getStart, getEnd, endpoints));
+}
+
+/**
+ * \brief copy the contents of an IntervalTree into our (empty) arrays,
+ *        numbering the nodes in breadth-first order as FlatIntervalTree does,
+ *        then pack the coordinates of the pool, and each node's order by
+ *        end, a block at a time. As there, the accessors are set by the
+ *        constructors.
+ * \throws IntervalTreeError if there are too many intervals to index
+ */
+template <class T, class R, class GetStart, class GetEnd>
+template <class Stats, class Endpoints>
+void
+CompactIntervalTree<T, R, GetStart, GetEnd>::compress(
+    const IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> &t) {
+  typedef IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> Source;
+  if (t.data == NULL) return;
+
+  std::vector<const Source*> queue(1, &t);
+  for (size_t i = 0; i < queue.size(); ++i) {
+    const Source *cur = queue[i];
+    if (this->intervals.size() + cur->data->starts.size() >
+        std::numeric_limits<uint32_t>::max())
+      throw IntervalTreeError("too many intervals for a CompactIntervalTree");
+
+    Node n;
+    n.mid = cur->data->mid;
+    n.minStart = cur->minStart;
+    n.maxEnd = cur->maxEnd;
+    n.offset = this->intervals.size();
+    n.count = cur->data->starts.size();
+    n.left = Node::NONE;
+    n.right = Node::NONE;
+    if (cur->left != NULL) {
+      n.left = queue.size();
+      queue.push_back(cur->left);
+    }
+    if (cur->right != NULL) {
+      n.right = queue.size();
+      queue.push_back(cur->right);
+    }
+    this->nodes.push_back(n);
+    this->intervals.insert(this->intervals.end(), cur->data->starts.begin(),
+                           cur->data->starts.end());
+  }
+
+  std::vector<uint32_t> order(this->intervals.size());
+  for (size_t i = 0; i < this->nodes.size(); ++i) {
+    const Node &n = this->nodes[i];
+    uint32_t *first = order.data() + n.offset;
+    for (uint32_t j = 0; j < n.count; ++j) first[j] = j;
+    const T *here = this->intervals.data() + n.offset;
+    const GetEnd getEndF = this->getEnd;
+    std::stable_sort(first, first + n.count,
+                     [here, getEndF](const uint32_t a, const uint32_t b) {
+                       return getEndF(here[a]) < getEndF(here[b]);
+                     });
+  }
+  for (size_t i = 0; i < this->intervals.size(); i += BLOCK_SIZE)
+    this->pack(i, std::min(BLOCK_SIZE, this->intervals.size() - i), order);
+}
+
+/**
+ * \brief write the value <v> into <to>, <width> bytes wide
+ */
+inline void
+compactIntervalEncode(const uint64_t v, const uint32_t width,
+                      unsigned char *to) {
+  switch (width) {
+    case 1: { const uint8_t x = v; memcpy(to, &x, 1); break; }
+    case 2: { const uint16_t x = v; memcpy(to, &x, 2); break; }
+    case 4: { const uint32_t x = v; memcpy(to, &x, 4); break; }
+    default: memcpy(to, &v, 8);
+  }
+}
+
+/**
+ * \brief add <base> back to the <n> differences packed as <U>s from <in>,
+ *        into <out>; the loop has no branches, so it vectorises
+ */
+template <class U, class R>
+inline void
+compactIntervalDecode(const unsigned char *in, const size_t n, const R base,
+                      R *out) {
+  typedef typename std::make_unsigned<R>::type Delta;
+  for (size_t i = 0; i < n; ++i) {
+    U v;
+    memcpy(&v, in + i * sizeof(U), sizeof(U));
+    out[i] = static_cast<R>(static_cast<Delta>(base) + static_cast<Delta>(v));
+  }
+}
+
+/**
+ * \brief decode the <n> differences packed <width> bytes each from <in>
+ */
+template <class R>
+inline void
+compactIntervalDecode(const unsigned char *in, const size_t n,
+                      const uint32_t width, const R base, R *out) {
+  switch (width) {
+    case 1: compactIntervalDecode<uint8_t>(in, n, base, out); break;
+    case 2: compactIntervalDecode<uint16_t>(in, n, base, out); break;
+    case 4: compactIntervalDecode<uint32_t>(in, n, base, out); break;
+    default: compactIntervalDecode<uint64_t>(in, n, base, out);
+  }
+}
+
+/**
+ * \brief the fewest bytes (1, 2, 4 or 8) that hold <w>
+ */
+inline uint32_t
+compactIntervalWidth(const uint64_t w) {
+  return (w <= 0xFFu) ? 1 : (w <= 0xFFFFu) ? 2 : (w <= 0xFFFFFFFFu) ? 4 : 8;
+}
+
+/**
+ * \brief pack the coordinates of the <n> intervals of the pool from <first>
+ *        into a new block, followed by their entries of <order>. Its base is
+ *        the smallest of them, so that every difference is positive even if
+ *        an interval ends before it starts.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+void
+CompactIntervalTree<T, R, GetStart, GetEnd>::pack(
+    const size_t first, const size_t n, const std::vector<uint32_t> &order) {
+  Block b;
+  b.base = this->getStart(this->intervals[first]);
+  for (size_t i = first; i < first + n; ++i) {
+    b.base = std::min(b.base, this->getStart(this->intervals[i]));
+    b.base = std::min(b.base, this->getEnd(this->intervals[i]));
+  }
+  Delta widest = 0;
+  for (size_t i = first; i < first + n; ++i) {
+    widest = std::max(widest, static_cast<Delta>(
+      static_cast<Delta>(this->getStart(this->intervals[i])) -
+      static_cast<Delta>(b.base)));
+    widest = std::max(widest, static_cast<Delta>(
+      static_cast<Delta>(this->getEnd(this->intervals[i])) -
+      static_cast<Delta>(b.base)));
+  }
+  b.width = compactIntervalWidth(widest);
+  b.orderWidth = compactIntervalWidth(
+    *std::max_element(order.begin() + first, order.begin() + first + n));
+  b.at = this->store.size();
+  this->store.resize(b.at + n * (2 * b.width + b.orderWidth));
+  unsigned char *to = this->store.data() + b.at;
+  for (size_t i = 0; i < n; ++i) {
+    const T &it = this->intervals[first + i];
+    compactIntervalEncode(static_cast<Delta>(this->getStart(it)) -
+                          static_cast<Delta>(b.base), b.width,
+                          to + i * b.width);
+    compactIntervalEncode(static_cast<Delta>(this->getEnd(it)) -
+                          static_cast<Delta>(b.base), b.width,
+                          to + (n + i) * b.width);
+    compactIntervalEncode(order[first + i], b.orderWidth,
+                          to + 2 * n * b.width + i * b.orderWidth);
+  }
+  this->blocks.push_back(b);
+}
+
+/**
+ * \brief decode the <k> entries of column <c> for the intervals of the pool
+ *        from <i>, which must all be in one block, into <out>
+ */
+template <class T, class R, class GetStart, class GetEnd>
+template <class U>
+void
+CompactIntervalTree<T, R, GetStart, GetEnd>::decode(const Column c,
+                                                    const size_t i,
+                                                    const size_t k,
+                                                    U *out) const {
+  const Block &b = this->blocks[i / BLOCK_SIZE];
+  const size_t from = i - i % BLOCK_SIZE;
+  const size_t inBlock = std::min(BLOCK_SIZE, this->intervals.size() - from);
+  const unsigned char *in = this->store.data() + b.at;
+  if (c == ORDER) {
+    in += 2 * inBlock * b.width + (i - from) * b.orderWidth;
+    compactIntervalDecode(in, k, b.orderWidth, U(0), out);
+  } else {
+    in += ((c == ENDS ? inBlock : 0) + (i - from)) * b.width;
+    compactIntervalDecode(in, k, b.width, static_cast<U>(b.base), out);
+  }
+}
+
+/**
+ * \brief decode the start or end (by <c>) of interval <i> of the pool
+ */
+template <class T, class R, class GetStart, class GetEnd>
+R
+CompactIntervalTree<T, R, GetStart, GetEnd>::decode(const Column c,
+                                                    const size_t i) const {
+  R v;
+  this->decode(c, i, 1, &v);
+  return v;
+}
+
+/**
+ * \brief given a point, determine which set of intervals in the tree are
+ *        intersected.
+ * \param point the point of intersection to test against
+ * \return vector of intersected intervals
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::vector<T>
+CompactIntervalTree<T, R, GetStart, GetEnd>::intersectingPoint(
+    const R point) const {
+  std::vector<T> res;
+  if (this->endpoints == INTERVAL_OPEN)
+    this->collectPoint(point, IntervalOpenEndpoints(), res);
+  else if (this->endpoints == INTERVAL_HALF_OPEN)
+    this->collectPoint(point, IntervalHalfOpenEndpoints(), res);
+  else
+    this->collectPoint(point, IntervalClosedEndpoints(), res);
+  return res;
+}
+
+/**
+ * \brief append the intervals that contain <point> to <res>, testing their
+ *        starts and ends by the convention <conv>.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+template <class Endpoints>
+void
+CompactIntervalTree<T, R, GetStart, GetEnd>::collectPoint(
+    const R point, const Endpoints &conv, std::vector<T> &res) const {
+  R starts[BLOCK_SIZE];
+  uint32_t order[BLOCK_SIZE];
+  uint32_t cur = this->nodes.empty() ? Node::NONE : 0;
+  while (cur != Node::NONE) {
+    const Node &n = this->nodes[cur];
+    const size_t last = n.offset + n.count;
+    if (point < n.mid) {
+      // everything here ends after point, find those that start before it;
+      // they are a prefix of the node's intervals
+      for (size_t i = n.offset, k = 0; i < last; i += k) {
+        k = this->chunk(i, last);
+        this->decode(STARTS, i, k, starts);
+        const size_t count = simdCountLeading(starts, k, point,
+                                              Endpoints::OPEN_START);
+        res.insert(res.end(), this->intervals.begin() + i,
+                   this->intervals.begin() + i + count);
+        if (count < k) break;
+      }
+      cur = n.left;
+    } else {
+      // everything here begins at or before point, find those that reach
+      // it, latest end first, up to the first that doesn't. On a perfect
+      // match with mid, open intervals may start there too, and nothing in
+      // either subtree can overlap
+      const bool atMid = !(point > n.mid);
+      bool more = true;
+      for (size_t j = last; more && (j > n.offset);) {
+        const size_t i = std::max<size_t>(n.offset, (j - 1) - (j - 1) %
+                                                    BLOCK_SIZE);
+        this->decode(ORDER, i, j - i, order);
+        for (size_t k = j - i; more && (k > 0); --k) {
+          const size_t at = n.offset + order[k - 1];
+          more = conv.reaches(this->decode(ENDS, at), point);
+          if (more && (!(Endpoints::OPEN_START && atMid) ||
+                       conv.begins(this->decode(STARTS, at), point)))
+            res.push_back(this->intervals[at]);
+        }
+        j = i;
+      }
+      if (atMid) break;
+      cur = n.right;
+    }
+  }
+}
+
+/**
+ * \brief given an interval, determine which set of intervals in the tree are
+ *        intersected.
+ * \param start start of the query interval
+ * \param end end of the query interval
+ * \return vector of intersected intervals
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::vector<T>
+CompactIntervalTree<T, R, GetStart, GetEnd>::intersectingInterval(
+    const R start, const R end) const {
+  std::vector<T> res;
+  if (this->nodes.empty()) return res;
+
+  IntervalTreeStack<uint32_t> stack;
+  stack.push(0);
+  R starts[BLOCK_SIZE], ends[BLOCK_SIZE];
+  uint32_t hits[BLOCK_SIZE];
+  while (!stack.empty()) {
+    const Node &n = this->nodes[stack.pop()];
+    const size_t last = n.offset + n.count;
+    for (size_t i = n.offset, k = 0; i < last; i += k) {
+      k = this->chunk(i, last);
+      this->decode(STARTS, i, k, starts);
+      this->decode(ENDS, i, k, ends);
+      const size_t h = simdIntersecting(starts, ends, k, start, end,
+                                        this->endpoints, hits);
+      for (size_t x = 0; x < h; ++x)
+        res.push_back(this->intervals[i + hits[x]]);
+    }
+    if ((n.right != Node::NONE) && (end >= n.mid)) stack.push(n.right);
+    if ((n.left != Node::NONE) && (start <= n.mid)) stack.push(n.left);
+  }
+  return res;
+}
+
+/**
+ * \brief get the number of bytes used to hold the coordinates: the packed
+ *        store, with each node's order by end, and the blocks describing
+ *        it. The nodes, which are the same as a FlatIntervalTree's, and the
+ *        intervals aren't counted.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+size_t
+CompactIntervalTree<T, R, GetStart, GetEnd>::coordinateBytes() const {
+  return this->store.size() + this->blocks.size() * sizeof(Block);
+}
+
+/**
+ * \brief return a string representation of the tree; one line per node, in
+ *        array order.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::string
+CompactIntervalTree<T, R, GetStart, GetEnd>::toString() const {
+  std::ostringstream s;
+  for (size_t i = 0; i < this->nodes.size(); ++i) {
+    const Node &n = this->nodes[i];
+    s << "node " << i << " mid: " << n.mid << " left: ";
+    if (n.left == Node::NONE) s << "<EMPTY>";
+    else s << n.left;
+    s << " right: ";
+    if (n.right == Node::NONE) s << "<EMPTY>";
+    else s << n.right;
+    s << " intervals:";
+    for (uint32_t j = n.offset; j < n.offset + n.count; ++j) {
+      s << " (" << this->getStart(this->intervals[j]) << " - "
+        << this->getEnd(this->intervals[j]) << ")";
+    }
+    s << std::endl;
+  }
+  return s.str();
+}
+
+#endif  // COMPACTINTERVALTREE_HPP_
@@ -0,0 +1,492 @@
+/**
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * \file  FlatIntervalTree.hpp
+ * \brief A frozen, pointer-free version of IntervalTree. All nodes are kept
+ *        in a single array in breadth-first order, and the intervals of each
+ *        node are stored as offset ranges into two shared pools (one sorted
+ *        by start, the other by end) rather than in per-node vectors. The
+ *        tree cannot be modified once built, but answers the same queries as
+ *        IntervalTree with the same semantics, while touching far fewer
+ *        cache lines when the tree is large. The coordinates of the intervals
+ *        are also kept in columns of their own, apart from the intervals,
+ *        so node scans can use the vectorised kernels in
+ *        IntervalTreeSimd.hpp rather than calling the accessors.
+ *
+ * \authors Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef FLATINTERVALTREE_HPP_
+#define FLATINTERVALTREE_HPP_
+
+// stl includes
+#include <vector>
+#include <string>
+#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <cassert>
+#include <stdint.h>
+
+// local includes
+#include "IntervalTree.hpp"
+#include "IntervalTreeSimd.hpp"
+
+
+/******************************************************************************
+ * Class definitions and prototypes
+ *****************************************************************************/
+
+/**
+ * \brief A single node of a FlatIntervalTree. The intervals that overlap
+ *        <mid> are the entries [offset, offset + count) of the tree's pools;
+ *        children are referred to by their index in the node array. The
+ *        mid-point has the same type as in IntervalTreeNode. <minStart> and
+ *        <maxEnd> bound the intervals of the whole subtree, as they do in
+ *        IntervalTree, so queries can skip subtrees they can't have hits in.
+ */
+template <class R>
+struct FlatIntervalTreeNode {
+  typename IntervalMidType<R>::type mid;
+  R minStart;
+  R maxEnd;
+  uint32_t offset;
+  uint32_t count;
+  uint32_t left;
+  uint32_t right;
+
+  // marks a missing child
+  static const uint32_t NONE = 0xFFFFFFFF;
+};
+
+/**
+ * \brief Queries over a flattened tree whose arrays live elsewhere; either in
+ *        the vectors of a FlatIntervalTree or in a read-only memory mapping
+ *        (see MappedIntervalTree.hpp). A view owns nothing, and is cheap to
+ *        copy.
+ */
+template <class T, class R, class GetStart = R (*)(const T&),
+          class GetEnd = R (*)(const T&)>
+class FlatIntervalTreeView {
+ public:
+  FlatIntervalTreeView();
+  FlatIntervalTreeView(const FlatIntervalTreeNode<R> *nodes, size_t numNodes,
+                       const T *starts, const T *ends, const R *startsStart,
+                       const R *startsEnd, const R *endsEnd,
+                       size_t numIntervals, GetStart getStart, GetEnd getEnd,
+                       const IntervalEndpointConvention endpoints);
+
+  // inspectors
+  const std::vector<T> intersectingPoint(const R point) const;
+  const std::vector<T> intersectingInterval(const R start, const R end) const;
+  const std::vector<T> squash() const;
+  const int size() const { return this->numIntervals; }
+  const std::string toString() const;
+  IntervalEndpointConvention endpointConvention() const {
+    return this->endpoints;
+  }
+
+ private:
+  const FlatIntervalTreeNode<R> *nodes;
+  size_t numNodes;
+  const T *starts;
+  const T *ends;
+  const R *startsStart;
+  const R *startsEnd;
+  const R *endsEnd;
+  size_t numIntervals;
+  typename IntervalAccessorHolder<GetStart>::type getStart;
+  typename IntervalAccessorHolder<GetEnd>::type getEnd;
+  IntervalEndpointConvention endpoints;
+
+  // how many entries of a node are scanned at a time, when they have to be
+  static const size_t SCAN_CHUNK = 128;
+};
+
+/**
+ * \brief Read-only interval tree stored in contiguous arrays
+ */
+template <class T, class R, class GetStart = R (*)(const T&),
+          class GetEnd = R (*)(const T&)>
+class FlatIntervalTree {
+ public:
+  typedef IntervalTree<T, R, GetStart, GetEnd> Tree;
+  typedef FlatIntervalTreeView<T, R, GetStart, GetEnd> View;
+
+  FlatIntervalTree();
+  template <class Stats, class Endpoints>
+  explicit FlatIntervalTree(
+      const IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> &t);
+  FlatIntervalTree(const std::vector<T> &intervals, GetStart getStart,
+                   GetEnd getEnd, const bool openEnded = false);
+  FlatIntervalTree(const std::vector<T> &intervals, GetStart getStart,
+                   GetEnd getEnd, const IntervalEndpointConvention endpoints);
+
+  // inspectors
+  const std::vector<T> intersectingPoint(const R point) const {
+    return this->view().intersectingPoint(point);
+  }
+  const std::vector<T> intersectingInterval(const R start,
+                                            const R end) const {
+    return this->view().intersectingInterval(start, end);
+  }
+  const std::vector<T> squash() const { return this->starts; }
+  const int size() const { return this->starts.size(); }
+  const std::string toString() const { return this->view().toString(); }
+  const View view() const;
+  IntervalEndpointConvention endpointConvention() const {
+    return this->endpoints;
+  }
+
+  // constants
+  static const bool OPEN_ENDED = true;
+
+ private:
+  template <class U, class S, class GS, class GE>
+  friend class MappedIntervalTree;
+  template <class Stats, class Endpoints>
+  void flatten(const IntervalTree<T, R, GetStart, GetEnd, Stats,
+                                  Endpoints> &t);
+
+  std::vector<FlatIntervalTreeNode<R>> nodes;
+  std::vector<T> starts;
+  std::vector<T> ends;
+  // the start and end of each entry of <starts>, and the end of each entry
+  // of <ends>
+  std::vector<R> startsStart;
+  std::vector<R> startsEnd;
+  std::vector<R> endsEnd;
+  typename IntervalAccessorHolder<GetStart>::type getStart;
+  typename IntervalAccessorHolder<GetEnd>::type getEnd;
+  IntervalEndpointConvention endpoints;
+};
+
+
+/******************************************************************************
+ * FlatIntervalTree class implementation
+ *****************************************************************************/
+
+/**
+ * \brief default constructor; gives an empty tree
+ */
+template <class T, class R, class GetStart, class GetEnd>
+FlatIntervalTree<T, R, GetStart, GetEnd>::FlatIntervalTree()
+    : getStart(), getEnd(), endpoints(INTERVAL_CLOSED) {;}
+
+/**
+ * \brief Build a FlatIntervalTree by freezing an existing IntervalTree. The
+ *        resulting tree has exactly the same shape as <t>, and reads
+ *        intervals by the same endpoint convention, whichever Endpoints
+ *        policy <t> has.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+template <class Stats, class Endpoints>
+FlatIntervalTree<T, R, GetStart, GetEnd>::FlatIntervalTree(
+    const IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> &t)
+    : getStart(t.getStart), getEnd(t.getEnd),
+      endpoints(t.endpointConvention()) {
+  this->flatten(t);
+}
+
+/**
+ * \brief Build a FlatIntervalTree directly from a set of intervals.
+ * \param intervals list of intervals, doesn't need to be sorted in any way.
+ * \throws IntervalTreeError if no intervals are provided
+ */
+template <class T, class R, class GetStart, class GetEnd>
+FlatIntervalTree<T, R, GetStart, GetEnd>::FlatIntervalTree(
+    const std::vector<T> &intervals, GetStart getStart, GetEnd getEnd,
+    const bool openEnded)
+    : getStart(getStart), getEnd(getEnd),
+      endpoints(intervalEndpointConvention(openEnded)) {
+  this->flatten(Tree(intervals, getStart, getEnd, openEnded));
+}
+
+/**
+ * \brief Build a FlatIntervalTree directly from a set of intervals, read
+ *        with the endpoint convention <endpoints>; e.g. INTERVAL_OPEN for
+ *        (s, e).
+ * \throws IntervalTreeError if no intervals are provided
+ */
+template <class T, class R, class GetStart, class GetEnd>
+FlatIntervalTree<T, R, GetStart, GetEnd>::FlatIntervalTree(
+    const std::vector<T> &intervals, GetStart getStart, GetEnd getEnd,
+    const IntervalEndpointConvention endpoints)
+    : getStart(getStart), getEnd(getEnd), endpoints(endpoints) {
+  this->flatten(Tree(intervals, getStart, getEnd, endpoints));
+}
+
+/**
+ * \brief copy the contents of an IntervalTree into our (empty) arrays,
+ *        numbering the nodes in breadth-first order so that the top levels
+ *        of the tree, which every query visits, sit together at the front of
+ *        the array. The accessors are set by the constructors, since lambdas
+ *        can't be assigned.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+template <class Stats, class Endpoints>
+void
+FlatIntervalTree<T, R, GetStart, GetEnd>::flatten(
+    const IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> &t) {
+  typedef IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> Source;
+  if (t.data == NULL) return;
+
+  // queue[i] is the subtree that becomes node i; children are numbered as
+  // they are appended, which gives breadth-first order.
+  std::vector<const Source*> queue(1, &t);
+  for (size_t i = 0; i < queue.size(); ++i) {
+    const Source *cur = queue[i];
+    if (this->starts.size() + cur->data->starts.size() >
+        std::numeric_limits<uint32_t>::max())
+      throw IntervalTreeError("too many intervals for a FlatIntervalTree");
+
+    FlatIntervalTreeNode<R> n;
+    n.mid = cur->data->mid;
+    n.minStart = cur->minStart;
+    n.maxEnd = cur->maxEnd;
+    n.offset = this->starts.size();
+    n.count = cur->data->starts.size();
+    n.left = FlatIntervalTreeNode<R>::NONE;
+    n.right = FlatIntervalTreeNode<R>::NONE;
+    if (cur->left != NULL) {
+      n.left = queue.size();
+      queue.push_back(cur->left);
+    }
+    if (cur->right != NULL) {
+      n.right = queue.size();
+      queue.push_back(cur->right);
+    }
+    this->nodes.push_back(n);
+    this->starts.insert(this->starts.end(), cur->data->starts.begin(),
+                        cur->data->starts.end());
+    this->ends.insert(this->ends.end(), cur->data->ends.begin(),
+                      cur->data->ends.end());
+  }
+  for (size_t i = 0; i < this->starts.size(); ++i) {
+    this->startsStart.push_back(this->getStart(this->starts[i]));
+    this->startsEnd.push_back(this->getEnd(this->starts[i]));
+    this->endsEnd.push_back(this->getEnd(this->ends[i]));
+  }
+}
+
+/**
+ * \brief get a view of this tree, for querying it
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const typename FlatIntervalTree<T, R, GetStart, GetEnd>::View
+FlatIntervalTree<T, R, GetStart, GetEnd>::view() const {
+  return View(this->nodes.data(), this->nodes.size(), this->starts.data(),
+              this->ends.data(), this->startsStart.data(),
+              this->startsEnd.data(), this->endsEnd.data(),
+              this->starts.size(), this->getStart, this->getEnd,
+              this->endpoints);
+}
+
+
+/******************************************************************************
+ * FlatIntervalTreeView class implementation
+ *****************************************************************************/
+
+template <class T, class R, class GetStart, class GetEnd>
+const size_t FlatIntervalTreeView<T, R, GetStart, GetEnd>::SCAN_CHUNK;
+
+/**
+ * \brief default constructor; gives a view of an empty tree
+ */
+template <class T, class R, class GetStart, class GetEnd>
+FlatIntervalTreeView<T, R, GetStart, GetEnd>::FlatIntervalTreeView()
+    : nodes(NULL), numNodes(0), starts(NULL), ends(NULL), startsStart(NULL),
+      startsEnd(NULL), endsEnd(NULL), numIntervals(0), getStart(), getEnd(),
+      endpoints(INTERVAL_CLOSED) {;}
+
+/**
+ * \brief Constructor
+ * \param nodes the node array, root first
+ * \param starts pool holding every node's intervals sorted by start
+ * \param ends pool holding every node's intervals sorted by end
+ * \param startsStart start of each entry of <starts>
+ * \param startsEnd end of each entry of <starts>
+ * \param endsEnd end of each entry of <ends>
+ * \param numIntervals the number of entries in each pool and column
+ * \param endpoints how intervals and queries are read
+ */
+template <class T, class R, class GetStart, class GetEnd>
+FlatIntervalTreeView<T, R, GetStart, GetEnd>::FlatIntervalTreeView(
+    const FlatIntervalTreeNode<R> *nodes, size_t numNodes, const T *starts,
+    const T *ends, const R *startsStart, const R *startsEnd, const R *endsEnd,
+    size_t numIntervals, GetStart getStart, GetEnd getEnd,
+    const IntervalEndpointConvention endpoints)
+    : nodes(nodes), numNodes(numNodes), starts(starts), ends(ends),
+      startsStart(startsStart), startsEnd(startsEnd), endsEnd(endsEnd),
+      numIntervals(numIntervals), getStart(getStart), getEnd(getEnd),
+      endpoints(endpoints) {;}
+
+/**
+ * \brief given a point, determine which set of intervals in the tree are
+ *        intersected.
+ * \param point the point of intersection to test against
+ * \return vector of intersected intervals
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::vector<T>
+FlatIntervalTreeView<T, R, GetStart, GetEnd>::intersectingPoint(
+    const R point) const {
+  std::vector<T> res;
+  const bool openEnded = (this->endpoints != INTERVAL_CLOSED);
+  const bool openStart = (this->endpoints == INTERVAL_OPEN);
+  uint32_t cur = this->numNodes == 0 ? FlatIntervalTreeNode<R>::NONE : 0;
+  while (cur != FlatIntervalTreeNode<R>::NONE) {
+    const FlatIntervalTreeNode<R> &n = this->nodes[cur];
+    if ((point < n.minStart) || (point > n.maxEnd)) break;
+    if (point > n.mid) {
+      // everything here begins before point, find those that end after it;
+      // they are the entries after those that end before it (or at it, for
+      // open-ended intervals)
+      const size_t first = n.offset +
+        simdCountLeading(this->endsEnd + n.offset, n.count, point,
+                         !openEnded);
+      for (size_t i = n.offset + n.count; i > first; --i)
+        res.push_back(this->ends[i - 1]);
+      cur = n.right;
+    } else if (point < n.mid) {
+      // everything here ends after point, find those that start before it
+      // (or at it, unless they're open at the start)
+      const size_t count = simdCountLeading(this->startsStart + n.offset,
+                                            n.count, point, openStart);
+      res.insert(res.end(), this->starts + n.offset,
+                 this->starts + n.offset + count);
+      cur = n.left;
+    } else if (openStart) {
+      // perfect match with mid; open intervals contain it if they start
+      // before it and end after it
+      const size_t count = simdCountLeading(this->startsStart + n.offset,
+                                            n.count, point, true);
+      for (size_t i = n.offset; i < n.offset + count; ++i) {
+        if (point < this->startsEnd[i]) res.push_back(this->starts[i]);
+      }
+      break;
+    } else {
+      // perfect match with mid; everything here overlaps, except open-ended
+      // intervals that end on it, and nothing in either subtree can
+      const size_t first = n.offset + (!openEnded ? 0 :
+        simdCountLeading(this->endsEnd + n.offset, n.count, point, false));
+      res.insert(res.end(), this->ends + first,
+                 this->ends + n.offset + n.count);
+      break;
+    }
+  }
+  return res;
+}
+
+/**
+ * \brief given an interval, determine which set of intervals in the tree are
+ *        intersected.
+ * \param start start of the query interval
+ * \param end end of the query interval
+ * \return vector of intersected intervals
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::vector<T>
+FlatIntervalTreeView<T, R, GetStart, GetEnd>::intersectingInterval(
+    const R start, const R end) const {
+  std::vector<T> res;
+  if (this->numNodes == 0) return res;
+
+  // visit nodes in the same (pre-)order the pointer-based tree does, and
+  // find the hits in each the same way: all of them contain mid, so a query
+  // to one side of it only needs a prefix of <starts> or a suffix of <ends>
+  const bool openEnded = (this->endpoints != INTERVAL_CLOSED);
+  const bool strict = (this->endpoints == INTERVAL_OPEN) ||
+                      (openEnded && (start != end));
+  IntervalTreeStack<uint32_t> stack;
+  stack.push(0);
+  uint32_t hits[SCAN_CHUNK];
+  while (!stack.empty()) {
+    const FlatIntervalTreeNode<R> &n = this->nodes[stack.pop()];
+    if ((end < n.minStart) || (start > n.maxEnd)) continue;
+    const size_t last = n.offset + n.count;
+    if (end < n.mid) {
+      const size_t count = simdCountLeading(this->startsStart + n.offset,
+                                            n.count, end, strict);
+      res.insert(res.end(), this->starts + n.offset,
+                 this->starts + n.offset + count);
+    } else if (start > n.mid) {
+      const size_t first = n.offset +
+        simdCountLeading(this->endsEnd + n.offset, n.count, start,
+                         !openEnded);
+      res.insert(res.end(), this->ends + first, this->ends + last);
+    } else if (openEnded && ((start == n.mid) || (end == n.mid))) {
+      // an end-point exactly on mid; intervals that start or end on it may
+      // or may not intersect the query, so check them all, a chunk at a time
+      for (size_t i = n.offset; i < last; i += SCAN_CHUNK) {
+        const size_t k = std::min(SCAN_CHUNK, last - i);
+        const size_t h = simdIntersecting(this->startsStart + i,
+                                          this->startsEnd + i, k, start, end,
+                                          this->endpoints, hits);
+        for (size_t x = 0; x < h; ++x)
+          res.push_back(this->starts[i + hits[x]]);
+      }
+    } else {
+      res.insert(res.end(), this->starts + n.offset, this->starts + last);
+    }
+    if ((n.right != FlatIntervalTreeNode<R>::NONE) && (end >= n.mid))
+      stack.push(n.right);
+    if ((n.left != FlatIntervalTreeNode<R>::NONE) && (start <= n.mid))
+      stack.push(n.left);
+  }
+  return res;
+}
+
+/**
+ * \brief return a string representation of the tree; one line per node, in
+ *        array order.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::string
+FlatIntervalTreeView<T, R, GetStart, GetEnd>::toString() const {
+  std::ostringstream s;
+  for (size_t i = 0; i < this->numNodes; ++i) {
+    const FlatIntervalTreeNode<R> &n = this->nodes[i];
+    s << "node " << i << " mid: " << n.mid << " left: ";
+    if (n.left == FlatIntervalTreeNode<R>::NONE) s << "<EMPTY>";
+    else s << n.left;
+    s << " right: ";
+    if (n.right == FlatIntervalTreeNode<R>::NONE) s << "<EMPTY>";
+    else s << n.right;
+    s << " intervals:";
+    for (uint32_t j = n.offset; j < n.offset + n.count; ++j) {
+      s << " (" << this->getStart(this->starts[j]) << " - "
+        << this->getEnd(this->starts[j]) << ")";
+    }
+    s << std::endl;
+  }
+  return s.str();
+}
+
+/**
+ * \brief squash the tree -- i.e. return a vector of all items in the tree
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::vector<T>
+FlatIntervalTreeView<T, R, GetStart, GetEnd>::squash() const {
+  return std::vector<T>(this->starts, this->starts + this->numIntervals);
+}
+
+#endif  // FLATINTERVALTREE_HPP_
@@ -0,0 +1,465 @@
+/**
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * \file  IndexedIntervalTree.hpp
+ * \brief An interval tree that never copies the intervals it indexes. The
+ *        records are either kept in a vector owned by the caller (the tree
+ *        holds a pointer to it) or moved into the tree, and every node keeps
+ *        only 32-bit indices into that vector; the sorted-by-start and
+ *        sorted-by-end lists are index permutations. Nodes are laid out
+ *        like those of a FlatIntervalTree. Queries return pointers to the
+ *        stored records.
+ *
+ * \authors Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef INDEXEDINTERVALTREE_HPP_
+#define INDEXEDINTERVALTREE_HPP_
+
+// stl includes
+#include <vector>
+#include <string>
+#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <stdint.h>
+
+// local includes
+#include "IntervalTreeNode.hpp"
+#include "FlatIntervalTree.hpp"
+
+/******************************************************************************
+ * Class definitions and prototypes
+ *****************************************************************************/
+
+/**
+ * \brief Interval tree over a vector of records that it does not copy. As
+ *        for IntervalTree, GetStart and GetEnd are the types of the
+ *        accessors; function pointers by default, but functor or lambda
+ *        types let the compiler inline them.
+ */
+template <class T, class R, class GetStart = R (*)(const T&),
+          class GetEnd = R (*)(const T&)>
+class IndexedIntervalTree {
+ public:
+  IndexedIntervalTree();
+  IndexedIntervalTree(const std::vector<T> *records, GetStart getStart,
+                      GetEnd getEnd, const bool openEnded = false);
+  IndexedIntervalTree(const std::vector<T> *records, GetStart getStart,
+                      GetEnd getEnd,
+                      const IntervalEndpointConvention endpoints);
+  IndexedIntervalTree(std::vector<T> &&records, GetStart getStart,
+                      GetEnd getEnd, const bool openEnded = false);
+  IndexedIntervalTree(std::vector<T> &&records, GetStart getStart,
+                      GetEnd getEnd,
+                      const IntervalEndpointConvention endpoints);
+  IndexedIntervalTree(const IndexedIntervalTree &t);
+  IndexedIntervalTree(IndexedIntervalTree &&t) noexcept;
+  IndexedIntervalTree& operator=(IndexedIntervalTree other);
+  void swap(IndexedIntervalTree& other) noexcept;
+
+  // inspectors
+  const std::vector<const T*> intersectingPoint(const R point) const;
+  const std::vector<const T*> intersectingInterval(const R start,
+                                                   const R end) const;
+  const std::vector<T>& records() const { return *(this->recs); }
+  const int size() const { return this->starts.size(); }
+  IntervalEndpointConvention endpointConvention() const {
+    return this->endpoints;
+  }
+  const std::string toString() const;
+
+  // constants
+  static const bool OPEN_ENDED = true;
+
+ private:
+  void build();
+  template <class Endpoints>
+  void collectPoint(const R point, const Endpoints &conv,
+                    std::vector<const T*> &res) const;
+  template <class Endpoints>
+  void collectInterval(const R start, const R end, const Endpoints &conv,
+                       std::vector<const T*> &res) const;
+
+  std::vector<FlatIntervalTreeNode<R>> nodes;
+  std::vector<uint32_t> starts;
+  std::vector<uint32_t> ends;
+  std::vector<T> owned;
+  const std::vector<T> *recs;
+  typename IntervalAccessorHolder<GetStart>::type getStart;
+  typename IntervalAccessorHolder<GetEnd>::type getEnd;
+  IntervalEndpointConvention endpoints;
+};
+
+/**
+ * \brief Functor for sorting indices by the start or end of the record they
+ *        refer to, as read by <Accessor>.
+ */
+template <class T, class R, class Accessor = R (*)(const T&)>
+class IndexComparator {
+ public:
+  IndexComparator(const std::vector<T> &recs, Accessor compFunc)
+    : recs(recs), compFunc(compFunc) {;}
+  bool operator()(const uint32_t i1, const uint32_t i2) const {
+    return this->compFunc(this->recs[i1]) < this->compFunc(this->recs[i2]);
+  }
+ private:
+  const std::vector<T> &recs;
+  Accessor compFunc;
+};
+
+
+/******************************************************************************
+ * IndexedIntervalTree class implementation
+ *****************************************************************************/
+
+/**
+ * \brief default constructor; gives an empty tree
+ */
+template <class T, class R, class GetStart, class GetEnd>
+IndexedIntervalTree<T, R, GetStart, GetEnd>::IndexedIntervalTree()
+    : recs(&owned), getStart(), getEnd(), endpoints(INTERVAL_CLOSED) {;}
+
+/**
+ * \brief Build a tree over records owned by the caller. Nothing is copied;
+ *        the caller must keep <records> alive, and unchanged, for as long as
+ *        the tree is used.
+ * \throws IntervalTreeError if no records are provided
+ */
+template <class T, class R, class GetStart, class GetEnd>
+IndexedIntervalTree<T, R, GetStart, GetEnd>::IndexedIntervalTree(
+    const std::vector<T> *records, GetStart getStart, GetEnd getEnd,
+    const bool openEnded)
+    : IndexedIntervalTree(records, getStart, getEnd,
+                          intervalEndpointConvention(openEnded)) {;}
+
+/**
+ * \brief Build a tree over records owned by the caller, as above, whose
+ *        records are read with the endpoint convention <endpoints>; e.g.
+ *        INTERVAL_OPEN for (s, e), which an open-ended flag can't ask for.
+ * \throws IntervalTreeError if no records are provided
+ */
+template <class T, class R, class GetStart, class GetEnd>
+IndexedIntervalTree<T, R, GetStart, GetEnd>::IndexedIntervalTree(
+    const std::vector<T> *records, GetStart getStart, GetEnd getEnd,
+    const IntervalEndpointConvention endpoints)
+    : recs(records), getStart(getStart), getEnd(getEnd),
+      endpoints(endpoints) {
+  this->build();
+}
+
+/**
+ * \brief Build a tree that takes ownership of <records>.
+ * \throws IntervalTreeError if no records are provided
+ */
+template <class T, class R, class GetStart, class GetEnd>
+IndexedIntervalTree<T, R, GetStart, GetEnd>::IndexedIntervalTree(
+    std::vector<T> &&records, GetStart getStart, GetEnd getEnd,
+    const bool openEnded)
+    : IndexedIntervalTree(std::move(records), getStart, getEnd,
+                          intervalEndpointConvention(openEnded)) {;}
+
+/**
+ * \brief Build a tree that takes ownership of <records>, read with the
+ *        endpoint convention <endpoints>.
+ * \throws IntervalTreeError if no records are provided
+ */
+template <class T, class R, class GetStart, class GetEnd>
+IndexedIntervalTree<T, R, GetStart, GetEnd>::IndexedIntervalTree(
+    std::vector<T> &&records, GetStart getStart, GetEnd getEnd,
+    const IntervalEndpointConvention endpoints)
+    : owned(std::move(records)), recs(&owned), getStart(getStart),
+      getEnd(getEnd), endpoints(endpoints) {
+  this->build();
+}
+
+/**
+ * \brief Copy constructor; a tree that owns its records gets its own copy
+ *        of them, otherwise both trees refer to the caller's records.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+IndexedIntervalTree<T, R, GetStart, GetEnd>::IndexedIntervalTree(
+    const IndexedIntervalTree &t)
+    : nodes(t.nodes), starts(t.starts), ends(t.ends), owned(t.owned),
+      recs(t.recs == &t.owned ? &owned : t.recs), getStart(t.getStart),
+      getEnd(t.getEnd), endpoints(t.endpoints) {;}
+
+/**
+ * \brief Move constructor; <t> is left empty. The accessors are moved
+ *        rather than swapped, since lambdas can't be assigned.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+IndexedIntervalTree<T, R, GetStart, GetEnd>::IndexedIntervalTree(
+    IndexedIntervalTree &&t) noexcept
+    : nodes(std::move(t.nodes)), starts(std::move(t.starts)),
+      ends(std::move(t.ends)), owned(std::move(t.owned)),
+      recs(t.recs == &t.owned ? &owned : t.recs),
+      getStart(std::move(t.getStart)), getEnd(std::move(t.getEnd)),
+      endpoints(t.endpoints) {
+  t.nodes.clear();
+  t.starts.clear();
+  t.ends.clear();
+  t.owned.clear();
+  t.recs = &t.owned;
+}
+
+/**
+ * \brief assignment operator; copy (or move) and swap
+ */
+template <class T, class R, class GetStart, class GetEnd>
+IndexedIntervalTree<T, R, GetStart, GetEnd>&
+IndexedIntervalTree<T, R, GetStart, GetEnd>::operator=(
+    IndexedIntervalTree other) {
+  this->swap(other);
+  return *this;
+}
+
+/**
+ * \brief swap the contents of this tree with another; care is needed since
+ *        <recs> may point at our own <owned> vector.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+void
+IndexedIntervalTree<T, R, GetStart, GetEnd>::swap(
+    IndexedIntervalTree& other) noexcept {
+  const bool ownsHere = (this->recs == &this->owned);
+  const bool ownsThere = (other.recs == &other.owned);
+  this->nodes.swap(other.nodes);
+  this->starts.swap(other.starts);
+  this->ends.swap(other.ends);
+  this->owned.swap(other.owned);
+  std::swap(this->recs, other.recs);
+  if (ownsThere) this->recs = &this->owned;
+  if (ownsHere) other.recs = &other.owned;
+  std::swap(this->getStart, other.getStart);
+  std::swap(this->getEnd, other.getEnd);
+  std::swap(this->endpoints, other.endpoints);
+}
+
+/**
+ * \brief build the node array and index permutations. Subsets of indices
+ *        are partitioned exactly as IntervalTree partitions intervals, but
+ *        the input is sorted by start only once; each partition keeps that
+ *        order. Nodes are numbered in breadth-first order.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+void
+IndexedIntervalTree<T, R, GetStart, GetEnd>::build() {
+  const std::vector<T> &r = *(this->recs);
+  if (r.size() <= 0)
+    throw IntervalTreeError("Interval tree constructor got empty set of "
+                            "intervals");
+  if (r.size() > std::numeric_limits<uint32_t>::max())
+    throw IntervalTreeError("too many intervals for an IndexedIntervalTree");
+
+  IndexComparator<T, R, GetStart> startComp(r, this->getStart);
+  IndexComparator<T, R, GetEnd> endComp(r, this->getEnd);
+
+  // pending[i] holds the (start-sorted) indices that will make up node i
+  std::vector< std::vector<uint32_t> > pending(1);
+  pending[0].reserve(r.size());
+  for (uint32_t i = 0; i < r.size(); ++i) pending[0].push_back(i);
+  std::stable_sort(pending[0].begin(), pending[0].end(), startComp);
+
+  this->starts.reserve(r.size());
+  this->ends.reserve(r.size());
+  for (size_t cur = 0; cur < pending.size(); ++cur) {
+    std::vector<uint32_t> idx;
+    idx.swap(pending[cur]);
+
+    const T &midInt = r[idx[idx.size() / 2]];
+    R mid = ((this->getEnd(midInt) - this->getStart(midInt)) / 2)
+              + this->getStart(midInt);
+
+    std::vector<uint32_t> here, lt, rt;
+    R maxEnd = this->getEnd(r[idx[0]]);
+    for (size_t i = 0; i < idx.size(); ++i) {
+      if (this->getEnd(r[idx[i]]) > maxEnd) maxEnd = this->getEnd(r[idx[i]]);
+      if (this->getEnd(r[idx[i]]) < mid) lt.push_back(idx[i]);
+      else if (this->getStart(r[idx[i]]) > mid) rt.push_back(idx[i]);
+      else here.push_back(idx[i]);
+    }
+    if (here.size() <= 0) {
+      std::ostringstream msg;
+      msg << "fatal error: picked mid point at " << mid
+          << " but this failed to intersect anything!";
+      throw IntervalTreeError(msg.str().c_str());
+    }
+
+    FlatIntervalTreeNode<R> n;
+    n.mid = mid;
+    n.minStart = this->getStart(r[idx.front()]);
+    n.maxEnd = maxEnd;
+    n.offset = this->starts.size();
+    n.count = here.size();
+    n.left = FlatIntervalTreeNode<R>::NONE;
+    n.right = FlatIntervalTreeNode<R>::NONE;
+    if (lt.size() > 0) {
+      n.left = pending.size();
+      pending.push_back(std::vector<uint32_t>());
+      pending.back().swap(lt);
+    }
+    if (rt.size() > 0) {
+      n.right = pending.size();
+      pending.push_back(std::vector<uint32_t>());
+      pending.back().swap(rt);
+    }
+    this->nodes.push_back(n);
+
+    this->starts.insert(this->starts.end(), here.begin(), here.end());
+    std::stable_sort(here.begin(), here.end(), endComp);
+    this->ends.insert(this->ends.end(), here.begin(), here.end());
+  }
+}
+
+/**
+ * \brief given a point, determine which set of records in the tree are
+ *        intersected.
+ * \param point the point of intersection to test against
+ * \return pointers to the intersected records
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::vector<const T*>
+IndexedIntervalTree<T, R, GetStart, GetEnd>::intersectingPoint(
+    const R point) const {
+  std::vector<const T*> res;
+  if (this->endpoints == INTERVAL_OPEN)
+    this->collectPoint(point, IntervalOpenEndpoints(), res);
+  else if (this->endpoints == INTERVAL_HALF_OPEN)
+    this->collectPoint(point, IntervalHalfOpenEndpoints(), res);
+  else
+    this->collectPoint(point, IntervalClosedEndpoints(), res);
+  return res;
+}
+
+/**
+ * \brief append the records that contain <point> to <res>, testing their
+ *        starts and ends by the convention <conv>.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+template <class Endpoints>
+void
+IndexedIntervalTree<T, R, GetStart, GetEnd>::collectPoint(
+    const R point, const Endpoints &conv, std::vector<const T*> &res) const {
+  const std::vector<T> &r = *(this->recs);
+  uint32_t cur = this->nodes.empty() ? FlatIntervalTreeNode<R>::NONE : 0;
+  while (cur != FlatIntervalTreeNode<R>::NONE) {
+    const FlatIntervalTreeNode<R> &n = this->nodes[cur];
+    if (point < n.mid) {
+      // everything here ends after point, find those that start before it
+      for (uint32_t i = n.offset; i < n.offset + n.count; ++i) {
+        if (conv.begins(this->getStart(r[this->starts[i]]), point))
+          res.push_back(&r[this->starts[i]]);
+        else
+          break;
+      }
+      cur = n.left;
+    } else {
+      // everything here begins at or before point, find those that reach
+      // it; on a perfect match with mid that's all of them, unless they end
+      // there (or, if they're open, start there), and nothing in either
+      // subtree can
+      const bool atMid = !(point > n.mid);
+      for (uint32_t i = n.offset + n.count; i > n.offset; --i) {
+        const T &rec = r[this->ends[i - 1]];
+        if (!conv.reaches(this->getEnd(rec), point)) break;
+        if (!Endpoints::OPEN_START || !atMid ||
+            conv.begins(this->getStart(rec), point))
+          res.push_back(&rec);
+      }
+      if (atMid) break;
+      cur = n.right;
+    }
+  }
+}
+
+/**
+ * \brief given an interval, determine which set of records in the tree are
+ *        intersected.
+ * \param start start of the query interval
+ * \param end end of the query interval
+ * \return pointers to the intersected records
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::vector<const T*>
+IndexedIntervalTree<T, R, GetStart, GetEnd>::intersectingInterval(
+    const R start, const R end) const {
+  std::vector<const T*> res;
+  if (this->endpoints == INTERVAL_OPEN) {
+    this->collectInterval(start, end, IntervalOpenEndpoints(), res);
+  } else if (end < start) {
+    this->collectInterval(start, end,
+                          IntervalRuntimeEndpoints(this->endpoints), res);
+  } else if (this->endpoints == INTERVAL_HALF_OPEN) {
+    this->collectInterval(start, end, IntervalHalfOpenEndpoints(), res);
+  } else {
+    this->collectInterval(start, end, IntervalClosedEndpoints(), res);
+  }
+  return res;
+}
+
+/**
+ * \brief append the records that intersect [start, end] to <res>, testing
+ *        each by the convention <conv>.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+template <class Endpoints>
+void
+IndexedIntervalTree<T, R, GetStart, GetEnd>::collectInterval(
+    const R start, const R end, const Endpoints &conv,
+    std::vector<const T*> &res) const {
+  if (this->nodes.empty()) return;
+  const std::vector<T> &r = *(this->recs);
+  IntervalTreeStack<uint32_t> stack;
+  stack.push(0);
+  while (!stack.empty()) {
+    const FlatIntervalTreeNode<R> &n = this->nodes[stack.pop()];
+    for (uint32_t i = n.offset; i < n.offset + n.count; ++i) {
+      const T &rec = r[this->starts[i]];
+      if (conv.intersects(this->getStart(rec), this->getEnd(rec), start, end))
+        res.push_back(&rec);
+    }
+    if ((n.right != FlatIntervalTreeNode<R>::NONE) && (end >= n.mid))
+      stack.push(n.right);
+    if ((n.left != FlatIntervalTreeNode<R>::NONE) && (start <= n.mid))
+      stack.push(n.left);
+  }
+}
+
+/**
+ * \brief return a string representation of the tree; one line per node, in
+ *        array order, giving the indices of the records stored there.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::string
+IndexedIntervalTree<T, R, GetStart, GetEnd>::toString() const {
+  std::ostringstream s;
+  for (size_t i = 0; i < this->nodes.size(); ++i) {
+    const FlatIntervalTreeNode<R> &n = this->nodes[i];
+    s << "node " << i << " mid: " << n.mid << " records:";
+    for (uint32_t j = n.offset; j < n.offset + n.count; ++j)
+      s << " " << this->starts[j];
+    s << std::endl;
+  }
+  return s.str();
+}
+
+#endif  // INDEXEDINTERVALTREE_HPP_
@@ -0,0 +1,381 @@
+/**
+ * \file  IntervalCoverage.hpp
+ * \brief A coverage index over a set of intervals: the positions at which
+ *        the number of intervals covering a point changes, each with the
+ *        depth from there to the next one and the running total of depth
+ *        times length up to it. Built once from an IntervalTree or any range
+ *        of intervals, it answers the depth at a point, and the total depth
+ *        over a range, with one binary search each, and gives the depth
+ *        profile over a range as runs of constant depth; it doesn't keep the
+ *        intervals themselves. For closed intervals the coordinates must be
+ *        integers, so that an interval ending at e stops covering at e + 1.
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef INTERVALCOVERAGE_HPP_
+#define INTERVALCOVERAGE_HPP_
+
+// stl includes
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <type_traits>
+
+// local includes
+#include "IntervalTree.hpp"
+
+/******************************************************************************
+ * Class definitions and prototypes
+ *****************************************************************************/
+
+/**
+ * \brief A run of positions, from start to end, that are all covered by the
+ *        same number of intervals. Its ends are inclusive or exclusive as the
+ *        ends of the intervals the coverage was built from are.
+ */
+template <class R>
+struct IntervalCoverageSegment {
+  IntervalCoverageSegment(const R start, const R end, const size_t depth)
+      : start(start), end(end), depth(depth) {;}
+  bool operator==(const IntervalCoverageSegment &o) const {
+    return (this->start == o.start) && (this->end == o.end) &&
+           (this->depth == o.depth);
+  }
+
+  R start;
+  R end;
+  size_t depth;
+};
+
+/**
+ * \brief The coverage index. Internally every interval is half open: closed
+ *        intervals [s, e] are stored as [s, e + 1), and open ones (s, e) as
+ *        [s + 1, e).
+ */
+template <class R>
+class IntervalCoverage {
+ public:
+  // depth times length; a double if R is, otherwise an unsigned integer
+  typedef typename std::common_type<R, size_t>::type Area;
+
+  IntervalCoverage();
+  template <class InputIterator, class GetStart, class GetEnd>
+  IntervalCoverage(InputIterator first, InputIterator last, GetStart getStart,
+                   GetEnd getEnd,
+                   const IntervalRuntimeEndpoints endpoints =
+                     IntervalRuntimeEndpoints());
+  template <class T, class GetStart, class GetEnd, class Stats,
+            class Endpoints>
+  explicit IntervalCoverage(
+      const IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> &tree);
+
+  // inspectors
+  size_t depthAt(const R point) const;
+  Area depthOver(const R start, const R end) const;
+  double meanDepth(const R start, const R end) const;
+  std::vector< IntervalCoverageSegment<R> > profile(const R start,
+                                                    const R end) const;
+  size_t maxDepth() const;
+  size_t size() const { return this->positions.size(); }
+  bool isOpenEnded() const { return this->endpoints != INTERVAL_CLOSED; }
+  IntervalEndpointConvention endpointConvention() const {
+    return this->endpoints;
+  }
+
+ private:
+  void build(std::vector<R> &starts, std::vector<R> &ends);
+  R inclusive(const R start) const;
+  R exclusive(const R end) const;
+  size_t segmentAt(const R point) const;
+  Area areaBefore(const R point) const;
+  static void checkCoordinates(const IntervalEndpointConvention endpoints);
+
+  IntervalEndpointConvention endpoints;
+  // the depth is depths[i] from positions[i] up to positions[i + 1], and 0
+  // before the first position and after the last
+  std::vector<R> positions;
+  std::vector<size_t> depths;
+  // areas[i] is the sum of depth times length before positions[i]
+  std::vector<Area> areas;
+};
+
+
+/******************************************************************************
+ * IntervalCoverage class implementation
+ *****************************************************************************/
+
+/**
+ * \brief Constructor for an empty IntervalCoverage; every depth is 0.
+ */
+template <class R>
+IntervalCoverage<R>::IntervalCoverage() : endpoints(INTERVAL_CLOSED),
+                                          positions(), depths(), areas() {;}
+
+/**
+ * \brief Constructor for IntervalCoverage over the intervals in
+ *        [first, last), which can be in any order.
+ * \param endpoints whether the intervals are closed, half open or open, as
+ *                  for IntervalTree; true means half open
+ * \throws IntervalTreeError if they aren't half open and R isn't an integer
+ *                           type
+ */
+template <class R>
+template <class InputIterator, class GetStart, class GetEnd>
+IntervalCoverage<R>::IntervalCoverage(InputIterator first, InputIterator last,
+                                      GetStart getStart, GetEnd getEnd,
+                                      const IntervalRuntimeEndpoints endpoints)
+    : endpoints(endpoints.convention()), positions(), depths(), areas() {
+  checkCoordinates(this->endpoints);
+  std::vector<R> starts, ends;
+  for (; first != last; ++first) {
+    starts.push_back(this->inclusive(getStart(*first)));
+    ends.push_back(this->exclusive(getEnd(*first)));
+  }
+  this->build(starts, ends);
+}
+
+/**
+ * \brief Constructor for IntervalCoverage over the intervals in <tree>,
+ *        taken straight from its nodes, without copying the intervals.
+ * \throws IntervalTreeError if the tree isn't half open and R isn't an
+ *                           integer type
+ */
+template <class R>
+template <class T, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalCoverage<R>::IntervalCoverage(
+    const IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> &tree)
+    : endpoints(tree.endpointConvention()), positions(), depths(), areas() {
+  typedef IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> Tree;
+  checkCoordinates(this->endpoints);
+  std::vector<R> starts, ends;
+  starts.reserve(tree.size());
+  ends.reserve(tree.size());
+  if (tree.data != NULL) {
+    typename Tree::Stack stack;
+    stack.push(&tree);
+    while (!stack.empty()) {
+      const Tree *cur = stack.pop();
+      for (size_t i = 0; i < cur->data->starts.size(); ++i) {
+        const T &it = cur->data->starts[i];
+        starts.push_back(this->inclusive(tree.getStart(it)));
+        ends.push_back(this->exclusive(tree.getEnd(it)));
+      }
+      if (cur->right != NULL) stack.push(cur->right);
+      if (cur->left != NULL) stack.push(cur->left);
+    }
+  }
+  this->build(starts, ends);
+}
+
+/**
+ * \brief sweep the half open intervals given by <starts> and <ends> (which
+ *        are sorted here) in order, recording each position where the depth
+ *        changes. Intervals that cover nothing are ignored.
+ */
+template <class R>
+void
+IntervalCoverage<R>::build(std::vector<R> &starts, std::vector<R> &ends) {
+  size_t kept = 0;
+  for (size_t i = 0; i < starts.size(); ++i) {
+    if (!(starts[i] < ends[i])) continue;
+    starts[kept] = starts[i];
+    ends[kept++] = ends[i];
+  }
+  starts.resize(kept);
+  ends.resize(kept);
+  std::sort(starts.begin(), starts.end());
+  std::sort(ends.begin(), ends.end());
+
+  size_t depth = 0, s = 0, e = 0;
+  while (e < ends.size()) {
+    const R pos = ((s < starts.size()) && (starts[s] < ends[e])) ? starts[s]
+                                                                 : ends[e];
+    for (; (s < starts.size()) && !(pos < starts[s]); ++s) ++depth;
+    for (; (e < ends.size()) && !(pos < ends[e]); ++e) --depth;
+    if (!this->depths.empty() && (this->depths.back() == depth)) continue;
+    if (!this->positions.empty()) {
+      const size_t last = this->positions.size() - 1;
+      this->areas.push_back(this->areas.back() +
+                            static_cast<Area>(this->depths[last]) *
+                            static_cast<Area>(pos - this->positions[last]));
+    } else {
+      this->areas.push_back(Area());
+    }
+    this->positions.push_back(pos);
+    this->depths.push_back(depth);
+  }
+}
+
+/**
+ * \brief get the number of intervals that cover <point>
+ */
+template <class R>
+size_t
+IntervalCoverage<R>::depthAt(const R point) const {
+  const size_t i = this->segmentAt(point);
+  return (i == this->positions.size()) ? 0 : this->depths[i];
+}
+
+/**
+ * \brief get the sum, over the positions from <start> to <end>, of their
+ *        depth; for integer coordinates this is the number of bases of the
+ *        intervals that fall in the range. The range's ends are inclusive or
+ *        exclusive as the intervals' are.
+ */
+template <class R>
+typename IntervalCoverage<R>::Area
+IntervalCoverage<R>::depthOver(const R start, const R end) const {
+  const R first = this->inclusive(start);
+  const R last = this->exclusive(end);
+  if (!(first < last)) return Area();
+  return this->areaBefore(last) - this->areaBefore(first);
+}
+
+/**
+ * \brief get the mean depth over the positions from <start> to <end>; see
+ *        depthOver.
+ */
+template <class R>
+double
+IntervalCoverage<R>::meanDepth(const R start, const R end) const {
+  const R first = this->inclusive(start);
+  const R last = this->exclusive(end);
+  if (!(first < last)) return 0;
+  return static_cast<double>(this->depthOver(start, end)) /
+         static_cast<double>(last - first);
+}
+
+/**
+ * \brief get the depth over the positions from <start> to <end> as runs of
+ *        constant depth, in order; together they cover exactly that range,
+ *        including any parts of it that no interval covers, which are given
+ *        with depth 0. Ends are inclusive or exclusive as for depthOver.
+ */
+template <class R>
+std::vector< IntervalCoverageSegment<R> >
+IntervalCoverage<R>::profile(const R start, const R end) const {
+  std::vector< IntervalCoverageSegment<R> > res;
+  const R first = this->inclusive(start);
+  const R last = this->exclusive(end);
+  if (!(first < last)) return res;
+
+  size_t i = this->segmentAt(first);
+  R from = first;
+  while (from < last) {
+    size_t depth = 0;
+    R to = last;
+    if (i == this->positions.size()) {
+      // before the first position
+      if ((!this->positions.empty()) && (this->positions[0] < last))
+        to = this->positions[0];
+      i = 0;
+    } else {
+      depth = this->depths[i];
+      if ((i + 1 < this->positions.size()) &&
+          (this->positions[i + 1] < last))
+        to = this->positions[i + 1];
+      ++i;
+    }
+    if (this->endpoints == INTERVAL_HALF_OPEN)
+      res.push_back(IntervalCoverageSegment<R>(from, to, depth));
+    else if (this->endpoints == INTERVAL_OPEN)
+      res.push_back(IntervalCoverageSegment<R>(from - 1, to, depth));
+    else res.push_back(IntervalCoverageSegment<R>(from, to - 1, depth));
+    from = to;
+  }
+  return res;
+}
+
+/**
+ * \brief get the greatest depth at any point
+ */
+template <class R>
+size_t
+IntervalCoverage<R>::maxDepth() const {
+  if (this->depths.empty()) return 0;
+  return *std::max_element(this->depths.begin(), this->depths.end());
+}
+
+/**
+ * \brief get the inclusive start of an interval that starts at <start>
+ */
+template <class R>
+R
+IntervalCoverage<R>::inclusive(const R start) const {
+  return (this->endpoints == INTERVAL_OPEN) ? static_cast<R>(start + 1)
+                                            : start;
+}
+
+/**
+ * \brief get the exclusive end of an interval that ends at <end>
+ */
+template <class R>
+R
+IntervalCoverage<R>::exclusive(const R end) const {
+  return (this->endpoints == INTERVAL_CLOSED) ? static_cast<R>(end + 1)
+                                              : end;
+}
+
+/**
+ * \brief get the index of the last position at or before <point>, or the
+ *        number of positions if there isn't one.
+ */
+template <class R>
+size_t
+IntervalCoverage<R>::segmentAt(const R point) const {
+  const size_t i = std::upper_bound(this->positions.begin(),
+                                    this->positions.end(), point) -
+                   this->positions.begin();
+  return (i == 0) ? this->positions.size() : i - 1;
+}
+
+/**
+ * \brief get the sum of depth times length over everything before <point>
+ */
+template <class R>
+typename IntervalCoverage<R>::Area
+IntervalCoverage<R>::areaBefore(const R point) const {
+  const size_t i = this->segmentAt(point);
+  if (i == this->positions.size()) return Area();
+  return this->areas[i] + static_cast<Area>(this->depths[i]) *
+                          static_cast<Area>(point - this->positions[i]);
+}
+
+/**
+ * \brief make sure closed or open intervals can be made half open
+ * \throws IntervalTreeError if they aren't half open and R isn't an integer
+ *                           type
+ */
+template <class R>
+void
+IntervalCoverage<R>::checkCoordinates(
+    const IntervalEndpointConvention endpoints) {
+  if ((endpoints == INTERVAL_HALF_OPEN) || std::is_integral<R>::value) return;
+  throw IntervalTreeError("IntervalCoverage needs integer coordinates for "
+                          "closed or open intervals; use half open ones "
+                          "instead");
+}
+
+#endif  // INTERVALCOVERAGE_HPP_
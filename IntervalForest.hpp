@@ -0,0 +1,822 @@
+/**
+ * \file  IntervalForest.hpp
+ * \brief A forest of IntervalTrees, one for each key (e.g. one per
+ *        chromosome or contig), behind a single query interface. Keys are
+ *        mapped to dense integer ids when the forest is built, so callers
+ *        that look a key up once and then query by id pay nothing for it on
+ *        each query. The whole forest can be written to a single file and
+ *        queried in place from there with MappedIntervalForest, which uses
+ *        the tree image format of MappedIntervalTree for each of its trees;
+ *        that part has the same restrictions (trivially copyable T, POSIX
+ *        only).
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef INTERVALFOREST_HPP_
+#define INTERVALFOREST_HPP_
+
+// stl includes
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <utility>
+#include <memory>
+#include <stdint.h>
+
+// system includes
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// local includes
+#include "IntervalTree.hpp"
+#include "FlatIntervalTree.hpp"
+#include "MappedIntervalTree.hpp"
+
+/******************************************************************************
+ * Class definitions and prototypes
+ *****************************************************************************/
+
+/**
+ * \brief One query on an IntervalForest: the interval [start, end] (or the
+ *        point start, for point queries) on the tree with the given id.
+ */
+template <class R>
+struct IntervalForestQuery {
+  IntervalForestQuery() : id(0), start(), end() {;}
+  IntervalForestQuery(const size_t id, const R start, const R end)
+      : id(id), start(start), end(end) {;}
+  size_t id;
+  R start;
+  R end;
+};
+
+/**
+ * \brief The header at the start of a forest file. The tree images follow
+ *        it, each starting a multiple of ALIGNMENT bytes into the file, and
+ *        then the key table: for each tree, in id order, the offset and size
+ *        of its image and the length of its key (all uint64_t), then the
+ *        key itself.
+ */
+struct IntervalForestHeader {
+  char magic[8];
+  uint32_t byteOrder;
+  uint32_t version;
+  uint64_t numTrees;
+  uint64_t tableOffset;
+  uint64_t tableSize;
+
+  static const uint32_t VERSION = 1;
+  static const uint32_t ALIGNMENT = MappedIntervalTreeHeader::ALIGNMENT;
+};
+
+/**
+ * \brief A forest of IntervalTrees, one per key
+ */
+template <class T, class R, class GetStart = R (*)(const T&),
+          class GetEnd = R (*)(const T&),
+          class Endpoints = IntervalRuntimeEndpoints>
+class IntervalForest {
+ public:
+  typedef IntervalTree<T, R, GetStart, GetEnd, IntervalTreeNoStats,
+                       Endpoints> Tree;
+  typedef IntervalForestQuery<R> Query;
+
+  IntervalForest() {;}
+  template <class GetKey>
+  IntervalForest(const std::vector<T> &intervals, GetKey getKey,
+                 GetStart getStart, GetEnd getEnd,
+                 const Endpoints endpoints = Endpoints(),
+                 const unsigned numThreads = 0,
+                 IntervalTreeArena *arena = NULL,
+                 const IntervalSplitStrategy split =
+                   INTERVAL_SPLIT_MIDDLE_INTERVAL);
+  template <class GetKey>
+  IntervalForest(std::vector<T> &&intervals, GetKey getKey,
+                 GetStart getStart, GetEnd getEnd,
+                 const Endpoints endpoints = Endpoints(),
+                 const unsigned numThreads = 0,
+                 IntervalTreeArena *arena = NULL,
+                 const IntervalSplitStrategy split =
+                   INTERVAL_SPLIT_MIDDLE_INTERVAL);
+
+  // keys and their trees
+  size_t numKeys() const { return this->keys.size(); }
+  size_t id(const std::string &key) const;
+  const std::string& key(const size_t id) const { return this->keys[id]; }
+  const Tree& tree(const size_t id) const { return this->trees[id]; }
+
+  // inspectors
+  const std::vector<T> intersectingPoint(const std::string &key,
+                                         const R point) const;
+  const std::vector<T> intersectingInterval(const std::string &key,
+                                            const R start,
+                                            const R end) const;
+  const std::vector<T> intersectingPoint(const size_t id,
+                                         const R point) const;
+  const std::vector<T> intersectingInterval(const size_t id, const R start,
+                                            const R end) const;
+  size_t countIntersectingInterval(const size_t id, const R start,
+                                   const R end) const;
+  IntervalTreeBatchResult<T> intersectingIntervals(
+      const std::vector<Query> &queries) const;
+  IntervalTreeBatchResult<T> intersectingPoints(
+      const std::vector<Query> &queries) const;
+  IntervalTreeBatchResult<T> intersectingIntervalsParallel(
+      const std::vector<Query> &queries, unsigned numThreads = 0) const;
+  IntervalTreeBatchResult<T> intersectingPointsParallel(
+      const std::vector<Query> &queries, unsigned numThreads = 0) const;
+  const int size() const;
+
+  // writing the forest to a file for MappedIntervalForest
+  void write(const std::string &filename) const;
+
+  // constants
+  static const size_t NO_ID = static_cast<size_t>(-1);
+
+ private:
+  template <class GetKey>
+  void build(std::vector<T> &intervals, GetKey getKey, GetStart getStart,
+             GetEnd getEnd, const Endpoints endpoints, unsigned numThreads,
+             IntervalTreeArena *arena, const IntervalSplitStrategy split);
+  IntervalTreeBatchResult<T> batch(const std::vector<Query> &queries,
+                                   const bool points,
+                                   unsigned numThreads) const;
+
+  std::vector<std::string> keys;
+  std::unordered_map<std::string, size_t> ids;
+  std::vector<Tree> trees;
+};
+
+/**
+ * \brief Read-only forest backed by a memory mapped file written by
+ *        IntervalForest::write
+ */
+template <class T, class R, class GetStart = R (*)(const T&),
+          class GetEnd = R (*)(const T&)>
+class MappedIntervalForest {
+ public:
+  typedef MappedIntervalTree<T, R, GetStart, GetEnd> Mapped;
+  typedef typename Mapped::View View;
+
+  MappedIntervalForest() : map(NULL), mapLength(0) {;}
+  MappedIntervalForest(const std::string &filename, GetStart getStart,
+                       GetEnd getEnd, const bool validate = false);
+  MappedIntervalForest(MappedIntervalForest &&f) noexcept;
+  ~MappedIntervalForest();
+  MappedIntervalForest& operator=(MappedIntervalForest &&f) noexcept;
+  void swap(MappedIntervalForest &other) noexcept;
+
+  // keys and their trees
+  size_t numKeys() const { return this->keys.size(); }
+  size_t id(const std::string &key) const;
+  const std::string& key(const size_t id) const { return this->keys[id]; }
+  const View& tree(const size_t id) const { return this->trees[id]; }
+
+  // inspectors
+  const std::vector<T> intersectingPoint(const std::string &key,
+                                         const R point) const;
+  const std::vector<T> intersectingInterval(const std::string &key,
+                                            const R start,
+                                            const R end) const;
+  const std::vector<T> intersectingPoint(const size_t id,
+                                         const R point) const;
+  const std::vector<T> intersectingInterval(const size_t id, const R start,
+                                            const R end) const;
+
+  // constants
+  static const size_t NO_ID = static_cast<size_t>(-1);
+
+ private:
+  // the mapping is owned, so copying is not allowed
+  MappedIntervalForest(const MappedIntervalForest &f);
+  MappedIntervalForest& operator=(const MappedIntervalForest &f);
+
+  void parse(GetStart getStart, GetEnd getEnd, const bool validate);
+
+  void *map;
+  size_t mapLength;
+  std::vector<std::string> keys;
+  std::unordered_map<std::string, size_t> ids;
+  std::vector<View> trees;
+};
+
+
+/******************************************************************************
+ * IntervalForest class implementation
+ *****************************************************************************/
+
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+const size_t IntervalForest<T, R, GetStart, GetEnd, Endpoints>::NO_ID;
+
+/**
+ * \brief Constructor for IntervalForest.
+ * \param intervals the intervals for all keys, in any order.
+ * \param getKey gives the key (e.g. chromosome name) of an interval, as
+ *               anything a std::string can be made from. Ids are given to
+ *               keys in the order they are first seen in <intervals>.
+ * \param numThreads maximum number of threads to build with; 0 means one per
+ *                   hardware thread. The trees are built in parallel,
+ *                   largest first.
+ * \param arena if not NULL, every tree is allocated in this one arena, which
+ *              must outlive the forest.
+ * The other arguments are as for the IntervalTree constructor, and apply to
+ * every tree.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+template <class GetKey>
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::IntervalForest(
+    const std::vector<T> &intervals, GetKey getKey, GetStart getStart,
+    GetEnd getEnd, const Endpoints endpoints, const unsigned numThreads,
+    IntervalTreeArena *arena, const IntervalSplitStrategy split) {
+  std::vector<T> work(intervals);
+  this->build(work, getKey, getStart, getEnd, endpoints, numThreads, arena,
+              split);
+}
+
+/**
+ * \brief As above, but taking over <intervals> rather than copying them;
+ *        the vector is left empty.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+template <class GetKey>
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::IntervalForest(
+    std::vector<T> &&intervals, GetKey getKey, GetStart getStart,
+    GetEnd getEnd, const Endpoints endpoints, const unsigned numThreads,
+    IntervalTreeArena *arena, const IntervalSplitStrategy split) {
+  std::vector<T> work(std::move(intervals));
+  this->build(work, getKey, getStart, getEnd, endpoints, numThreads, arena,
+              split);
+}
+
+/**
+ * \brief split <intervals> up by key, giving each key its id, and build a
+ *        tree for each key. Each thread takes the largest tree not yet
+ *        started, so one big chromosome doesn't hold up the rest; if there
+ *        are fewer trees than threads, the spare threads go to building the
+ *        trees themselves. <intervals> is left empty.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+template <class GetKey>
+void
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::build(
+    std::vector<T> &intervals, GetKey getKey, GetStart getStart,
+    GetEnd getEnd, const Endpoints endpoints, unsigned numThreads,
+    IntervalTreeArena *arena, const IntervalSplitStrategy split) {
+  std::vector<size_t> of(intervals.size());
+  std::vector<size_t> counts;
+  for (size_t i = 0; i < intervals.size(); ++i) {
+    const std::string k(getKey(intervals[i]));
+    typename std::unordered_map<std::string, size_t>::const_iterator it =
+      this->ids.find(k);
+    if (it == this->ids.end()) {
+      it = this->ids.insert(std::make_pair(k, this->keys.size())).first;
+      this->keys.push_back(k);
+      counts.push_back(0);
+    }
+    of[i] = it->second;
+    counts[it->second] += 1;
+  }
+  std::vector< std::vector<T> > groups(this->keys.size());
+  for (size_t g = 0; g < groups.size(); ++g) groups[g].reserve(counts[g]);
+  for (size_t i = 0; i < intervals.size(); ++i)
+    groups[of[i]].push_back(std::move(intervals[i]));
+  std::vector<T>().swap(intervals);
+  std::vector<size_t>().swap(of);
+
+  std::vector<size_t> order(groups.size());
+  for (size_t g = 0; g < order.size(); ++g) order[g] = g;
+  std::stable_sort(order.begin(), order.end(),
+                   [&counts](size_t a, size_t b) {
+                     return counts[a] > counts[b];
+                   });
+
+  if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+  if (numThreads == 0) numThreads = 1;
+  const unsigned workers = std::min<size_t>(numThreads, groups.size());
+  const unsigned perTree = std::max(1u, numThreads / std::max(1u, workers));
+  // each tree is built in place, so Tree needn't be default constructible
+  // or assignable, and moved into the forest once all are done
+  std::vector< std::unique_ptr<Tree> > built(groups.size());
+  std::atomic<size_t> next(0);
+  std::vector<std::exception_ptr> errors(workers);
+  auto work = [&](unsigned w) {
+    try {
+      for (size_t i = next++; i < order.size(); i = next++) {
+        const size_t g = order[i];
+        built[g].reset(new Tree(std::move(groups[g]), getStart, getEnd,
+                                endpoints, perTree, arena, split));
+      }
+    } catch (...) {
+      errors[w] = std::current_exception();
+      next = order.size();
+    }
+  };
+  if (workers <= 1) {
+    if (workers == 1) work(0);
+  } else {
+    std::vector<std::thread> threads;
+    for (unsigned w = 0; w < workers; ++w)
+      threads.push_back(std::thread(work, w));
+    for (size_t w = 0; w < threads.size(); ++w) threads[w].join();
+  }
+  for (size_t w = 0; w < errors.size(); ++w)
+    if (errors[w]) std::rethrow_exception(errors[w]);
+  this->trees.reserve(built.size());
+  for (size_t g = 0; g < built.size(); ++g)
+    this->trees.push_back(std::move(*built[g]));
+}
+
+/**
+ * \brief the id of <key>, or NO_ID if the forest has no intervals for it.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+size_t
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::id(
+    const std::string &key) const {
+  typename std::unordered_map<std::string, size_t>::const_iterator it =
+    this->ids.find(key);
+  return it == this->ids.end() ? NO_ID : it->second;
+}
+
+/**
+ * \brief get the intervals with key <key> that intersect <point>; there
+ *        are none for a key the forest doesn't have.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+const std::vector<T>
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::intersectingPoint(
+    const std::string &key, const R point) const {
+  return this->intersectingPoint(this->id(key), point);
+}
+
+/**
+ * \brief get the intervals with key <key> that intersect [start, end];
+ *        there are none for a key the forest doesn't have.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+const std::vector<T>
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::intersectingInterval(
+    const std::string &key, const R start, const R end) const {
+  return this->intersectingInterval(this->id(key), start, end);
+}
+
+/**
+ * \brief get the intervals in the tree with id <id> that intersect <point>;
+ *        there are none if <id> is NO_ID.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+const std::vector<T>
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::intersectingPoint(
+    const size_t id, const R point) const {
+  if (id >= this->trees.size()) return std::vector<T>();
+  return this->trees[id].intersectingPoint(point);
+}
+
+/**
+ * \brief get the intervals in the tree with id <id> that intersect
+ *        [start, end]; there are none if <id> is NO_ID.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+const std::vector<T>
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::intersectingInterval(
+    const size_t id, const R start, const R end) const {
+  if (id >= this->trees.size()) return std::vector<T>();
+  return this->trees[id].intersectingInterval(start, end);
+}
+
+/**
+ * \brief count the intervals in the tree with id <id> that intersect
+ *        [start, end]
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+size_t
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::countIntersectingInterval(
+    const size_t id, const R start, const R end) const {
+  if (id >= this->trees.size()) return 0;
+  return this->trees[id].countIntersectingInterval(start, end);
+}
+
+/**
+ * \brief answer a set of interval queries, each on the tree with its id.
+ *        The queries for each tree are answered together as one of that
+ *        tree's batches, but the hits come back in query order, as for
+ *        IntervalTree::intersectingIntervals. Queries with an id of NO_ID
+ *        have no hits.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+IntervalTreeBatchResult<T>
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::intersectingIntervals(
+    const std::vector<Query> &queries) const {
+  return this->batch(queries, false, 1);
+}
+
+/**
+ * \brief answer a set of point queries (the point being each query's
+ *        start); see intersectingIntervals.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+IntervalTreeBatchResult<T>
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::intersectingPoints(
+    const std::vector<Query> &queries) const {
+  return this->batch(queries, true, 1);
+}
+
+/**
+ * \brief as intersectingIntervals, but with the trees' batches shared out
+ *        among several threads; the result is the same.
+ * \param numThreads how many threads to use; 0 means one per hardware thread
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+IntervalTreeBatchResult<T>
+IntervalForest<T, R, GetStart, GetEnd,
+               Endpoints>::intersectingIntervalsParallel(
+    const std::vector<Query> &queries, unsigned numThreads) const {
+  return this->batch(queries, false, numThreads);
+}
+
+/**
+ * \brief as intersectingPoints, but using several threads; see
+ *        intersectingIntervalsParallel.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+IntervalTreeBatchResult<T>
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::intersectingPointsParallel(
+    const std::vector<Query> &queries, unsigned numThreads) const {
+  return this->batch(queries, true, numThreads);
+}
+
+/**
+ * \brief group <queries> by tree, run each group as a batch on its tree
+ *        (in parallel, if we have more than one thread), and put the hits
+ *        back into query order.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+IntervalTreeBatchResult<T>
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::batch(
+    const std::vector<Query> &queries, const bool points,
+    unsigned numThreads) const {
+  // where each query is in its tree's group
+  std::vector< std::vector< std::pair<R, R> > > groups(this->trees.size());
+  std::vector<size_t> pos(queries.size());
+  for (size_t i = 0; i < queries.size(); ++i) {
+    const size_t id = queries[i].id;
+    if (id >= this->trees.size()) continue;
+    pos[i] = groups[id].size();
+    groups[id].push_back(std::make_pair(queries[i].start,
+                                        points ? queries[i].start
+                                               : queries[i].end));
+  }
+
+  std::vector< IntervalTreeBatchResult<T> > parts(groups.size());
+  if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+  if (numThreads == 0) numThreads = 1;
+  const unsigned workers = std::min<size_t>(numThreads, groups.size());
+  std::atomic<size_t> next(0);
+  std::vector<std::exception_ptr> errors(std::max(1u, workers));
+  auto work = [&](unsigned w) {
+    try {
+      for (size_t g = next++; g < groups.size(); g = next++) {
+        if (groups[g].empty()) continue;
+        if (!points) {
+          parts[g] = this->trees[g].intersectingIntervals(groups[g]);
+          continue;
+        }
+        std::vector<R> pts;
+        pts.reserve(groups[g].size());
+        for (size_t j = 0; j < groups[g].size(); ++j)
+          pts.push_back(groups[g][j].first);
+        parts[g] = this->trees[g].intersectingPoints(pts);
+      }
+    } catch (...) {
+      errors[w] = std::current_exception();
+      next = groups.size();
+    }
+  };
+  if (workers <= 1) {
+    work(0);
+  } else {
+    std::vector<std::thread> threads;
+    for (unsigned w = 0; w < workers; ++w)
+      threads.push_back(std::thread(work, w));
+    for (size_t w = 0; w < threads.size(); ++w) threads[w].join();
+  }
+  for (size_t w = 0; w < errors.size(); ++w)
+    if (errors[w]) std::rethrow_exception(errors[w]);
+
+  IntervalTreeBatchResult<T> res;
+  size_t numHits = 0;
+  for (size_t g = 0; g < parts.size(); ++g) numHits += parts[g].hits.size();
+  res.offsets.reserve(queries.size() + 1);
+  res.offsets.push_back(0);
+  res.hits.reserve(numHits);
+  for (size_t i = 0; i < queries.size(); ++i) {
+    const size_t id = queries[i].id;
+    if (id < this->trees.size()) {
+      const IntervalTreeBatchResult<T> &p = parts[id];
+      res.hits.insert(res.hits.end(), p.hits.begin() + p.offsets[pos[i]],
+                      p.hits.begin() + p.offsets[pos[i] + 1]);
+    }
+    res.offsets.push_back(res.hits.size());
+  }
+  return res;
+}
+
+/**
+ * \brief get the number of intervals in the forest
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+const int
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::size() const {
+  size_t res = 0;
+  for (size_t i = 0; i < this->trees.size(); ++i)
+    res += this->trees[i].size();
+  return res;
+}
+
+/**
+ * \brief write the forest to <filename>, as flattened tree images and a key
+ *        table, for MappedIntervalForest to open.
+ * \throws IntervalTreeError if the file can't be written
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Endpoints>
+void
+IntervalForest<T, R, GetStart, GetEnd, Endpoints>::write(
+    const std::string &filename) const {
+  typedef MappedIntervalTree<T, R, GetStart, GetEnd> Mapped;
+  typedef FlatIntervalTree<T, R, GetStart, GetEnd> Flat;
+  const uint64_t align = IntervalForestHeader::ALIGNMENT;
+  std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary |
+                                      std::ios::trunc);
+  if (!out) throw IntervalTreeError("failed to open " + filename);
+
+  // the header is written again once the table's position is known
+  IntervalForestHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, "ITREEFOR", sizeof(h.magic));
+  h.byteOrder = MappedIntervalTreeHeader::BYTE_ORDER_MARK;
+  h.version = IntervalForestHeader::VERSION;
+  h.numTrees = this->trees.size();
+  const char zeros[IntervalForestHeader::ALIGNMENT] = {0};
+  uint64_t pos = ((sizeof(h) + align - 1) / align) * align;
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  out.write(zeros, pos - sizeof(h));
+
+  std::string table;
+  for (size_t i = 0; i < this->trees.size(); ++i) {
+    const uint64_t size = Mapped::writeImage(Flat(this->trees[i]), out);
+    const uint64_t entry[] = {pos, size, this->keys[i].size()};
+    table.append(reinterpret_cast<const char*>(entry), sizeof(entry));
+    table.append(this->keys[i]);
+    pos += size;
+  }
+  h.tableOffset = pos;
+  h.tableSize = table.size();
+  out.write(table.data(), table.size());
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  out.close();
+  if (!out) throw IntervalTreeError("failed to write " + filename);
+}
+
+
+/******************************************************************************
+ * MappedIntervalForest class implementation
+ *****************************************************************************/
+
+template <class T, class R, class GetStart, class GetEnd>
+const size_t MappedIntervalForest<T, R, GetStart, GetEnd>::NO_ID;
+
+/**
+ * \brief map the forest in <filename>, which must have been written by
+ *        IntervalForest::write. The accessors must be the same ones the
+ *        forest was built with (they are not stored in the file).
+ * \param validate if set, check every node of every tree as well as the
+ *                 headers; see MappedIntervalTree::viewImage
+ * \throws IntervalTreeError if the file can't be mapped, or isn't a forest
+ *         written with this version, byte order and type sizes
+ */
+template <class T, class R, class GetStart, class GetEnd>
+MappedIntervalForest<T, R, GetStart, GetEnd>::MappedIntervalForest(
+    const std::string &filename, GetStart getStart, GetEnd getEnd,
+    const bool validate)
+    : map(NULL), mapLength(0) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) throw IntervalTreeError("failed to open " + filename);
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw IntervalTreeError("failed to stat " + filename);
+  }
+  if (st.st_size > 0) {
+    this->mapLength = st.st_size;
+    this->map = mmap(NULL, this->mapLength, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if ((this->map == NULL) || (this->map == MAP_FAILED)) {
+    this->map = NULL;
+    throw IntervalTreeError("failed to map " + filename);
+  }
+
+  try {
+    this->parse(getStart, getEnd, validate);
+  } catch (const IntervalTreeError &e) {
+    munmap(this->map, this->mapLength);
+    this->map = NULL;
+    throw IntervalTreeError(filename + ": " + e.what());
+  }
+}
+
+/**
+ * \brief Move constructor; the mapping now belongs to us
+ */
+template <class T, class R, class GetStart, class GetEnd>
+MappedIntervalForest<T, R, GetStart, GetEnd>::MappedIntervalForest(
+    MappedIntervalForest &&f) noexcept : map(NULL), mapLength(0) {
+  this->swap(f);
+}
+
+/**
+ * \brief Destructor; unmaps the file
+ */
+template <class T, class R, class GetStart, class GetEnd>
+MappedIntervalForest<T, R, GetStart, GetEnd>::~MappedIntervalForest() {
+  if (this->map != NULL) munmap(this->map, this->mapLength);
+}
+
+/**
+ * \brief move assignment
+ */
+template <class T, class R, class GetStart, class GetEnd>
+MappedIntervalForest<T, R, GetStart, GetEnd>&
+MappedIntervalForest<T, R, GetStart, GetEnd>::operator=(
+    MappedIntervalForest &&f) noexcept {
+  MappedIntervalForest tmp(std::move(f));
+  this->swap(tmp);
+  return *this;
+}
+
+/**
+ * \brief swap the contents of this forest with another
+ */
+template <class T, class R, class GetStart, class GetEnd>
+void
+MappedIntervalForest<T, R, GetStart, GetEnd>::swap(
+    MappedIntervalForest &other) noexcept {
+  std::swap(this->map, other.map);
+  std::swap(this->mapLength, other.mapLength);
+  this->keys.swap(other.keys);
+  this->ids.swap(other.ids);
+  this->trees.swap(other.trees);
+}
+
+/**
+ * \brief check the mapped file's header and key table, and get a view of
+ *        each tree image in it.
+ * \throws IntervalTreeError if the file isn't a valid forest of this type
+ */
+template <class T, class R, class GetStart, class GetEnd>
+void
+MappedIntervalForest<T, R, GetStart, GetEnd>::parse(GetStart getStart,
+                                                    GetEnd getEnd,
+                                                    const bool validate) {
+  const char *image = static_cast<const char*>(this->map);
+  IntervalForestHeader h;
+  if (this->mapLength < sizeof(h))
+    throw IntervalTreeError("truncated interval forest");
+  memcpy(&h, image, sizeof(h));
+  if (memcmp(h.magic, "ITREEFOR", sizeof(h.magic)) != 0)
+    throw IntervalTreeError("not an interval forest");
+  if (h.byteOrder != MappedIntervalTreeHeader::BYTE_ORDER_MARK)
+    throw IntervalTreeError("interval forest has the wrong byte order");
+  if (h.version != IntervalForestHeader::VERSION) {
+    std::ostringstream msg;
+    msg << "interval forest has version " << h.version << ", expected "
+        << IntervalForestHeader::VERSION;
+    throw IntervalTreeError(msg.str());
+  }
+  if ((h.tableOffset > this->mapLength) ||
+      (h.tableSize > this->mapLength - h.tableOffset))
+    throw IntervalTreeError("truncated interval forest");
+
+  const char *table = image + h.tableOffset;
+  uint64_t at = 0;
+  for (uint64_t i = 0; i < h.numTrees; ++i) {
+    uint64_t entry[3];
+    if (h.tableSize - at < sizeof(entry))
+      throw IntervalTreeError("corrupt interval forest key table");
+    memcpy(entry, table + at, sizeof(entry));
+    at += sizeof(entry);
+    if ((entry[2] > h.tableSize - at) || (entry[0] > h.tableOffset) ||
+        (entry[1] > h.tableOffset - entry[0]))
+      throw IntervalTreeError("corrupt interval forest key table");
+    const std::string k(table + at, entry[2]);
+    at += entry[2];
+    this->trees.push_back(Mapped::viewImage(image + entry[0], entry[1],
+                                            getStart, getEnd, validate));
+    this->ids[k] = this->keys.size();
+    this->keys.push_back(k);
+  }
+}
+
+/**
+ * \brief the id of <key>, or NO_ID if the forest has no intervals for it.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+size_t
+MappedIntervalForest<T, R, GetStart, GetEnd>::id(
+    const std::string &key) const {
+  typename std::unordered_map<std::string, size_t>::const_iterator it =
+    this->ids.find(key);
+  return it == this->ids.end() ? NO_ID : it->second;
+}
+
+/**
+ * \brief get the intervals with key <key> that intersect <point>
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::vector<T>
+MappedIntervalForest<T, R, GetStart, GetEnd>::intersectingPoint(
+    const std::string &key, const R point) const {
+  return this->intersectingPoint(this->id(key), point);
+}
+
+/**
+ * \brief get the intervals with key <key> that intersect [start, end]
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::vector<T>
+MappedIntervalForest<T, R, GetStart, GetEnd>::intersectingInterval(
+    const std::string &key, const R start, const R end) const {
+  return this->intersectingInterval(this->id(key), start, end);
+}
+
+/**
+ * \brief get the intervals in the tree with id <id> that intersect <point>
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::vector<T>
+MappedIntervalForest<T, R, GetStart, GetEnd>::intersectingPoint(
+    const size_t id, const R point) const {
+  if (id >= this->trees.size()) return std::vector<T>();
+  return this->trees[id].intersectingPoint(point);
+}
+
+/**
+ * \brief get the intervals in the tree with id <id> that intersect
+ *        [start, end]
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const std::vector<T>
+MappedIntervalForest<T, R, GetStart, GetEnd>::intersectingInterval(
+    const size_t id, const R start, const R end) const {
+  if (id >= this->trees.size()) return std::vector<T>();
+  return this->trees[id].intersectingInterval(start, end);
+}
+
+#endif  // INTERVALFOREST_HPP_
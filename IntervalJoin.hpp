@@ -0,0 +1,692 @@
+/**
+ * \file  IntervalJoin.hpp
+ * \brief Overlap joins: find every pair of intervals, one from each of two
+ *        sets, that intersect, in a single merge-style sweep over both sets
+ *        in order of start, rather than with one tree query per interval of
+ *        the first set. Either set can be a start-sorted range or an
+ *        IntervalTree. Each pair is handed to a sink as soon as it's found,
+ *        so the join itself holds nothing but the intervals of each set that
+ *        are still open at the sweep's current position. The parallel joins
+ *        split the coordinate range into one block per thread.
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef INTERVALJOIN_HPP_
+#define INTERVALJOIN_HPP_
+
+// stl includes
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+// local includes
+#include "IntervalTree.hpp"
+
+/******************************************************************************
+ * Class definitions and prototypes
+ *****************************************************************************/
+
+/**
+ * \brief Gets an interval from an element of one side of a join; the element
+ *        is the interval itself, unless INDIRECT is set, in which case it's a
+ *        pair of the interval's start and a pointer to it.
+ */
+template <class Element, bool INDIRECT>
+struct IntervalJoinItem {
+  typedef Element T;
+  static const T& get(const Element &e) { return e; }
+  template <class GetStart>
+  static auto start(const Element &e, const GetStart &getStart)
+      -> decltype(getStart(e)) {
+    return getStart(e);
+  }
+};
+
+template <class Element>
+struct IntervalJoinItem<Element, true> {
+  typedef typename std::remove_cv<typename std::remove_pointer<
+    typename Element::second_type>::type>::type T;
+  static const T& get(const Element &e) { return *e.second; }
+  template <class GetStart>
+  static typename Element::first_type start(const Element &e,
+                                            const GetStart&) {
+    return e.first;
+  }
+};
+
+/**
+ * \brief One side of a join: the range [first, last), sorted by start, and
+ *        the accessors for its intervals. If INDIRECT is set, the range holds
+ *        the start of each interval and a pointer to it rather than the
+ *        intervals themselves (see IntervalJoinItem).
+ */
+template <class It, class GetStart, class GetEnd, bool INDIRECT = false>
+struct IntervalJoinSide {
+  typedef It Iterator;
+  typedef typename std::iterator_traits<Iterator>::value_type Element;
+  typedef typename IntervalJoinItem<Element, INDIRECT>::T T;
+  typedef typename std::decay<decltype(
+      std::declval<GetStart>()(std::declval<const T&>()))>::type R;
+
+  IntervalJoinSide(Iterator first, Iterator last, GetStart getStart,
+                   GetEnd getEnd) : first(first), last(last),
+                                    getStart(getStart), getEnd(getEnd) {;}
+  const T& item(const Iterator it) const {
+    return IntervalJoinItem<Element, INDIRECT>::get(*it);
+  }
+  R start(const Iterator it) const {
+    return IntervalJoinItem<Element, INDIRECT>::start(*it, this->getStart);
+  }
+  R end(const Iterator it) const { return this->getEnd(this->item(it)); }
+  void checkOrder(const char *name) const;
+
+  Iterator first;
+  Iterator last;
+  GetStart getStart;
+  GetEnd getEnd;
+};
+
+/**
+ * \brief Gives the joins what they need from an IntervalTree: its accessors,
+ *        its endpoint convention, and its intervals in order of start.
+ */
+class IntervalJoinTreeAccess {
+ public:
+  template <class T, class R, class GS, class GE, class St, class Ep>
+  static std::vector< std::pair<R, const T*> >
+  sorted(const IntervalTree<T, R, GS, GE, St, Ep> &tree);
+  template <class T, class R, class GS, class GE, class St, class Ep>
+  static GS getStart(const IntervalTree<T, R, GS, GE, St, Ep> &tree) {
+    return tree.getStart;
+  }
+  template <class T, class R, class GS, class GE, class St, class Ep>
+  static GE getEnd(const IntervalTree<T, R, GS, GE, St, Ep> &tree) {
+    return tree.getEnd;
+  }
+  template <class T, class R, class GS, class GE, class St, class Ep>
+  static IntervalEndpointConvention endpoints(
+      const IntervalTree<T, R, GS, GE, St, Ep> &tree) {
+    return tree.endpointConvention();
+  }
+};
+
+/**
+ * \brief An IntervalTree as one side of a join: its intervals' starts and
+ *        pointers to them, sorted by start, which the side refers to.
+ */
+template <class T, class R, class GS, class GE, class St, class Ep>
+struct IntervalJoinTreeSide {
+  typedef std::vector< std::pair<R, const T*> > Order;
+  typedef IntervalJoinSide<typename Order::const_iterator, GS, GE, true> Side;
+
+  explicit IntervalJoinTreeSide(const IntervalTree<T, R, GS, GE, St, Ep> &tree)
+      : order(IntervalJoinTreeAccess::sorted(tree)),
+        side(order.begin(), order.end(),
+             IntervalJoinTreeAccess::getStart(tree),
+             IntervalJoinTreeAccess::getEnd(tree)) {;}
+  IntervalJoinTreeSide(const IntervalJoinTreeSide&) = delete;
+  IntervalJoinTreeSide& operator=(const IntervalJoinTreeSide&) = delete;
+
+  const Order order;
+  const Side side;
+};
+
+// joins of two start-sorted ranges
+template <class IteratorA, class GetStartA, class GetEndA,
+          class IteratorB, class GetStartB, class GetEndB, class Sink>
+Sink intervalJoin(IteratorA firstA, IteratorA lastA, GetStartA getStartA,
+                  GetEndA getEndA, IteratorB firstB, IteratorB lastB,
+                  GetStartB getStartB, GetEndB getEndB, Sink sink,
+                  const bool openEnded = false);
+template <class IteratorA, class GetStartA, class GetEndA,
+          class IteratorB, class GetStartB, class GetEndB, class Sink>
+Sink intervalJoin(IteratorA firstA, IteratorA lastA, GetStartA getStartA,
+                  GetEndA getEndA, IteratorB firstB, IteratorB lastB,
+                  GetStartB getStartB, GetEndB getEndB, Sink sink,
+                  const IntervalEndpointConvention endpoints);
+template <class IteratorA, class GetStartA, class GetEndA,
+          class IteratorB, class GetStartB, class GetEndB, class Sink>
+std::vector<Sink>
+intervalJoinParallel(IteratorA firstA, IteratorA lastA, GetStartA getStartA,
+                     GetEndA getEndA, IteratorB firstB, IteratorB lastB,
+                     GetStartB getStartB, GetEndB getEndB, Sink sink,
+                     const bool openEnded = false, unsigned numThreads = 0);
+template <class IteratorA, class GetStartA, class GetEndA,
+          class IteratorB, class GetStartB, class GetEndB, class Sink>
+std::vector<Sink>
+intervalJoinParallel(IteratorA firstA, IteratorA lastA, GetStartA getStartA,
+                     GetEndA getEndA, IteratorB firstB, IteratorB lastB,
+                     GetStartB getStartB, GetEndB getEndB, Sink sink,
+                     const IntervalEndpointConvention endpoints,
+                     unsigned numThreads = 0);
+
+// joins of a start-sorted range with a tree
+template <class IteratorA, class GetStartA, class GetEndA,
+          class T, class R, class GS, class GE, class St, class Ep,
+          class Sink>
+Sink intervalJoin(IteratorA firstA, IteratorA lastA, GetStartA getStartA,
+                  GetEndA getEndA,
+                  const IntervalTree<T, R, GS, GE, St, Ep> &tree, Sink sink);
+template <class IteratorA, class GetStartA, class GetEndA,
+          class T, class R, class GS, class GE, class St, class Ep,
+          class Sink>
+std::vector<Sink>
+intervalJoinParallel(IteratorA firstA, IteratorA lastA, GetStartA getStartA,
+                     GetEndA getEndA,
+                     const IntervalTree<T, R, GS, GE, St, Ep> &tree, Sink sink,
+                     unsigned numThreads = 0);
+
+// joins of two trees
+template <class TA, class RA, class GSA, class GEA, class StA, class EpA,
+          class TB, class RB, class GSB, class GEB, class StB, class EpB,
+          class Sink>
+Sink intervalJoin(const IntervalTree<TA, RA, GSA, GEA, StA, EpA> &a,
+                  const IntervalTree<TB, RB, GSB, GEB, StB, EpB> &b,
+                  Sink sink);
+template <class TA, class RA, class GSA, class GEA, class StA, class EpA,
+          class TB, class RB, class GSB, class GEB, class StB, class EpB,
+          class Sink>
+std::vector<Sink>
+intervalJoinParallel(const IntervalTree<TA, RA, GSA, GEA, StA, EpA> &a,
+                     const IntervalTree<TB, RB, GSB, GEB, StB, EpB> &b,
+                     Sink sink,
+                     unsigned numThreads = 0);
+
+
+/******************************************************************************
+ * IntervalJoinSide and IntervalJoinTreeAccess implementation
+ *****************************************************************************/
+
+/**
+ * \brief make sure the range is sorted by start.
+ * \param name what to call the range in the error message
+ * \throws IntervalTreeError if it isn't
+ */
+template <class It, class GetStart, class GetEnd, bool INDIRECT>
+void
+IntervalJoinSide<It, GetStart, GetEnd, INDIRECT>::checkOrder(
+    const char *name) const {
+  if (this->first == this->last) return;
+  size_t n = 1;
+  It prev = this->first;
+  for (It it = std::next(prev); it != this->last; prev = it++, ++n) {
+    if (!(this->start(it) < this->start(prev))) continue;
+    std::ostringstream msg;
+    msg << "intervalJoin got the " << name << " set out of order: interval "
+        << n << " starts at " << this->start(it)
+        << ", before the one preceding it at " << this->start(prev);
+    throw IntervalTreeError(msg.str());
+  }
+}
+
+/**
+ * \brief get the start of, and a pointer to, each of the intervals in
+ *        <tree>, sorted by start. The pointers stay valid as long as the tree
+ *        isn't changed. Sorting the starts along with the pointers keeps the
+ *        sort from having to follow the pointers.
+ */
+template <class T, class R, class GS, class GE, class St, class Ep>
+std::vector< std::pair<R, const T*> >
+IntervalJoinTreeAccess::sorted(const IntervalTree<T, R, GS, GE, St, Ep> &tree) {
+  typedef IntervalTree<T, R, GS, GE, St, Ep> Tree;
+  std::vector< std::pair<R, const T*> > res;
+  res.reserve(tree.size());
+  if (tree.data == NULL) return res;
+  typename Tree::Stack stack;
+  stack.push(&tree);
+  while (!stack.empty()) {
+    const Tree *cur = stack.pop();
+    for (size_t i = 0; i < cur->data->starts.size(); ++i) {
+      const T &it = cur->data->starts[i];
+      res.push_back(std::make_pair(tree.getStart(it), &it));
+    }
+    if (cur->right != NULL) stack.push(cur->right);
+    if (cur->left != NULL) stack.push(cur->left);
+  }
+  std::sort(res.begin(), res.end(),
+            [](const std::pair<R, const T*> &x,
+               const std::pair<R, const T*> &y) {
+    return x.first < y.first;
+  });
+  return res;
+}
+
+
+/******************************************************************************
+ * The sweep
+ *****************************************************************************/
+
+/**
+ * \brief drop the intervals in <active> that end before <s>, and so can't
+ *        intersect anything starting at or after it, and give each of the
+ *        rest that intersects the interval from the other side to <report>.
+ *        Intervals are dropped by swapping them with the last, so the order
+ *        of <active> isn't kept.
+ */
+template <class Side, class Report>
+void
+intervalJoinScan(const Side &side, std::vector<typename Side::Iterator> &active,
+                 const typename Side::R s, Report report) {
+  size_t i = 0;
+  while (i < active.size()) {
+    if (side.end(active[i]) < s) {
+      active[i] = active.back();
+      active.pop_back();
+    } else {
+      report(active[i++]);
+    }
+  }
+}
+
+/**
+ * \brief sweep the intervals in [ai, aLast) and [bi, bLast) in order of
+ *        start, giving <sink> each intersecting pair with at least one of
+ *        them in those ranges. <activeA> and <activeB> hold, on entry, any
+ *        intervals from before the ranges that may still intersect them;
+ *        pairs of those with each other aren't reported. Each pair is found
+ *        when the later starting of the two is reached, among the intervals
+ *        from the other set still open there, so each interval is looked at
+ *        once when it's reached, once for each pair it's in, and once more
+ *        when it's dropped. Pairs are tested by the endpoint convention
+ *        <conv>, so the test is fixed for the whole sweep.
+ */
+template <class SideA, class SideB, class Sink, class Endpoints>
+void
+intervalJoinSweepWith(const SideA &a, typename SideA::Iterator ai,
+                      const typename SideA::Iterator aLast,
+                      std::vector<typename SideA::Iterator> &activeA,
+                      const SideB &b, typename SideB::Iterator bi,
+                      const typename SideB::Iterator bLast,
+                      std::vector<typename SideB::Iterator> &activeB,
+                      Sink &sink, const Endpoints &conv) {
+  typedef typename SideA::R R;
+  while ((ai != aLast) || (bi != bLast)) {
+    if ((bi == bLast) || ((ai != aLast) && !(b.start(bi) < a.start(ai)))) {
+      const R s = a.start(ai), e = a.end(ai);
+      intervalJoinScan(b, activeB, s, [&](const typename SideB::Iterator j) {
+        if (conv.template intersects<R>(b.start(j), b.end(j), s, e))
+          sink(a.item(ai), b.item(j));
+      });
+      if (bi != bLast) activeA.push_back(ai);
+      ++ai;
+    } else {
+      const R s = b.start(bi), e = b.end(bi);
+      intervalJoinScan(a, activeA, s, [&](const typename SideA::Iterator j) {
+        if (conv.template intersects<R>(s, e, a.start(j), a.end(j)))
+          sink(a.item(j), b.item(bi));
+      });
+      if (ai != aLast) activeB.push_back(bi);
+      ++bi;
+    }
+  }
+}
+
+/**
+ * \brief sweep with the endpoint convention <endpoints>; see
+ *        intervalJoinSweepWith.
+ */
+template <class SideA, class SideB, class Sink>
+void
+intervalJoinSweep(const SideA &a, typename SideA::Iterator ai,
+                  const typename SideA::Iterator aLast,
+                  std::vector<typename SideA::Iterator> &activeA,
+                  const SideB &b, typename SideB::Iterator bi,
+                  const typename SideB::Iterator bLast,
+                  std::vector<typename SideB::Iterator> &activeB,
+                  Sink &sink, const IntervalEndpointConvention endpoints) {
+  if (endpoints == INTERVAL_OPEN) {
+    intervalJoinSweepWith(a, ai, aLast, activeA, b, bi, bLast, activeB, sink,
+                          IntervalOpenEndpoints());
+  } else if (endpoints == INTERVAL_HALF_OPEN) {
+    intervalJoinSweepWith(a, ai, aLast, activeA, b, bi, bLast, activeB, sink,
+                          IntervalHalfOpenEndpoints());
+  } else {
+    intervalJoinSweepWith(a, ai, aLast, activeA, b, bi, bLast, activeB, sink,
+                          IntervalClosedEndpoints());
+  }
+}
+
+/**
+ * \brief join two sides serially.
+ */
+template <class SideA, class SideB, class Sink>
+Sink
+intervalJoinSides(const SideA &a, const SideB &b, Sink sink,
+                  const IntervalEndpointConvention endpoints) {
+  a.checkOrder("first");
+  b.checkOrder("second");
+  std::vector<typename SideA::Iterator> activeA;
+  std::vector<typename SideB::Iterator> activeB;
+  intervalJoinSweep(a, a.first, a.last, activeA, b, b.first, b.last, activeB,
+                    sink, endpoints);
+  return sink;
+}
+
+/**
+ * \brief find the intervals on <side>, before <it>, that may intersect
+ *        something starting at or after <c>, given that none is longer than
+ *        <longest>, and add them to <active>.
+ */
+template <class Side>
+void
+intervalJoinSeed(const Side &side, typename Side::Iterator it,
+                 const typename Side::R c, const typename Side::R longest,
+                 std::vector<typename Side::Iterator> &active) {
+  while (it != side.first) {
+    --it;
+    if (longest < c - side.start(it)) break;
+    if (!(side.end(it) < c)) active.push_back(it);
+  }
+}
+
+/**
+ * \brief the first interval on <side>, at or after <lo>, that doesn't start
+ *        before <c>
+ */
+template <class Side>
+typename Side::Iterator
+intervalJoinLowerBound(const Side &side, typename Side::Iterator lo,
+                       const typename Side::R c) {
+  size_t len = side.last - lo;
+  while (len > 0) {
+    const size_t half = len / 2;
+    const typename Side::Iterator mid = lo + half;
+    if (side.start(mid) < c) {
+      lo = mid + 1;
+      len -= half + 1;
+    } else {
+      len = half;
+    }
+  }
+  return lo;
+}
+
+/**
+ * \brief the length of the longest interval on <side>
+ */
+template <class Side>
+typename Side::R
+intervalJoinLongest(const Side &side) {
+  typename Side::R longest = typename Side::R();
+  for (typename Side::Iterator it = side.first; it != side.last; ++it) {
+    if (side.end(it) < side.start(it)) continue;
+    const typename Side::R len = side.end(it) - side.start(it);
+    if (longest < len) longest = len;
+  }
+  return longest;
+}
+
+/**
+ * \brief join two sides using several threads. The coordinate range is cut,
+ *        at the starts of evenly spaced intervals of <a>, into one block per
+ *        thread, and each pair is found by the block that the later starting
+ *        of its two intervals falls in. Each block starts its sweep from the
+ *        intervals of earlier blocks that reach into it, which it finds by
+ *        looking back from its first interval as far as the longest interval
+ *        on that side, so a few very long intervals make that look back, but
+ *        not the result, worse. The iterators must be random access.
+ */
+template <class SideA, class SideB, class Sink>
+std::vector<Sink>
+intervalJoinSidesParallel(const SideA &a, const SideB &b, const Sink &sink,
+                          const IntervalEndpointConvention endpoints,
+                          unsigned numThreads) {
+  typedef typename SideA::Iterator IteratorA;
+  typedef typename SideB::Iterator IteratorB;
+  typedef typename SideA::R R;
+  const size_t n = a.last - a.first;
+  if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+  if (numThreads == 0) numThreads = 1;
+  if (numThreads > n) numThreads = n;
+  if (numThreads <= 1)
+    return std::vector<Sink>(1, intervalJoinSides(a, b, sink, endpoints));
+  a.checkOrder("first");
+  b.checkOrder("second");
+
+  // block i holds the intervals starting in [cuts[i], cuts[i + 1])
+  std::vector<R> cuts(1, R());
+  std::vector<IteratorA> firstA(1, a.first);
+  std::vector<IteratorB> firstB(1, b.first);
+  for (unsigned i = 1; i < numThreads; ++i) {
+    cuts.push_back(a.start(a.first + (i * n) / numThreads));
+    firstA.push_back(intervalJoinLowerBound(a, firstA.back(), cuts.back()));
+    firstB.push_back(intervalJoinLowerBound(b, firstB.back(), cuts.back()));
+  }
+  firstA.push_back(a.last);
+  firstB.push_back(b.last);
+  const R longestA = intervalJoinLongest(a), longestB = intervalJoinLongest(b);
+
+  std::vector<Sink> parts(numThreads, sink);
+  std::vector<std::exception_ptr> errors(numThreads);
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < numThreads; ++i) {
+    threads.push_back(std::thread([&, i]() {
+      try {
+        std::vector<IteratorA> activeA;
+        std::vector<IteratorB> activeB;
+        if (i > 0) {
+          intervalJoinSeed(a, firstA[i], cuts[i], longestA, activeA);
+          intervalJoinSeed(b, firstB[i], cuts[i], longestB, activeB);
+        }
+        intervalJoinSweep(a, firstA[i], firstA[i + 1], activeA,
+                          b, firstB[i], firstB[i + 1], activeB,
+                          parts[i], endpoints);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }));
+  }
+  for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+  for (size_t i = 0; i < errors.size(); ++i)
+    if (errors[i]) std::rethrow_exception(errors[i]);
+  return parts;
+}
+
+
+/******************************************************************************
+ * The joins
+ *****************************************************************************/
+
+/**
+ * \brief find all pairs of intersecting intervals, one from [firstA, lastA)
+ *        and one from [firstB, lastB). Both ranges must be sorted by start;
+ *        they need only be forward ranges. As in a tree, no interval may end
+ *        before it starts. This gives the same pairs as querying a tree of
+ *        the second set with each interval of the first, but in one pass
+ *        over both.
+ * \param sink called as sink(a, b) for each pair, as soon as it's found, in
+ *             order of the later start of the two, but in no particular
+ *             order for pairs with the same later start.
+ * \param openEnded whether the intervals are open ended, as for IntervalTree
+ * \return the sink, after it has been given all the pairs
+ * \throws IntervalTreeError if either range isn't sorted by start
+ */
+template <class IteratorA, class GetStartA, class GetEndA,
+          class IteratorB, class GetStartB, class GetEndB, class Sink>
+Sink
+intervalJoin(IteratorA firstA, IteratorA lastA, GetStartA getStartA,
+             GetEndA getEndA, IteratorB firstB, IteratorB lastB,
+             GetStartB getStartB, GetEndB getEndB, Sink sink,
+             const bool openEnded) {
+  return intervalJoin(firstA, lastA, getStartA, getEndA, firstB, lastB,
+                      getStartB, getEndB, sink,
+                      intervalEndpointConvention(openEnded));
+}
+
+/**
+ * \brief find all pairs of intersecting intervals, one from each range, as
+ *        above, with both sets read by the endpoint convention <endpoints>;
+ *        e.g. INTERVAL_OPEN for (s, e), which an open-ended flag can't ask
+ *        for.
+ */
+template <class IteratorA, class GetStartA, class GetEndA,
+          class IteratorB, class GetStartB, class GetEndB, class Sink>
+Sink
+intervalJoin(IteratorA firstA, IteratorA lastA, GetStartA getStartA,
+             GetEndA getEndA, IteratorB firstB, IteratorB lastB,
+             GetStartB getStartB, GetEndB getEndB, Sink sink,
+             const IntervalEndpointConvention endpoints) {
+  typedef IntervalJoinSide<IteratorA, GetStartA, GetEndA> SideA;
+  typedef IntervalJoinSide<IteratorB, GetStartB, GetEndB> SideB;
+  return intervalJoinSides(SideA(firstA, lastA, getStartA, getEndA),
+                           SideB(firstB, lastB, getStartB, getEndB),
+                           sink, endpoints);
+}
+
+/**
+ * \brief find all pairs of intersecting intervals, one from each range, as
+ *        for intervalJoin, but using several threads. The ranges must be
+ *        random access. Each thread is given its own copy of <sink>, and
+ *        calls it for the pairs in its own block of the coordinate range,
+ *        so the sink needn't be thread safe unless its copies share
+ *        something. An exception in any thread is re-thrown once all have
+ *        finished.
+ * \param numThreads how many threads to use; 0 for one per core
+ * \return the copies of the sink, one per block, in order of coordinate
+ */
+template <class IteratorA, class GetStartA, class GetEndA,
+          class IteratorB, class GetStartB, class GetEndB, class Sink>
+std::vector<Sink>
+intervalJoinParallel(IteratorA firstA, IteratorA lastA, GetStartA getStartA,
+                     GetEndA getEndA, IteratorB firstB, IteratorB lastB,
+                     GetStartB getStartB, GetEndB getEndB, Sink sink,
+                     const bool openEnded, unsigned numThreads) {
+  return intervalJoinParallel(firstA, lastA, getStartA, getEndA, firstB,
+                              lastB, getStartB, getEndB, sink,
+                              intervalEndpointConvention(openEnded),
+                              numThreads);
+}
+
+/**
+ * \brief the parallel version of the join of two ranges with an endpoint
+ *        convention; see intervalJoin.
+ */
+template <class IteratorA, class GetStartA, class GetEndA,
+          class IteratorB, class GetStartB, class GetEndB, class Sink>
+std::vector<Sink>
+intervalJoinParallel(IteratorA firstA, IteratorA lastA, GetStartA getStartA,
+                     GetEndA getEndA, IteratorB firstB, IteratorB lastB,
+                     GetStartB getStartB, GetEndB getEndB, Sink sink,
+                     const IntervalEndpointConvention endpoints,
+                     unsigned numThreads) {
+  typedef IntervalJoinSide<IteratorA, GetStartA, GetEndA> SideA;
+  typedef IntervalJoinSide<IteratorB, GetStartB, GetEndB> SideB;
+  return intervalJoinSidesParallel(SideA(firstA, lastA, getStartA, getEndA),
+                                   SideB(firstB, lastB, getStartB, getEndB),
+                                   sink, endpoints, numThreads);
+}
+
+/**
+ * \brief find all pairs of an interval from the start-sorted range
+ *        [firstA, lastA) and one from <tree> that intersect, as for
+ *        intervalJoin on two ranges. The tree's intervals are visited in
+ *        order of start through pointers to them, which are sorted once, so
+ *        the intervals aren't copied. The endpoint convention is taken from
+ *        the tree.
+ */
+template <class IteratorA, class GetStartA, class GetEndA,
+          class T, class R, class GS, class GE, class St, class Ep,
+          class Sink>
+Sink
+intervalJoin(IteratorA firstA, IteratorA lastA, GetStartA getStartA,
+             GetEndA getEndA, const IntervalTree<T, R, GS, GE, St, Ep> &tree,
+             Sink sink) {
+  typedef IntervalJoinSide<IteratorA, GetStartA, GetEndA> SideA;
+  const IntervalJoinTreeSide<T, R, GS, GE, St, Ep> b(tree);
+  return intervalJoinSides(SideA(firstA, lastA, getStartA, getEndA), b.side,
+                           sink, IntervalJoinTreeAccess::endpoints(tree));
+}
+
+/**
+ * \brief the parallel version of the join of a range with a tree; see
+ *        intervalJoinParallel for two ranges.
+ */
+template <class IteratorA, class GetStartA, class GetEndA,
+          class T, class R, class GS, class GE, class St, class Ep,
+          class Sink>
+std::vector<Sink>
+intervalJoinParallel(IteratorA firstA, IteratorA lastA, GetStartA getStartA,
+                     GetEndA getEndA,
+                     const IntervalTree<T, R, GS, GE, St, Ep> &tree, Sink sink,
+                     unsigned numThreads) {
+  typedef IntervalJoinSide<IteratorA, GetStartA, GetEndA> SideA;
+  const IntervalJoinTreeSide<T, R, GS, GE, St, Ep> b(tree);
+  return intervalJoinSidesParallel(SideA(firstA, lastA, getStartA, getEndA),
+                                   b.side, sink,
+                                   IntervalJoinTreeAccess::endpoints(tree),
+                                   numThreads);
+}
+
+/**
+ * \brief find all pairs of an interval from tree <a> and one from tree <b>
+ *        that intersect, as for intervalJoin on two ranges; sink is called
+ *        as sink(x, y) with x from <a> and y from <b>.
+ * \throws IntervalTreeError if the trees' endpoint conventions differ
+ */
+template <class TA, class RA, class GSA, class GEA, class StA, class EpA,
+          class TB, class RB, class GSB, class GEB, class StB, class EpB,
+          class Sink>
+Sink
+intervalJoin(const IntervalTree<TA, RA, GSA, GEA, StA, EpA> &a,
+             const IntervalTree<TB, RB, GSB, GEB, StB, EpB> &b, Sink sink) {
+  const IntervalEndpointConvention endpoints =
+    IntervalJoinTreeAccess::endpoints(a);
+  if (endpoints != IntervalJoinTreeAccess::endpoints(b))
+    throw IntervalTreeError("intervalJoin can't join trees with different "
+                            "endpoint conventions");
+  const IntervalJoinTreeSide<TA, RA, GSA, GEA, StA, EpA> x(a);
+  const IntervalJoinTreeSide<TB, RB, GSB, GEB, StB, EpB> y(b);
+  return intervalJoinSides(x.side, y.side, sink, endpoints);
+}
+
+/**
+ * \brief the parallel version of the join of two trees; see
+ *        intervalJoinParallel for two ranges.
+ * \throws IntervalTreeError if the trees' endpoint conventions differ
+ */
+template <class TA, class RA, class GSA, class GEA, class StA, class EpA,
+          class TB, class RB, class GSB, class GEB, class StB, class EpB,
+          class Sink>
+std::vector<Sink>
+intervalJoinParallel(const IntervalTree<TA, RA, GSA, GEA, StA, EpA> &a,
+                     const IntervalTree<TB, RB, GSB, GEB, StB, EpB> &b,
+                     Sink sink,
+                     unsigned numThreads) {
+  const IntervalEndpointConvention endpoints =
+    IntervalJoinTreeAccess::endpoints(a);
+  if (endpoints != IntervalJoinTreeAccess::endpoints(b))
+    throw IntervalTreeError("intervalJoinParallel can't join trees with "
+                            "different endpoint conventions");
+  const IntervalJoinTreeSide<TA, RA, GSA, GEA, StA, EpA> x(a);
+  const IntervalJoinTreeSide<TB, RB, GSB, GEB, StB, EpB> y(b);
+  return intervalJoinSidesParallel(x.side, y.side, sink, endpoints,
+                                   numThreads);
+}
+
+#endif  // INTERVALJOIN_HPP_
@@ -11,7 +11,11 @@
  *        restrictions are that R is ordinal (specifically, must define +, -
  *        and /). T can be any type as long as the user can provide pointers to
  *        functions 'R getStart(T)' and 'R getEnd(T)' (trivial in most cases,
- *        and should be do-able with a functor).
+ *        and should be do-able with a functor). The optional parameters
+ *        GetStart and GetEnd give the types of these accessors; they default
+ *        to function pointers, but functor types (e.g. IntervalStartMember
+ *        and IntervalEndMember, or a lambda's type) let the compiler inline
+ *        them into the sorts and scans.
  *
  * \authors Philip J. Uren
  *
@@ -44,48 +48,579 @@
 #include <cassert>
 #include <algorithm>
 #include <utility>
+#include <iterator>
+#include <thread>
+#include <future>
+#include <type_traits>
+#include <new>
+#include <cstddef>
+#include <queue>
+#include <functional>
+#if __cplusplus >= 202002L
+#include <ranges>
+#endif
 
 // local includes
 #include "IntervalTreeNode.hpp"
+#include "IntervalTreeStats.hpp"
 
 /******************************************************************************
  * Class definitions and prototypes
  *****************************************************************************/
 
 /**
- * \brief The actual IntervalTree class
+ * \brief Visitor that copies each interval it is given to an output iterator
  */
-template <class T, class R>
-class IntervalTree {
+template <class T, class OutputIterator>
+class IntervalTreeOutputVisitor {
+ public:
+  explicit IntervalTreeOutputVisitor(OutputIterator out) : out(out) {;}
+  void operator()(const T &interval) { *(this->out)++ = interval; }
+  OutputIterator out;
+};
+
+/**
+ * \brief The results of a batch of queries, in compressed sparse row form:
+ *        the hits for query i are hits[offsets[i], offsets[i + 1]).
+ */
+template <class T>
+struct IntervalTreeBatchResult {
+  std::vector<size_t> offsets;
+  std::vector<T> hits;
+
+  // number of queries, and number of hits for query i
+  size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+  size_t count(const size_t i) const { return offsets[i + 1] - offsets[i]; }
+};
+
+/**
+ * \brief How a (sub)tree picks the mid-point it splits its intervals at.
+ *        INTERVAL_SPLIT_MIDDLE_INTERVAL uses the centre of the interval with
+ *        the median start; it's cheap, but clustered or nested intervals can
+ *        leave one subtree with nearly all of them. INTERVAL_SPLIT_MEDIAN
+ *        uses the median of all the end-points, so neither subtree gets more
+ *        than half of the intervals and the depth is at most log2(n) + 1.
+ *        INTERVAL_SPLIT_SAMPLED_MEDIAN estimates that median from a fixed
+ *        sample of intervals, and falls back to the exact median when the
+ *        estimate would put more than 3/4 of them in one subtree, so the
+ *        depth stays O(log n).
+ */
+enum IntervalSplitStrategy {
+  INTERVAL_SPLIT_MIDDLE_INTERVAL,
+  INTERVAL_SPLIT_MEDIAN,
+  INTERVAL_SPLIT_SAMPLED_MEDIAN
+};
+
+/**
+ * \brief The shape of an IntervalTree, for checking how well a split
+ *        strategy suits a data set.
+ */
+struct IntervalTreeReport {
+  size_t intervals;     // number of intervals in the tree
+  size_t nodes;         // number of (non-empty) subtrees
+  size_t depth;         // number of subtrees on the longest path from the root
+  size_t maxNodeSize;   // most intervals held in any one node
+  // largest fraction of a subtree's intervals that are in one of its
+  // subtrees, over all subtrees; 0.5 or less is perfectly balanced
+  double imbalance;
+
+  IntervalTreeReport() : intervals(0), nodes(0), depth(0), maxNodeSize(0),
+                         imbalance(0) {;}
+};
+
+template <class T, class R, class GetStart, class GetEnd,
+          class Stats = IntervalTreeNoStats,
+          class Endpoints = IntervalRuntimeEndpoints>
+class IntervalTreeQueryRange;
+
+/**
+ * \brief The actual IntervalTree class. Stats picks what statistics it
+ *        gathers (see IntervalTreeStats.hpp); the default gathers none and
+ *        takes no space. Only the single queries that return or visit their
+ *        hits are counted, not the counting, batch or range queries. Only
+ *        the root keeps totals; subtrees hold none of their own.
+ *        Endpoints picks how intervals and queries are read: one of
+ *        IntervalClosedEndpoints, IntervalHalfOpenEndpoints and
+ *        IntervalOpenEndpoints fixes the convention at compile time, so the
+ *        queries never look at it per node; the default,
+ *        IntervalRuntimeEndpoints, takes it (or the old open-ended flag)
+ *        when the tree is constructed.
+ */
+template <class T, class R, class GetStart = R (*)(const T&),
+          class GetEnd = R (*)(const T&), class Stats = IntervalTreeNoStats,
+          class Endpoints = IntervalRuntimeEndpoints>
+class IntervalTree : private IntervalTreeStatsHolder<Stats> {
  public:
   IntervalTree();
-  explicit IntervalTree(bool openEnded) : openEnded(openEnded) {}
-  IntervalTree(const std::vector<T> &intervals, R (*getStart)(const T&),
-               R (*getEnd)(const T&), const bool openEnded = false);
-  IntervalTree(const IntervalTree<T, R> &t);
+  explicit IntervalTree(const Endpoints endpoints)
+      : data(NULL), left(NULL), right(NULL), getStart(), getEnd(),
+        endpoints(endpoints), arena(NULL),
+        split(INTERVAL_SPLIT_MIDDLE_INTERVAL), count(0), builtCount(0),
+        minStart(), maxEnd() {;}
+  IntervalTree(GetStart getStart, GetEnd getEnd,
+               const Endpoints endpoints = Endpoints(),
+               IntervalTreeArena *arena = NULL,
+               const IntervalSplitStrategy split =
+                 INTERVAL_SPLIT_MIDDLE_INTERVAL);
+  IntervalTree(const std::vector<T> &intervals, GetStart getStart,
+               GetEnd getEnd, const Endpoints endpoints = Endpoints(),
+               const unsigned numThreads = 0,
+               IntervalTreeArena *arena = NULL,
+               const IntervalSplitStrategy split =
+                 INTERVAL_SPLIT_MIDDLE_INTERVAL);
+  IntervalTree(std::vector<T> &&intervals, GetStart getStart,
+               GetEnd getEnd, const Endpoints endpoints = Endpoints(),
+               const unsigned numThreads = 0,
+               IntervalTreeArena *arena = NULL,
+               const IntervalSplitStrategy split =
+                 INTERVAL_SPLIT_MIDDLE_INTERVAL);
+  explicit IntervalTree(const std::vector<T> &intervals,
+                        const Endpoints endpoints = Endpoints(),
+                        const unsigned numThreads = 0,
+                        IntervalTreeArena *arena = NULL,
+                        const IntervalSplitStrategy split =
+                          INTERVAL_SPLIT_MIDDLE_INTERVAL);
+  explicit IntervalTree(std::vector<T> &&intervals,
+                        const Endpoints endpoints = Endpoints(),
+                        const unsigned numThreads = 0,
+                        IntervalTreeArena *arena = NULL,
+                        const IntervalSplitStrategy split =
+                          INTERVAL_SPLIT_MIDDLE_INTERVAL);
+  IntervalTree(const IntervalTree &t);
+  IntervalTree(IntervalTree &&t) noexcept;
   ~IntervalTree();
-  IntervalTree<T, R>& operator=(const IntervalTree<T, R>& other);
-  void swap(IntervalTree<T, R>& other);
+  IntervalTree& operator=(const IntervalTree& other);
+  IntervalTree& operator=(IntervalTree&& other) noexcept;
+  void swap(IntervalTree& other) noexcept;
+
+  // mutators
+  void insert(const T &interval);
+  bool erase(const T &interval);
 
   // inspectors
   const std::vector<T> intersectingPoint(const R point) const;
   const std::vector<T> intersectingInterval(const R start, const R end) const;
-  const std::vector<T> squash() const;
+  void intersectingPoint(const R point, std::vector<T> &res) const;
+  void intersectingInterval(const R start, const R end,
+                            std::vector<T> &res) const;
+  template <class OutputIterator>
+  OutputIterator intersectingPoint(const R point, OutputIterator out) const;
+  template <class OutputIterator>
+  OutputIterator intersectingInterval(const R start, const R end,
+                                      OutputIterator out) const;
+  template <class Visitor>
+  Visitor visitIntersectingPoint(const R point, Visitor visit) const;
+  template <class Visitor>
+  Visitor visitIntersectingInterval(const R start, const R end,
+                                    Visitor visit) const;
+  size_t countIntersectingPoint(const R point) const;
+  size_t countIntersectingInterval(const R start, const R end) const;
+  bool anyIntersecting(const R point) const;
+  bool anyIntersecting(const R start, const R end) const;
+  const std::vector<T> nearest(const R point, const size_t k = 1) const;
+  const std::vector<T> nearestBefore(const R point,
+                                     const size_t k = 1) const;
+  const std::vector<T> nearestAfter(const R point, const size_t k = 1) const;
+  IntervalTreeBatchResult<T> intersectingIntervals(
+      const std::vector< std::pair<R, R> > &queries) const;
+  template <class InputIterator>
+  IntervalTreeBatchResult<T> intersectingIntervals(InputIterator first,
+                                                   InputIterator last) const;
+  IntervalTreeBatchResult<T> intersectingPoints(
+      const std::vector<R> &points) const;
+  template <class InputIterator>
+  IntervalTreeBatchResult<T> intersectingPoints(InputIterator first,
+                                                InputIterator last) const;
+  IntervalTreeBatchResult<T> intersectingIntervalsParallel(
+      const std::vector< std::pair<R, R> > &queries,
+      unsigned numThreads = 0) const;
+  IntervalTreeBatchResult<T> intersectingPointsParallel(
+      const std::vector<R> &points, unsigned numThreads = 0) const;
+  IntervalTreeQueryRange<T, R, GetStart, GetEnd, Stats, Endpoints>
+  intersectingPointRange(const R point) const;
+  IntervalTreeQueryRange<T, R, GetStart, GetEnd, Stats, Endpoints>
+  intersectingIntervalRange(const R start, const R end) const;
+  const std::vector<T> squash(const bool sorted = false) const;
   const int size() const;
   const std::string toString() const;
+  IntervalTreeReport report() const;
+  IntervalEndpointConvention endpointConvention() const {
+    return this->endpoints.convention();
+  }
+  IntervalTreeStats stats() const { return this->StatsHolder::get(); }
+  void resetStats() { this->StatsHolder::reset(); }
 
   // constants
   static const bool OPEN_ENDED = true;
 
+  // subtrees of at least this many intervals may be built in parallel
+  static const long PARALLEL_BUILD_THRESHOLD = 1 << 15;
+
+  // subtrees smaller than this are never rebuilt after an insert
+  static const size_t REBUILD_THRESHOLD = 16;
+
+  // number of intervals INTERVAL_SPLIT_SAMPLED_MEDIAN samples per subtree
+  static const size_t SPLIT_SAMPLE_SIZE = 32;
+
+ private:
+  template <class U, class S, class GS, class GE>
+  friend class FlatIntervalTree;
+  template <class U, class S, class GS, class GE>
+  friend class CompactIntervalTree;
+  template <class U, class S, class GS, class GE, class St, class Ep>
+  friend class IntervalTreeBuilder;
+  template <class U, class S, class GS, class GE, class St, class Ep>
+  friend class IntervalTreeQueryIterator;
+  friend class IntervalJoinTreeAccess;
+  template <class S>
+  friend class IntervalCoverage;
+
+  typedef IntervalTreeNode<T, R, GetStart, GetEnd> Node;
+  typedef IntervalTreeStatsHolder<Stats> StatsHolder;
+  typedef typename std::vector<T>::iterator WorkIterator;
+  // picks the constructor for an empty subtree, which keeps no statistics
+  struct Subtree {};
+  IntervalTree(GetStart getStart, GetEnd getEnd, const Endpoints endpoints,
+               IntervalTreeArena *arena, const IntervalSplitStrategy split,
+               Subtree);
+  IntervalTree(WorkIterator first, WorkIterator last, GetStart getStart,
+               GetEnd getEnd, const Endpoints endpoints,
+               const unsigned threads, IntervalTreeArena *arena,
+               const IntervalSplitStrategy split);
+  void build(WorkIterator first, WorkIterator last, const unsigned threads);
+  R pickMid(WorkIterator first, WorkIterator last) const;
+  R medianEndpoint(WorkIterator first, WorkIterator last) const;
+  void rebuild(const T *extra);
+  void destroyAll();
+  void updateBounds();
+  void squashSorted(std::vector<T> &res) const;
+  bool outside(const R start, const R end) const {
+    return (end < this->minStart) || (start > this->maxEnd);
+  }
+  template <class U, class... Args>
+  U* make(Args&&... args) const;
+  template <class U>
+  void destroy(U *p) const;
+
+  template <class Visitor>
+  void visitPoint(const R point, Visitor &visit) const;
+  template <class Visitor>
+  void visitInterval(const R start, const R end, Visitor &visit) const;
+  size_t countHerePoint(const R point) const;
+  size_t countHereInterval(const R start, const R end) const;
+  typedef IntervalTreeStack<const IntervalTree*> Stack;
+  unsigned pushSubtrees(const R start, const R end, Stack &stack) const;
+
+  // the entries [lo, hi) of one of a node's sorted lists; if <scan> is set,
+  // each one still has to be checked against the query, by isHit. That
+  // only happens when the convention is open ended, for queries with an
+  // end-point on mid, so with a fixed closed convention it never does.
+  struct NodeHits {
+    const typename Node::List *list;
+    size_t lo;
+    size_t hi;
+    bool scan;
+  };
+  NodeHits herePoint(const R point) const;
+  NodeHits hereInterval(const R start, const R end) const;
+  size_t countHits(const NodeHits &h, const R start, const R end) const;
+  bool isHit(const T &interval, const R start, const R end) const {
+    return this->endpoints.intersects(this->getStart(interval),
+                                      this->getEnd(interval), start, end);
+  }
+
+  // which intervals the nearest queries consider, and how they measure
+  // distance: to either side of the point, or only wholly before or after it
+  enum NearestDirection { NEAREST_ANY, NEAREST_BEFORE, NEAREST_AFTER };
+  // an entry in the best-first search of a nearest query: a subtree not yet
+  // looked into, or the next interval of a node, going up its <starts> from
+  // index <next> or down its <ends> from index <next> - 1, or just the one
+  // at <next> - 1 in <ends>. At the same distance, an interval that doesn't
+  // contain the point (one that's open ended and ends at it, or open and
+  // starts at it) comes after those that do.
+  enum NearestKind { NEAREST_SUBTREE, NEAREST_STARTS, NEAREST_ENDS,
+                     NEAREST_ONE };
+  struct NearestEntry {
+    NearestEntry(const R distance, const bool outside,
+                 const IntervalTree *tree, const size_t next,
+                 const NearestKind kind)
+        : distance(distance), outside(outside), tree(tree), next(next),
+          kind(kind) {;}
+    bool operator>(const NearestEntry &o) const {
+      if (o.distance < this->distance) return true;
+      return !(this->distance < o.distance) && this->outside && !o.outside;
+    }
+    R distance;
+    bool outside;
+    const IntervalTree *tree;
+    size_t next;
+    NearestKind kind;
+  };
+  typedef std::priority_queue<NearestEntry, std::vector<NearestEntry>,
+                              std::greater<NearestEntry> > NearestQueue;
+  const std::vector<T> nearestSearch(const R point, const size_t k,
+                                     const NearestDirection dir) const;
+  bool nearestBound(const R point, const NearestDirection dir,
+                    R &bound) const;
+  void nearestPushNode(const R point, const NearestDirection dir,
+                       NearestQueue &queue) const;
+  NearestEntry nearestInterval(const T &interval, const R point,
+                               const NearestDirection dir, const size_t next,
+                               const NearestKind kind) const;
+  // a subtree on the path a batch keeps from one query to the next, which
+  // the last query lay entirely to one side of mid in: its hits were a
+  // prefix of <starts> (left of mid) or a suffix of <ends> (right of mid).
+  // What decides whether the next query gets the same hits here is copied
+  // in, so checking that touches nothing but the level. The path is only
+  // kept while starts don't decrease, so what depends on the start alone
+  // comes down to a bound on it: it holds while the start is below <until>,
+  // or at it if <through> is set. Left of mid the hits depend on the end,
+  // which needn't be sorted, so the entries either side of the cut in
+  // <starts> are kept to check it against.
+  struct BatchLevel {
+    const IntervalTree *tree;
+    const IntervalTree *next;
+    NodeHits hits;
+    bool ends;
+    typename Node::Mid mid;
+    R minStart;
+    R until;
+    bool through;
+    bool hasBefore;
+    bool hasAfter;
+    R before;
+    R after;
+  };
+  // what a batch does with the hits it finds for each query: append them
+  // to the result, count them, or copy them to where they go in a result
+  // already sized by counting them. begin and end bracket each query, given
+  // its index in the batch, and add is given the hits in one node.
+  struct BatchAppend {
+    BatchAppend(IntervalTreeBatchResult<T> &res, const size_t numQueries)
+        : res(res), sample(numQueries / 16) {;}
+    void begin(const size_t) {;}
+    void add(const IntervalTree *tree, const NodeHits &h, const R start,
+             const R end) {
+      if (h.lo == h.hi) return;
+      if (!h.scan) {
+        this->res.hits.insert(this->res.hits.end(), h.list->begin() + h.lo,
+                              h.list->begin() + h.hi);
+        return;
+      }
+      for (size_t i = h.lo; i < h.hi; ++i)
+        if (tree->isHit((*h.list)[i], start, end))
+          this->res.hits.push_back((*h.list)[i]);
+    }
+    void end(const size_t q) {
+      this->res.offsets.push_back(this->res.hits.size());
+
+      // once a sixteenth of the queries are answered, make room for the
+      // rest at the rate seen so far, rather than growing a doubling at a
+      // time
+      if (q + 1 == this->sample)
+        this->res.hits.reserve(this->res.hits.size() * 17);
+    }
+    IntervalTreeBatchResult<T> &res;
+    size_t sample;
+  };
+  struct BatchCount {
+    explicit BatchCount(std::vector<size_t> &counts)
+        : counts(counts), n(0), any(NULL) {;}
+    void begin(const size_t) { this->n = 0; }
+    void add(const IntervalTree *tree, const NodeHits &h, const R start,
+             const R end) {
+      if (h.lo == h.hi) return;
+      this->n += tree->countHits(h, start, end);
+      if (this->any == NULL) this->any = &(*h.list)[h.lo];
+    }
+    void end(const size_t q) { this->counts[q + 1] = this->n; }
+    std::vector<size_t> &counts;
+    size_t n;
+    // some interval seen, to fill the hits with before they're placed
+    const T *any;
+  };
+  struct BatchPlace {
+    explicit BatchPlace(IntervalTreeBatchResult<T> &res) : res(res), out() {;}
+    void begin(const size_t q) {
+      this->out = this->res.hits.begin() + this->res.offsets[q];
+    }
+    void add(const IntervalTree *tree, const NodeHits &h, const R start,
+             const R end) {
+      if (!h.scan) {
+        this->out = std::copy(h.list->begin() + h.lo, h.list->begin() + h.hi,
+                              this->out);
+        return;
+      }
+      for (size_t i = h.lo; i < h.hi; ++i)
+        if (tree->isHit((*h.list)[i], start, end))
+          *(this->out++) = (*h.list)[i];
+    }
+    void end(const size_t) {;}
+    IntervalTreeBatchResult<T> &res;
+    typename std::vector<T>::iterator out;
+  };
+  IntervalTreeBatchResult<T> batch(const std::vector< std::pair<R, R> > &q,
+                                   const bool points) const;
+  std::vector<size_t> batchOrder(
+      const std::vector< std::pair<R, R> > &queries) const;
+  template <class Sink>
+  void batchRun(const std::vector< std::pair<R, R> > &queries,
+                const bool points, const std::vector<size_t> &order,
+                const size_t first, const size_t last, Sink &sink) const;
+  template <class Sink>
+  void batchQuery(const R start, const R end, const bool points,
+                  std::vector<BatchLevel> &path, Sink &sink) const;
+  bool batchLevel(const R start, const R end, BatchLevel &level) const;
+  bool batchKeeps(const BatchLevel &level, const R start, const R end,
+                  const bool strict) const;
+  IntervalTreeBatchResult<T> parallelBatch(
+      const std::vector< std::pair<R, R> > &queries, const bool points,
+      unsigned numThreads) const;
+  template <class Job>
+  static void batchThreads(const unsigned numThreads, const size_t n,
+                           const Job &job);
+
+  Node* data;
+  IntervalTree* left;
+  IntervalTree* right;
+  typename IntervalAccessorHolder<GetStart>::type getStart;
+  typename IntervalAccessorHolder<GetEnd>::type getEnd;
+  Endpoints endpoints;
+
+  // the arena subtrees and nodes are allocated in; NULL for the heap
+  IntervalTreeArena *arena;
+
+  // how this tree, and any subtree rebuilt later, picks its mid-point
+  IntervalSplitStrategy split;
+
+  // number of intervals in this subtree, and how many it was built with
+  size_t count;
+  size_t builtCount;
+
+  // smallest start and largest end of the intervals in this subtree, so
+  // queries can skip subtrees they lie entirely outside of
+  R minStart;
+  R maxEnd;
+};
+
+/**
+ * \brief Forward iterator over the hits of one query on an IntervalTree.
+ *        Nothing is collected up front: each increment resumes the
+ *        traversal where the last one left off, so stopping early skips the
+ *        rest of the work, and nothing is allocated unless the tree is deep
+ *        enough to spill the traversal stack. Hits come in the same order
+ *        as from the visitor queries. A default constructed iterator is the
+ *        end of every query. The tree must not be modified while iterating.
+ */
+template <class T, class R, class GetStart, class GetEnd,
+          class Stats = IntervalTreeNoStats,
+          class Endpoints = IntervalRuntimeEndpoints>
+class IntervalTreeQueryIterator {
+ public:
+  typedef IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> Tree;
+  typedef std::forward_iterator_tag iterator_category;
+  typedef T value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef const T* pointer;
+  typedef const T& reference;
+
+  IntervalTreeQueryIterator() : tree(NULL), list(NULL), i(0), hi(0),
+                                scan(false), point(false), start(), end() {;}
+  IntervalTreeQueryIterator(const Tree *root, const R start, const R end,
+                            const bool point);
+
+  reference operator*() const { return (*this->list)[this->i]; }
+  pointer operator->() const { return &((*this->list)[this->i]); }
+  IntervalTreeQueryIterator& operator++() {
+    ++this->i;
+    this->settle();
+    return *this;
+  }
+  IntervalTreeQueryIterator operator++(int) {
+    IntervalTreeQueryIterator res(*this);
+    ++(*this);
+    return res;
+  }
+
+  // every hit is at its own place in one node's list, so that's enough to
+  // tell iterators over the same query apart
+  bool operator==(const IntervalTreeQueryIterator &o) const {
+    return (this->list == o.list) && (this->i == o.i);
+  }
+  bool operator!=(const IntervalTreeQueryIterator &o) const {
+    return !(*this == o);
+  }
+
  private:
-  IntervalTreeNode<T, R>* data;
-  IntervalTree<T, R>* left;
-  IntervalTree<T, R>* right;
-  R (*getStart)(const T&);
-  R (*getEnd)(const T&);
-  bool openEnded;
+  void settle();
+
+  // the subtree the current hit is in, and where it is in that subtree's
+  // node; tree is NULL at the end
+  const Tree *tree;
+  const typename Tree::Node::List *list;
+  size_t i;
+  size_t hi;
+  bool scan;
+
+  // the query, and the subtrees that still have to be looked at
+  bool point;
+  R start;
+  R end;
+  typename Tree::Stack stack;
 };
 
+/**
+ * \brief The hits of one query on an IntervalTree, as a range that can be
+ *        used in a range-based for, with the standard algorithms, or (from
+ *        C++20) as a view. It only refers to the tree, which must outlive
+ *        it and its iterators.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+class IntervalTreeQueryRange {
+ public:
+  typedef IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> Tree;
+  typedef IntervalTreeQueryIterator<T, R, GetStart, GetEnd, Stats,
+                                    Endpoints> iterator;
+  typedef iterator const_iterator;
+
+  IntervalTreeQueryRange() : tree(NULL), start(), end_(), point(false) {;}
+  IntervalTreeQueryRange(const Tree *tree, const R start, const R end,
+                         const bool point)
+      : tree(tree), start(start), end_(end), point(point) {;}
+
+  iterator begin() const {
+    return iterator(this->tree, this->start, this->end_, this->point);
+  }
+  iterator end() const { return iterator(); }
+  bool empty() const { return this->begin() == this->end(); }
+
+ private:
+  const Tree *tree;
+  R start;
+  R end_;
+  bool point;
+};
+
+#if defined(__cpp_lib_ranges)
+// a query range only points at the tree, so it's cheap to copy and its
+// iterators don't depend on it staying alive
+namespace std {
+namespace ranges {
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+inline constexpr bool
+enable_view<
+    IntervalTreeQueryRange<T, R, GetStart, GetEnd, Stats, Endpoints> > = true;
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+inline constexpr bool
+enable_borrowed_range<
+    IntervalTreeQueryRange<T, R, GetStart, GetEnd, Stats, Endpoints> > = true;
+}  // namespace ranges
+}  // namespace std
+#endif
+
 
 
 /******************************************************************************
@@ -95,138 +630,661 @@ class IntervalTree {
 /**
  * \brief default constructor
  */
-template <class T, class R>
-IntervalTree<T, R>::IntervalTree() : data(NULL), left(NULL), right(NULL),
-                                     getStart(NULL), getEnd(NULL) {;}
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::IntervalTree()
+    : data(NULL), left(NULL), right(NULL), getStart(), getEnd(),
+      endpoints(), arena(NULL), split(INTERVAL_SPLIT_MIDDLE_INTERVAL),
+      count(0), builtCount(0), minStart(), maxEnd() {;}
+
+/**
+ * \brief Constructor for an empty IntervalTree that intervals can be
+ *        inserted into later; unlike the default constructor, this gives the
+ *        tree the accessors it needs to do that.
+ * \param arena if not NULL, the arena to allocate inserted intervals in
+ * \param split how subtrees pick their mid-points when they are (re)built
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::IntervalTree(
+    GetStart getStart, GetEnd getEnd, const Endpoints endpoints,
+    IntervalTreeArena *arena, const IntervalSplitStrategy split)
+    : data(NULL), left(NULL), right(NULL), getStart(getStart),
+      getEnd(getEnd), endpoints(endpoints), arena(arena), split(split),
+      count(0), builtCount(0), minStart(), maxEnd() {;}
 
 /**
  * \brief Constructor for IntervalTree.
  * \param intervals list of intervals, doesn't need to be sorted in any way.
+ *                  This is the only copy of them the tree makes.
+ * \param endpoints how intervals and queries are read. The default
+ *                  Endpoints takes OPEN_ENDED (or true) for [s, e), false
+ *                  for [s, e], or any IntervalEndpointConvention.
+ * \param numThreads maximum number of threads to build with; 0 means one per
+ *                   hardware thread. Only large trees use more than one.
+ * \param arena if not NULL, every subtree and node of the tree is allocated
+ *              in this arena, which must outlive the tree. Destroying the
+ *              tree then frees nothing itself (when neither the intervals
+ *              nor the accessors have destructors to run, it doesn't even
+ *              walk the tree); the memory is returned all at once when the
+ *              arena is released. Memory given up by later inserts and
+ *              erases is only reclaimed then.
+ * \param split how each subtree picks the mid-point it splits at; see
+ *              IntervalSplitStrategy
  * \throws IntervalTreeError if no intervals are provided
  */
-template <class T, class R>
-IntervalTree<T, R>::IntervalTree(const std::vector<T> &intervals,
-                                 R (*getStart)(const T&), R (*getEnd)(const T&),
-                                 const bool openEnded) {
-  this->left = NULL;
-  this->right = NULL;
-  this->getStart = getStart;
-  this->getEnd = getEnd;
-  this->openEnded = openEnded;
-  IntervalComparator<T, R> startComp = IntervalComparator<T, R>(getStart);
-
-  // because we're going to sort them, and want to force const on paramater
-  std::vector<T> cIntervals = std::vector<T>(intervals);
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::IntervalTree(
+    const std::vector<T> &intervals, GetStart getStart, GetEnd getEnd,
+    const Endpoints endpoints, const unsigned numThreads,
+    IntervalTreeArena *arena, const IntervalSplitStrategy split)
+    : IntervalTree(std::vector<T>(intervals), getStart, getEnd, endpoints,
+                   numThreads, arena, split) {;}
 
+/**
+ * \brief As above, but taking over <intervals> rather than copying them;
+ *        the vector is left empty.
+ * \throws IntervalTreeError if no intervals are provided
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::IntervalTree(
+    std::vector<T> &&intervals, GetStart getStart, GetEnd getEnd,
+    const Endpoints endpoints, const unsigned numThreads,
+    IntervalTreeArena *arena, const IntervalSplitStrategy split)
+    : data(NULL), left(NULL), right(NULL), getStart(getStart),
+      getEnd(getEnd), endpoints(endpoints), arena(arena), split(split),
+      count(0), builtCount(0), minStart(), maxEnd() {
   // can't build a tree with no intervals...
   if (intervals.size() <= 0)
     throw IntervalTreeError("Interval tree constructor got empty set of "
                             "intervals");
 
-  // sort the list by start index (this is arbitrary and just lets us try to
-  // split it evenly)
-  sort(cIntervals.begin(), cIntervals.end(), startComp);
+  // the intervals are sorted by start once, here, and each subtree then
+  // works on its own part of them in place.
+  std::vector<T> work(std::move(intervals));
+  IntervalComparator<T, R, GetStart> startComp =
+    IntervalComparator<T, R, GetStart>(getStart);
+  const uint64_t sortBegin = Stats::now();
+  sort(work.begin(), work.end(), startComp);
+  const uint64_t buildBegin = Stats::now();
+  this->build(work.begin(), work.end(),
+              numThreads > 0 ? numThreads
+                             : std::thread::hardware_concurrency());
+  this->StatsHolder::addBuild(buildBegin - sortBegin,
+                              Stats::now() - buildBegin);
+}
+
+/**
+ * \brief Constructor for IntervalTree with accessor types that can be
+ *        default constructed, such as IntervalStartMember and
+ *        IntervalEndMember; function pointers have to be given explicitly.
+ * \throws IntervalTreeError if no intervals are provided
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::IntervalTree(
+    const std::vector<T> &intervals, const Endpoints endpoints,
+    const unsigned numThreads, IntervalTreeArena *arena,
+    const IntervalSplitStrategy split)
+    : IntervalTree(intervals, GetStart(), GetEnd(), endpoints, numThreads,
+                   arena, split) {
+  static_assert(!std::is_pointer<GetStart>::value &&
+                !std::is_pointer<GetEnd>::value,
+                "function pointer accessors must be passed to the constructor");
+}
+
+/**
+ * \brief As above, but taking over <intervals> rather than copying them
+ * \throws IntervalTreeError if no intervals are provided
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::IntervalTree(
+    std::vector<T> &&intervals, const Endpoints endpoints,
+    const unsigned numThreads, IntervalTreeArena *arena,
+    const IntervalSplitStrategy split)
+    : IntervalTree(std::move(intervals), GetStart(), GetEnd(), endpoints,
+                   numThreads, arena, split) {
+  static_assert(!std::is_pointer<GetStart>::value &&
+                !std::is_pointer<GetEnd>::value,
+                "function pointer accessors must be passed to the constructor");
+}
+
+/**
+ * \brief Constructor for a subtree, from part of the (start-sorted) working
+ *        copy of the intervals made by the public constructor.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::IntervalTree(
+    WorkIterator first, WorkIterator last, GetStart getStart, GetEnd getEnd,
+    const Endpoints endpoints, const unsigned threads, IntervalTreeArena *arena,
+    const IntervalSplitStrategy split)
+    : StatsHolder(false), data(NULL), left(NULL), right(NULL),
+      getStart(getStart), getEnd(getEnd), endpoints(endpoints), arena(arena),
+      split(split), count(0), builtCount(0), minStart(), maxEnd() {
+  this->build(first, last, threads);
+}
+
+/**
+ * \brief Constructor for an empty subtree, to be filled in by whoever makes
+ *        it; unlike the public constructor for an empty tree, it keeps no
+ *        statistics.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::IntervalTree(
+    GetStart getStart, GetEnd getEnd, const Endpoints endpoints,
+    IntervalTreeArena *arena, const IntervalSplitStrategy split, Subtree)
+    : StatsHolder(false), data(NULL), left(NULL), right(NULL),
+      getStart(getStart), getEnd(getEnd), endpoints(endpoints), arena(arena),
+      split(split), count(0), builtCount(0), minStart(), maxEnd() {;}
+
+/**
+ * \brief build this (sub)tree from [first, last), which is sorted by start.
+ *        The range is partitioned in place into the intervals that end
+ *        before mid, those that overlap it and those that begin after it,
+ *        keeping each group sorted by start, so no subtree ever sorts again.
+ *        When both subtrees are large and we have more than one thread to
+ *        use, the left one is built in a separate thread.
+ * \param threads number of threads this subtree may use
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::build(
+    WorkIterator first, WorkIterator last, const unsigned threads) {
+  this->count = this->builtCount = last - first;
 
   // pick a mid-point and split the list
-  T midInt = cIntervals[intervals.size() / 2];
-  R mid = ((this->getEnd(midInt) - this->getStart(midInt)) / 2)
-            + this->getStart(midInt);
-
-  std::vector<T> here, lt, rt;
-  for (typename std::vector<T>::iterator it = cIntervals.begin();
-       it != cIntervals.end(); it++) {
-    // place all intervals that end before <mid> into the left subtree
-    if (this->getEnd(*it) < mid) {
-      lt.push_back(*it);
-    } else {
-      if (this->getStart(*it) > mid) {
-        // place all intervals that begin after <mid> into the right subtree
-        rt.push_back(*it);
-      } else {
-        // everything else must overlap mid, so we keep it here
-        here.push_back(*it);
-      }
-    }
-  }
+  const R mid = this->pickMid(first, last);
+
+  // all intervals that begin after <mid> go into the right subtree; since
+  // we're sorted by start, they're a suffix of the range. From the rest,
+  // those that end before <mid> go left and the others must overlap it,
+  // so we keep them here.
+  const GetStart getStartF = this->getStart;
+  const GetEnd getEndF = this->getEnd;
+  WorkIterator rtBegin = std::partition_point(first, last,
+      [getStartF, mid](const T &i) { return !(getStartF(i) > mid); });
+  WorkIterator hereBegin = std::stable_partition(first, rtBegin,
+      [getEndF, mid](const T &i) { return getEndF(i) < mid; });
 
-  if (here.size() <= 0) {
+  if (hereBegin == rtBegin) {
     std::ostringstream msg;
     msg << "fatal error: picked mid point at " << mid
         << " but this failed to intersect anything!";
     throw IntervalTreeError(msg.str().c_str());
   }
 
-  if (lt.size() > 0) this->left = new IntervalTree(lt, getStart, getEnd,
-                                                   openEnded);
-  if (rt.size() > 0) this->right = new IntervalTree(rt, getStart, getEnd,
-                                                    openEnded);
-  this->data = new IntervalTreeNode<T, R>(here, mid, this->getStart,
-                                          this->getEnd);
+  const bool parallel = (threads > 1) &&
+    (hereBegin - first >= PARALLEL_BUILD_THRESHOLD) &&
+    (last - rtBegin >= PARALLEL_BUILD_THRESHOLD);
+  // a subtree built in this thread may still split its own work, whichever
+  // side it's on
+  const unsigned ltThreads = parallel ? threads / 2 : threads;
+  const unsigned rtThreads = parallel ? threads - ltThreads : threads;
+  std::future<IntervalTree*> ltFuture;
+  try {
+    if (parallel) {
+      ltFuture = std::async(std::launch::async,
+                            [this, first, hereBegin, ltThreads]() {
+        return this->make<IntervalTree>(first, hereBegin, this->getStart,
+                                        this->getEnd, this->endpoints,
+                                        ltThreads, this->arena, this->split);
+      });
+    } else if (hereBegin != first) {
+      this->left = this->make<IntervalTree>(first, hereBegin, this->getStart,
+                                            this->getEnd, this->endpoints,
+                                            ltThreads, this->arena,
+                                            this->split);
+    }
+    if (rtBegin != last)
+      this->right = this->make<IntervalTree>(rtBegin, last, this->getStart,
+                                             this->getEnd, this->endpoints,
+                                             rtThreads, this->arena,
+                                             this->split);
+    if (ltFuture.valid()) this->left = ltFuture.get();
+    this->data = this->make<Node>(std::make_move_iterator(hereBegin),
+                                  std::make_move_iterator(rtBegin), mid,
+                                  this->getStart, this->getEnd,
+                                  typename Node::Allocator(this->arena));
+    this->updateBounds();
+  } catch (...) {
+    // a subtree we started must finish before we can get rid of it
+    if (ltFuture.valid()) {
+      try { this->left = ltFuture.get(); } catch (...) {;}
+    }
+    this->destroy(this->left);
+    this->destroy(this->right);
+    this->left = NULL;
+    this->right = NULL;
+    throw;
+  }
+}
+
+/**
+ * \brief pick the mid-point to split [first, last), which is sorted by start,
+ *        at, according to this tree's split strategy. Whatever the strategy,
+ *        the mid-point lies within at least one of the intervals, so the
+ *        node is never empty.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+R
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::pickMid(
+    WorkIterator first, WorkIterator last) const {
+  const size_t n = last - first;
+  if (this->split == INTERVAL_SPLIT_MIDDLE_INTERVAL) {
+    const T &midInt = first[n / 2];
+    return ((this->getEnd(midInt) - this->getStart(midInt)) / 2)
+             + this->getStart(midInt);
+  }
+  if ((this->split == INTERVAL_SPLIT_SAMPLED_MEDIAN) &&
+      (n > 4 * SPLIT_SAMPLE_SIZE)) {
+    // the lower median of the end-points of evenly spaced intervals
+    R pts[2 * SPLIT_SAMPLE_SIZE];
+    for (size_t i = 0; i < SPLIT_SAMPLE_SIZE; ++i) {
+      const T &sample = first[i * n / SPLIT_SAMPLE_SIZE];
+      pts[2 * i] = this->getStart(sample);
+      pts[2 * i + 1] = this->getEnd(sample);
+    }
+    std::nth_element(pts, pts + SPLIT_SAMPLE_SIZE - 1,
+                     pts + 2 * SPLIT_SAMPLE_SIZE);
+    const R mid = pts[SPLIT_SAMPLE_SIZE - 1];
+
+    // an unlucky sample is caught by counting what each side would get
+    const GetStart getStartF = this->getStart;
+    const GetEnd getEndF = this->getEnd;
+    const size_t rt = last - std::partition_point(first, last,
+        [getStartF, mid](const T &i) { return !(getStartF(i) > mid); });
+    const size_t lt = std::count_if(first, last - rt,
+        [getEndF, mid](const T &i) { return getEndF(i) < mid; });
+    if ((4 * lt <= 3 * n) && (4 * rt <= 3 * n)) return mid;
+  }
+  return this->medianEndpoint(first, last);
 }
 
 /**
- * \brief Copy constructor
+ * \brief the lower median of the 2n end-points of the n intervals in
+ *        [first, last). At most n - 1 end-points are smaller than it and at
+ *        most n larger, so no more than half the intervals can lie wholly to
+ *        either side of it.
  */
-template <class T, class R>
-IntervalTree<T, R>::IntervalTree(const IntervalTree<T, R> &t) {
-  // deep copy data tree node
-  if (t.data == NULL)
-    this->data = NULL;
-  else
-    this->data = new IntervalTreeNode<T, R>(*(t.data));
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+R
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::medianEndpoint(
+    WorkIterator first, WorkIterator last) const {
+  const size_t n = last - first;
+  std::vector<R> pts;
+  pts.reserve(2 * n);
+  for (WorkIterator it = first; it != last; ++it) {
+    pts.push_back(this->getStart(*it));
+    pts.push_back(this->getEnd(*it));
+  }
+  std::nth_element(pts.begin(), pts.begin() + (n - 1), pts.end());
+  return pts[n - 1];
+}
 
-  // deep copy left and right branches
-  if (t.left == NULL)
-    this->left = NULL;
-  else
-    this->left = new IntervalTree(*(t.left));
-  if (t.right == NULL)
-    this->right = NULL;
-  else
-    this->right = new IntervalTree(*(t.right));
+/**
+ * \brief Copy constructor. As for std::pmr containers, the copy doesn't
+ *        share the original's arena; it's allocated on the heap. Nor does it
+ *        share the original's statistics; it starts with fresh ones.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::IntervalTree(
+    const IntervalTree &t)
+    : StatsHolder(), data(NULL), left(NULL), right(NULL), getStart(t.getStart),
+      getEnd(t.getEnd), endpoints(t.endpoints), arena(NULL), split(t.split),
+      count(t.count), builtCount(t.builtCount), minStart(t.minStart),
+      maxEnd(t.maxEnd) {
+  // deep copy one subtree at a time, rather than recursively, so a deep
+  // tree can't exhaust the stack; each copy starts as an empty shell
+  typedef std::pair<const IntervalTree*, IntervalTree*> Job;
+  IntervalTreeStack<Job> stack;
+  stack.push(Job(&t, this));
+  try {
+    while (!stack.empty()) {
+      const Job job = stack.pop();
+      const IntervalTree &src = *(job.first);
+      IntervalTree &dst = *(job.second);
+      if (src.data != NULL)
+        dst.data = new Node(*(src.data), typename Node::Allocator());
+      const IntervalTree *from[] = {src.left, src.right};
+      IntervalTree **to[] = {&(dst.left), &(dst.right)};
+      for (size_t i = 0; i < 2; ++i) {
+        if (from[i] == NULL) continue;
+        IntervalTree *shell = new IntervalTree(from[i]->getStart,
+                                               from[i]->getEnd,
+                                               from[i]->endpoints, NULL,
+                                               from[i]->split, Subtree());
+        shell->count = from[i]->count;
+        shell->builtCount = from[i]->builtCount;
+        shell->minStart = from[i]->minStart;
+        shell->maxEnd = from[i]->maxEnd;
+        *(to[i]) = shell;
+        stack.push(Job(from[i], shell));
+      }
+    }
+  } catch (...) {
+    this->destroyAll();
+    throw;
+  }
+}
 
-  // function pointers can be copied shallow
-  this->getStart = t.getStart;
-  this->getEnd = t.getEnd;
+/**
+ * \brief Move constructor; takes over the structure and statistics of
+ *        <t>, which is left empty, and counting nothing.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::IntervalTree(
+    IntervalTree &&t) noexcept
+    : StatsHolder(std::move(static_cast<StatsHolder&>(t))), data(t.data),
+      left(t.left), right(t.right),
+      getStart(std::move(t.getStart)), getEnd(std::move(t.getEnd)),
+      endpoints(t.endpoints), arena(t.arena), split(t.split), count(t.count),
+      builtCount(t.builtCount), minStart(t.minStart), maxEnd(t.maxEnd) {
+  t.data = NULL;
+  t.left = NULL;
+  t.right = NULL;
+  t.count = 0;
+  t.builtCount = 0;
+}
 
-  // open-ended is shallow
-  this->openEnded = t.openEnded;
+/**
+ * \brief Destructor for IntervalTree. A tree in an arena is left for the
+ *        arena to release in one go, if nothing in its subtrees and nodes
+ *        (the intervals, coordinates and accessors; subtrees keep no
+ *        statistics) has anything to destroy; otherwise each of them is
+ *        destroyed, but still not freed.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::~IntervalTree() {
+  const bool trivial = std::is_trivially_destructible<T>::value &&
+                       std::is_trivially_destructible<R>::value &&
+                       std::is_trivially_destructible<GetStart>::value &&
+                       std::is_trivially_destructible<GetEnd>::value;
+  if ((this->arena != NULL) && trivial) return;
+  this->destroyAll();
 }
 
 /**
- * \brief Destructor for IntervalTree
+ * \brief destroy this tree's node and all of its subtrees, leaving it empty.
+ *        Each subtree is detached from its children before it's destroyed,
+ *        so this works through the tree one subtree at a time instead of
+ *        recursing, and a deep tree can't exhaust the stack.
  */
-template <class T, class R>
-IntervalTree<T, R>::~IntervalTree() {
-  if (this->data != NULL) delete this->data;
-  if (this->left != NULL) delete this->left;
-  if (this->right != NULL) delete this->right;
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::destroyAll() {
+  IntervalTreeStack<IntervalTree*> stack;
+  if (this->left != NULL) stack.push(this->left);
+  if (this->right != NULL) stack.push(this->right);
+  this->destroy(this->data);
+  this->data = NULL;
+  this->left = NULL;
+  this->right = NULL;
+  while (!stack.empty()) {
+    IntervalTree *t = stack.pop();
+    if (t->left != NULL) stack.push(t->left);
+    if (t->right != NULL) stack.push(t->right);
+    t->left = NULL;
+    t->right = NULL;
+    this->destroy(t);
+  }
 }
 
 /**
  * \brief assignment operator; need to be careful here, since we have
  *				pointer members. Swap idiom should work for copy-assignment
  */
-template <class T, class R>
-IntervalTree<T, R>&
-IntervalTree<T, R>::operator=(const IntervalTree<T, R>& other) {
-  IntervalTree<T, R> tmp(other);
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>&
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::operator=(
+    const IntervalTree& other) {
+  IntervalTree tmp(other);
+  this->swap(tmp);
+  return *this;
+}
+
+/**
+ * \brief move assignment; takes over the statistics of <other> too, where
+ *        copy assignment and swap leave each tree with its own
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>&
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::operator=(
+    IntervalTree&& other) noexcept {
+  IntervalTree tmp(std::move(other));
   this->swap(tmp);
+  this->StatsHolder::swap(tmp);
   return *this;
 }
 
 /**
- * \brief swap the contents of this IntervalTree with another
+ * \brief swap the contents of this IntervalTree with another; each keeps its
+ *        own statistics
  */
-template <class T, class R>
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
 void
-IntervalTree<T, R>::swap(IntervalTree<T, R>& other) {
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::swap(
+    IntervalTree& other) noexcept {
   std::swap(this->data, other.data);
   std::swap(this->left, other.left);
   std::swap(this->right, other.right);
   std::swap(this->getStart, other.getStart);
   std::swap(this->getEnd, other.getEnd);
-  std::swap(this->openEnded, other.openEnded);
+  std::swap(this->endpoints, other.endpoints);
+  std::swap(this->arena, other.arena);
+  std::swap(this->split, other.split);
+  std::swap(this->count, other.count);
+  std::swap(this->builtCount, other.builtCount);
+  std::swap(this->minStart, other.minStart);
+  std::swap(this->maxEnd, other.maxEnd);
+}
+
+/**
+ * \brief add <interval> to the tree, in the first node on its path whose mid
+ *        it overlaps, or in a new leaf if it runs off the bottom. So that a
+ *        run of insertions can't unbalance the tree, the highest subtree on
+ *        the path that has doubled in size since it was built is rebuilt
+ *        instead, with the new interval included. A subtree of m intervals
+ *        is rebuilt at most once per m insertions into it, so updates cost
+ *        amortised O(log^2 n) and the tree is never far from the one a fresh
+ *        build would give. The tree must not be queried while this runs.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::insert(
+    const T &interval) {
+  const R s = this->getStart(interval), e = this->getEnd(interval);
+  std::vector<IntervalTree*> path;
+  IntervalTree *cur = this;
+  while (true) {
+    if (cur->data == NULL) {
+      // only an empty tree has no node
+      std::vector<T> work(1, interval);
+      cur->build(work.begin(), work.end(), 1);
+      break;
+    }
+    if ((cur->count >= REBUILD_THRESHOLD) &&
+        (cur->count >= 2 * cur->builtCount)) {
+      const uint64_t begin = Stats::now();
+      cur->rebuild(&interval);
+      this->StatsHolder::addRebuild(Stats::now() - begin);
+      break;
+    }
+    path.push_back(cur);
+    IntervalTree **child = NULL;
+    if (s > cur->data->mid) {
+      child = &(cur->right);
+    } else if (e < cur->data->mid) {
+      child = &(cur->left);
+    } else {
+      cur->data->insert(interval);
+      break;
+    }
+    if (*child == NULL) {
+      std::vector<T> work(1, interval);
+      *child = this->make<IntervalTree>(work.begin(), work.end(),
+                                        this->getStart, this->getEnd,
+                                        this->endpoints, 1u, this->arena,
+                                        this->split);
+      break;
+    }
+    cur = *child;
+  }
+  for (size_t i = 0; i < path.size(); ++i) {
+    path[i]->count += 1;
+    if (s < path[i]->minStart) path[i]->minStart = s;
+    if (e > path[i]->maxEnd) path[i]->maxEnd = e;
+  }
+}
+
+/**
+ * \brief remove one interval equal to <interval> (by T's operator==) from
+ *        the tree. It can only be in the node its end-points lead to, so
+ *        this is a single descent. A subtree left with nothing in it is
+ *        removed, and the highest one on the path that has shrunk to less
+ *        than half the size it was built with is rebuilt. The tree must not
+ *        be queried while this runs.
+ * \return true if a matching interval was found and removed
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+bool
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::erase(
+    const T &interval) {
+  const R s = this->getStart(interval), e = this->getEnd(interval);
+  std::vector<IntervalTree*> path;
+  IntervalTree *cur = this;
+  while ((cur != NULL) && (cur->data != NULL)) {
+    path.push_back(cur);
+    if (s > cur->data->mid) cur = cur->right;
+    else if (e < cur->data->mid) cur = cur->left;
+    else break;
+  }
+  if ((cur == NULL) || (cur->data == NULL) || !cur->data->erase(interval))
+    return false;
+
+  for (size_t i = 0; i < path.size(); ++i) path[i]->count -= 1;
+  size_t i = 0;
+  for (; i < path.size(); ++i) {
+    IntervalTree *t = path[i];
+    if (t->count == 0) {
+      if (i == 0) {
+        IntervalTree empty(this->getStart, this->getEnd, this->endpoints,
+                           this->arena, this->split);
+        this->swap(empty);
+      } else {
+        IntervalTree *parent = path[i - 1];
+        if (parent->left == t) parent->left = NULL;
+        else parent->right = NULL;
+        this->destroy(t);
+      }
+      break;
+    }
+    if (2 * t->count < t->builtCount) {
+      const uint64_t begin = Stats::now();
+      t->rebuild(NULL);
+      this->StatsHolder::addRebuild(Stats::now() - begin);
+      break;
+    }
+  }
+
+  // subtrees below path[i] are gone, and it's been rebuilt or removed; the
+  // ones above it may now have tighter bounds
+  while (i > 0) path[--i]->updateBounds();
+  return true;
+}
+
+/**
+ * \brief work out minStart and maxEnd for this subtree from the intervals in
+ *        its node and the bounds of its subtrees
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::updateBounds() {
+  const IntervalTree *parts[] = {this->left, this->right};
+  bool any = !this->data->starts.empty();
+  if (any) {
+    this->minStart = this->getStart(this->data->starts.front());
+    this->maxEnd = this->getEnd(this->data->ends.back());
+  }
+  for (size_t i = 0; i < 2; ++i) {
+    if (parts[i] == NULL) continue;
+    if ((!any) || (parts[i]->minStart < this->minStart))
+      this->minStart = parts[i]->minStart;
+    if ((!any) || (parts[i]->maxEnd > this->maxEnd))
+      this->maxEnd = parts[i]->maxEnd;
+    any = true;
+  }
+}
+
+/**
+ * \brief rebuild this subtree from scratch from the intervals in it, plus
+ *        <extra> if it isn't NULL.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::rebuild(
+    const T *extra) {
+  std::vector<T> work(this->squash(true));
+  if (extra != NULL) {
+    IntervalComparator<T, R, GetStart> startComp =
+      IntervalComparator<T, R, GetStart>(this->getStart);
+    work.insert(std::upper_bound(work.begin(), work.end(), *extra,
+                                 startComp), *extra);
+  }
+  // asking for the number of hardware threads isn't free, so only do it
+  // when the rebuild is big enough to use them
+  const unsigned threads = (work.size() >= 2 * PARALLEL_BUILD_THRESHOLD) ?
+                           std::thread::hardware_concurrency() : 1;
+  IntervalTree tmp(work.begin(), work.end(), this->getStart, this->getEnd,
+                   this->endpoints, threads, this->arena, this->split);
+  this->swap(tmp);
+}
+
+/**
+ * \brief construct a U from <args> in this tree's arena, or on the heap if
+ *        it doesn't have one.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class U, class... Args>
+U*
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::make(
+    Args&&... args) const {
+  if (this->arena == NULL) return new U(std::forward<Args>(args)...);
+  void *p = this->arena->allocate(sizeof(U), alignof(U));
+  return new (p) U(std::forward<Args>(args)...);
+}
+
+/**
+ * \brief destroy something made by make(); the memory is only given back if
+ *        it came from the heap. Does nothing if <p> is NULL.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class U>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::destroy(U *p) const {
+  if (p == NULL) return;
+  if (this->arena == NULL) delete p;
+  else p->~U();
 }
 
 /**
@@ -235,161 +1293,1256 @@ IntervalTree<T, R>::swap(IntervalTree<T, R>& other) {
  * \param point the point of intersection to test against
  * \return vector of intersected intervals
  */
-template <class T, class R>
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
 const std::vector<T>
-IntervalTree<T, R>::intersectingPoint(const R point) const {
-  if (point > this->data->mid) {
-    // we know all intervals in this->data begin before p (if they began
-    // after p, they would have not included mid) we just need to find
-    // those that end after p
-    std::vector<T> endAfterP;
-    for (auto it = this->data->ends.rbegin();
-         it != this->data->ends.rend(); it++) {
-      if (((!this->openEnded) && (this->getEnd(*it) >= point)) ||
-          ((this->openEnded) && (this->getEnd(*it) > point))) {
-        endAfterP.push_back(*it);
-      } else {
-        break;
-      }
-    }
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::intersectingPoint(
+    const R point) const {
+  std::vector<T> res;
+  this->intersectingPoint(point, res);
+  return res;
+}
 
-    if (this->right != NULL) {
-      std::vector<T> descendRight = this->right->intersectingPoint(point);
-      for (typename std::vector<T>::iterator it = descendRight.begin();
-           it != descendRight.end(); it++) {
-        endAfterP.push_back(*it);
-      }
-    }
-    return endAfterP;
-  }
-  if (point < this->data->mid) {
-    // we know all intervals in this->data end after p (if they ended before
-    // p, they would have not included mid) we just need to find those that
-    // start before p
-    std::vector<T> startBeforeP;
-    for (typename std::vector<T>::iterator it = this->data->starts.begin();
-         it != this->data->starts.end(); it++) {
-      if (this->getStart(*it) <= point)
-        startBeforeP.push_back(*it);
-      else
-        break;
-    }
+/**
+ * \brief given a point, append the intervals in the tree that intersect it
+ *        to <res>. Nothing already in <res> is removed, so the same vector
+ *        can be reused across queries without reallocating.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::intersectingPoint(
+    const R point, std::vector<T> &res) const {
+  this->intersectingPoint(point, std::back_inserter(res));
+}
+
+/**
+ * \brief given a point, copy the intervals in the tree that intersect it to
+ *        the output iterator <out>.
+ * \return the output iterator, one past the last element written
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class OutputIterator>
+OutputIterator
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::intersectingPoint(
+    const R point, OutputIterator out) const {
+  IntervalTreeOutputVisitor<T, OutputIterator> v(out);
+  this->visitPoint(point, v);
+  return v.out;
+}
 
-    if (this->left != NULL) {
-      std::vector<T> descendLeft = this->left->intersectingPoint(point);
-      for (typename std::vector<T>::iterator it = descendLeft.begin();
-           it != descendLeft.end(); it++) {
-        startBeforeP.push_back(*it);
+/**
+ * \brief given a point, call <visit> once for each interval in the tree that
+ *        intersects it; <visit> can be a function pointer or a functor taking
+ *        a const T&. No memory is allocated by the query itself.
+ * \return the visitor, so any state it accumulated can be inspected
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class Visitor>
+Visitor
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::visitIntersectingPoint(
+    const R point, Visitor visit) const {
+  this->visitPoint(point, visit);
+  return visit;
+}
+
+/**
+ * \brief implementation of the point query; visits each interval in a node
+ *        that contains <point>, then moves down into the (only) subtree that
+ *        can contain more of them.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class Visitor>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::visitPoint(
+    const R point, Visitor &visit) const {
+  typename Stats::Probe probe;
+  size_t depth = 0;
+  const IntervalTree *cur = this;
+  while ((cur != NULL) && (cur->data != NULL) &&
+         !cur->outside(point, point)) {
+    const NodeHits h = cur->herePoint(point);
+    probe.visit(++depth, h.hi - h.lo);
+    if (!h.scan) probe.hits(h.hi - h.lo);
+    for (size_t i = h.lo; i < h.hi; ++i) {
+      const T &it = (*h.list)[i];
+      if (!h.scan) {
+        visit(it);
+      } else if (cur->isHit(it, point, point)) {
+        probe.hits(1);
+        visit(it);
       }
     }
-    return startBeforeP;
-  }
 
-  // must be a perfect match, since point is neither > nor < mid
-  assert(point == this->data->mid);
-  return this->data->ends;
+    // a perfect match with mid can't intersect anything in either subtree
+    if (point > cur->data->mid) cur = cur->right;
+    else if (point < cur->data->mid) cur = cur->left;
+    else break;
+  }
+  this->StatsHolder::add(probe);
 }
 
 /**
  * \brief given an interval, determine which set of intervals in the tree are
  *        intersected.
- * \param start TODO
- * \param end TODO
+ * \param start start of the query interval
+ * \param end end of the query interval
  * \return: vector of intersected intervals
  */
-template <class T, class R>
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
 const std::vector<T>
-IntervalTree<T, R>::intersectingInterval(const R start, const R end) const {
-  // find all intervals in this node that intersect start and end
-  std::vector<T> intersecting;
-  for (typename std::vector<T>::iterator it = this->data->starts.begin();
-       it != this->data->starts.end(); it++) {
-      if (this->openEnded) {
-        if (((this->getStart(*it) >= start) && (this->getStart(*it) < end)) ||
-              ((this->getEnd(*it) > start) && (this->getEnd(*it) < end)) ||
-              ((start >= this->getStart(*it) && start < this->getEnd(*it))) ||
-              ((end > this->getStart(*it)) && (end < this->getEnd(*it)))) {
-            intersecting.push_back(*it);
-        }
-      } else {
-        if (((this->getStart(*it) >= start) && (this->getStart(*it) <= end)) ||
-              ((this->getEnd(*it) >= start) && (this->getEnd(*it) <= end)) ||
-              ((start >= this->getStart(*it) && start <= this->getEnd(*it))) ||
-              ((end >= this->getStart(*it)) && (end <= this->getEnd(*it)))) {
-            intersecting.push_back(*it);
-        }
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::intersectingInterval(
+    const R start, const R end) const {
+  std::vector<T> res;
+  this->intersectingInterval(start, end, res);
+  return res;
+}
+
+/**
+ * \brief given an interval, append the intervals in the tree that intersect
+ *        it to <res>; as for the point query, <res> is not cleared first.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::intersectingInterval(
+    const R start, const R end, std::vector<T> &res) const {
+  this->intersectingInterval(start, end, std::back_inserter(res));
+}
+
+/**
+ * \brief given an interval, copy the intervals in the tree that intersect it
+ *        to the output iterator <out>.
+ * \return the output iterator, one past the last element written
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class OutputIterator>
+OutputIterator
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::intersectingInterval(
+    const R start, const R end, OutputIterator out) const {
+  IntervalTreeOutputVisitor<T, OutputIterator> v(out);
+  this->visitInterval(start, end, v);
+  return v.out;
+}
+
+/**
+ * \brief given an interval, call <visit> once for each interval in the tree
+ *        that intersects it.
+ * \return the visitor, so any state it accumulated can be inspected
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class Visitor>
+Visitor
+IntervalTree<T, R, GetStart, GetEnd, Stats,
+             Endpoints>::visitIntersectingInterval(
+    const R start, const R end, Visitor visit) const {
+  this->visitInterval(start, end, visit);
+  return visit;
+}
+
+/**
+ * \brief implementation of the interval query; visits the subtrees in
+ *        pre-order, using an explicit stack rather than recursion.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class Visitor>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::visitInterval(
+    const R start, const R end, Visitor &visit) const {
+  // the probe keeps the depth of each subtree on the stack, if it needs to
+  typename Stats::Probe probe;
+  Stack stack;
+  stack.push(this);
+  probe.push(1);
+  while (!stack.empty()) {
+    const IntervalTree *cur = stack.pop();
+    const size_t depth = probe.pop();
+    if ((cur->data == NULL) || cur->outside(start, end)) continue;
+
+    // find all intervals in this node that intersect start and end
+    const NodeHits h = cur->hereInterval(start, end);
+    probe.visit(depth, h.hi - h.lo);
+    if (!h.scan) probe.hits(h.hi - h.lo);
+    for (size_t i = h.lo; i < h.hi; ++i) {
+      const T &it = (*h.list)[i];
+      if (!h.scan) {
+        visit(it);
+      } else if (cur->isHit(it, start, end)) {
+        probe.hits(1);
+        visit(it);
       }
+    }
+    const unsigned pushed = cur->pushSubtrees(start, end, stack);
+    for (unsigned k = 0; k < pushed; ++k) probe.push(depth + 1);
   }
+  this->StatsHolder::add(probe);
+}
 
-  // process left subtree (if we have one) if the requested interval begins
-  // before mid
+/**
+ * \brief push the subtrees that [start, end] may have hits in onto <stack>:
+ *        the left one if the query begins before mid, and the right one if
+ *        it ends after mid. The right is pushed first, so that it's popped
+ *        second and hits come out in the same order as a recursive
+ *        traversal would give.
+ * \return the number of subtrees pushed
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+unsigned
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::pushSubtrees(
+    const R start, const R end, Stack &stack) const {
+  unsigned pushed = 0;
+  if ((this->right != NULL) && (end >= this->data->mid)) {
+    stack.push(this->right);
+    ++pushed;
+  }
   if ((this->left != NULL) && (start <= this->data->mid)) {
-    std::vector<T> descendLeft = this->left->intersectingInterval(start, end);
-    for (typename std::vector<T>::iterator it = descendLeft.begin();
-         it != descendLeft.end(); it++) {
-      intersecting.push_back(*it);
+    stack.push(this->left);
+    ++pushed;
+  }
+  return pushed;
+}
+
+/**
+ * \brief work out which of the intervals in this node contain <point>;
+ *        those that begin before it if it is left of mid, and those that
+ *        end after it if it is right of mid, found by binary search.
+ *        Only an open (s, e) convention has to check them, for a point on
+ *        mid.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+typename IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::NodeHits
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::herePoint(
+    const R point) const {
+  const Node &n = *(this->data);
+  NodeHits h = {&n.ends, 0, n.ends.size(), false};
+  if (point < n.mid) {
+    // one that's open at the start doesn't contain the point it starts on
+    h.list = &n.starts;
+    h.hi = n.startsUpTo(point, this->endpoints.openStart());
+  } else if ((point > n.mid) || this->endpoints.openEnded()) {
+    // an open-ended interval that ends on mid doesn't contain it, and at
+    // mid one that's open at the start too doesn't if it starts there
+    h.lo = n.endsFrom(point, this->endpoints.openEnded());
+    h.scan = this->endpoints.openStart() && !(point > n.mid);
+  }
+  return h;
+}
+
+/**
+ * \brief count the intervals in this node that contain <point>
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+size_t
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::countHerePoint(
+    const R point) const {
+  return this->countHits(this->herePoint(point), point, point);
+}
+
+/**
+ * \brief work out which of the intervals in this node intersect [start, end].
+ *        All of them contain mid, so when the query lies entirely to one
+ *        side of mid only one of their end-points matters, and the hits are
+ *        a prefix of <starts> or a suffix of <ends> that a binary search
+ *        finds; when the query spans mid, everything here intersects it.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+typename IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::NodeHits
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::hereInterval(
+    const R start, const R end) const {
+  const Node &n = *(this->data);
+  NodeHits h = {&n.starts, 0, n.starts.size(), false};
+  if (end < n.mid) {
+    // an empty open-ended query [p, p) behaves like the point p, which an
+    // interval open at the start must begin before
+    h.hi = n.startsUpTo(end, this->endpoints.openStart() ||
+                             (this->endpoints.openEnded() && (start != end)));
+  } else if (start > n.mid) {
+    h.list = &n.ends;
+    h.lo = n.endsFrom(start, this->endpoints.openEnded());
+  } else if (this->endpoints.openEnded() &&
+             ((start == n.mid) || (end == n.mid))) {
+    // open-ended query with an end-point exactly on mid; intervals that
+    // start or end on mid may or may not intersect it, so check them all
+    h.scan = true;
+  }
+  return h;
+}
+
+/**
+ * \brief count the intervals in this node that intersect [start, end]
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+size_t
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::countHereInterval(
+    const R start, const R end) const {
+  return this->countHits(this->hereInterval(start, end), start, end);
+}
+
+/**
+ * \brief count the entries of <h> that are hits for [start, end]; only
+ *        those in a list that has to be scanned need to be looked at.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+size_t
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::countHits(
+    const NodeHits &h, const R start, const R end) const {
+  if (!h.scan) return h.hi - h.lo;
+  size_t res = 0;
+  for (size_t i = h.lo; i < h.hi; ++i)
+    res += this->isHit((*h.list)[i], start, end);
+  return res;
+}
+
+/**
+ * \brief count the intervals in the tree that contain <point>; equivalent
+ *        to intersectingPoint(point).size(), but nothing is copied.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+size_t
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::countIntersectingPoint(
+    const R point) const {
+  size_t res = 0;
+  const IntervalTree *cur = this;
+  while ((cur != NULL) && (cur->data != NULL) &&
+         !cur->outside(point, point)) {
+    res += cur->countHerePoint(point);
+    if (point > cur->data->mid) cur = cur->right;
+    else if (point < cur->data->mid) cur = cur->left;
+    else break;
+  }
+  return res;
+}
+
+/**
+ * \brief count the intervals in the tree that intersect [start, end];
+ *        equivalent to intersectingInterval(start, end).size().
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+size_t
+IntervalTree<T, R, GetStart, GetEnd, Stats,
+             Endpoints>::countIntersectingInterval(
+    const R start, const R end) const {
+  size_t res = 0;
+  Stack stack;
+  stack.push(this);
+  while (!stack.empty()) {
+    const IntervalTree *cur = stack.pop();
+    if ((cur->data == NULL) || cur->outside(start, end)) continue;
+    res += cur->countHereInterval(start, end);
+    cur->pushSubtrees(start, end, stack);
+  }
+  return res;
+}
+
+/**
+ * \brief determine whether any interval in the tree contains <point>; stops
+ *        at the first node that has one.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+bool
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::anyIntersecting(
+    const R point) const {
+  const IntervalTree *cur = this;
+  while ((cur != NULL) && (cur->data != NULL) &&
+         !cur->outside(point, point)) {
+    if (cur->countHerePoint(point) > 0) return true;
+    if (point > cur->data->mid) cur = cur->right;
+    else if (point < cur->data->mid) cur = cur->left;
+    else break;
+  }
+  return false;
+}
+
+/**
+ * \brief determine whether any interval in the tree intersects [start, end];
+ *        stops at the first node that has one.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+bool
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::anyIntersecting(
+    const R start, const R end) const {
+  Stack stack;
+  stack.push(this);
+  while (!stack.empty()) {
+    const IntervalTree *cur = stack.pop();
+    if ((cur->data == NULL) || cur->outside(start, end)) continue;
+    if (cur->countHereInterval(start, end) > 0) return true;
+    cur->pushSubtrees(start, end, stack);
+  }
+  return false;
+}
+
+/**
+ * \brief find the <k> intervals nearest to <point>, closest first. The
+ *        distance to an interval is 0 if it contains the point, and otherwise
+ *        the gap between the point and its nearer end, so intervals that
+ *        intersect the point come first. In an open ended tree an interval
+ *        [s, e) doesn't contain e, so for a point at or after e the distance
+ *        is point - e, and one ending at the point comes after all those
+ *        that contain it; with open (s, e) intervals, so does one starting
+ *        at the point, and nearestAfter counts it as after the point. Other
+ *        ties are broken arbitrarily.
+ *
+ *        Subtrees are searched best first, in order of the distance from the
+ *        point to their bounds, and each node's intervals are taken from its
+ *        sorted lists in order of distance (every interval in a node contains
+ *        its mid, so they're in order of start if the point is at or before
+ *        mid, and in reverse order of end if it's after), so only the nodes
+ *        on the way to the <k> answers are looked into, and for each only the
+ *        intervals that are answers.
+ * \return at most <k> intervals; fewer only if the tree has fewer
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+const std::vector<T>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::nearest(
+    const R point, const size_t k) const {
+  return this->nearestSearch(point, k, NEAREST_ANY);
+}
+
+/**
+ * \brief find the <k> intervals that end nearest before <point>, without
+ *        containing it, closest first; e.g. the nearest feature upstream of a
+ *        position on the forward strand. See nearest.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+const std::vector<T>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::nearestBefore(
+    const R point, const size_t k) const {
+  return this->nearestSearch(point, k, NEAREST_BEFORE);
+}
+
+/**
+ * \brief find the <k> intervals that start nearest after <point>, closest
+ *        first. See nearest.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+const std::vector<T>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::nearestAfter(
+    const R point, const size_t k) const {
+  return this->nearestSearch(point, k, NEAREST_AFTER);
+}
+
+/**
+ * \brief the best-first search behind the nearest queries. Each entry taken
+ *        from the queue is either a subtree, which is replaced by its node's
+ *        first interval in order of distance and by its own subtrees, or an
+ *        interval, which is the next answer, and is replaced by the one after
+ *        it in its node. An entry's distance is never more than that of
+ *        anything it's replaced by, so the answers come out closest first.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+const std::vector<T>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::nearestSearch(
+    const R point, const size_t k, const NearestDirection dir) const {
+  std::vector<T> res;
+  R bound = R();
+  if ((k == 0) || (this->data == NULL) ||
+      !this->nearestBound(point, dir, bound))
+    return res;
+  std::vector<NearestEntry> entries;
+  entries.reserve(64);
+  NearestQueue queue(std::greater<NearestEntry>(), std::move(entries));
+  queue.push(NearestEntry(bound, false, this, 0, NEAREST_SUBTREE));
+  while ((!queue.empty()) && (res.size() < k)) {
+    const NearestEntry top = queue.top();
+    queue.pop();
+    const IntervalTree *cur = top.tree;
+    if (top.kind == NEAREST_SUBTREE) {
+      cur->nearestPushNode(point, dir, queue);
+      const IntervalTree *parts[] = {cur->left, cur->right};
+      for (size_t i = 0; i < 2; ++i) {
+        if ((parts[i] != NULL) && (parts[i]->data != NULL) &&
+            parts[i]->nearestBound(point, dir, bound))
+          queue.push(NearestEntry(bound, false, parts[i], 0,
+                                  NEAREST_SUBTREE));
+      }
+    } else if (top.kind == NEAREST_STARTS) {
+      const typename Node::List &starts = cur->data->starts;
+      res.push_back(starts[top.next]);
+      if (top.next + 1 < starts.size()) {
+        queue.push(cur->nearestInterval(starts[top.next + 1], point, dir,
+                                        top.next + 1, NEAREST_STARTS));
+      }
+    } else {
+      const typename Node::List &ends = cur->data->ends;
+      res.push_back(ends[top.next - 1]);
+      if ((top.kind == NEAREST_ENDS) && (top.next > 1)) {
+        queue.push(cur->nearestInterval(ends[top.next - 2], point, dir,
+                                        top.next - 1, NEAREST_ENDS));
+      }
     }
   }
+  return res;
+}
 
-  // process right subtree (if we have one) if the requested interval
-  // ends after mid
-  if ((this->right != NULL) && (end >= this->data->mid)) {
-    std::vector<T> desendRight = this->right->intersectingInterval(start, end);
-    for (typename std::vector<T>::iterator it = desendRight.begin();
-      it != desendRight.end(); it++) {
-      intersecting.push_back(*it);
+/**
+ * \brief work out, from this subtree's bounds, the least distance from
+ *        <point> that any interval in it could be.
+ * \return false if none of its intervals can be in the direction asked for
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+bool
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::nearestBound(
+    const R point, const NearestDirection dir, R &bound) const {
+  bound = R();
+  if (dir == NEAREST_AFTER) {
+    if (this->endpoints.openStart() ? (this->maxEnd < point)
+                                    : !(point < this->maxEnd)) return false;
+    if (point < this->minStart) bound = this->minStart - point;
+  } else if (dir == NEAREST_BEFORE) {
+    if (this->endpoints.openEnded() ? (point < this->minStart)
+                                    : !(this->minStart < point)) return false;
+    if (this->maxEnd < point) bound = point - this->maxEnd;
+  } else {
+    if (point < this->minStart) bound = this->minStart - point;
+    else if (this->maxEnd < point) bound = point - this->maxEnd;
+  }
+  return true;
+}
+
+/**
+ * \brief add the first of this node's intervals, in order of distance from
+ *        <point>, that's in the direction asked for, if there is one, to
+ *        <queue>
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::nearestPushNode(
+    const R point, const NearestDirection dir, NearestQueue &queue) const {
+  const Node &node = *(this->data);
+  if ((dir == NEAREST_ANY) && this->endpoints.openStart() &&
+      (point == node.mid)) {
+    // at mid with open intervals, those starting on mid and those ending on
+    // it are both at distance 0 without containing the point, so neither
+    // list is in order of distance; each interval goes in on its own
+    for (size_t i = node.ends.size(); i > 0; --i)
+      queue.push(this->nearestInterval(node.ends[i - 1], point, dir, i,
+                                       NEAREST_ONE));
+    return;
+  }
+  // at mid in an open ended tree, those ending at mid don't contain the
+  // point, so it's the ends that are in order of distance
+  if ((dir == NEAREST_AFTER) ||
+      ((dir == NEAREST_ANY) &&
+       ((point < node.mid) ||
+        (!this->endpoints.openEnded() && (point == node.mid))))) {
+    // an open interval that starts at the point is after it
+    const size_t first = (dir == NEAREST_AFTER)
+                           ? node.startsUpTo(point,
+                                             this->endpoints.openStart())
+                           : 0;
+    if (first < node.starts.size()) {
+      queue.push(this->nearestInterval(node.starts[first], point, dir, first,
+                                       NEAREST_STARTS));
+    }
+  } else {
+    // one past the first interval to take, going down the ends
+    const size_t last = (dir == NEAREST_ANY)
+                          ? node.ends.size()
+                          : node.endsFrom(point,
+                                          this->endpoints.openEnded());
+    if (last > 0) {
+      queue.push(this->nearestInterval(node.ends[last - 1], point, dir, last,
+                                       NEAREST_ENDS));
+    }
+  }
+}
+
+/**
+ * \brief get the search entry for <interval>, at <next> in its node's list,
+ *        with its distance from <point> for the direction given; the
+ *        interval is taken to be in that direction. In an open ended tree a
+ *        point at or after an interval's end is past it, at distance
+ *        point - end, so an interval ending at the point is at distance 0
+ *        without containing it; likewise, with open intervals a point at or
+ *        before an interval's start is before it.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+typename IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::NearestEntry
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::nearestInterval(
+    const T &interval, const R point, const NearestDirection dir,
+    const size_t next, const NearestKind kind) const {
+  const R s = this->getStart(interval), e = this->getEnd(interval);
+  R distance = R();
+  bool outside = true;
+  if (dir == NEAREST_AFTER) distance = s - point;
+  else if (dir == NEAREST_BEFORE) distance = point - e;
+  else if (!this->endpoints.begins(s, point)) distance = s - point;
+  else if (!this->endpoints.reaches(e, point)) distance = point - e;
+  else outside = false;
+  return NearestEntry(distance, outside, this, next, kind);
+}
+
+/**
+ * \brief answer a whole set of interval queries at once.
+ * \param queries (start, end) pairs; they may be given in any order
+ * \return the hits for each query, grouped by query in the order given
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeBatchResult<T>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::intersectingIntervals(
+    const std::vector< std::pair<R, R> > &queries) const {
+  return this->batch(queries, false);
+}
+
+/**
+ * \brief answer the interval queries in the range [first, last), whose
+ *        elements must be convertible to std::pair<R, R>.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class InputIterator>
+IntervalTreeBatchResult<T>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::intersectingIntervals(
+    InputIterator first, InputIterator last) const {
+  return this->batch(std::vector< std::pair<R, R> >(first, last), false);
+}
+
+/**
+ * \brief answer a whole set of point queries at once.
+ * \param points the query points; they may be given in any order
+ * \return the hits for each point, grouped by point in the order given
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeBatchResult<T>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::intersectingPoints(
+    const std::vector<R> &points) const {
+  return this->intersectingPoints(points.begin(), points.end());
+}
+
+/**
+ * \brief answer the point queries in the range [first, last)
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class InputIterator>
+IntervalTreeBatchResult<T>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::intersectingPoints(
+    InputIterator first, InputIterator last) const {
+  std::vector< std::pair<R, R> > queries;
+  for (; first != last; ++first)
+    queries.push_back(std::make_pair(*first, *first));
+  return this->batch(queries, true);
+}
+
+/**
+ * \brief run a batch of queries. Neighbouring queries in sorted input mostly
+ *        go the same way down the tree, and mostly get the same hits in each
+ *        node on the way, so batchRun keeps the path the last query took,
+ *        and the next takes over the part of it that still holds rather than
+ *        descending from the root. Queries sorted by start are answered in
+ *        one pass, each query's hits appended to the result as they're
+ *        found. Any others are answered in order of start all the same: a
+ *        first pass counts the hits for each query, so the result can be
+ *        sized, and a second copies them straight to where they go.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeBatchResult<T>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::batch(
+    const std::vector< std::pair<R, R> > &queries, const bool points) const {
+  IntervalTreeBatchResult<T> res;
+  const std::vector<size_t> order = this->batchOrder(queries);
+  if (order.empty()) {
+    res.offsets.reserve(queries.size() + 1);
+    res.offsets.push_back(0);
+    BatchAppend append(res, queries.size());
+    this->batchRun(queries, points, order, 0, queries.size(), append);
+    return res;
+  }
+
+  res.offsets.assign(queries.size() + 1, 0);
+  BatchCount count(res.offsets);
+  this->batchRun(queries, points, order, 0, queries.size(), count);
+  for (size_t i = 0; i < queries.size(); ++i)
+    res.offsets[i + 1] += res.offsets[i];
+  if (count.any == NULL) return res;
+
+  // T needn't be default constructible, so the hits are sized with copies
+  // of one of them and then overwritten
+  res.hits.assign(res.offsets.back(), *(count.any));
+  BatchPlace place(res);
+  this->batchRun(queries, points, order, 0, queries.size(), place);
+  return res;
+}
+
+/**
+ * \brief the order to answer <queries> in: by start, so that batchRun keeps
+ *        as much of its path as it can from one query to the next.
+ * \return the indices of the queries in that order, or nothing if they're
+ *         in order already
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+std::vector<size_t>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::batchOrder(
+    const std::vector< std::pair<R, R> > &queries) const {
+  std::vector<size_t> order;
+  size_t i = 1;
+  while ((i < queries.size()) && !(queries[i].first < queries[i - 1].first))
+    ++i;
+  if (i >= queries.size()) return order;
+
+  std::vector< std::pair<R, size_t> > keyed;
+  keyed.reserve(queries.size());
+  for (i = 0; i < queries.size(); ++i)
+    keyed.push_back(std::make_pair(queries[i].first, i));
+  std::sort(keyed.begin(), keyed.end());
+  order.reserve(keyed.size());
+  for (i = 0; i < keyed.size(); ++i) order.push_back(keyed[i].second);
+  return order;
+}
+
+/**
+ * \brief answer the queries at positions [first, last) of <order> (or of
+ *        <queries> itself, if <order> is empty), passing the hits to <sink>.
+ *        The path batchQuery keeps carries over from one query to the next
+ *        as long as they don't start any earlier.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class Sink>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::batchRun(
+    const std::vector< std::pair<R, R> > &queries, const bool points,
+    const std::vector<size_t> &order, const size_t first, const size_t last,
+    Sink &sink) const {
+  std::vector<BatchLevel> path;
+  R prev = R();
+  for (size_t i = first; i < last; ++i) {
+    const size_t q = order.empty() ? i : order[i];
+    const R start = queries[q].first;
+    const R end = points ? start : queries[q].second;
+    if ((i > first) && (start < prev)) path.clear();
+    prev = start;
+    sink.begin(q);
+    this->batchQuery(start, end, points, path, sink);
+    sink.end(q);
+  }
+}
+
+/**
+ * \brief answer one query of a batch, handing the hits in each node to
+ *        <sink> in the same order that intersectingInterval (or
+ *        intersectingPoint) would find them. <path> holds the subtrees the
+ *        last query was to one side of mid in, from the root down, and that
+ *        query must not have started after this one; those levels that
+ *        still give the same hits are taken as they are, and the descent
+ *        carries on from the first that doesn't, replacing the rest of the
+ *        path. Where the query stops being to one side of mid, a point query
+ *        is on mid and ends there, while an interval query spans it and goes
+ *        on into both subtrees as usual.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class Sink>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::batchQuery(
+    const R start, const R end, const bool points,
+    std::vector<BatchLevel> &path, Sink &sink) const {
+  // how hereInterval searches <starts>, for a query left of mid
+  const bool strict = this->endpoints.openStart() ||
+                      (this->endpoints.openEnded() && (start != end));
+  const IntervalTree *cur = this;
+  size_t depth = 0;
+  for (; depth < path.size(); ++depth) {
+    const BatchLevel &level = path[depth];
+    if (!this->batchKeeps(level, start, end, strict)) break;
+    sink.add(level.tree, level.hits, start, end);
+    cur = level.next;
+  }
+  path.resize(depth);
+
+  BatchLevel level;
+  while ((cur != NULL) && (cur->data != NULL) && !cur->outside(start, end) &&
+         cur->batchLevel(start, end, level)) {
+    sink.add(cur, level.hits, start, end);
+    path.push_back(level);
+    cur = level.next;
+  }
+  if ((cur == NULL) || (cur->data == NULL) || cur->outside(start, end))
+    return;
+  if (points) {
+    sink.add(cur, cur->herePoint(start), start, end);
+    return;
+  }
+  Stack stack;
+  stack.push(cur);
+  while (!stack.empty()) {
+    cur = stack.pop();
+    if ((cur->data == NULL) || cur->outside(start, end)) continue;
+    sink.add(cur, cur->hereInterval(start, end), start, end);
+    cur->pushSubtrees(start, end, stack);
+  }
+}
+
+/**
+ * \brief if [start, end] lies to one side of this subtree's mid, fill in
+ *        <level> with the hits here and what's needed to check them against
+ *        later queries that start no earlier. The hits are those
+ *        hereInterval finds, which for a point off mid are the same as
+ *        herePoint's.
+ * \return false, leaving <level> alone, if the query spans mid
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+bool
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::batchLevel(
+    const R start, const R end, BatchLevel &level) const {
+  const Node &n = *(this->data);
+  const bool ends = (start > n.mid);
+  if (!ends && !(end < n.mid)) return false;
+  level.tree = this;
+  level.next = ends ? this->right : this->left;
+  level.hits = this->hereInterval(start, end);
+  level.ends = ends;
+  level.mid = n.mid;
+  level.minStart = this->minStart;
+
+  // a later start stays inside the subtree up to maxEnd
+  level.until = this->maxEnd;
+  level.through = true;
+  if (ends) {
+    // right of mid, a later start is still past mid and still past the
+    // ends cut off before lo, and still gets ends[lo] as long as it's
+    // before (or, closed, at) where that ends
+    level.hasBefore = level.hasAfter = false;
+    if (level.hits.lo == level.hits.list->size()) return true;
+    const R e = this->getEnd((*level.hits.list)[level.hits.lo]);
+    const bool through = !this->endpoints.openEnded();
+    if (e < level.until) {
+      level.until = e;
+      level.through = through;
+    } else if (!(level.until < e)) {
+      level.through = level.through && through;
     }
+    return true;
+  }
+  level.hasBefore = (level.hits.hi > 0);
+  level.hasAfter = (level.hits.hi < level.hits.list->size());
+  if (level.hasBefore)
+    level.before = this->getStart((*level.hits.list)[level.hits.hi - 1]);
+  if (level.hasAfter)
+    level.after = this->getStart((*level.hits.list)[level.hits.hi]);
+  return true;
+}
+
+/**
+ * \brief check whether [start, end] gets the same hits from <level>'s
+ *        subtree, and goes on into the same subtree, as the query it was
+ *        made for, which didn't start after it: it must still be inside the
+ *        subtree's bounds, on the same side of mid, and the search
+ *        hereInterval does must still cut the list in the same place.
+ *        <strict> is how that search treats <starts>, for this query.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+bool
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::batchKeeps(
+    const BatchLevel &level, const R start, const R end,
+    const bool strict) const {
+  if (!((start < level.until) || (level.through && (start == level.until))))
+    return false;
+  if (end < level.minStart) return false;
+  if (level.ends) return true;
+
+  // left of mid, starts[0, hi) are those that begin at or before end
+  if (!(end < level.mid)) return false;
+  if (level.hasBefore &&
+      !((level.before < end) || ((!strict) && (level.before == end))))
+    return false;
+  return !(level.hasAfter &&
+           ((level.after < end) || ((!strict) && (level.after == end))));
+}
+
+/**
+ * \brief answer a set of interval queries using several threads. The tree
+ *        is only read, so all threads share it; each takes a contiguous
+ *        block of the queries and writes its hits straight into the one
+ *        result. The result is identical to that of
+ *        intersectingIntervals(queries), whatever the number of threads.
+ * \param numThreads how many threads to use; 0 means one per hardware thread
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeBatchResult<T>
+IntervalTree<T, R, GetStart, GetEnd, Stats,
+             Endpoints>::intersectingIntervalsParallel(
+    const std::vector< std::pair<R, R> > &queries, unsigned numThreads) const {
+  return this->parallelBatch(queries, false, numThreads);
+}
+
+/**
+ * \brief answer a set of point queries using several threads; see
+ *        intersectingIntervalsParallel.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeBatchResult<T>
+IntervalTree<T, R, GetStart, GetEnd, Stats,
+             Endpoints>::intersectingPointsParallel(
+    const std::vector<R> &points, unsigned numThreads) const {
+  std::vector< std::pair<R, R> > queries;
+  queries.reserve(points.size());
+  for (size_t i = 0; i < points.size(); ++i)
+    queries.push_back(std::make_pair(points[i], points[i]));
+  return this->parallelBatch(queries, true, numThreads);
+}
+
+/**
+ * \brief answer <queries> as batch does, with one contiguous block of them
+ *        (in the order batch would answer them) per thread. Each thread
+ *        first counts the hits for its block's queries into the offsets;
+ *        once those are summed, each places its block's hits straight into
+ *        the result, so nothing is copied more than once and no thread keeps
+ *        a result of its own.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeBatchResult<T>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::parallelBatch(
+    const std::vector< std::pair<R, R> > &queries, const bool points,
+    unsigned numThreads) const {
+  if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+  if (numThreads == 0) numThreads = 1;
+  if (numThreads > queries.size()) numThreads = queries.size();
+  if (numThreads <= 1) return this->batch(queries, points);
+
+  IntervalTreeBatchResult<T> res;
+  const std::vector<size_t> order = this->batchOrder(queries);
+  res.offsets.assign(queries.size() + 1, 0);
+  std::vector<const T*> any(numThreads, NULL);
+  batchThreads(numThreads, queries.size(),
+               [this, &queries, points, &order, &res, &any](
+                   const unsigned i, const size_t first, const size_t last) {
+    BatchCount count(res.offsets);
+    this->batchRun(queries, points, order, first, last, count);
+    any[i] = count.any;
+  });
+  for (size_t i = 0; i < queries.size(); ++i)
+    res.offsets[i + 1] += res.offsets[i];
+  const T *some = NULL;
+  for (size_t i = 0; (i < any.size()) && (some == NULL); ++i) some = any[i];
+  if (some == NULL) return res;
+
+  // as in batch, the hits are sized with copies of one of them
+  res.hits.assign(res.offsets.back(), *some);
+  batchThreads(numThreads, queries.size(),
+               [this, &queries, points, &order, &res](
+                   const unsigned, const size_t first, const size_t last) {
+    BatchPlace place(res);
+    this->batchRun(queries, points, order, first, last, place);
+  });
+  return res;
+}
+
+/**
+ * \brief split [0, n) into <numThreads> contiguous blocks and call
+ *        job(i, first, last) for the i'th block in a thread of its own. An
+ *        exception in any thread is re-thrown once all have finished.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class Job>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::batchThreads(
+    const unsigned numThreads, const size_t n, const Job &job) {
+  std::vector<std::exception_ptr> errors(numThreads);
+  std::vector<std::thread> threads;
+  const size_t block = (n + numThreads - 1) / numThreads;
+  for (unsigned i = 0; i < numThreads; ++i) {
+    const size_t first = std::min(n, i * block);
+    const size_t last = std::min(n, first + block);
+    threads.push_back(std::thread([&job, &errors, first, last, i]() {
+      try {
+        job(i, first, last);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }));
   }
+  for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+  for (size_t i = 0; i < errors.size(); ++i)
+    if (errors[i]) std::rethrow_exception(errors[i]);
+}
 
-  return intersecting;
+/**
+ * \brief get the intervals that intersect <point>, as a range whose
+ *        iterators find them one at a time as they're advanced.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeQueryRange<T, R, GetStart, GetEnd, Stats, Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::intersectingPointRange(
+    const R point) const {
+  return IntervalTreeQueryRange<T, R, GetStart, GetEnd, Stats,
+                                Endpoints>(this, point, point, true);
 }
 
 /**
- * \brief squash the tree -- i.e. return a vector of all items in the tree
+ * \brief get the intervals that intersect [start, end] (or [start, end) if
+ *        the tree is open-ended), as a range whose iterators find them one
+ *        at a time as they're advanced.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeQueryRange<T, R, GetStart, GetEnd, Stats, Endpoints>
+IntervalTree<T, R, GetStart, GetEnd, Stats,
+             Endpoints>::intersectingIntervalRange(
+    const R start, const R end) const {
+  return IntervalTreeQueryRange<T, R, GetStart, GetEnd, Stats,
+                                Endpoints>(this, start, end, false);
+}
+
+/**
+ * \brief squash the tree -- i.e. return a vector of all items in the tree.
+ *        The vector is allocated once, at the size of the tree, and each
+ *        item is copied into it once.
+ * \param sorted if set, the items are in order of start; otherwise they're
+ *               in the order of the tree's nodes, which is a little quicker
  * \note this is not destructive, the original tree remains
  */
-template <class T, class R>
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
 const std::vector<T>
-IntervalTree<T, R>::squash() const {
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::squash(
+    const bool sorted) const {
   std::vector<T> res;
-  res.insert(res.end(), this->data->starts.begin(), this->data->starts.end());
-  if (this->left != NULL) {
-    std::vector<T> l = this->left->squash();
-    res.insert(res.end(), l.begin(), l.end());
+  if (this->data == NULL) return res;
+  res.reserve(this->count);
+  if (sorted) {
+    this->squashSorted(res);
+    return res;
   }
-  if (this->right != NULL) {
-    std::vector<T> r = this->right->squash();
-    res.insert(res.end(), r.begin(), r.end());
+  Stack stack;
+  stack.push(this);
+  while (!stack.empty()) {
+    const IntervalTree *cur = stack.pop();
+    res.insert(res.end(), cur->data->starts.begin(), cur->data->starts.end());
+    if (cur->right != NULL) stack.push(cur->right);
+    if (cur->left != NULL) stack.push(cur->left);
   }
   return res;
 }
 
 /**
- * \brief get the number of items in the tree.
- *
- * This is a little expensive at the moment, since it requires a full traversal
- * of the tree
+ * \brief append all the items in this subtree to <res>, in order of start,
+ *        by walking it in order. Everything in a left subtree ends before
+ *        mid and everything in a right one starts after it, while a node's
+ *        own items (already in order of start) contain it, so a subtree in
+ *        order is its left subtree in order merged with its node's items,
+ *        then its right subtree in order. Only those of the left subtree's
+ *        items that start after the first of the node's need merging, which
+ *        is usually a few or none, so this is close to a straight copy.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::squashSorted(
+    std::vector<T> &res) const {
+  IntervalComparator<T, R, GetStart> startComp =
+    IntervalComparator<T, R, GetStart>(this->getStart);
+  // a subtree still to be walked, or, once its left subtree has been, the
+  // index in <res> where that left subtree's items begin
+  typedef std::pair<const IntervalTree*, size_t> Frame;
+  const size_t PENDING = static_cast<size_t>(-1);
+  IntervalTreeStack<Frame> stack;
+  stack.push(Frame(this, PENDING));
+  while (!stack.empty()) {
+    const Frame f = stack.pop();
+    const IntervalTree *cur = f.first;
+    if (f.second == PENDING) {
+      stack.push(Frame(cur, res.size()));
+      if ((cur->left != NULL) && (cur->left->data != NULL))
+        stack.push(Frame(cur->left, PENDING));
+      continue;
+    }
+
+    const typename Node::List &starts = cur->data->starts;
+    const size_t here = res.size();
+    res.insert(res.end(), starts.begin(), starts.end());
+    if ((here > f.second) && (!starts.empty())) {
+      typename std::vector<T>::iterator from =
+        std::upper_bound(res.begin() + f.second, res.begin() + here,
+                         starts.front(), startComp);
+      std::inplace_merge(from, res.begin() + here, res.end(), startComp);
+    }
+    if ((cur->right != NULL) && (cur->right->data != NULL))
+      stack.push(Frame(cur->right, PENDING));
+  }
+}
+
+/**
+ * \brief get the number of items in the tree. This is stored, and kept up to
+ *        date by insert and erase, so it takes constant time.
  */
-template <class T, class R>
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
 const int
-IntervalTree<T, R>::size() const {
-  int res = this->data->starts.size();
-  if (this->left != NULL) res += this->left->size();
-  if (this->right != NULL) res += this->right->size();
-  return res;
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::size() const {
+  return this->count;
 }
 
 /**
- * \brief return a string representation of an IntervalTree
+ * \brief return a string representation of an IntervalTree: its node, then
+ *        each of its subtrees (or <EMPTY>), labelled. The stack holds what's
+ *        still to be written, either a subtree or a piece of text.
  */
-template <class T, class R>
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
 const std::string
-IntervalTree<T, R>::toString() const {
-  std::string left = "<EMPTY>", right = "<EMPTY>";
-  if (this->left != NULL) left = this->left->toString();
-  if (this->right != NULL) right = this->right->toString();
-  return this->data->toString() + "\n** left ** " + left +
-         "\n** right ** " + right;
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::toString() const {
+  typedef std::pair<const IntervalTree*, const char*> Part;
+  if (this->data == NULL) return "<EMPTY>";
+  std::string res;
+  IntervalTreeStack<Part> stack;
+  stack.push(Part(this, NULL));
+  while (!stack.empty()) {
+    const Part p = stack.pop();
+    if (p.first == NULL) {
+      res += p.second;
+      continue;
+    }
+    res += p.first->data->toString();
+    const IntervalTree *l = p.first->left, *r = p.first->right;
+    stack.push(r == NULL ? Part(NULL, "<EMPTY>") : Part(r, NULL));
+    stack.push(Part(NULL, "\n** right ** "));
+    stack.push(l == NULL ? Part(NULL, "<EMPTY>") : Part(l, NULL));
+    stack.push(Part(NULL, "\n** left ** "));
+  }
+  return res;
+}
+
+/**
+ * \brief describe the shape of the tree: its size, depth, biggest node and
+ *        how unevenly its subtrees split their intervals. This walks the
+ *        whole tree, so it's meant for checking a build, not for hot paths.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeReport
+IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints>::report() const {
+  typedef std::pair<const IntervalTree*, size_t> Level;
+  IntervalTreeReport res;
+  if (this->data == NULL) return res;
+  res.intervals = this->count;
+  IntervalTreeStack<Level> stack;
+  stack.push(Level(this, 1));
+  while (!stack.empty()) {
+    const Level lv = stack.pop();
+    const IntervalTree *t = lv.first;
+    res.nodes += 1;
+    res.depth = std::max(res.depth, lv.second);
+    res.maxNodeSize = std::max(res.maxNodeSize, t->data->starts.size());
+    size_t biggest = 0;
+    const IntervalTree *parts[] = {t->left, t->right};
+    for (size_t i = 0; i < 2; ++i) {
+      if (parts[i] == NULL) continue;
+      biggest = std::max(biggest, parts[i]->count);
+      stack.push(Level(parts[i], lv.second + 1));
+    }
+    const double frac = static_cast<double>(biggest) / t->count;
+    if (frac > res.imbalance) res.imbalance = frac;
+  }
+  return res;
+}
+
+
+/******************************************************************************
+ * IntervalTreeQueryIterator class implementation
+ *****************************************************************************/
+
+/**
+ * \brief Constructor for IntervalTreeQueryIterator; the iterator starts at
+ *        the first hit of the query on <root>, or at the end if there are
+ *        none.
+ * \param point if true, the query is the point <start> (and <end> must
+ *              equal it), otherwise it's the interval [start, end]
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeQueryIterator<T, R, GetStart, GetEnd, Stats,
+                          Endpoints>::IntervalTreeQueryIterator(
+    const Tree *root, const R start, const R end, const bool point)
+    : tree(NULL), list(NULL), i(0), hi(0), scan(false), point(point),
+      start(start), end(end) {
+  if (root != NULL) this->stack.push(root);
+  this->settle();
+}
+
+/**
+ * \brief move on to the first hit at or after position i in the current
+ *        node, taking up the traversal where it left off once the node runs
+ *        out, or to the end if there are no more.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTreeQueryIterator<T, R, GetStart, GetEnd, Stats, Endpoints>::settle() {
+  while (true) {
+    if (this->tree != NULL) {
+      for (; this->i < this->hi; ++this->i) {
+        const T &it = (*this->list)[this->i];
+        if ((!this->scan) || this->tree->isHit(it, this->start, this->end))
+          return;
+      }
+      if (!this->point) {
+        this->tree->pushSubtrees(this->start, this->end, this->stack);
+      } else if ((this->start > this->tree->data->mid) &&
+                 (this->tree->right != NULL)) {
+        this->stack.push(this->tree->right);
+      } else if ((this->start < this->tree->data->mid) &&
+                 (this->tree->left != NULL)) {
+        this->stack.push(this->tree->left);
+      }
+    }
+
+    this->tree = NULL;
+    while ((this->tree == NULL) && !this->stack.empty()) {
+      const Tree *t = this->stack.pop();
+      if ((t->data != NULL) && !t->outside(this->start, this->end))
+        this->tree = t;
+    }
+    if (this->tree == NULL) {
+      this->list = NULL;
+      this->i = 0;
+      this->hi = 0;
+      return;
+    }
+    const typename Tree::NodeHits h = this->point ?
+      this->tree->herePoint(this->start) :
+      this->tree->hereInterval(this->start, this->end);
+    this->list = h.list;
+    this->i = h.lo;
+    this->hi = h.hi;
+    this->scan = h.scan;
+  }
 }
 
 #endif  // INTERVALTREE_HPP_
@@ -0,0 +1,172 @@
+/**
+ * \file  IntervalTreeArena.hpp
+ * \brief A monotonic arena that an IntervalTree can be built in, and the
+ *        allocator its nodes use to draw from it. Memory is handed out from
+ *        large blocks and never given back piecemeal; it's all returned at
+ *        once when the arena is released or destroyed. This stands in for
+ *        std::pmr::monotonic_buffer_resource, which needs C++17.
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef INTERVALTREEARENA_HPP_
+#define INTERVALTREEARENA_HPP_
+
+// stl includes
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <mutex>
+#include <type_traits>
+#include <stdint.h>
+
+/******************************************************************************
+ * Class definitions and prototypes
+ *****************************************************************************/
+
+/**
+ * \brief Monotonic arena. Allocation is a pointer bump within the current
+ *        block, under a lock so that subtrees built in parallel can share
+ *        one arena. Requests bigger than a quarter of a block get a block of
+ *        their own, so they don't waste the rest of the current one.
+ */
+class IntervalTreeArena {
+ public:
+  explicit IntervalTreeArena(const size_t blockSize = DEFAULT_BLOCK_SIZE)
+      : blockSize(blockSize), cur(NULL), left(0), used(0) {;}
+  ~IntervalTreeArena() { this->release(); }
+
+  void* allocate(const size_t bytes, const size_t alignment);
+  void release();
+  size_t bytesAllocated() const { return this->used; }
+
+  // constants
+  static const size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+
+ private:
+  // an arena owns its blocks, so it can't be copied
+  IntervalTreeArena(const IntervalTreeArena&);
+  IntervalTreeArena& operator=(const IntervalTreeArena&);
+
+  std::mutex lock;
+  std::vector<char*> blocks;
+  size_t blockSize;
+  char *cur;
+  size_t left;
+  size_t used;
+};
+
+/**
+ * \brief Allocator for the containers in an IntervalTree. It holds a
+ *        pointer to the arena to draw from, like std::pmr's
+ *        polymorphic_allocator; with no arena it uses the heap. Freeing
+ *        memory that came from an arena does nothing.
+ */
+template <class T>
+class IntervalTreeArenaAllocator {
+ public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_copy_assignment;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  IntervalTreeArenaAllocator() : arena(NULL) {;}
+  explicit IntervalTreeArenaAllocator(IntervalTreeArena *arena)
+      : arena(arena) {;}
+  template <class U>
+  IntervalTreeArenaAllocator(const IntervalTreeArenaAllocator<U> &o)
+      : arena(o.arena) {;}
+
+  T* allocate(const size_t n) {
+    if (this->arena == NULL)
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    return static_cast<T*>(this->arena->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *p, const size_t) {
+    if (this->arena == NULL) ::operator delete(p);
+  }
+
+  template <class U>
+  bool operator==(const IntervalTreeArenaAllocator<U> &o) const {
+    return this->arena == o.arena;
+  }
+  template <class U>
+  bool operator!=(const IntervalTreeArenaAllocator<U> &o) const {
+    return this->arena != o.arena;
+  }
+
+  IntervalTreeArena *arena;
+};
+
+
+/******************************************************************************
+ * IntervalTreeArena class implementation
+ *****************************************************************************/
+
+/**
+ * \brief get <bytes> of memory aligned to <alignment> (a power of two no
+ *        bigger than that of max_align_t) from the arena.
+ * \throws std::bad_alloc if a new block can't be allocated
+ */
+inline void*
+IntervalTreeArena::allocate(const size_t bytes, const size_t alignment) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  size_t pad = (alignment - reinterpret_cast<uintptr_t>(this->cur) %
+                alignment) % alignment;
+  if (pad + bytes > this->left) {
+    // blocks come from operator new, so they're suitably aligned already
+    // (the slot is made first, so the block can't leak if that fails)
+    const bool own = bytes > this->blockSize / 4;
+    this->blocks.push_back(NULL);
+    char *block = static_cast<char*>(::operator new(own ? bytes
+                                                        : this->blockSize));
+    this->blocks.back() = block;
+    this->used += bytes;
+    if (own) return block;
+    this->cur = block;
+    this->left = this->blockSize;
+    pad = 0;
+  } else {
+    this->used += bytes;
+  }
+  char *res = this->cur + pad;
+  this->cur += pad + bytes;
+  this->left -= pad + bytes;
+  return res;
+}
+
+/**
+ * \brief give every block back to the heap at once. Everything that was
+ *        allocated from the arena must be finished with by now.
+ */
+inline void
+IntervalTreeArena::release() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  for (size_t i = 0; i < this->blocks.size(); ++i)
+    ::operator delete(this->blocks[i]);
+  this->blocks.clear();
+  this->cur = NULL;
+  this->left = 0;
+  this->used = 0;
+}
+
+#endif  // INTERVALTREEARENA_HPP_
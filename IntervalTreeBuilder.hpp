@@ -0,0 +1,460 @@
+/**
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * \file  IntervalTreeBuilder.hpp
+ * \brief Builds an IntervalTree from intervals that are already sorted by
+ *        start, such as those read in order from a sorted BED or GFF file.
+ *        They're taken one at a time, or from any input iterator (e.g. an
+ *        istream_iterator), in a single pass, and go straight into the
+ *        nodes of the tree (in its arena, if it has one), so neither the
+ *        caller nor the builder ever holds all of them, and they're never
+ *        sorted as a whole. Their order is checked as they arrive. The only
+ *        intervals held back are those whose node isn't known yet, which all
+ *        overlap one of two points, so building needs memory for at most
+ *        twice as many intervals as overlap any one point, not for all of
+ *        them.
+ *
+ * \authors Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef INTERVALTREEBUILDER_HPP_
+#define INTERVALTREEBUILDER_HPP_
+
+// stl includes
+#include <vector>
+#include <sstream>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+// local includes
+#include "IntervalTree.hpp"
+
+/******************************************************************************
+ * Class definitions and prototypes
+ *****************************************************************************/
+
+/**
+ * \brief Builds an IntervalTree from start-sorted intervals as they arrive.
+ *        They're cut into groups that all overlap the last start in the
+ *        group, and each group gets a node, with that start as its mid. The
+ *        nodes are numbered in the order they're made, which is also their
+ *        order in the tree, and node q sits as many levels up as q has
+ *        trailing zero bits, so the shape of the tree never depends on how
+ *        many nodes come after it and it's balanced however many there are.
+ *        An interval belongs in the highest node whose mid it overlaps; it
+ *        waits until a group starts after its end, at which point we know
+ *        all the mids it overlaps, and goes straight into that node's lists.
+ */
+template <class T, class R, class GetStart = R (*)(const T&),
+          class GetEnd = R (*)(const T&), class Stats = IntervalTreeNoStats,
+          class Endpoints = IntervalRuntimeEndpoints>
+class IntervalTreeBuilder {
+ public:
+  typedef IntervalTree<T, R, GetStart, GetEnd, Stats, Endpoints> Tree;
+
+  IntervalTreeBuilder(GetStart getStart, GetEnd getEnd,
+                      const Endpoints endpoints = Endpoints(),
+                      IntervalTreeArena *arena = NULL,
+                      const IntervalSplitStrategy split =
+                        INTERVAL_SPLIT_MIDDLE_INTERVAL);
+  explicit IntervalTreeBuilder(const Endpoints endpoints = Endpoints(),
+                               IntervalTreeArena *arena = NULL,
+                               const IntervalSplitStrategy split =
+                                 INTERVAL_SPLIT_MIDDLE_INTERVAL);
+  IntervalTreeBuilder(const IntervalTreeBuilder &b) = delete;
+  IntervalTreeBuilder& operator=(const IntervalTreeBuilder &b) = delete;
+  ~IntervalTreeBuilder();
+
+  // mutators
+  void add(const T &interval);
+  void add(T &&interval);
+  template <class InputIterator>
+  void add(InputIterator first, InputIterator last);
+  Tree build();
+
+  // inspectors
+  size_t size() const { return this->added; }
+  size_t waiting() const { return this->pending.size(); }
+
+ private:
+  typedef typename Tree::Node Node;
+
+  // an interval that hasn't been put in a node yet, and the number of the
+  // node made for the group it's in
+  struct Pending {
+    Pending(T &&interval, const size_t group)
+        : interval(std::move(interval)), group(group) {;}
+    T interval;
+    size_t group;
+  };
+
+  void checkOrder(const R start) const;
+  void push(T &&interval);
+  void closeGroup();
+  void place(const R mid, const bool all);
+  Tree* assemble();
+  void finish(Tree *root) const;
+  static unsigned trailingZeros(size_t q);
+  static unsigned highestBit(size_t q);
+
+  // an empty subtree with the accessors and settings for the tree being
+  // built, used to allocate its subtrees and nodes
+  Tree shell;
+
+  // intervals waiting for a node, kept as a heap on their ends
+  std::vector<Pending> pending;
+
+  // the last node made at each height; the ones whose parents don't exist
+  // yet are the roots of the finished parts of the tree
+  Tree* spine[sizeof(size_t) * 8];
+  size_t nodes;
+  size_t added;
+
+  // the last start added and the smallest end in the group being collected
+  R lastStart;
+  R groupEnd;
+  bool grouping;
+
+  // time spent adding intervals since the last build
+  uint64_t elapsed;
+};
+
+
+/******************************************************************************
+ * IntervalTreeBuilder class implementation
+ *****************************************************************************/
+
+/**
+ * \brief Constructor for IntervalTreeBuilder. The arguments are as for the
+ *        IntervalTree constructor; the tree's nodes are allocated in <arena>
+ *        as the intervals are added.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats,
+                    Endpoints>::IntervalTreeBuilder(
+    GetStart getStart, GetEnd getEnd, const Endpoints endpoints,
+    IntervalTreeArena *arena, const IntervalSplitStrategy split)
+    : shell(getStart, getEnd, endpoints, arena, split,
+            typename Tree::Subtree()),
+      pending(), nodes(0), added(0), lastStart(), groupEnd(), grouping(false),
+      elapsed(0) {;}
+
+/**
+ * \brief Constructor for IntervalTreeBuilder with accessor types that can be
+ *        default constructed; function pointers have to be given explicitly.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats,
+                    Endpoints>::IntervalTreeBuilder(
+    const Endpoints endpoints, IntervalTreeArena *arena,
+    const IntervalSplitStrategy split)
+    : shell(GetStart(), GetEnd(), endpoints, arena, split,
+            typename Tree::Subtree()),
+      pending(), nodes(0), added(0), lastStart(), groupEnd(), grouping(false),
+      elapsed(0) {
+  static_assert(!std::is_pointer<GetStart>::value &&
+                !std::is_pointer<GetEnd>::value,
+                "function pointer accessors must be passed to the constructor");
+}
+
+/**
+ * \brief Destructor; gets rid of the part of a tree that was never built.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats,
+                    Endpoints>::~IntervalTreeBuilder() {
+  this->shell.destroy(this->assemble());
+}
+
+/**
+ * \brief add the next interval.
+ * \throws IntervalTreeError if it starts before the one added before it
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::add(
+    const T &interval) {
+  this->push(T(interval));
+}
+
+/**
+ * \brief add the next interval, moving it into the builder.
+ * \throws IntervalTreeError if it starts before the one added before it
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::add(
+    T &&interval) {
+  this->push(std::move(interval));
+}
+
+/**
+ * \brief add each of the intervals in [first, last), in a single pass; the
+ *        iterators need only be input iterators.
+ * \throws IntervalTreeError if they're not sorted by start, following on
+ *         from those already added
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+template <class InputIterator>
+void
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::add(
+    InputIterator first, InputIterator last) {
+  for (; first != last; ++first) this->add(*first);
+}
+
+/**
+ * \brief build the tree from the intervals added so far; the builder is left
+ *        empty, and can be used again. If nothing was added, the tree is
+ *        empty, but can still be inserted into.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+typename IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::Tree
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::build() {
+  const uint64_t begin = Stats::now();
+  if (this->grouping) this->closeGroup();
+  this->place(R(), true);
+  Tree *root = this->assemble();
+  Tree res(this->shell.getStart, this->shell.getEnd, this->shell.endpoints,
+           this->shell.arena, this->shell.split);
+  if (root != NULL) {
+    // the root's structure moves into <res>, which keeps the statistics
+    this->finish(root);
+    res.data = root->data;
+    res.left = root->left;
+    res.right = root->right;
+    res.count = root->count;
+    res.builtCount = root->builtCount;
+    res.minStart = root->minStart;
+    res.maxEnd = root->maxEnd;
+    root->data = NULL;
+    root->left = NULL;
+    root->right = NULL;
+    this->shell.destroy(root);
+  }
+  res.addBuild(0, this->elapsed + (Stats::now() - begin));
+  this->added = 0;
+  this->elapsed = 0;
+  return res;
+}
+
+/**
+ * \brief make sure an interval starting at <start> doesn't start before the
+ *        last one added.
+ * \throws IntervalTreeError if it does
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::checkOrder(
+    const R start) const {
+  if ((this->added == 0) || !(start < this->lastStart)) return;
+  std::ostringstream msg;
+  msg << "IntervalTreeBuilder got intervals out of order: interval "
+      << this->added << " starts at " << start
+      << ", before the one preceding it at " << this->lastStart;
+  throw IntervalTreeError(msg.str().c_str());
+}
+
+/**
+ * \brief add <interval> to the group being collected, first closing that
+ *        group if <interval> starts after one of its members ends.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::push(
+    T &&interval) {
+  const uint64_t begin = Stats::now();
+  const R s = this->shell.getStart(interval);
+  const R e = this->shell.getEnd(interval);
+  this->checkOrder(s);
+  if (this->grouping && (s > this->groupEnd)) this->closeGroup();
+  if ((!this->grouping) || (e < this->groupEnd)) this->groupEnd = e;
+  this->grouping = true;
+
+  const GetEnd getEndF = this->shell.getEnd;
+  this->pending.push_back(Pending(std::move(interval), this->nodes + 1));
+  std::push_heap(this->pending.begin(), this->pending.end(),
+                 [getEndF](const Pending &a, const Pending &b) {
+                   return getEndF(b.interval) < getEndF(a.interval);
+                 });
+  this->lastStart = s;
+  this->added += 1;
+  this->elapsed += Stats::now() - begin;
+}
+
+/**
+ * \brief make the node for the group being collected. Every interval in the
+ *        group overlaps its last start, which becomes the node's mid; those
+ *        waiting that end before it now know where they belong. The node
+ *        takes the last node one level down as its left subtree, and is the
+ *        right subtree of the last node one level up if that's its parent.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::closeGroup() {
+  this->place(this->lastStart, false);
+
+  const size_t q = this->nodes + 1;
+  const unsigned h = trailingZeros(q);
+  Tree *sub = this->shell.template make<Tree>(this->shell.getStart,
+                                              this->shell.getEnd,
+                                              this->shell.endpoints,
+                                              this->shell.arena,
+                                              this->shell.split,
+                                              typename Tree::Subtree());
+  try {
+    const std::vector<T> none;
+    sub->data = this->shell.template make<Node>(none.begin(), none.end(),
+        static_cast<typename Node::Mid>(this->lastStart),
+        this->shell.getStart, this->shell.getEnd,
+        typename Node::Allocator(this->shell.arena));
+  } catch (...) {
+    this->shell.destroy(sub);
+    throw;
+  }
+  if (h > 0) sub->left = this->spine[h - 1];
+  if ((q >> (h + 1)) & 1) this->spine[h + 1]->right = sub;
+  this->spine[h] = sub;
+  this->nodes = q;
+  this->grouping = false;
+}
+
+/**
+ * \brief put each waiting interval that ends before <mid> (or all of them,
+ *        if <all> is set) into its node. It overlaps the mids of its own
+ *        group's node through to the last one made, and the highest of
+ *        those nodes is the one numbered with the most trailing zeros.
+ *        Since the intervals come off the heap in order of end, each node's
+ *        by-end list is built in order.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::place(
+    const R mid, const bool all) {
+  const GetEnd getEndF = this->shell.getEnd;
+  auto later = [getEndF](const Pending &a, const Pending &b) {
+    return getEndF(b.interval) < getEndF(a.interval);
+  };
+  while (!this->pending.empty() &&
+         (all || (getEndF(this->pending.front().interval) < mid))) {
+    std::pop_heap(this->pending.begin(), this->pending.end(), later);
+    Pending &p = this->pending.back();
+    const unsigned k = highestBit((p.group - 1) ^ this->nodes);
+    const size_t top = (this->nodes >> k) << k;
+    Node *n = this->spine[trailingZeros(top)]->data;
+    n->starts.push_back(p.interval);
+    n->ends.push_back(std::move(p.interval));
+    this->pending.pop_back();
+  }
+}
+
+/**
+ * \brief join the finished parts of the tree: for each set bit of the
+ *        number of nodes, from the top, the last node at that height is the
+ *        right subtree of the one before it.
+ * \return the root of the tree, or NULL if it has no nodes; the builder is
+ *         left with none
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+typename IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::Tree*
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::assemble() {
+  Tree *root = NULL;
+  Tree *above = NULL;
+  for (unsigned h = sizeof(size_t) * 8; h-- > 0;) {
+    if (((this->nodes >> h) & 1) == 0) continue;
+    if (above == NULL) root = this->spine[h];
+    else above->right = this->spine[h];
+    above = this->spine[h];
+  }
+  this->nodes = 0;
+  this->grouping = false;
+  this->pending.clear();
+  return root;
+}
+
+/**
+ * \brief sort each node's by-start list, and work out the size and bounds of
+ *        each subtree, children first.
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+void
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::finish(
+    Tree *root) const {
+  IntervalComparator<T, R, GetStart> startComp(this->shell.getStart);
+  IntervalTreeStack<std::pair<Tree*, bool> > stack;
+  stack.push(std::make_pair(root, false));
+  while (!stack.empty()) {
+    std::pair<Tree*, bool> e = stack.pop();
+    Tree *t = e.first;
+    if (!e.second) {
+      stack.push(std::make_pair(t, true));
+      if (t->left != NULL) stack.push(std::make_pair(t->left, false));
+      if (t->right != NULL) stack.push(std::make_pair(t->right, false));
+      continue;
+    }
+    std::sort(t->data->starts.begin(), t->data->starts.end(), startComp);
+    t->count = t->data->starts.size() +
+               ((t->left != NULL) ? t->left->count : 0) +
+               ((t->right != NULL) ? t->right->count : 0);
+    t->builtCount = t->count;
+    t->updateBounds();
+  }
+}
+
+/**
+ * \brief number of trailing zero bits in <q>, which isn't 0
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+unsigned
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::trailingZeros(
+    size_t q) {
+  unsigned n = 0;
+  for (; (q & 1) == 0; q >>= 1) ++n;
+  return n;
+}
+
+/**
+ * \brief position of the highest set bit in <q>, which isn't 0
+ */
+template <class T, class R, class GetStart, class GetEnd, class Stats,
+          class Endpoints>
+unsigned
+IntervalTreeBuilder<T, R, GetStart, GetEnd, Stats, Endpoints>::highestBit(
+    size_t q) {
+  unsigned n = 0;
+  for (; q > 1; q >>= 1) ++n;
+  return n;
+}
+
+#endif  // INTERVALTREEBUILDER_HPP_
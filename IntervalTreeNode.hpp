@@ -32,7 +32,14 @@
 #include <utility>
 #include <string>
 #include <vector>
+#include <exception>
+#include <sstream>
+#include <iterator>
+#include <type_traits>
+#include <new>
 
+// local includes
+#include "IntervalTreeArena.hpp"
 
 /******************************************************************************
  * Class definitions and prototypes
@@ -43,50 +50,362 @@
  */
 class IntervalTreeError: public std::exception {
  public:
-  explicit IntervalTreeError(const char* msg) { this->msg = msg; }
-  virtual const char* what() const throw() { return this->msg; }
+  explicit IntervalTreeError(const std::string &msg) : msg(msg) {;}
+  virtual ~IntervalTreeError() throw() {;}
+  virtual const char* what() const throw() { return this->msg.c_str(); }
  private:
-  const char* msg;
+  std::string msg;
 };
 
 /**
  * \brief Functor for use in sorting Intervals of type <T> using a comparison
- *        function provided at construction time
+ *        function provided at construction time. <Accessor> is anything that
+ *        can be called as 'R f(const T&) const'; a function pointer by
+ *        default, but a functor type lets the comparisons be inlined.
  */
-template <class T, class R>
+template <class T, class R, class Accessor = R (*)(const T&)>
 class IntervalComparator {
  public:
-  explicit IntervalComparator(R (*compFunc)(const T&)) {
-    this->compFunc = compFunc;
-  }
-  bool operator()(T i1, T i2) {
+  explicit IntervalComparator(Accessor compFunc) : compFunc(compFunc) {;}
+  bool operator()(const T &i1, const T &i2) const {
     return this->compFunc(i1) < this->compFunc(i2);
   }
  private:
-  R (*compFunc)(const T&);
+  Accessor compFunc;
 };
 
 /**
- * \brief Stores a set of intervals sorted by start and end
+ * \brief Accessor that gets the start of an interval by calling its
+ *        getStart() member
  */
 template <class T, class R>
+struct IntervalStartMember {
+  R operator()(const T &i) const { return i.getStart(); }
+};
+
+/**
+ * \brief Accessor that gets the end of an interval by calling its getEnd()
+ *        member
+ */
+template <class T, class R>
+struct IntervalEndMember {
+  R operator()(const T &i) const { return i.getEnd(); }
+};
+
+/**
+ * \brief Holds an accessor of type <F> that can't be assigned, as a lambda
+ *        can't before C++20, so that the trees holding it can be: assigning
+ *        destroys the accessor held and copy or move constructs the other
+ *        one in its place. One that can't be default constructed either is
+ *        left empty by the default constructor, and must not be called until
+ *        another is assigned to it.
+ */
+template <class F>
+class IntervalAccessor {
+ public:
+  IntervalAccessor() : held(false) {
+    this->construct(std::is_default_constructible<F>());
+  }
+  IntervalAccessor(const F &f) : held(false) {
+    new (&this->store) F(f);
+    this->held = true;
+  }
+  IntervalAccessor(const IntervalAccessor &a) : held(false) {
+    if (a.held) new (&this->store) F(a.get());
+    this->held = a.held;
+  }
+  IntervalAccessor(IntervalAccessor &&a)
+      noexcept(std::is_nothrow_move_constructible<F>::value) : held(false) {
+    if (a.held) new (&this->store) F(std::move(a.get()));
+    this->held = a.held;
+  }
+  ~IntervalAccessor() { this->reset(); }
+  IntervalAccessor& operator=(const IntervalAccessor &a) {
+    if (this != &a) {
+      this->reset();
+      if (a.held) new (&this->store) F(a.get());
+      this->held = a.held;
+    }
+    return *this;
+  }
+  IntervalAccessor& operator=(IntervalAccessor &&a)
+      noexcept(std::is_nothrow_move_constructible<F>::value) {
+    if (this != &a) {
+      this->reset();
+      if (a.held) new (&this->store) F(std::move(a.get()));
+      this->held = a.held;
+    }
+    return *this;
+  }
+
+  operator const F&() const { return this->get(); }
+  template <class T>
+  auto operator()(const T &t) const -> decltype(std::declval<const F&>()(t)) {
+    return this->get()(t);
+  }
+
+ private:
+  const F &get() const { return *reinterpret_cast<const F*>(&this->store); }
+  F &get() { return *reinterpret_cast<F*>(&this->store); }
+  void construct(std::true_type) {
+    new (&this->store) F();
+    this->held = true;
+  }
+  void construct(std::false_type) {;}
+  void reset() {
+    if (this->held) this->get().~F();
+    this->held = false;
+  }
+
+  typename std::aligned_storage<sizeof(F), alignof(F)>::type store;
+  bool held;
+};
+
+/**
+ * \brief The type the trees hold an accessor of type <F> as: <F> itself if
+ *        it can be assigned, which keeps function pointers and ordinary
+ *        functors as they are, and otherwise an IntervalAccessor holding it.
+ */
+template <class F>
+struct IntervalAccessorHolder {
+  typedef typename std::conditional<std::is_copy_assignable<F>::value &&
+                                    std::is_move_assignable<F>::value, F,
+                                    IntervalAccessor<F> >::type type;
+};
+
+/**
+ * \brief determine whether the interval [s, e] intersects the query interval
+ *        [start, end]. If openEnded is set, both are treated as [s, e).
+ */
+template <class R>
+inline bool
+intervalIntersects(const R s, const R e, const R start, const R end,
+                   const bool openEnded) {
+  if (openEnded) {
+    return ((s >= start) && (s < end)) || ((e > start) && (e < end)) ||
+           ((start >= s) && (start < e)) || ((end > s) && (end < e));
+  }
+  return ((s >= start) && (s <= end)) || ((e >= start) && (e <= end)) ||
+         ((start >= s) && (start <= e)) || ((end >= s) && (end <= e));
+}
+
+/**
+ * \brief The endpoint conventions an interval can be read with: closed
+ *        [s, e], half open [s, e) (what IntervalTree calls open ended), and
+ *        open (s, e).
+ */
+enum IntervalEndpointConvention {
+  INTERVAL_CLOSED,
+  INTERVAL_HALF_OPEN,
+  INTERVAL_OPEN
+};
+
+/**
+ * \brief get the convention that a tree's open-ended flag stands for
+ */
+inline IntervalEndpointConvention
+intervalEndpointConvention(const bool openEnded) {
+  return openEnded ? INTERVAL_HALF_OPEN : INTERVAL_CLOSED;
+}
+
+/**
+ * \brief Endpoint conventions, for code that tests many intervals against
+ *        the same query. IntervalClosedEndpoints treats intervals and
+ *        queries as [s, e], IntervalHalfOpenEndpoints as [s, e) and
+ *        IntervalOpenEndpoints as (s, e); each answers with one branch-free
+ *        expression, for intervals and queries that don't end before they
+ *        start. Code picks one of them once, from a tree's convention, and
+ *        is instantiated for each; IntervalTree takes one as its Endpoints
+ *        parameter. IntervalRuntimeEndpoints holds the convention as a value
+ *        instead, for trees whose convention is only known at run time; for
+ *        closed and half open intervals it tests exactly as
+ *        intervalIntersects does, so also for queries that are the wrong way
+ *        round.
+ *          intersects(s, e, start, end): [s, e] meets [start, end]
+ *          reaches(e, point): an interval that ends at e contains point,
+ *                             if its start does
+ *          begins(s, point): an interval that starts at s contains point,
+ *                            if its end does
+ *          openEnded(), openStart(): whether reaches is point < e rather
+ *                             than point <= e, and begins s < point rather
+ *                             than s <= point
+ *        The static policies also give the last two as OPEN_ENDED and
+ *        OPEN_START. The trees place intervals the same way for every
+ *        convention, since an interval that meets a query by any of them
+ *        does so as a closed one too.
+ */
+struct IntervalClosedEndpoints {
+  static const bool OPEN_ENDED = false;
+  static const bool OPEN_START = false;
+  template <class R>
+  bool intersects(const R s, const R e, const R start, const R end) const {
+    return (s <= end) & (start <= e);
+  }
+  template <class R>
+  bool reaches(const R e, const R point) const { return !(e < point); }
+  template <class R>
+  bool begins(const R s, const R point) const { return !(point < s); }
+  bool openEnded() const { return false; }
+  bool openStart() const { return false; }
+  IntervalEndpointConvention convention() const { return INTERVAL_CLOSED; }
+};
+
+struct IntervalHalfOpenEndpoints {
+  static const bool OPEN_ENDED = true;
+  static const bool OPEN_START = false;
+  // an empty interval or query [p, p) is the point p, if the other one
+  // contains it
+  template <class R>
+  bool intersects(const R s, const R e, const R start, const R end) const {
+    return ((s < end) & (start < e)) |
+           ((s == start) & ((s < end) | (start < e)));
+  }
+  template <class R>
+  bool reaches(const R e, const R point) const { return point < e; }
+  template <class R>
+  bool begins(const R s, const R point) const { return !(point < s); }
+  bool openEnded() const { return true; }
+  bool openStart() const { return false; }
+  IntervalEndpointConvention convention() const {
+    return INTERVAL_HALF_OPEN;
+  }
+};
+
+struct IntervalOpenEndpoints {
+  static const bool OPEN_ENDED = true;
+  static const bool OPEN_START = true;
+  // likewise, an empty interval or query (p, p) is the point p, if the other
+  // one contains it; two such points never meet
+  template <class R>
+  bool intersects(const R s, const R e, const R start, const R end) const {
+    return (s < end) & (start < e);
+  }
+  template <class R>
+  bool reaches(const R e, const R point) const { return point < e; }
+  template <class R>
+  bool begins(const R s, const R point) const { return s < point; }
+  bool openEnded() const { return true; }
+  bool openStart() const { return true; }
+  IntervalEndpointConvention convention() const { return INTERVAL_OPEN; }
+};
+
+class IntervalRuntimeEndpoints {
+ public:
+  // a flag is what the trees have always taken: open ended or not
+  IntervalRuntimeEndpoints(const bool openEnded = false)
+      : conv(intervalEndpointConvention(openEnded)) {;}
+  IntervalRuntimeEndpoints(const IntervalEndpointConvention conv)
+      : conv(conv) {;}
+  template <class R>
+  bool intersects(const R s, const R e, const R start, const R end) const {
+    if (this->conv == INTERVAL_OPEN)
+      return IntervalOpenEndpoints().intersects(s, e, start, end);
+    return intervalIntersects(s, e, start, end,
+                              this->conv == INTERVAL_HALF_OPEN);
+  }
+  template <class R>
+  bool reaches(const R e, const R point) const {
+    return (this->conv != INTERVAL_CLOSED) ? (point < e) : !(e < point);
+  }
+  template <class R>
+  bool begins(const R s, const R point) const {
+    return (this->conv == INTERVAL_OPEN) ? (s < point) : !(point < s);
+  }
+  bool openEnded() const { return this->conv != INTERVAL_CLOSED; }
+  bool openStart() const { return this->conv == INTERVAL_OPEN; }
+  IntervalEndpointConvention convention() const {
+    return static_cast<IntervalEndpointConvention>(this->conv);
+  }
+
+ private:
+  // one byte, since every subtree of a tree keeps a copy
+  unsigned char conv;
+};
+
+/**
+ * \brief Stack for the iterative tree traversals. The first N entries are
+ *        stored in the object itself, so walking a tree less than N levels
+ *        deep allocates nothing and needs only a small, fixed amount of the
+ *        calling thread's (or fiber's) stack; deeper trees spill onto the
+ *        heap instead of overflowing anything.
+ */
+template <class E, size_t N = 64>
+class IntervalTreeStack {
+ public:
+  IntervalTreeStack() : n(0) {;}
+  bool empty() const { return this->n == 0; }
+  void push(const E &e) {
+    if (this->n < N) this->local[this->n] = e;
+    else this->spill.push_back(e);
+    ++this->n;
+  }
+  E pop() {
+    --this->n;
+    if (this->n < N) return this->local[this->n];
+    E e = this->spill.back();
+    this->spill.pop_back();
+    return e;
+  }
+
+ private:
+  E local[N];
+  size_t n;
+  std::vector<E> spill;
+};
+
+/**
+ * \brief The type a node keeps its mid-point in. For integer coordinates
+ *        that's R itself: mid-points are picked from the coordinates with
+ *        integer arithmetic, so they're exact even above 2^53, and queries
+ *        compare against them without converting every coordinate to a
+ *        double. Anything else keeps a double.
+ */
+template <class R>
+struct IntervalMidType {
+  typedef typename std::conditional<std::is_integral<R>::value, R,
+                                    double>::type type;
+};
+
+/**
+ * \brief Stores a set of intervals sorted by start and end. The lists draw
+ *        their memory from the arena the tree was built in, if any.
+ */
+template <class T, class R, class GetStart = R (*)(const T&),
+          class GetEnd = R (*)(const T&)>
 class IntervalTreeNode {
  public:
+  typedef IntervalTreeArenaAllocator<T> Allocator;
+  typedef std::vector<T, Allocator> List;
+  typedef typename IntervalMidType<R>::type Mid;
+
   IntervalTreeNode();
-  IntervalTreeNode(const std::vector<T>, const double mid,
-                   R (*getStart)(const T&), R (*getEnd)(const T&));
-  IntervalTreeNode(const IntervalTreeNode<T, R> &n);
+  IntervalTreeNode(const std::vector<T> &intervals, const Mid mid,
+                   GetStart getStart, GetEnd getEnd);
+  IntervalTreeNode(std::vector<T> &&intervals, const Mid mid,
+                   GetStart getStart, GetEnd getEnd);
+  template <class Iterator>
+  IntervalTreeNode(Iterator first, Iterator last, const Mid mid,
+                   GetStart getStart, GetEnd getEnd,
+                   const Allocator &alloc = Allocator());
+  IntervalTreeNode(const IntervalTreeNode &n);
+  IntervalTreeNode(const IntervalTreeNode &n, const Allocator &alloc);
+  IntervalTreeNode(IntervalTreeNode &&n) noexcept;
   ~IntervalTreeNode();
-  IntervalTreeNode<T, R>& operator=(const IntervalTreeNode<T, R>& other);
-  void swap(IntervalTreeNode<T, R>& other);
+  IntervalTreeNode& operator=(const IntervalTreeNode& other);
+  IntervalTreeNode& operator=(IntervalTreeNode&& other) noexcept;
+  void swap(IntervalTreeNode& other) noexcept;
   std::string toString();
+  size_t startsUpTo(const R point, const bool strict = false) const;
+  size_t endsFrom(const R point, const bool strict = false) const;
+  void insert(const T &interval);
+  bool erase(const T &interval);
 
-  std::vector<T> starts;
-  std::vector<T> ends;
-  double mid;
+  List starts;
+  List ends;
+  Mid mid;
  private:
-  R (*getStart)(const T&);
-  R (*getEnd)(const T&);
+  typename IntervalAccessorHolder<GetStart>::type getStart;
+  typename IntervalAccessorHolder<GetEnd>::type getEnd;
 };
 
 
@@ -96,60 +415,125 @@ class IntervalTreeNode {
 /**
  * \brief default constructor
  */
-template <class T, class R>
-IntervalTreeNode<T, R>::IntervalTreeNode() : mid(0), getStart(NULL),
-                                             getEnd(NULL),
-                                             starts(std::vector<T>()),
-                                             ends(std::vector<T>())  {;}
+template <class T, class R, class GetStart, class GetEnd>
+IntervalTreeNode<T, R, GetStart, GetEnd>::IntervalTreeNode()
+    : starts(), ends(), mid(0), getStart(), getEnd() {;}
 
 /**
  * \brief IntervalTreeNode constructor
- * \param intervals TODO
+ * \param intervals the intervals in the node, in any order; each of the
+ *                  lists gets one copy of them.
  */
-template <class T, class R>
-IntervalTreeNode<T, R>::IntervalTreeNode(const std::vector<T> intervals,
-                                         const double mid,
-                                         R (*getStart)(const T&),
-                                         R (*getEnd)(const T&)) {
-  this->getStart = getStart;
-  this->getEnd = getEnd;
-  IntervalComparator<T, R> startComp = IntervalComparator<T, R>(getStart);
-  IntervalComparator<T, R> endComp = IntervalComparator<T, R>(getEnd);
-  this->starts = std::vector<T> (intervals);
+template <class T, class R, class GetStart, class GetEnd>
+IntervalTreeNode<T, R, GetStart, GetEnd>::IntervalTreeNode(
+    const std::vector<T> &intervals, const Mid mid, GetStart getStart,
+    GetEnd getEnd)
+    : starts(intervals.begin(), intervals.end()), ends(starts), mid(mid),
+      getStart(getStart), getEnd(getEnd) {
+  IntervalComparator<T, R, GetStart> startComp =
+    IntervalComparator<T, R, GetStart>(getStart);
+  IntervalComparator<T, R, GetEnd> endComp =
+    IntervalComparator<T, R, GetEnd>(getEnd);
+  sort(this->starts.begin(), this->starts.end(), startComp);
+  sort(this->ends.begin(), this->ends.end(), endComp);
+}
+
+/**
+ * \brief IntervalTreeNode constructor that moves the intervals into the
+ *        by-start list rather than copying them.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+IntervalTreeNode<T, R, GetStart, GetEnd>::IntervalTreeNode(
+    std::vector<T> &&intervals, const Mid mid, GetStart getStart,
+    GetEnd getEnd)
+    : starts(std::make_move_iterator(intervals.begin()),
+             std::make_move_iterator(intervals.end())),
+      ends(starts), mid(mid), getStart(getStart), getEnd(getEnd) {
+  IntervalComparator<T, R, GetStart> startComp =
+    IntervalComparator<T, R, GetStart>(getStart);
+  IntervalComparator<T, R, GetEnd> endComp =
+    IntervalComparator<T, R, GetEnd>(getEnd);
   sort(this->starts.begin(), this->starts.end(), startComp);
-  this->ends = std::vector<T> (intervals);
   sort(this->ends.begin(), this->ends.end(), endComp);
-  this->mid = mid;
+}
+
+/**
+ * \brief IntervalTreeNode constructor for intervals that are already sorted
+ *        by start, so only the by-end copy needs sorting. Pass move
+ *        iterators to move the intervals in rather than copy them.
+ * \param first start of the range of intervals, sorted by start
+ * \param last end of the range
+ * \param alloc allocator for the lists
+ */
+template <class T, class R, class GetStart, class GetEnd>
+template <class Iterator>
+IntervalTreeNode<T, R, GetStart, GetEnd>::IntervalTreeNode(
+    Iterator first, Iterator last, const Mid mid, GetStart getStart,
+    GetEnd getEnd, const Allocator &alloc)
+    : starts(first, last, alloc), ends(starts, alloc), mid(mid),
+      getStart(getStart), getEnd(getEnd) {
+  IntervalComparator<T, R, GetEnd> endComp =
+    IntervalComparator<T, R, GetEnd>(getEnd);
+  std::stable_sort(this->ends.begin(), this->ends.end(), endComp);
 }
 
 /**
  * \brief Copy constructor
  */
-template <class T, class R>
-IntervalTreeNode<T, R>::IntervalTreeNode(const IntervalTreeNode<T, R> &n) {
+template <class T, class R, class GetStart, class GetEnd>
+IntervalTreeNode<T, R, GetStart, GetEnd>::IntervalTreeNode(
+    const IntervalTreeNode &n)
+    : starts(n.starts), ends(n.ends), mid(n.mid), getStart(n.getStart),
+      getEnd(n.getEnd) {
   // shallow copy is fine here
-  this->starts = n.starts;
-  this->ends = n.ends;
-  this->mid = n.mid;
-  this->getStart = n.getStart;
-  this->getEnd = n.getEnd;
 }
 
+/**
+ * \brief Copy constructor, with the copy's lists drawing on <alloc>
+ */
+template <class T, class R, class GetStart, class GetEnd>
+IntervalTreeNode<T, R, GetStart, GetEnd>::IntervalTreeNode(
+    const IntervalTreeNode &n, const Allocator &alloc)
+    : starts(n.starts, alloc), ends(n.ends, alloc), mid(n.mid),
+      getStart(n.getStart), getEnd(n.getEnd) {;}
+
+/**
+ * \brief Move constructor; <n> is left with no intervals
+ */
+template <class T, class R, class GetStart, class GetEnd>
+IntervalTreeNode<T, R, GetStart, GetEnd>::IntervalTreeNode(
+    IntervalTreeNode &&n) noexcept
+    : starts(std::move(n.starts)), ends(std::move(n.ends)), mid(n.mid),
+      getStart(std::move(n.getStart)), getEnd(std::move(n.getEnd)) {;}
+
 /**
  * \brief destructor
  */
-template <class T, class R>
-IntervalTreeNode<T, R>::~IntervalTreeNode() {
+template <class T, class R, class GetStart, class GetEnd>
+IntervalTreeNode<T, R, GetStart, GetEnd>::~IntervalTreeNode() {
   // nothing special to do..
 }
 
 /**
 * \brief assignment; have to be careful here, since we have pointer members.
 */
-template <class T, class R>
-IntervalTreeNode<T, R>&
-IntervalTreeNode<T, R>::operator=(const IntervalTreeNode<T, R>& other) {
-  IntervalTreeNode<T, R> tmp(other);
+template <class T, class R, class GetStart, class GetEnd>
+IntervalTreeNode<T, R, GetStart, GetEnd>&
+IntervalTreeNode<T, R, GetStart, GetEnd>::operator=(
+    const IntervalTreeNode& other) {
+  IntervalTreeNode tmp(other);
+  this->swap(tmp);
+  return *this;
+}
+
+/**
+* \brief move assignment
+*/
+template <class T, class R, class GetStart, class GetEnd>
+IntervalTreeNode<T, R, GetStart, GetEnd>&
+IntervalTreeNode<T, R, GetStart, GetEnd>::operator=(
+    IntervalTreeNode&& other) noexcept {
+  IntervalTreeNode tmp(std::move(other));
   this->swap(tmp);
   return *this;
 }
@@ -157,9 +541,10 @@ IntervalTreeNode<T, R>::operator=(const IntervalTreeNode<T, R>& other) {
 /**
 * \brief swap the contents of this node with another one.
 */
-template <class T, class R>
+template <class T, class R, class GetStart, class GetEnd>
 void
-IntervalTreeNode<T, R>::swap(IntervalTreeNode<T, R>& other) {
+IntervalTreeNode<T, R, GetStart, GetEnd>::swap(
+    IntervalTreeNode& other) noexcept {
   std::swap(this->mid, other.mid);
   this->starts.swap(other.starts);
   this->ends.swap(other.ends);
@@ -167,22 +552,97 @@ IntervalTreeNode<T, R>::swap(IntervalTreeNode<T, R>& other) {
   std::swap(this->getEnd, other.getEnd);
 }
 
+/**
+ * \brief binary search <starts> for the intervals that begin at or before
+ *        <point> (strictly before it, if <strict> is set).
+ * \return the number of such intervals; they are starts[0, result)
+ */
+template <class T, class R, class GetStart, class GetEnd>
+size_t
+IntervalTreeNode<T, R, GetStart, GetEnd>::startsUpTo(const R point,
+                                                     const bool strict) const {
+  size_t lo = 0, hi = this->starts.size();
+  while (lo < hi) {
+    const size_t m = lo + (hi - lo) / 2;
+    const R s = this->getStart(this->starts[m]);
+    if ((s < point) || ((!strict) && (s == point))) lo = m + 1;
+    else hi = m;
+  }
+  return lo;
+}
+
+/**
+ * \brief binary search <ends> for the intervals that end at or after
+ *        <point> (strictly after it, if <strict> is set).
+ * \return the index of the first such interval; they are ends[result, size)
+ */
+template <class T, class R, class GetStart, class GetEnd>
+size_t
+IntervalTreeNode<T, R, GetStart, GetEnd>::endsFrom(const R point,
+                                                   const bool strict) const {
+  size_t lo = 0, hi = this->ends.size();
+  while (lo < hi) {
+    const size_t m = lo + (hi - lo) / 2;
+    const R e = this->getEnd(this->ends[m]);
+    if ((e < point) || (strict && (e == point))) lo = m + 1;
+    else hi = m;
+  }
+  return lo;
+}
+
+/**
+ * \brief add <interval> to this node, after any intervals with the same
+ *        start (or end) so both lists stay sorted. It's up to the caller to
+ *        make sure the interval contains mid.
+ */
+template <class T, class R, class GetStart, class GetEnd>
+void
+IntervalTreeNode<T, R, GetStart, GetEnd>::insert(const T &interval) {
+  this->starts.insert(this->starts.begin() +
+                      this->startsUpTo(this->getStart(interval)), interval);
+  this->ends.insert(this->ends.begin() +
+                    this->endsFrom(this->getEnd(interval), true), interval);
+}
+
+/**
+ * \brief remove one interval equal to <interval> (by T's operator==) from
+ *        this node; only those with the same start and end are compared.
+ * \return true if one was found and removed
+ */
+template <class T, class R, class GetStart, class GetEnd>
+bool
+IntervalTreeNode<T, R, GetStart, GetEnd>::erase(const T &interval) {
+  const R s = this->getStart(interval), e = this->getEnd(interval);
+  typename List::iterator sEnd = this->starts.begin() + this->startsUpTo(s);
+  typename List::iterator sIt =
+    std::find(this->starts.begin() + this->startsUpTo(s, true), sEnd,
+              interval);
+  if (sIt == sEnd) return false;
+  typename List::iterator eEnd = this->ends.begin() + this->endsFrom(e, true);
+  typename List::iterator eIt =
+    std::find(this->ends.begin() + this->endsFrom(e), eEnd, interval);
+  if (eIt == eEnd) return false;
+  this->starts.erase(sIt);
+  this->ends.erase(eIt);
+  return true;
+}
+
 /**
  * \brief return a string representation of an IntervalTreeNode
  */
-template <class T, class R>
+template <class T, class R, class GetStart, class GetEnd>
 std::string
-IntervalTreeNode<T, R>::toString() {
+IntervalTreeNode<T, R, GetStart, GetEnd>::toString() {
   std::ostringstream s;
   s << "mid: " << this->mid << std::endl;
   s << "intervals sorted by start:" << std::endl;
-  for (typename std::vector<T>::iterator it = this->starts.begin();
+  for (typename List::iterator it = this->starts.begin();
        it != this->starts.end(); it++) {
     s << "(" << this->getStart(*it) << " - " << this->getEnd(*it) << ")"
       << std::endl;
   }
   s << "intervals sorted by end:" << std::endl;
-  for (typename std::vector<T>::iterator it = this->ends.begin();
+  for (typename List::iterator it = this->ends.begin();
        it != this->ends.end(); it++) {
       s << "(" << this->getStart(*it) << " - " << this->getEnd(*it) << ")"
         << std::endl;
@@ -0,0 +1,768 @@
+/**
+ * \file  IntervalTreeSimd.hpp
+ * \brief Vectorised kernels for scanning the coordinate columns of a
+ *        FlatIntervalTree node. Each kernel compares a block of 8 (or 16)
+ *        coordinates with the query at once and turns the result into a bit
+ *        mask of hits. There are AVX2 and AVX-512 versions for x86, chosen
+ *        at run time from what the CPU supports so that one binary works on
+ *        any x86-64 machine, and a NEON version for AArch64. Coordinates of
+ *        any other type, other CPUs, and builds with INTERVALTREE_NO_SIMD
+ *        defined use a plain scalar loop. Only 32 and 64 bit integer and
+ *        floating point coordinates are vectorised.
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef INTERVALTREESIMD_HPP_
+#define INTERVALTREESIMD_HPP_
+
+// stl includes
+#include <cstddef>
+#include <type_traits>
+#include <stdint.h>
+
+// local includes
+#include "IntervalTreeNode.hpp"
+
+// which kernels can be built here
+#if !defined(INTERVALTREE_NO_SIMD) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define INTERVALTREE_SIMD_X86 1
+#include <immintrin.h>
+#define INTERVALTREE_AVX2 \
+  __attribute__((target("avx2"), always_inline)) inline
+#define INTERVALTREE_AVX2_KERNEL __attribute__((target("avx2")))
+#define INTERVALTREE_AVX512 \
+  __attribute__((target("avx512f"), always_inline)) inline
+#define INTERVALTREE_AVX512_KERNEL __attribute__((target("avx512f")))
+#elif !defined(INTERVALTREE_NO_SIMD) && defined(__aarch64__)
+#define INTERVALTREE_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+/******************************************************************************
+ * Class definitions and prototypes
+ *****************************************************************************/
+
+/**
+ * \brief the instruction sets the kernels can use, in increasing order of
+ *        preference
+ */
+enum IntervalSimdLevel {
+  INTERVAL_SIMD_SCALAR = 0,
+  INTERVAL_SIMD_NEON = 1,
+  INTERVAL_SIMD_AVX2 = 2,
+  INTERVAL_SIMD_AVX512 = 3
+};
+
+/**
+ * \brief the best instruction set this machine supports; detected on the
+ *        first call, then fixed
+ */
+inline IntervalSimdLevel
+intervalSimdLevel() {
+#if defined(INTERVALTREE_SIMD_X86)
+  static const IntervalSimdLevel level =
+    __builtin_cpu_supports("avx512f") ? INTERVAL_SIMD_AVX512
+    : __builtin_cpu_supports("avx2") ? INTERVAL_SIMD_AVX2
+    : INTERVAL_SIMD_SCALAR;
+  return level;
+#elif defined(INTERVALTREE_SIMD_NEON)
+  return INTERVAL_SIMD_NEON;
+#else
+  return INTERVAL_SIMD_SCALAR;
+#endif
+}
+
+/**
+ * \brief the kind of lanes a coordinate type <R> is compared in; 0 if it
+ *        can't be vectorised
+ */
+enum {
+  INTERVAL_LANES_NONE = 0,
+  INTERVAL_LANES_I32, INTERVAL_LANES_U32, INTERVAL_LANES_I64,
+  INTERVAL_LANES_U64, INTERVAL_LANES_F32, INTERVAL_LANES_F64
+};
+
+template <class R>
+struct IntervalSimdLanes {
+  static const int value =
+    std::is_same<R, float>::value ? INTERVAL_LANES_F32
+    : std::is_same<R, double>::value ? INTERVAL_LANES_F64
+    : (!std::is_integral<R>::value) ? INTERVAL_LANES_NONE
+    : (sizeof(R) == 4) ? (std::is_signed<R>::value ? INTERVAL_LANES_I32
+                                                   : INTERVAL_LANES_U32)
+    : (sizeof(R) == 8) ? (std::is_signed<R>::value ? INTERVAL_LANES_I64
+                                                   : INTERVAL_LANES_U64)
+    : INTERVAL_LANES_NONE;
+};
+
+template <class R>
+size_t simdIntersecting(const R *starts, const R *ends, const size_t n,
+                        const R start, const R end,
+                        const IntervalEndpointConvention conv, uint32_t *out,
+                        const IntervalSimdLevel level = intervalSimdLevel());
+template <class R>
+size_t simdIntersecting(const R *starts, const R *ends, const size_t n,
+                        const R start, const R end, const bool openEnded,
+                        uint32_t *out,
+                        const IntervalSimdLevel level = intervalSimdLevel());
+template <class R>
+size_t simdCountLeading(const R *col, const size_t n, const R bound,
+                        const bool strict,
+                        const IntervalSimdLevel level = intervalSimdLevel());
+
+
+/******************************************************************************
+ * Scalar kernels, and the parts shared by all kernels
+ *****************************************************************************/
+
+/**
+ * \brief how the kernels test a block of intervals [s, e] against a query
+ *        [start, end]. For intervals that don't end before they start, and
+ *        a query that doesn't either, intervalIntersects reduces to:
+ *          closed:                   s <= end && e >= start
+ *          open-ended:               s < end && (e > start || s >= start)
+ *          open-ended, start == end: s <= start && e > start
+ *        and the open (s, e) convention, which has no flag there, to:
+ *          open:                     s < end && e > start
+ */
+enum IntervalHitTest {
+  INTERVAL_HITS_CLOSED, INTERVAL_HITS_OPEN, INTERVAL_HITS_OPEN_POINT,
+  INTERVAL_HITS_OPEN_BOTH
+};
+
+template <class R>
+inline IntervalHitTest
+intervalHitTest(const R start, const R end,
+                const IntervalEndpointConvention conv) {
+  if (conv == INTERVAL_CLOSED) return INTERVAL_HITS_CLOSED;
+  if (conv == INTERVAL_OPEN) return INTERVAL_HITS_OPEN_BOTH;
+  return start == end ? INTERVAL_HITS_OPEN_POINT : INTERVAL_HITS_OPEN;
+}
+
+/**
+ * \brief append base + i to <out> for each bit i set in <hits>
+ * \return the new number of entries in <out>
+ */
+inline size_t
+intervalEmitHits(unsigned hits, const size_t base, uint32_t *out, size_t k) {
+  while (hits != 0) {
+    out[k++] = base + __builtin_ctz(hits);
+    hits &= hits - 1;
+  }
+  return k;
+}
+
+/**
+ * \brief scalar version of simdIntersecting, for [from, n)
+ */
+template <class R>
+size_t
+scalarIntersecting(const R *starts, const R *ends, const size_t from,
+                   const size_t n, const R start, const R end,
+                   const IntervalEndpointConvention conv,
+                   uint32_t *out, size_t k) {
+  const IntervalRuntimeEndpoints test(conv);
+  for (size_t i = from; i < n; ++i) {
+    if (test.intersects(starts[i], ends[i], start, end)) out[k++] = i;
+  }
+  return k;
+}
+
+/**
+ * \brief scalar version of simdCountLeading, for [from, n)
+ */
+template <class R>
+size_t
+scalarCountLeading(const R *col, const size_t from, const size_t n,
+                   const R bound, const bool strict) {
+  size_t i = from;
+  while ((i < n) && ((col[i] < bound) || ((!strict) && (col[i] == bound))))
+    ++i;
+  return i;
+}
+
+
+/******************************************************************************
+ * AVX2 and AVX-512 kernels
+ *****************************************************************************/
+
+#if defined(INTERVALTREE_SIMD_X86)
+
+/**
+ * \brief AVX2 comparisons of 8 coordinates with a value. gt(p, x) has bit i
+ *        set if p[i] > x, and lt(p, x) if p[i] < x. AVX2 only has signed
+ *        integer compares, so unsigned values are biased by flipping their
+ *        top bit first, which keeps their order.
+ */
+template <int Lanes> struct IntervalAvx2Ops;
+
+template <bool Unsigned>
+struct IntervalAvx2Int64 {
+  INTERVALTREE_AVX2 static __m256i bias(const __m256i v) {
+    return Unsigned ? _mm256_xor_si256(v, _mm256_set1_epi64x(INT64_MIN)) : v;
+  }
+  INTERVALTREE_AVX2 static __m256i load(const void *p) {
+    return bias(_mm256_loadu_si256(static_cast<const __m256i*>(p)));
+  }
+  INTERVALTREE_AVX2 static unsigned mask(const __m256i v) {
+    return _mm256_movemask_pd(_mm256_castsi256_pd(v));
+  }
+  template <class R>
+  INTERVALTREE_AVX2 static unsigned gt(const R *p, const R x) {
+    const __m256i b = bias(_mm256_set1_epi64x(static_cast<int64_t>(x)));
+    return mask(_mm256_cmpgt_epi64(load(p), b)) |
+           (mask(_mm256_cmpgt_epi64(load(p + 4), b)) << 4);
+  }
+  template <class R>
+  INTERVALTREE_AVX2 static unsigned lt(const R *p, const R x) {
+    const __m256i b = bias(_mm256_set1_epi64x(static_cast<int64_t>(x)));
+    return mask(_mm256_cmpgt_epi64(b, load(p))) |
+           (mask(_mm256_cmpgt_epi64(b, load(p + 4))) << 4);
+  }
+};
+
+template <bool Unsigned>
+struct IntervalAvx2Int32 {
+  INTERVALTREE_AVX2 static __m256i bias(const __m256i v) {
+    return Unsigned ? _mm256_xor_si256(v, _mm256_set1_epi32(INT32_MIN)) : v;
+  }
+  INTERVALTREE_AVX2 static __m256i load(const void *p) {
+    return bias(_mm256_loadu_si256(static_cast<const __m256i*>(p)));
+  }
+  INTERVALTREE_AVX2 static unsigned mask(const __m256i v) {
+    return _mm256_movemask_ps(_mm256_castsi256_ps(v));
+  }
+  template <class R>
+  INTERVALTREE_AVX2 static unsigned gt(const R *p, const R x) {
+    const __m256i b = bias(_mm256_set1_epi32(static_cast<int32_t>(x)));
+    return mask(_mm256_cmpgt_epi32(load(p), b));
+  }
+  template <class R>
+  INTERVALTREE_AVX2 static unsigned lt(const R *p, const R x) {
+    const __m256i b = bias(_mm256_set1_epi32(static_cast<int32_t>(x)));
+    return mask(_mm256_cmpgt_epi32(b, load(p)));
+  }
+};
+
+template <> struct IntervalAvx2Ops<INTERVAL_LANES_I64>
+  : IntervalAvx2Int64<false> {;};
+template <> struct IntervalAvx2Ops<INTERVAL_LANES_U64>
+  : IntervalAvx2Int64<true> {;};
+template <> struct IntervalAvx2Ops<INTERVAL_LANES_I32>
+  : IntervalAvx2Int32<false> {;};
+template <> struct IntervalAvx2Ops<INTERVAL_LANES_U32>
+  : IntervalAvx2Int32<true> {;};
+
+template <> struct IntervalAvx2Ops<INTERVAL_LANES_F64> {
+  INTERVALTREE_AVX2 static unsigned gt(const double *p, const double x) {
+    const __m256d b = _mm256_set1_pd(x);
+    return _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(p), b,
+                                            _CMP_GT_OQ)) |
+           (_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(p + 4), b,
+                                             _CMP_GT_OQ)) << 4);
+  }
+  INTERVALTREE_AVX2 static unsigned lt(const double *p, const double x) {
+    const __m256d b = _mm256_set1_pd(x);
+    return _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(p), b,
+                                            _CMP_LT_OQ)) |
+           (_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(p + 4), b,
+                                             _CMP_LT_OQ)) << 4);
+  }
+};
+
+template <> struct IntervalAvx2Ops<INTERVAL_LANES_F32> {
+  INTERVALTREE_AVX2 static unsigned gt(const float *p, const float x) {
+    return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(p),
+                                            _mm256_set1_ps(x), _CMP_GT_OQ));
+  }
+  INTERVALTREE_AVX2 static unsigned lt(const float *p, const float x) {
+    return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(p),
+                                            _mm256_set1_ps(x), _CMP_LT_OQ));
+  }
+};
+
+/**
+ * \brief AVX-512 comparisons of 8 (64 bit) or 16 (32 bit) coordinates with
+ *        a value, straight into a mask register
+ */
+template <int Lanes> struct IntervalAvx512Ops;
+
+template <> struct IntervalAvx512Ops<INTERVAL_LANES_I64> {
+  static const size_t BLOCK = 8;
+  template <class R>
+  INTERVALTREE_AVX512 static unsigned gt(const R *p, const R x) {
+    return _mm512_cmpgt_epi64_mask(_mm512_loadu_si512(p),
+                                   _mm512_set1_epi64(x));
+  }
+  template <class R>
+  INTERVALTREE_AVX512 static unsigned lt(const R *p, const R x) {
+    return _mm512_cmplt_epi64_mask(_mm512_loadu_si512(p),
+                                   _mm512_set1_epi64(x));
+  }
+};
+
+template <> struct IntervalAvx512Ops<INTERVAL_LANES_U64> {
+  static const size_t BLOCK = 8;
+  template <class R>
+  INTERVALTREE_AVX512 static unsigned gt(const R *p, const R x) {
+    return _mm512_cmpgt_epu64_mask(_mm512_loadu_si512(p),
+                                   _mm512_set1_epi64(x));
+  }
+  template <class R>
+  INTERVALTREE_AVX512 static unsigned lt(const R *p, const R x) {
+    return _mm512_cmplt_epu64_mask(_mm512_loadu_si512(p),
+                                   _mm512_set1_epi64(x));
+  }
+};
+
+template <> struct IntervalAvx512Ops<INTERVAL_LANES_I32> {
+  static const size_t BLOCK = 16;
+  template <class R>
+  INTERVALTREE_AVX512 static unsigned gt(const R *p, const R x) {
+    return _mm512_cmpgt_epi32_mask(_mm512_loadu_si512(p),
+                                   _mm512_set1_epi32(x));
+  }
+  template <class R>
+  INTERVALTREE_AVX512 static unsigned lt(const R *p, const R x) {
+    return _mm512_cmplt_epi32_mask(_mm512_loadu_si512(p),
+                                   _mm512_set1_epi32(x));
+  }
+};
+
+template <> struct IntervalAvx512Ops<INTERVAL_LANES_U32> {
+  static const size_t BLOCK = 16;
+  template <class R>
+  INTERVALTREE_AVX512 static unsigned gt(const R *p, const R x) {
+    return _mm512_cmpgt_epu32_mask(_mm512_loadu_si512(p),
+                                   _mm512_set1_epi32(x));
+  }
+  template <class R>
+  INTERVALTREE_AVX512 static unsigned lt(const R *p, const R x) {
+    return _mm512_cmplt_epu32_mask(_mm512_loadu_si512(p),
+                                   _mm512_set1_epi32(x));
+  }
+};
+
+template <> struct IntervalAvx512Ops<INTERVAL_LANES_F64> {
+  static const size_t BLOCK = 8;
+  INTERVALTREE_AVX512 static unsigned gt(const double *p, const double x) {
+    return _mm512_cmp_pd_mask(_mm512_loadu_pd(p), _mm512_set1_pd(x),
+                              _CMP_GT_OQ);
+  }
+  INTERVALTREE_AVX512 static unsigned lt(const double *p, const double x) {
+    return _mm512_cmp_pd_mask(_mm512_loadu_pd(p), _mm512_set1_pd(x),
+                              _CMP_LT_OQ);
+  }
+};
+
+template <> struct IntervalAvx512Ops<INTERVAL_LANES_F32> {
+  static const size_t BLOCK = 16;
+  INTERVALTREE_AVX512 static unsigned gt(const float *p, const float x) {
+    return _mm512_cmp_ps_mask(_mm512_loadu_ps(p), _mm512_set1_ps(x),
+                              _CMP_GT_OQ);
+  }
+  INTERVALTREE_AVX512 static unsigned lt(const float *p, const float x) {
+    return _mm512_cmp_ps_mask(_mm512_loadu_ps(p), _mm512_set1_ps(x),
+                              _CMP_LT_OQ);
+  }
+};
+
+/**
+ * \brief AVX2 version of simdIntersecting
+ */
+template <int Lanes, class R>
+INTERVALTREE_AVX2_KERNEL size_t
+avx2Intersecting(const R *s, const R *e, const size_t n, const R start,
+                 const R end, const IntervalEndpointConvention conv,
+                 uint32_t *out) {
+  typedef IntervalAvx2Ops<Lanes> Ops;
+  const IntervalHitTest test = intervalHitTest(start, end, conv);
+  size_t i = 0, k = 0;
+  for (; i + 8 <= n; i += 8) {
+    unsigned hits;
+    if (test == INTERVAL_HITS_CLOSED)
+      hits = ~Ops::gt(s + i, end) & ~Ops::lt(e + i, start);
+    else if (test == INTERVAL_HITS_OPEN)
+      hits = Ops::lt(s + i, end) &
+             (Ops::gt(e + i, start) | ~Ops::lt(s + i, start));
+    else if (test == INTERVAL_HITS_OPEN_BOTH)
+      hits = Ops::lt(s + i, end) & Ops::gt(e + i, start);
+    else
+      hits = ~Ops::gt(s + i, start) & Ops::gt(e + i, start);
+    k = intervalEmitHits(hits & 0xFFu, i, out, k);
+  }
+  return scalarIntersecting(s, e, i, n, start, end, conv, out, k);
+}
+
+/**
+ * \brief AVX2 version of simdCountLeading
+ */
+template <int Lanes, class R>
+INTERVALTREE_AVX2_KERNEL size_t
+avx2CountLeading(const R *col, const size_t n, const R bound,
+                 const bool strict) {
+  typedef IntervalAvx2Ops<Lanes> Ops;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const unsigned in = (strict ? Ops::lt(col + i, bound)
+                                : ~Ops::gt(col + i, bound)) & 0xFFu;
+    if (in != 0xFFu) return i + __builtin_ctz(~in);
+  }
+  return scalarCountLeading(col, i, n, bound, strict);
+}
+
+/**
+ * \brief AVX-512 version of simdIntersecting
+ */
+template <int Lanes, class R>
+INTERVALTREE_AVX512_KERNEL size_t
+avx512Intersecting(const R *s, const R *e, const size_t n, const R start,
+                   const R end, const IntervalEndpointConvention conv,
+                   uint32_t *out) {
+  typedef IntervalAvx512Ops<Lanes> Ops;
+  const IntervalHitTest test = intervalHitTest(start, end, conv);
+  const size_t block = Ops::BLOCK;
+  const unsigned full = (1u << block) - 1;
+  size_t i = 0, k = 0;
+  for (; i + block <= n; i += block) {
+    unsigned hits;
+    if (test == INTERVAL_HITS_CLOSED)
+      hits = ~Ops::gt(s + i, end) & ~Ops::lt(e + i, start);
+    else if (test == INTERVAL_HITS_OPEN)
+      hits = Ops::lt(s + i, end) &
+             (Ops::gt(e + i, start) | ~Ops::lt(s + i, start));
+    else if (test == INTERVAL_HITS_OPEN_BOTH)
+      hits = Ops::lt(s + i, end) & Ops::gt(e + i, start);
+    else
+      hits = ~Ops::gt(s + i, start) & Ops::gt(e + i, start);
+    k = intervalEmitHits(hits & full, i, out, k);
+  }
+  return scalarIntersecting(s, e, i, n, start, end, conv, out, k);
+}
+
+/**
+ * \brief AVX-512 version of simdCountLeading
+ */
+template <int Lanes, class R>
+INTERVALTREE_AVX512_KERNEL size_t
+avx512CountLeading(const R *col, const size_t n, const R bound,
+                   const bool strict) {
+  typedef IntervalAvx512Ops<Lanes> Ops;
+  const size_t block = Ops::BLOCK;
+  const unsigned full = (1u << block) - 1;
+  size_t i = 0;
+  for (; i + block <= n; i += block) {
+    const unsigned in = (strict ? Ops::lt(col + i, bound)
+                                : ~Ops::gt(col + i, bound)) & full;
+    if (in != full) return i + __builtin_ctz(~in);
+  }
+  return scalarCountLeading(col, i, n, bound, strict);
+}
+
+#endif  // INTERVALTREE_SIMD_X86
+
+
+/******************************************************************************
+ * NEON kernels
+ *****************************************************************************/
+
+#if defined(INTERVALTREE_SIMD_NEON)
+
+/**
+ * \brief NEON comparisons of 4 coordinates with a value; bit i is set in
+ *        gt(p, x) if p[i] > x, and in lt(p, x) if p[i] < x
+ */
+template <int Lanes> struct IntervalNeonOps;
+
+template <> struct IntervalNeonOps<INTERVAL_LANES_I64> {
+  static unsigned mask(const uint64x2_t v) {
+    return (vgetq_lane_u64(v, 0) & 1) | (vgetq_lane_u64(v, 1) & 2);
+  }
+  template <class R>
+  static unsigned gt(const R *p, const R x) {
+    const int64_t *q = reinterpret_cast<const int64_t*>(p);
+    const int64x2_t b = vdupq_n_s64(x);
+    return mask(vcgtq_s64(vld1q_s64(q), b)) |
+           (mask(vcgtq_s64(vld1q_s64(q + 2), b)) << 2);
+  }
+  template <class R>
+  static unsigned lt(const R *p, const R x) {
+    const int64_t *q = reinterpret_cast<const int64_t*>(p);
+    const int64x2_t b = vdupq_n_s64(x);
+    return mask(vcltq_s64(vld1q_s64(q), b)) |
+           (mask(vcltq_s64(vld1q_s64(q + 2), b)) << 2);
+  }
+};
+
+template <> struct IntervalNeonOps<INTERVAL_LANES_U64> {
+  template <class R>
+  static unsigned gt(const R *p, const R x) {
+    const uint64_t *q = reinterpret_cast<const uint64_t*>(p);
+    const uint64x2_t b = vdupq_n_u64(x);
+    return IntervalNeonOps<INTERVAL_LANES_I64>::mask(vcgtq_u64(vld1q_u64(q),
+                                                               b)) |
+           (IntervalNeonOps<INTERVAL_LANES_I64>::mask(
+              vcgtq_u64(vld1q_u64(q + 2), b)) << 2);
+  }
+  template <class R>
+  static unsigned lt(const R *p, const R x) {
+    const uint64_t *q = reinterpret_cast<const uint64_t*>(p);
+    const uint64x2_t b = vdupq_n_u64(x);
+    return IntervalNeonOps<INTERVAL_LANES_I64>::mask(vcltq_u64(vld1q_u64(q),
+                                                               b)) |
+           (IntervalNeonOps<INTERVAL_LANES_I64>::mask(
+              vcltq_u64(vld1q_u64(q + 2), b)) << 2);
+  }
+};
+
+template <> struct IntervalNeonOps<INTERVAL_LANES_F64> {
+  static unsigned gt(const double *p, const double x) {
+    const float64x2_t b = vdupq_n_f64(x);
+    return IntervalNeonOps<INTERVAL_LANES_I64>::mask(vcgtq_f64(vld1q_f64(p),
+                                                               b)) |
+           (IntervalNeonOps<INTERVAL_LANES_I64>::mask(
+              vcgtq_f64(vld1q_f64(p + 2), b)) << 2);
+  }
+  static unsigned lt(const double *p, const double x) {
+    const float64x2_t b = vdupq_n_f64(x);
+    return IntervalNeonOps<INTERVAL_LANES_I64>::mask(vcltq_f64(vld1q_f64(p),
+                                                               b)) |
+           (IntervalNeonOps<INTERVAL_LANES_I64>::mask(
+              vcltq_f64(vld1q_f64(p + 2), b)) << 2);
+  }
+};
+
+template <> struct IntervalNeonOps<INTERVAL_LANES_I32> {
+  static unsigned mask(const uint32x4_t v) {
+    const uint32_t bits[4] = {1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32(v, vld1q_u32(bits)));
+  }
+  template <class R>
+  static unsigned gt(const R *p, const R x) {
+    return mask(vcgtq_s32(vld1q_s32(reinterpret_cast<const int32_t*>(p)),
+                          vdupq_n_s32(x)));
+  }
+  template <class R>
+  static unsigned lt(const R *p, const R x) {
+    return mask(vcltq_s32(vld1q_s32(reinterpret_cast<const int32_t*>(p)),
+                          vdupq_n_s32(x)));
+  }
+};
+
+template <> struct IntervalNeonOps<INTERVAL_LANES_U32> {
+  template <class R>
+  static unsigned gt(const R *p, const R x) {
+    return IntervalNeonOps<INTERVAL_LANES_I32>::mask(
+      vcgtq_u32(vld1q_u32(reinterpret_cast<const uint32_t*>(p)),
+                vdupq_n_u32(x)));
+  }
+  template <class R>
+  static unsigned lt(const R *p, const R x) {
+    return IntervalNeonOps<INTERVAL_LANES_I32>::mask(
+      vcltq_u32(vld1q_u32(reinterpret_cast<const uint32_t*>(p)),
+                vdupq_n_u32(x)));
+  }
+};
+
+template <> struct IntervalNeonOps<INTERVAL_LANES_F32> {
+  static unsigned gt(const float *p, const float x) {
+    return IntervalNeonOps<INTERVAL_LANES_I32>::mask(
+      vcgtq_f32(vld1q_f32(p), vdupq_n_f32(x)));
+  }
+  static unsigned lt(const float *p, const float x) {
+    return IntervalNeonOps<INTERVAL_LANES_I32>::mask(
+      vcltq_f32(vld1q_f32(p), vdupq_n_f32(x)));
+  }
+};
+
+/**
+ * \brief NEON version of simdIntersecting; 8 intervals per step, as two
+ *        groups of 4 lanes
+ */
+template <int Lanes, class R>
+size_t
+neonIntersecting(const R *s, const R *e, const size_t n, const R start,
+                 const R end, const IntervalEndpointConvention conv,
+                 uint32_t *out) {
+  typedef IntervalNeonOps<Lanes> Ops;
+  const IntervalHitTest test = intervalHitTest(start, end, conv);
+  size_t i = 0, k = 0;
+  for (; i + 8 <= n; i += 8) {
+    unsigned hits = 0;
+    for (size_t j = 0; j < 8; j += 4) {
+      const R *sj = s + i + j, *ej = e + i + j;
+      unsigned h;
+      if (test == INTERVAL_HITS_CLOSED)
+        h = ~Ops::gt(sj, end) & ~Ops::lt(ej, start);
+      else if (test == INTERVAL_HITS_OPEN)
+        h = Ops::lt(sj, end) & (Ops::gt(ej, start) | ~Ops::lt(sj, start));
+      else if (test == INTERVAL_HITS_OPEN_BOTH)
+        h = Ops::lt(sj, end) & Ops::gt(ej, start);
+      else
+        h = ~Ops::gt(sj, start) & Ops::gt(ej, start);
+      hits |= (h & 0xFu) << j;
+    }
+    k = intervalEmitHits(hits, i, out, k);
+  }
+  return scalarIntersecting(s, e, i, n, start, end, conv, out, k);
+}
+
+/**
+ * \brief NEON version of simdCountLeading
+ */
+template <int Lanes, class R>
+size_t
+neonCountLeading(const R *col, const size_t n, const R bound,
+                 const bool strict) {
+  typedef IntervalNeonOps<Lanes> Ops;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const unsigned in = (strict ? Ops::lt(col + i, bound)
+                                : ~Ops::gt(col + i, bound)) & 0xFu;
+    if (in != 0xFu) return i + __builtin_ctz(~in);
+  }
+  return scalarCountLeading(col, i, n, bound, strict);
+}
+
+#endif  // INTERVALTREE_SIMD_NEON
+
+
+/******************************************************************************
+ * Dispatch
+ *****************************************************************************/
+
+/**
+ * \brief pick the kernel for <level>, for coordinates that can be
+ *        vectorised
+ */
+template <int Lanes, class R>
+size_t
+simdIntersectingDispatch(std::integral_constant<int, Lanes>, const R *s,
+                         const R *e, const size_t n, const R start,
+                         const R end, const IntervalEndpointConvention conv,
+                         uint32_t *out, const IntervalSimdLevel level) {
+  // queries the wrong way round don't fit the kernels' assumptions
+  if (end < start)
+    return scalarIntersecting(s, e, 0, n, start, end, conv, out, 0);
+#if defined(INTERVALTREE_SIMD_X86)
+  if (level >= INTERVAL_SIMD_AVX512)
+    return avx512Intersecting<Lanes>(s, e, n, start, end, conv, out);
+  if (level >= INTERVAL_SIMD_AVX2)
+    return avx2Intersecting<Lanes>(s, e, n, start, end, conv, out);
+#elif defined(INTERVALTREE_SIMD_NEON)
+  if (level >= INTERVAL_SIMD_NEON)
+    return neonIntersecting<Lanes>(s, e, n, start, end, conv, out);
+#endif
+  return scalarIntersecting(s, e, 0, n, start, end, conv, out, 0);
+}
+
+/**
+ * \brief coordinates that can't be vectorised always use the scalar kernel
+ */
+template <class R>
+size_t
+simdIntersectingDispatch(std::integral_constant<int, INTERVAL_LANES_NONE>,
+                         const R *s, const R *e, const size_t n,
+                         const R start, const R end,
+                         const IntervalEndpointConvention conv,
+                         uint32_t *out, const IntervalSimdLevel) {
+  return scalarIntersecting(s, e, 0, n, start, end, conv, out, 0);
+}
+
+template <int Lanes, class R>
+size_t
+simdCountLeadingDispatch(std::integral_constant<int, Lanes>, const R *col,
+                         const size_t n, const R bound, const bool strict,
+                         const IntervalSimdLevel level) {
+#if defined(INTERVALTREE_SIMD_X86)
+  if (level >= INTERVAL_SIMD_AVX512)
+    return avx512CountLeading<Lanes>(col, n, bound, strict);
+  if (level >= INTERVAL_SIMD_AVX2)
+    return avx2CountLeading<Lanes>(col, n, bound, strict);
+#elif defined(INTERVALTREE_SIMD_NEON)
+  if (level >= INTERVAL_SIMD_NEON)
+    return neonCountLeading<Lanes>(col, n, bound, strict);
+#endif
+  return scalarCountLeading(col, 0, n, bound, strict);
+}
+
+template <class R>
+size_t
+simdCountLeadingDispatch(std::integral_constant<int, INTERVAL_LANES_NONE>,
+                         const R *col, const size_t n, const R bound,
+                         const bool strict, const IntervalSimdLevel) {
+  return scalarCountLeading(col, 0, n, bound, strict);
+}
+
+/**
+ * \brief find the intervals [starts[i], ends[i]], i in [0, n), that
+ *        intersect the query [start, end] by the convention <conv>, as
+ *        IntervalRuntimeEndpoints tests it (so for closed and half open ones
+ *        as intervalIntersects does). Intervals must not end before they
+ *        start (the trees need that anyway); a query that does is scanned
+ *        without the vectorised kernels.
+ * \param out receives the indices of the hits, in increasing order; it needs
+ *            room for n entries
+ * \param level the most capable instruction set to use; the default is the
+ *              best one this machine has
+ * \return the number of hits
+ */
+template <class R>
+size_t
+simdIntersecting(const R *starts, const R *ends, const size_t n,
+                 const R start, const R end,
+                 const IntervalEndpointConvention conv, uint32_t *out,
+                 const IntervalSimdLevel level) {
+  return simdIntersectingDispatch(
+    std::integral_constant<int, IntervalSimdLanes<R>::value>(), starts, ends,
+    n, start, end, conv, out, level);
+}
+
+/**
+ * \brief as above, for closed intervals, or [s, e) ones if <openEnded> is set
+ */
+template <class R>
+size_t
+simdIntersecting(const R *starts, const R *ends, const size_t n,
+                 const R start, const R end, const bool openEnded,
+                 uint32_t *out, const IntervalSimdLevel level) {
+  return simdIntersecting(starts, ends, n, start, end,
+                          intervalEndpointConvention(openEnded), out, level);
+}
+
+/**
+ * \brief count the leading entries of the ascending column <col> that are
+ *        less than <bound> (or equal to it, unless <strict> is set)
+ */
+template <class R>
+size_t
+simdCountLeading(const R *col, const size_t n, const R bound,
+                 const bool strict, const IntervalSimdLevel level) {
+  return simdCountLeadingDispatch(
+    std::integral_constant<int, IntervalSimdLanes<R>::value>(), col, n,
+    bound, strict, level);
+}
+
+#endif  // INTERVALTREESIMD_HPP_
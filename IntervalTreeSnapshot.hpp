@@ -0,0 +1,287 @@
+/**
+ * \file  IntervalTreeSnapshot.hpp
+ * \brief A holder for the current version of a read-only tree (an
+ *        IntervalTree, or any of the other trees or forests here) that is
+ *        swapped out whole while it's being queried. Readers take a shared
+ *        pointer to the version that's current and query that for as long
+ *        as they like; a new version, usually built in the background, is
+ *        published by swapping the pointer, so no reader ever waits for a
+ *        build to finish, and each old version is freed when the last
+ *        reader still holding it lets go.
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef INTERVALTREESNAPSHOT_HPP_
+#define INTERVALTREESNAPSHOT_HPP_
+
+// stl includes
+#include <memory>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <utility>
+#include <stdint.h>
+
+// local includes
+#include "IntervalTreeArena.hpp"
+
+/******************************************************************************
+ * Class definitions and prototypes
+ *****************************************************************************/
+
+/**
+ * \brief One published version of a tree, together with the arena it was
+ *        built in, if any. The tree is declared last so that it's destroyed
+ *        before its arena.
+ */
+template <class Tree>
+struct IntervalTreeSnapshotVersion {
+  IntervalTreeSnapshotVersion(Tree &&tree,
+                              std::unique_ptr<IntervalTreeArena> &&arena)
+      : arena(std::move(arena)), tree(std::move(tree)) {;}
+
+  std::unique_ptr<IntervalTreeArena> arena;
+  Tree tree;
+};
+
+/**
+ * \brief The snapshot holder. Taking the current version is a single atomic
+ *        load of a shared pointer, with the std::atomic_load overloads that
+ *        C++11 has for them; at most a reader waits for another thread's
+ *        copy or swap of that pointer, never for a query or a build.
+ *        Publishing is serialised between writers. The tree type only has
+ *        to be move constructible, and is never modified once it's
+ *        published.
+ */
+template <class Tree>
+class IntervalTreeSnapshot {
+ public:
+  typedef std::shared_ptr<const Tree> Pointer;
+
+  IntervalTreeSnapshot();
+  explicit IntervalTreeSnapshot(Tree &&tree);
+  ~IntervalTreeSnapshot();
+
+  // inspectors
+  Pointer current() const;
+  uint64_t version() const { return this->published.load(); }
+
+  // mutators
+  Pointer publish(Tree &&tree);
+  Pointer publish(Tree &&tree, std::unique_ptr<IntervalTreeArena> arena);
+  Pointer publish(Pointer tree);
+  template <class Build>
+  std::future<void> rebuild(Build build);
+  template <class Build>
+  std::future<void> rebuildInArena(Build build);
+
+ private:
+  // the pointer is shared between threads, so the holder can't be copied
+  IntervalTreeSnapshot(const IntervalTreeSnapshot&);
+  IntervalTreeSnapshot& operator=(const IntervalTreeSnapshot&);
+
+  Pointer exchange(Pointer tree);
+  template <class Task>
+  std::future<void> background(Task task);
+
+  // only ever touched through the std::atomic_ overloads for shared_ptr
+  Pointer tree;
+  std::atomic<uint64_t> published;
+  std::mutex writer;
+  // rebuilds still running, which the destructor waits for
+  size_t building;
+  std::condition_variable built;
+};
+
+
+/******************************************************************************
+ * IntervalTreeSnapshot class implementation
+ *****************************************************************************/
+
+/**
+ * \brief Constructor for an IntervalTreeSnapshot with nothing published;
+ *        current() gives a null pointer until something is.
+ */
+template <class Tree>
+IntervalTreeSnapshot<Tree>::IntervalTreeSnapshot() : tree(), published(0),
+                                                     writer(), building(0),
+                                                     built() {;}
+
+/**
+ * \brief Constructor for an IntervalTreeSnapshot with <tree> as its first
+ *        version.
+ */
+template <class Tree>
+IntervalTreeSnapshot<Tree>::IntervalTreeSnapshot(Tree &&tree)
+    : tree(), published(0), writer(), building(0), built() {
+  this->publish(std::move(tree));
+}
+
+/**
+ * \brief get the current version. The tree it points to stays valid, and
+ *        unchanged, for as long as the pointer is held, whatever is
+ *        published in the meantime. A reader that wants several queries to
+ *        see the same version should take the pointer once and use it for
+ *        all of them.
+ */
+template <class Tree>
+typename IntervalTreeSnapshot<Tree>::Pointer
+IntervalTreeSnapshot<Tree>::current() const {
+  return std::atomic_load(&this->tree);
+}
+
+/**
+ * \brief publish <tree> as the current version, moving it into the holder.
+ * \return the version it replaces. If no reader still holds that, it's
+ *         freed when this is dropped, in the calling thread.
+ */
+template <class Tree>
+typename IntervalTreeSnapshot<Tree>::Pointer
+IntervalTreeSnapshot<Tree>::publish(Tree &&tree) {
+  return this->publish(std::move(tree),
+                       std::unique_ptr<IntervalTreeArena>());
+}
+
+/**
+ * \brief publish <tree>, which was built in <arena>, as the current version.
+ *        The version owns the arena, and releases it after the tree is
+ *        destroyed, once the last reader has let go of it; each version can
+ *        so be built in an arena of its own and freed in one go.
+ * \return the version it replaces.
+ */
+template <class Tree>
+typename IntervalTreeSnapshot<Tree>::Pointer
+IntervalTreeSnapshot<Tree>::publish(Tree &&tree,
+                                    std::unique_ptr<IntervalTreeArena> arena) {
+  typedef IntervalTreeSnapshotVersion<Tree> Version;
+  std::shared_ptr<Version> v =
+    std::make_shared<Version>(std::move(tree), std::move(arena));
+  return this->exchange(Pointer(v, &v->tree));
+}
+
+/**
+ * \brief publish the tree that <tree> points to, which must not be modified
+ *        through any other pointer from now on. Publishing a null pointer
+ *        leaves nothing current.
+ * \return the version it replaces.
+ */
+template <class Tree>
+typename IntervalTreeSnapshot<Tree>::Pointer
+IntervalTreeSnapshot<Tree>::publish(Pointer tree) {
+  return this->exchange(std::move(tree));
+}
+
+/**
+ * \brief Destructor for IntervalTreeSnapshot. Any rebuilds still running are
+ *        waited for first, since they publish into this holder.
+ */
+template <class Tree>
+IntervalTreeSnapshot<Tree>::~IntervalTreeSnapshot() {
+  std::unique_lock<std::mutex> guard(this->writer);
+  while (this->building > 0) this->built.wait(guard);
+}
+
+/**
+ * \brief build a new version in a thread of its own, by calling <build>
+ *        with no arguments to get the tree, and publish it when it's done.
+ *        Readers carry on with the current version in the meantime. The
+ *        thread is detached, so this returns straight away, and the future
+ *        can be dropped for a refresh that nothing waits on; destroying the
+ *        holder waits for the build instead. If the build throws, the
+ *        current version stays, and the exception is rethrown from the
+ *        future's get().
+ * \return a future that's ready once the new version is published and the
+ *         one it replaced has been let go of.
+ */
+template <class Tree>
+template <class Build>
+std::future<void>
+IntervalTreeSnapshot<Tree>::rebuild(Build build) {
+  return this->background([this, build]() {
+    this->publish(build());
+  });
+}
+
+/**
+ * \brief as rebuild, but <build> is called with a fresh IntervalTreeArena
+ *        to build the tree in (e.g. to pass to the IntervalTree
+ *        constructor), which the new version then owns.
+ */
+template <class Tree>
+template <class Build>
+std::future<void>
+IntervalTreeSnapshot<Tree>::rebuildInArena(Build build) {
+  return this->background([this, build]() {
+    std::unique_ptr<IntervalTreeArena> arena(new IntervalTreeArena());
+    Tree built = build(arena.get());
+    this->publish(std::move(built), std::move(arena));
+  });
+}
+
+/**
+ * \brief run <task> in a detached thread, counted as a build in progress
+ *        until it's done.
+ * \return a future for the result of <task>
+ */
+template <class Tree>
+template <class Task>
+std::future<void>
+IntervalTreeSnapshot<Tree>::background(Task task) {
+  std::shared_ptr< std::promise<void> > done(new std::promise<void>());
+  std::future<void> res = done->get_future();
+  {
+    std::lock_guard<std::mutex> guard(this->writer);
+    ++this->building;
+  }
+  std::thread([this, task, done]() {
+    std::exception_ptr failed;
+    try { task(); } catch (...) { failed = std::current_exception(); }
+    {
+      // the holder may be destroyed as soon as this is released
+      std::lock_guard<std::mutex> guard(this->writer);
+      --this->building;
+      this->built.notify_all();
+    }
+    if (failed) done->set_exception(failed);
+    else done->set_value();
+  }).detach();
+  return res;
+}
+
+/**
+ * \brief swap <tree> in as the current version and count it.
+ * \return the version it replaces
+ */
+template <class Tree>
+typename IntervalTreeSnapshot<Tree>::Pointer
+IntervalTreeSnapshot<Tree>::exchange(Pointer tree) {
+  std::lock_guard<std::mutex> guard(this->writer);
+  Pointer old = std::atomic_exchange(&this->tree, std::move(tree));
+  ++this->published;
+  return old;
+}
+
+#endif  // INTERVALTREESNAPSHOT_HPP_
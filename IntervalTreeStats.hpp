@@ -0,0 +1,293 @@
+/**
+ * \file  IntervalTreeStats.hpp
+ * \brief Statistics policies for IntervalTree. The tree's last template
+ *        parameter picks one: IntervalTreeNoStats, the default, does
+ *        nothing and compiles away entirely; IntervalTreeCountingStats
+ *        counts, for the queries that return hits, the nodes visited, the
+ *        intervals scanned and returned and the deepest level reached, and
+ *        times the phases of building the tree. Each query counts into a
+ *        probe on its own stack, which is added to the tree's totals once
+ *        when the query finishes, so queries from several threads only meet
+ *        once per query, on relaxed atomics. Only the root of a tree keeps
+ *        any totals; its subtrees hold none.
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef INTERVALTREESTATS_HPP_
+#define INTERVALTREESTATS_HPP_
+
+// stl includes
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <stdint.h>
+#include <utility>
+#include <type_traits>
+
+// local includes
+#include "IntervalTreeNode.hpp"
+
+/******************************************************************************
+ * Class definitions and prototypes
+ *****************************************************************************/
+
+/**
+ * \brief A snapshot of the statistics gathered for an IntervalTree. All
+ *        zero for a tree that doesn't gather any.
+ */
+struct IntervalTreeStats {
+  uint64_t queries;           // queries counted
+  uint64_t nodesVisited;      // nodes whose intervals were looked at
+  uint64_t elementsScanned;   // intervals looked at in those nodes
+  uint64_t elementsReturned;  // intervals given back as hits
+  uint64_t maxDepth;          // deepest node visited by any query (root = 1)
+  uint64_t sortNanos;         // sorting the intervals when the tree was built
+  uint64_t buildNanos;        // building the tree from the sorted intervals
+  uint64_t rebuilds;          // subtrees rebuilt by insert and erase
+  uint64_t rebuildNanos;      // time spent in those rebuilds
+
+  IntervalTreeStats() : queries(0), nodesVisited(0), elementsScanned(0),
+                        elementsReturned(0), maxDepth(0), sortNanos(0),
+                        buildNanos(0), rebuilds(0), rebuildNanos(0) {;}
+};
+
+/**
+ * \brief The default statistics policy: gathers nothing, and every call on
+ *        it is an empty inline, so it costs nothing.
+ */
+class IntervalTreeNoStats {
+ public:
+  static const bool ENABLED = false;
+
+  // counts for one query
+  struct Probe {
+    void push(const size_t) {;}
+    size_t pop() { return 0; }
+    void visit(const size_t, const size_t) {;}
+    void hits(const size_t) {;}
+  };
+
+  static uint64_t now() { return 0; }
+  void add(const Probe&) const {;}
+  void addBuild(const uint64_t, const uint64_t) {;}
+  void addRebuild(const uint64_t) {;}
+  IntervalTreeStats get() const { return IntervalTreeStats(); }
+  void reset() {;}
+};
+
+/**
+ * \brief Statistics policy that counts queries and times builds.
+ */
+class IntervalTreeCountingStats {
+ public:
+  static const bool ENABLED = true;
+
+  /**
+   * \brief counts for one query. The queries that use a stack to traverse
+   *        the tree push each subtree's depth here alongside it.
+   */
+  class Probe {
+   public:
+    Probe() : nodes(0), scanned(0), returned(0), depth(0) {;}
+    void push(const size_t d) { this->depths.push(d); }
+    size_t pop() { return this->depths.pop(); }
+    void visit(const size_t d, const size_t n) {
+      ++this->nodes;
+      this->scanned += n;
+      if (d > this->depth) this->depth = d;
+    }
+    void hits(const size_t n) { this->returned += n; }
+
+   private:
+    friend class IntervalTreeCountingStats;
+    uint64_t nodes;
+    uint64_t scanned;
+    uint64_t returned;
+    uint64_t depth;
+    IntervalTreeStack<size_t> depths;
+  };
+
+  IntervalTreeCountingStats() { this->reset(); }
+  // the counts belong to the tree they were made for, so copies start over
+  IntervalTreeCountingStats(const IntervalTreeCountingStats&) {
+    this->reset();
+  }
+  IntervalTreeCountingStats& operator=(const IntervalTreeCountingStats&) {
+    return *this;
+  }
+
+  static uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  void add(const Probe &p) const;
+  void addBuild(const uint64_t sortNanos, const uint64_t buildNanos);
+  void addRebuild(const uint64_t nanos);
+  IntervalTreeStats get() const;
+  void reset();
+
+ private:
+  mutable std::atomic<uint64_t> queries;
+  mutable std::atomic<uint64_t> nodesVisited;
+  mutable std::atomic<uint64_t> elementsScanned;
+  mutable std::atomic<uint64_t> elementsReturned;
+  mutable std::atomic<uint64_t> maxDepth;
+  std::atomic<uint64_t> sortNanos;
+  std::atomic<uint64_t> buildNanos;
+  std::atomic<uint64_t> rebuilds;
+  std::atomic<uint64_t> rebuildNanos;
+};
+
+
+/**
+ * \brief What a tree holds of its statistics policy. Subtrees are trees
+ *        too, but only the root's totals are ever added to, so the root owns
+ *        one block of them on the heap and a subtree holds a NULL pointer in
+ *        its place. Moving a root moves its block; a moved-from tree, like a
+ *        subtree, counts nothing. A policy with nothing in it is held in
+ *        place, and takes no space in any of them.
+ */
+template <class Stats, bool Empty = std::is_empty<Stats>::value>
+class IntervalTreeStatsHolder {
+ public:
+  explicit IntervalTreeStatsHolder(const bool root = true)
+      : block(root ? new Stats() : NULL) {;}
+  IntervalTreeStatsHolder(IntervalTreeStatsHolder &&h) noexcept
+      : block(h.block) {
+    h.block = NULL;
+  }
+  IntervalTreeStatsHolder(const IntervalTreeStatsHolder&) = delete;
+  IntervalTreeStatsHolder& operator=(const IntervalTreeStatsHolder&) = delete;
+  ~IntervalTreeStatsHolder() { delete this->block; }
+  void swap(IntervalTreeStatsHolder &h) noexcept {
+    std::swap(this->block, h.block);
+  }
+
+  void add(const typename Stats::Probe &p) const {
+    if (this->block != NULL) this->block->add(p);
+  }
+  void addBuild(const uint64_t sortNanos, const uint64_t buildNanos) {
+    if (this->block != NULL) this->block->addBuild(sortNanos, buildNanos);
+  }
+  void addRebuild(const uint64_t nanos) {
+    if (this->block != NULL) this->block->addRebuild(nanos);
+  }
+  IntervalTreeStats get() const {
+    return (this->block != NULL) ? this->block->get() : IntervalTreeStats();
+  }
+  void reset() {
+    if (this->block != NULL) this->block->reset();
+  }
+
+ private:
+  Stats *block;
+};
+
+/**
+ * \brief What a tree holds of a statistics policy with nothing in it: the
+ *        policy itself, which costs nothing as a base.
+ */
+template <class Stats>
+class IntervalTreeStatsHolder<Stats, true> : private Stats {
+ public:
+  explicit IntervalTreeStatsHolder(const bool = true) {;}
+  void swap(IntervalTreeStatsHolder&) noexcept {;}
+  using Stats::add;
+  using Stats::addBuild;
+  using Stats::addRebuild;
+  using Stats::get;
+  using Stats::reset;
+};
+
+/******************************************************************************
+ * IntervalTreeCountingStats class implementation
+ *****************************************************************************/
+
+/**
+ * \brief add the counts for one finished query to the totals
+ */
+inline void
+IntervalTreeCountingStats::add(const Probe &p) const {
+  const std::memory_order relaxed = std::memory_order_relaxed;
+  this->queries.fetch_add(1, relaxed);
+  this->nodesVisited.fetch_add(p.nodes, relaxed);
+  this->elementsScanned.fetch_add(p.scanned, relaxed);
+  this->elementsReturned.fetch_add(p.returned, relaxed);
+  uint64_t deepest = this->maxDepth.load(relaxed);
+  while ((p.depth > deepest) &&
+         !this->maxDepth.compare_exchange_weak(deepest, p.depth, relaxed)) {;}
+}
+
+/**
+ * \brief add the time taken by the phases of building the tree
+ */
+inline void
+IntervalTreeCountingStats::addBuild(const uint64_t sortNanos,
+                                    const uint64_t buildNanos) {
+  this->sortNanos.fetch_add(sortNanos, std::memory_order_relaxed);
+  this->buildNanos.fetch_add(buildNanos, std::memory_order_relaxed);
+}
+
+/**
+ * \brief count one rebuild of a subtree, which took <nanos>
+ */
+inline void
+IntervalTreeCountingStats::addRebuild(const uint64_t nanos) {
+  this->rebuilds.fetch_add(1, std::memory_order_relaxed);
+  this->rebuildNanos.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+/**
+ * \brief get a snapshot of the totals. Queries still running may or may not
+ *        be in it.
+ */
+inline IntervalTreeStats
+IntervalTreeCountingStats::get() const {
+  IntervalTreeStats s;
+  s.queries = this->queries.load(std::memory_order_relaxed);
+  s.nodesVisited = this->nodesVisited.load(std::memory_order_relaxed);
+  s.elementsScanned = this->elementsScanned.load(std::memory_order_relaxed);
+  s.elementsReturned = this->elementsReturned.load(std::memory_order_relaxed);
+  s.maxDepth = this->maxDepth.load(std::memory_order_relaxed);
+  s.sortNanos = this->sortNanos.load(std::memory_order_relaxed);
+  s.buildNanos = this->buildNanos.load(std::memory_order_relaxed);
+  s.rebuilds = this->rebuilds.load(std::memory_order_relaxed);
+  s.rebuildNanos = this->rebuildNanos.load(std::memory_order_relaxed);
+  return s;
+}
+
+/**
+ * \brief set all the totals back to zero
+ */
+inline void
+IntervalTreeCountingStats::reset() {
+  std::atomic<uint64_t> *all[] = {&this->queries, &this->nodesVisited,
+                                  &this->elementsScanned,
+                                  &this->elementsReturned, &this->maxDepth,
+                                  &this->sortNanos, &this->buildNanos,
+                                  &this->rebuilds, &this->rebuildNanos};
+  for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); ++i)
+    all[i]->store(0, std::memory_order_relaxed);
+}
+
+#endif  // INTERVALTREESTATS_HPP_
@@ -0,0 +1,438 @@
+/**
+ * \file  MappedIntervalTree.hpp
+ * \brief A versioned binary file format for FlatIntervalTrees, and a
+ *        read-only tree that queries such a file in place through mmap. The
+ *        node array, both interval pools and the coordinate columns are
+ *        written exactly as they sit in memory, so opening a file costs the
+ *        same whatever its size, and processes that open the same file share
+ *        its pages through the OS page cache. This only works when T is
+ *        trivially copyable (no pointers or strings inside); the file is also
+ *        specific to the byte order and type sizes it was written with, which
+ *        are checked when it is opened. Only the header and the bounds of
+ *        each section are checked then; checking every node too, so that a
+ *        corrupt file can't send a query outside the mapping, takes time in
+ *        proportion to the size of the tree and has to be asked for. POSIX
+ *        only.
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef MAPPEDINTERVALTREE_HPP_
+#define MAPPEDINTERVALTREE_HPP_
+
+// stl includes
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <stdint.h>
+
+// system includes
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// local includes
+#include "IntervalTreeNode.hpp"
+#include "FlatIntervalTree.hpp"
+
+/******************************************************************************
+ * Class definitions and prototypes
+ *****************************************************************************/
+
+/**
+ * \brief The header at the start of a tree image. All offsets are in bytes
+ *        from the start of the header, and are multiples of ALIGNMENT.
+ */
+struct MappedIntervalTreeHeader {
+  char magic[8];
+  uint32_t byteOrder;
+  uint32_t version;
+  uint32_t sizeOfT;
+  uint32_t sizeOfNode;
+  // an IntervalEndpointConvention
+  uint32_t endpoints;
+  uint32_t sizeOfR;
+  uint64_t numNodes;
+  uint64_t numIntervals;
+  uint64_t nodesOffset;
+  uint64_t startsOffset;
+  uint64_t endsOffset;
+  uint64_t startsStartOffset;
+  uint64_t startsEndOffset;
+  uint64_t endsEndOffset;
+  uint64_t imageSize;
+
+  // version 2 added the coordinate columns; version 3 keeps the mid-points
+  // of trees with integer coordinates as R rather than double; version 4
+  // records the endpoint convention rather than an open-ended flag, so it
+  // can be open (s, e); version 5 bounds each node's subtree
+  static const uint32_t VERSION = 5;
+  static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+  static const uint32_t ALIGNMENT = 64;
+};
+
+/**
+ * \brief Read-only interval tree backed by a memory mapped file
+ */
+template <class T, class R, class GetStart = R (*)(const T&),
+          class GetEnd = R (*)(const T&)>
+class MappedIntervalTree {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "MappedIntervalTree needs a trivially copyable interval type");
+  static_assert(std::is_trivially_copyable<R>::value,
+                "MappedIntervalTree needs a trivially copyable index type");
+
+ public:
+  typedef FlatIntervalTree<T, R, GetStart, GetEnd> Flat;
+  typedef typename Flat::View View;
+
+  MappedIntervalTree();
+  MappedIntervalTree(const std::string &filename, GetStart getStart,
+                     GetEnd getEnd, const bool validate = false);
+  MappedIntervalTree(MappedIntervalTree &&t) noexcept;
+  ~MappedIntervalTree();
+  MappedIntervalTree& operator=(MappedIntervalTree &&t) noexcept;
+  void swap(MappedIntervalTree &other) noexcept;
+
+  // inspectors
+  const std::vector<T> intersectingPoint(const R point) const {
+    return this->tree.intersectingPoint(point);
+  }
+  const std::vector<T> intersectingInterval(const R start,
+                                            const R end) const {
+    return this->tree.intersectingInterval(start, end);
+  }
+  const std::vector<T> squash() const { return this->tree.squash(); }
+  const int size() const { return this->tree.size(); }
+  const std::string toString() const { return this->tree.toString(); }
+  IntervalEndpointConvention endpointConvention() const {
+    return this->tree.endpointConvention();
+  }
+  const View &view() const { return this->tree; }
+
+  // writing and reading tree images
+  static void write(const Flat &t, const std::string &filename);
+  static uint64_t writeImage(const Flat &t, std::ostream &out);
+  static const View viewImage(const char *image, uint64_t length,
+                              GetStart getStart, GetEnd getEnd,
+                              const bool validate = false);
+
+ private:
+  static void checkNodes(const FlatIntervalTreeNode<R> *nodes,
+                         const uint64_t numNodes,
+                         const uint64_t numIntervals);
+
+  // the mapping is owned, so copying is not allowed
+  MappedIntervalTree(const MappedIntervalTree &t);
+  MappedIntervalTree& operator=(const MappedIntervalTree &t);
+
+  void *map;
+  size_t mapLength;
+  View tree;
+};
+
+
+/******************************************************************************
+ * MappedIntervalTree class implementation
+ *****************************************************************************/
+
+/**
+ * \brief default constructor; gives an empty tree with nothing mapped
+ */
+template <class T, class R, class GetStart, class GetEnd>
+MappedIntervalTree<T, R, GetStart, GetEnd>::MappedIntervalTree()
+    : map(NULL), mapLength(0) {;}
+
+/**
+ * \brief map the tree in <filename>, which must have been written by
+ *        MappedIntervalTree::write. The accessors must be the same
+ *        ones the tree was built with (they are not stored in the file).
+ * \param validate if set, check every node as well as the header; see
+ *                 viewImage
+ * \throws IntervalTreeError if the file can't be mapped, or isn't a tree
+ *         written with this version, byte order and type sizes
+ */
+template <class T, class R, class GetStart, class GetEnd>
+MappedIntervalTree<T, R, GetStart, GetEnd>::MappedIntervalTree(
+    const std::string &filename, GetStart getStart, GetEnd getEnd,
+    const bool validate)
+    : map(NULL), mapLength(0) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) throw IntervalTreeError("failed to open " + filename);
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw IntervalTreeError("failed to stat " + filename);
+  }
+  if (st.st_size > 0) {
+    this->mapLength = st.st_size;
+    this->map = mmap(NULL, this->mapLength, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if ((this->map == NULL) || (this->map == MAP_FAILED)) {
+    this->map = NULL;
+    throw IntervalTreeError("failed to map " + filename);
+  }
+
+  try {
+    this->tree = viewImage(static_cast<const char*>(this->map),
+                           this->mapLength, getStart, getEnd, validate);
+  } catch (const IntervalTreeError &e) {
+    munmap(this->map, this->mapLength);
+    this->map = NULL;
+    throw IntervalTreeError(filename + ": " + e.what());
+  }
+}
+
+/**
+ * \brief Move constructor; the mapping now belongs to us
+ */
+template <class T, class R, class GetStart, class GetEnd>
+MappedIntervalTree<T, R, GetStart, GetEnd>::MappedIntervalTree(
+    MappedIntervalTree &&t) noexcept : map(NULL), mapLength(0) {
+  this->swap(t);
+}
+
+/**
+ * \brief Destructor; unmaps the file
+ */
+template <class T, class R, class GetStart, class GetEnd>
+MappedIntervalTree<T, R, GetStart, GetEnd>::~MappedIntervalTree() {
+  if (this->map != NULL) munmap(this->map, this->mapLength);
+}
+
+/**
+ * \brief move assignment
+ */
+template <class T, class R, class GetStart, class GetEnd>
+MappedIntervalTree<T, R, GetStart, GetEnd>&
+MappedIntervalTree<T, R, GetStart, GetEnd>::operator=(
+    MappedIntervalTree &&t) noexcept {
+  MappedIntervalTree tmp(std::move(t));
+  this->swap(tmp);
+  return *this;
+}
+
+/**
+ * \brief swap the contents of this tree with another
+ */
+template <class T, class R, class GetStart, class GetEnd>
+void
+MappedIntervalTree<T, R, GetStart, GetEnd>::swap(
+    MappedIntervalTree &other) noexcept {
+  std::swap(this->map, other.map);
+  std::swap(this->mapLength, other.mapLength);
+  std::swap(this->tree, other.tree);
+}
+
+/**
+ * \brief write <t> to <filename>
+ * \throws IntervalTreeError if the file can't be written
+ */
+template <class T, class R, class GetStart, class GetEnd>
+void
+MappedIntervalTree<T, R, GetStart, GetEnd>::write(
+    const Flat &t, const std::string &filename) {
+  std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary |
+                                      std::ios::trunc);
+  if (!out) throw IntervalTreeError("failed to open " + filename);
+  writeImage(t, out);
+  out.close();
+  if (!out) throw IntervalTreeError("failed to write " + filename);
+}
+
+/**
+ * \brief write the image of <t> (header, nodes, pools and columns) to <out>.
+ *        Images can be embedded in larger files, as long as they start at a
+ *        multiple of MappedIntervalTreeHeader::ALIGNMENT bytes from the
+ *        start of the mapping.
+ * \return the number of bytes written, which is a multiple of ALIGNMENT
+ * \throws IntervalTreeError if writing fails
+ */
+template <class T, class R, class GetStart, class GetEnd>
+uint64_t
+MappedIntervalTree<T, R, GetStart, GetEnd>::writeImage(
+    const Flat &t, std::ostream &out) {
+  const uint64_t align = MappedIntervalTreeHeader::ALIGNMENT;
+  MappedIntervalTreeHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, "ITREEMAP", sizeof(h.magic));
+  h.byteOrder = MappedIntervalTreeHeader::BYTE_ORDER_MARK;
+  h.version = MappedIntervalTreeHeader::VERSION;
+  h.sizeOfT = sizeof(T);
+  h.sizeOfR = sizeof(R);
+  h.sizeOfNode = sizeof(FlatIntervalTreeNode<R>);
+  h.endpoints = t.endpoints;
+  h.numNodes = t.nodes.size();
+  h.numIntervals = t.starts.size();
+
+  // the sections follow the header in this order, each one aligned
+  const char *sections[] = {
+    reinterpret_cast<const char*>(&h),
+    reinterpret_cast<const char*>(t.nodes.data()),
+    reinterpret_cast<const char*>(t.starts.data()),
+    reinterpret_cast<const char*>(t.ends.data()),
+    reinterpret_cast<const char*>(t.startsStart.data()),
+    reinterpret_cast<const char*>(t.startsEnd.data()),
+    reinterpret_cast<const char*>(t.endsEnd.data())};
+  uint64_t *offsets[] = {NULL, &h.nodesOffset, &h.startsOffset,
+                         &h.endsOffset, &h.startsStartOffset,
+                         &h.startsEndOffset, &h.endsEndOffset};
+  const uint64_t lengths[] = {sizeof(h),
+                              h.numNodes * sizeof(FlatIntervalTreeNode<R>),
+                              h.numIntervals * sizeof(T),
+                              h.numIntervals * sizeof(T),
+                              h.numIntervals * sizeof(R),
+                              h.numIntervals * sizeof(R),
+                              h.numIntervals * sizeof(R)};
+  const size_t numSections = sizeof(lengths) / sizeof(lengths[0]);
+  uint64_t pos = 0;
+  for (size_t i = 0; i < numSections; ++i) {
+    if (offsets[i] != NULL) *(offsets[i]) = pos;
+    pos = ((pos + lengths[i] + align - 1) / align) * align;
+  }
+  h.imageSize = pos;
+
+  // write each section, zero padded up to the start of the next
+  const char zeros[MappedIntervalTreeHeader::ALIGNMENT] = {0};
+  uint64_t written = 0;
+  for (size_t i = 0; i < numSections; ++i) {
+    if (lengths[i] > 0) out.write(sections[i], lengths[i]);
+    written += lengths[i];
+    const uint64_t next = i + 1 < numSections ? *(offsets[i + 1])
+                                              : h.imageSize;
+    while (written < next) {
+      const uint64_t pad = std::min<uint64_t>(next - written, align);
+      out.write(zeros, pad);
+      written += pad;
+    }
+  }
+  if (!out) throw IntervalTreeError("failed to write interval tree image");
+  return written;
+}
+
+/**
+ * \brief check the tree image at <image> and get a view of it. Nothing is
+ *        copied; the view is only valid for as long as the image is. The
+ *        header is checked, and that every section lies within the image,
+ *        which takes the same time whatever the size of the tree.
+ * \param length the number of bytes available at <image>
+ * \param validate if set, every node is checked too, so that no query on
+ *                 the view can read outside the image even if it's corrupt;
+ *                 that takes time in proportion to the number of nodes
+ * \throws IntervalTreeError if the image is not a valid tree of this type
+ */
+template <class T, class R, class GetStart, class GetEnd>
+const typename MappedIntervalTree<T, R, GetStart, GetEnd>::View
+MappedIntervalTree<T, R, GetStart, GetEnd>::viewImage(
+    const char *image, uint64_t length, GetStart getStart, GetEnd getEnd,
+    const bool validate) {
+  MappedIntervalTreeHeader h;
+  if (length < sizeof(h))
+    throw IntervalTreeError("truncated interval tree image");
+  memcpy(&h, image, sizeof(h));
+  if (memcmp(h.magic, "ITREEMAP", sizeof(h.magic)) != 0)
+    throw IntervalTreeError("not an interval tree image");
+  if (h.byteOrder != MappedIntervalTreeHeader::BYTE_ORDER_MARK)
+    throw IntervalTreeError("interval tree image has the wrong byte order");
+  if (h.version != MappedIntervalTreeHeader::VERSION) {
+    std::ostringstream msg;
+    msg << "interval tree image has version " << h.version << ", expected "
+        << MappedIntervalTreeHeader::VERSION;
+    throw IntervalTreeError(msg.str());
+  }
+  if ((h.sizeOfT != sizeof(T)) || (h.sizeOfR != sizeof(R)) ||
+      (h.sizeOfNode != sizeof(FlatIntervalTreeNode<R>)))
+    throw IntervalTreeError("interval tree image was written for a different "
+                            "interval type");
+  if (h.endpoints > INTERVAL_OPEN)
+    throw IntervalTreeError("corrupt interval tree image");
+  typedef FlatIntervalTreeNode<R> Node;
+  // the section lengths below can't overflow once these hold
+  const uint64_t most = std::max<uint64_t>(sizeof(T), sizeof(R));
+  if ((h.numNodes > h.imageSize / sizeof(Node)) ||
+      (h.numIntervals > h.imageSize / most))
+    throw IntervalTreeError("corrupt interval tree image");
+  const uint64_t offsets[] = {h.nodesOffset, h.startsOffset, h.endsOffset,
+                              h.startsStartOffset, h.startsEndOffset,
+                              h.endsEndOffset};
+  const uint64_t lengths[] = {h.numNodes * sizeof(Node),
+                              h.numIntervals * sizeof(T),
+                              h.numIntervals * sizeof(T),
+                              h.numIntervals * sizeof(R),
+                              h.numIntervals * sizeof(R),
+                              h.numIntervals * sizeof(R)};
+  if (h.imageSize > length)
+    throw IntervalTreeError("truncated interval tree image");
+  for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i) {
+    if ((offsets[i] < sizeof(h)) || (offsets[i] > h.imageSize) ||
+        (lengths[i] > h.imageSize - offsets[i]) ||
+        (offsets[i] % MappedIntervalTreeHeader::ALIGNMENT != 0))
+      throw IntervalTreeError("corrupt interval tree image");
+  }
+  if (reinterpret_cast<uintptr_t>(image) % MappedIntervalTreeHeader::ALIGNMENT)
+    throw IntervalTreeError("interval tree image is not aligned");
+
+  const Node *nodes = reinterpret_cast<const Node*>(image + h.nodesOffset);
+  if (validate) checkNodes(nodes, h.numNodes, h.numIntervals);
+  return View(
+    nodes, h.numNodes, reinterpret_cast<const T*>(image + h.startsOffset),
+    reinterpret_cast<const T*>(image + h.endsOffset),
+    reinterpret_cast<const R*>(image + h.startsStartOffset),
+    reinterpret_cast<const R*>(image + h.startsEndOffset),
+    reinterpret_cast<const R*>(image + h.endsEndOffset), h.numIntervals,
+    getStart, getEnd, static_cast<IntervalEndpointConvention>(h.endpoints));
+}
+
+/**
+ * \brief check that every node's intervals are in the pools, and that its
+ *        children come after it, as they do in breadth-first order; that
+ *        also rules out cycles.
+ * \throws IntervalTreeError naming the first node that isn't valid
+ */
+template <class T, class R, class GetStart, class GetEnd>
+void
+MappedIntervalTree<T, R, GetStart, GetEnd>::checkNodes(
+    const FlatIntervalTreeNode<R> *nodes, const uint64_t numNodes,
+    const uint64_t numIntervals) {
+  typedef FlatIntervalTreeNode<R> Node;
+  for (uint64_t i = 0; i < numNodes; ++i) {
+    const Node &n = nodes[i];
+    const bool badLeft = (n.left != Node::NONE) &&
+                         ((n.left <= i) || (n.left >= numNodes));
+    const bool badRight = (n.right != Node::NONE) &&
+                          ((n.right <= i) || (n.right >= numNodes));
+    if ((static_cast<uint64_t>(n.offset) + n.count > numIntervals) ||
+        badLeft || badRight) {
+      std::ostringstream msg;
+      msg << "corrupt interval tree image: node " << i << " is invalid";
+      throw IntervalTreeError(msg.str());
+    }
+  }
+}
+
+#endif  // MAPPEDINTERVALTREE_HPP_
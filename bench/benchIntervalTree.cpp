@@ -0,0 +1,497 @@
+/**
+ * \file  benchIntervalTree.cpp
+ * \brief Benchmarks for building and querying IntervalTree. For each of a
+ *        range of sizes, distributions of intervals and interval types, a
+ *        tree is built and then queried with points and with intervals,
+ *        half of them anchored on intervals in the tree and half spread
+ *        uniformly over its extent. Reported are the build time, ns per
+ *        query, hits per second and the peak resident set size. Each case
+ *        runs in a process of its own, so that its peak RSS is its alone
+ *        (it includes the input vector as well as the tree). Every case is
+ *        deterministic, so runs before and after a change can be compared
+ *        line by line.
+ *
+ *        usage: benchIntervalTree [-n maxSize] [-m minSize] [-q queries]
+ *                                 [-d distribution] [-t small|fat]
+ *                                 [-j threads] [-s seconds]
+ *                                 [-b sorted|unsorted]
+ *
+ *        Sizes go up by factors of 10 from minSize (default 1e3) to maxSize
+ *        (default 1e6; 1e8 needs tens of GB with fat intervals). Each query
+ *        phase stops after <seconds> (default 2) if it hasn't finished, so
+ *        dense trees (e.g. nested) don't take forever; the ns/query is over
+ *        the queries that did run.
+ *
+ *        With -b, the queries are instead answered one at a time, and as a
+ *        single batch, with the queries sorted by start or left as they are;
+ *        all of them are run, whatever the time. One at a time, they're run
+ *        twice: copying each query's hits into a buffer that's reused from
+ *        query to query (pt1, iv1), and keeping them all in the same form as
+ *        the batch gives them (ptc, ivc).
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+// stl includes
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+// system includes
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// local includes
+#include "IntervalTree.hpp"
+
+// bring the following into the local name-space
+using std::vector;
+using std::string;
+
+typedef std::chrono::steady_clock Clock;
+
+/******************************************************************************
+ * Interval types and synthetic data
+ *****************************************************************************/
+
+/**
+ * \brief An interval with nothing but its end-points
+ */
+struct SmallInterval {
+  SmallInterval(size_t s, size_t e) : start(s), end(e) {;}
+  size_t getStart() const { return this->start; }
+  size_t getEnd() const { return this->end; }
+  size_t start;
+  size_t end;
+};
+
+/**
+ * \brief An interval carrying a payload, like an annotation record with a
+ *        name and a few fields, so that moving intervals around costs what
+ *        it would with real data
+ */
+struct FatInterval {
+  FatInterval(size_t s, size_t e) : start(s), end(e) {
+    memset(this->payload, 0, sizeof(this->payload));
+  }
+  size_t getStart() const { return this->start; }
+  size_t getEnd() const { return this->end; }
+  size_t start;
+  size_t end;
+  char payload[112];
+};
+
+/**
+ * \brief The shapes of data sets we benchmark with
+ *        UNIFORM: short intervals spread evenly.
+ *        CLUSTERED: short intervals packed around a few dozen loci.
+ *        NESTED: intervals around a few centres, with log-uniform lengths,
+ *                so they nest many deep and queries hit a lot of them.
+ *        GENOME: a human-sized genome; most features are in gene-rich
+ *                regions covering a tenth of it, with log-normal lengths
+ *                (median about 2kb, a tail out to megabases).
+ */
+enum Distribution { UNIFORM, CLUSTERED, NESTED, GENOME, NUM_DISTRIBUTIONS };
+const char *DISTRIBUTION_NAMES[] = {"uniform", "clustered", "nested",
+                                    "genome"};
+
+/**
+ * \brief the extent of a data set of <n> intervals with distribution <d>
+ */
+size_t
+extent(const Distribution d, const size_t n) {
+  return d == GENOME ? size_t(3100000000ULL) : 100 * n;
+}
+
+/**
+ * \brief generate <n> intervals with distribution <d>; deterministic for a
+ *        given seed.
+ */
+template <class T>
+vector<T>
+generate(const Distribution d, const size_t n, const unsigned seed) {
+  std::mt19937_64 rng(seed);
+  const size_t span = extent(d, n);
+  std::uniform_int_distribution<size_t> anywhere(0, span - 1);
+  std::uniform_int_distribution<size_t> shortLen(1, 1000);
+  vector<size_t> centres;
+  for (size_t i = 0; i < 64; ++i) centres.push_back(anywhere(rng));
+
+  vector<T> res;
+  res.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    size_t s = 0, len = 0;
+    if (d == UNIFORM) {
+      s = anywhere(rng);
+      len = shortLen(rng);
+    } else if (d == CLUSTERED) {
+      std::normal_distribution<double> near(centres[i % centres.size()],
+                                            span / 2000.0);
+      s = static_cast<size_t>(std::max(0.0, near(rng)));
+      len = shortLen(rng);
+    } else if (d == NESTED) {
+      std::uniform_real_distribution<double> logLen(0, std::log(span / 2.0));
+      const size_t c = centres[i % 8], half = std::exp(logLen(rng));
+      s = c > half ? c - half : 0;
+      len = 2 * half;
+    } else {
+      // gene-rich regions take up the first tenth of each tenth of the genome
+      std::uniform_int_distribution<size_t> tenth(0, 9);
+      std::uniform_int_distribution<size_t> within(0, span / 100 - 1);
+      std::lognormal_distribution<double> featureLen(std::log(2000.0), 1.5);
+      s = (rng() % 5 != 0) ? tenth(rng) * (span / 10) + within(rng)
+                           : anywhere(rng);
+      len = std::min(static_cast<size_t>(featureLen(rng)) + 1,
+                     size_t(5000000));
+    }
+    res.push_back(T(s, s + len));
+  }
+  return res;
+}
+
+/**
+ * \brief generate <q> queries of length up to <maxLen> (0 for points) over
+ *        <intervals>; half start in or near an interval from the set, half
+ *        anywhere in its extent.
+ */
+template <class T>
+vector< std::pair<size_t, size_t> >
+queries(const vector<T> &intervals, const size_t span, const size_t q,
+        const size_t maxLen, const unsigned seed) {
+  std::mt19937_64 rng(seed);
+  std::uniform_int_distribution<size_t> anywhere(0, span - 1);
+  std::uniform_int_distribution<size_t> pick(0, intervals.size() - 1);
+  std::uniform_int_distribution<size_t> len(0, maxLen);
+  vector< std::pair<size_t, size_t> > res;
+  res.reserve(q);
+  for (size_t i = 0; i < q; ++i) {
+    size_t s = anywhere(rng);
+    if (i % 2 == 0) {
+      const T &near = intervals[pick(rng)];
+      s = near.getStart() + (rng() % (near.getEnd() - near.getStart() + 1));
+    }
+    res.push_back(std::make_pair(s, s + (maxLen == 0 ? 0 : len(rng))));
+  }
+  return res;
+}
+
+/******************************************************************************
+ * Running the benchmarks
+ *****************************************************************************/
+
+/**
+ * \brief Adds up the hits it's shown, so that every hit is really touched
+ */
+template <class T>
+struct HitCounter {
+  HitCounter() : hits(0), sum(0) {;}
+  void operator()(const T &i) {
+    ++this->hits;
+    this->sum += i.getStart();
+  }
+  size_t hits;
+  size_t sum;
+};
+
+/**
+ * \brief The results of running one batch of queries
+ */
+struct QueryTiming {
+  size_t run;
+  size_t hits;
+  double seconds;
+  double nsPerQuery() const { return this->run ? 1e9 * seconds / run : 0; }
+  double hitsPerSecond() const { return seconds > 0 ? hits / seconds : 0; }
+};
+
+/**
+ * \brief run the queries <qs> against <tree>, as points if <points> is set,
+ *        for up to <budget> seconds.
+ */
+template <class Tree, class T>
+QueryTiming
+timeQueries(const Tree &tree, const vector< std::pair<size_t, size_t> > &qs,
+            const bool points, const double budget) {
+  HitCounter<T> counter;
+  QueryTiming res = {0, 0, 0};
+  const Clock::time_point begin = Clock::now();
+  for (size_t i = 0; i < qs.size(); ++i) {
+    if (points) counter = tree.visitIntersectingPoint(qs[i].first, counter);
+    else counter = tree.visitIntersectingInterval(qs[i].first, qs[i].second,
+                                                  counter);
+    res.run = i + 1;
+    if ((i % 64 == 63) &&
+        (std::chrono::duration<double>(Clock::now() - begin).count() >
+         budget))
+      break;
+  }
+  res.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+  res.hits = counter.hits;
+  // keep the sum alive, so the compiler can't skip looking at the hits
+  if (counter.sum == 1) fprintf(stderr, " ");
+  return res;
+}
+
+/**
+ * \brief run all the queries <qs> against <tree> one at a time, as points
+ *        if <points> is set. If <keep> is set, the hits are all kept, as a
+ *        batch would give them; otherwise each query's hits are copied into
+ *        a buffer that's reused from one query to the next.
+ */
+template <class Tree, class T>
+QueryTiming
+timeSingleQueries(const Tree &tree,
+                  const vector< std::pair<size_t, size_t> > &qs,
+                  const bool points, const bool keep) {
+  IntervalTreeBatchResult<T> kept;
+  QueryTiming res = {qs.size(), 0, 0};
+  const Clock::time_point begin = Clock::now();
+  kept.offsets.push_back(0);
+  for (size_t i = 0; i < qs.size(); ++i) {
+    if (!keep) kept.hits.clear();
+    if (points) tree.intersectingPoint(qs[i].first, kept.hits);
+    else tree.intersectingInterval(qs[i].first, qs[i].second, kept.hits);
+    if (keep) kept.offsets.push_back(kept.hits.size());
+    else res.hits += kept.hits.size();
+  }
+  res.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+  if (keep) res.hits = kept.hits.size();
+  return res;
+}
+
+/**
+ * \brief answer all the queries <qs> against <tree> as one batch, as points
+ *        if <points> is set.
+ */
+template <class Tree, class T>
+QueryTiming
+timeBatchQueries(const Tree &tree,
+                 const vector< std::pair<size_t, size_t> > &qs,
+                 const bool points) {
+  vector<size_t> at;
+  if (points)
+    for (size_t i = 0; i < qs.size(); ++i) at.push_back(qs[i].first);
+  QueryTiming res = {qs.size(), 0, 0};
+  const Clock::time_point begin = Clock::now();
+  const IntervalTreeBatchResult<T> r = points ? tree.intersectingPoints(at)
+                                              : tree.intersectingIntervals(qs);
+  res.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+  res.hits = r.hits.size();
+  return res;
+}
+
+/**
+ * \brief peak resident set size of this process so far, in MB
+ */
+double
+peakRssMb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+  return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+/**
+ * \brief The settings for a run of the benchmarks
+ */
+struct Options {
+  size_t minSize;
+  size_t maxSize;
+  size_t numQueries;
+  int distribution;   // -1 for all of them
+  int type;           // 0 for small, 1 for fat, -1 for both
+  unsigned threads;
+  double budget;
+  int batch;          // -1 for no batches, 0 for sorted, 1 for unsorted
+};
+
+const char *BATCH_ORDER_NAMES[] = {"sorted", "unsorted"};
+
+/**
+ * \brief build a tree of <n> intervals of type T with distribution <d> and
+ *        query it, printing one line of results.
+ */
+template <class T>
+void
+runCase(const Distribution d, const size_t n, const char *typeName,
+        const Options &opts) {
+  typedef IntervalTree<T, size_t, IntervalStartMember<T, size_t>,
+                       IntervalEndMember<T, size_t> > Tree;
+  const unsigned seed = 1000 * d + static_cast<unsigned>(std::log10(n));
+  const vector<T> intervals = generate<T>(d, n, seed);
+
+  const Clock::time_point begin = Clock::now();
+  Tree tree(intervals, false, opts.threads);
+  const double buildMs =
+    std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+  const size_t span = extent(d, n);
+  if (opts.batch >= 0) {
+    vector< std::pair<size_t, size_t> > pq =
+      queries(intervals, span, opts.numQueries, 0, seed + 1);
+    vector< std::pair<size_t, size_t> > iq =
+      queries(intervals, span, opts.numQueries, 10000, seed + 2);
+    if (opts.batch == 0) {
+      std::sort(pq.begin(), pq.end());
+      std::sort(iq.begin(), iq.end());
+    }
+    const QueryTiming p1 = timeSingleQueries<Tree, T>(tree, pq, true, false);
+    const QueryTiming pc = timeSingleQueries<Tree, T>(tree, pq, true, true);
+    const QueryTiming pb = timeBatchQueries<Tree, T>(tree, pq, true);
+    const QueryTiming i1 = timeSingleQueries<Tree, T>(tree, iq, false, false);
+    const QueryTiming ic = timeSingleQueries<Tree, T>(tree, iq, false, true);
+    const QueryTiming ib = timeBatchQueries<Tree, T>(tree, iq, false);
+    if ((p1.hits != pb.hits) || (pc.hits != pb.hits) ||
+        (i1.hits != ib.hits) || (ic.hits != ib.hits))
+      fprintf(stderr, "batch and single queries disagree\n");
+    printf("%-9s %-5s %10zu %-8s %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f "
+           "%9.1f\n", DISTRIBUTION_NAMES[d], typeName, n,
+           BATCH_ORDER_NAMES[opts.batch], p1.nsPerQuery(), pc.nsPerQuery(),
+           pb.nsPerQuery(), i1.nsPerQuery(), ic.nsPerQuery(),
+           ib.nsPerQuery(), peakRssMb());
+    fflush(stdout);
+    return;
+  }
+  const QueryTiming pts = timeQueries<Tree, T>(tree,
+      queries(intervals, span, opts.numQueries, 0, seed + 1), true,
+      opts.budget);
+  const QueryTiming ivs = timeQueries<Tree, T>(tree,
+      queries(intervals, span, opts.numQueries, 10000, seed + 2), false,
+      opts.budget);
+
+  printf("%-9s %-5s %10zu %10.1f %10.1f %12.4g %10.1f %12.4g %9.1f\n",
+         DISTRIBUTION_NAMES[d], typeName, n, buildMs, pts.nsPerQuery(),
+         pts.hitsPerSecond(), ivs.nsPerQuery(), ivs.hitsPerSecond(),
+         peakRssMb());
+  fflush(stdout);
+}
+
+/**
+ * \brief run one case in a child process, so its peak RSS is its own
+ * \return false if the case failed
+ */
+bool
+forkCase(const Distribution d, const size_t n, const int type,
+         const Options &opts) {
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return false;
+  }
+  if (pid == 0) {
+    try {
+      if (type == 0) runCase<SmallInterval>(d, n, "small", opts);
+      else runCase<FatInterval>(d, n, "fat", opts);
+    } catch (const std::exception &e) {
+      fprintf(stderr, "%s/%zu failed: %s\n", DISTRIBUTION_NAMES[d], n,
+              e.what());
+      _exit(1);
+    }
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+/**
+ * \brief parse the command line into <opts>
+ * \return false if it couldn't be parsed
+ */
+bool
+parseArgs(int argc, char **argv, Options &opts) {
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    if ((arg.size() != 2) || (arg[0] != '-') || (i + 1 >= argc)) return false;
+    const string val = argv[++i];
+    if (arg == "-n") {
+      opts.maxSize = static_cast<size_t>(atof(val.c_str()));
+    } else if (arg == "-m") {
+      opts.minSize = static_cast<size_t>(atof(val.c_str()));
+    } else if (arg == "-q") {
+      opts.numQueries = static_cast<size_t>(atof(val.c_str()));
+    } else if (arg == "-j") {
+      opts.threads = atoi(val.c_str());
+    } else if (arg == "-s") {
+      opts.budget = atof(val.c_str());
+    } else if (arg == "-b") {
+      if (val == "sorted") opts.batch = 0;
+      else if (val == "unsorted") opts.batch = 1;
+      else return false;
+    } else if (arg == "-t") {
+      if (val == "small") opts.type = 0;
+      else if (val == "fat") opts.type = 1;
+      else return false;
+    } else if (arg == "-d") {
+      opts.distribution = -2;
+      for (int k = 0; k < NUM_DISTRIBUTIONS; ++k)
+        if (val == DISTRIBUTION_NAMES[k]) opts.distribution = k;
+      if (opts.distribution == -2) return false;
+    } else {
+      return false;
+    }
+  }
+  return (opts.minSize > 0) && (opts.minSize <= opts.maxSize) &&
+         (opts.numQueries > 0);
+}
+
+int
+main(int argc, char **argv) {
+  Options opts = {1000, 1000000, 100000, -1, -1, 1, 2.0, -1};
+  if (!parseArgs(argc, argv, opts)) {
+    fprintf(stderr, "usage: %s [-n maxSize] [-m minSize] [-q queries] "
+            "[-d uniform|clustered|nested|genome] [-t small|fat] "
+            "[-j threads] [-s seconds] [-b sorted|unsorted]\n", argv[0]);
+    return 1;
+  }
+
+  if (opts.batch >= 0) {
+    printf("%-9s %-5s %10s %-8s %8s %8s %8s %8s %8s %8s %9s\n", "dist",
+           "T", "n", "order", "pt1_ns/q", "ptc_ns/q", "ptb_ns/q", "iv1_ns/q",
+           "ivc_ns/q", "ivb_ns/q", "rss_MB");
+  } else {
+    printf("%-9s %-5s %10s %10s %10s %12s %10s %12s %9s\n", "dist", "T",
+           "n", "build_ms", "pt_ns/q", "pt_hits/s", "iv_ns/q", "iv_hits/s",
+           "rss_MB");
+  }
+  bool ok = true;
+  for (int d = 0; d < NUM_DISTRIBUTIONS; ++d) {
+    if ((opts.distribution >= 0) && (d != opts.distribution)) continue;
+    for (int t = 0; t < 2; ++t) {
+      if ((opts.type >= 0) && (t != opts.type)) continue;
+      for (size_t n = opts.minSize; n <= opts.maxSize; n *= 10)
+        ok = forkCase(static_cast<Distribution>(d), n, t, opts) && ok;
+    }
+  }
+  return ok ? 0 : 1;
+}
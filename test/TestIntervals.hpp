@@ -0,0 +1,163 @@
+/**
+ * \file  TestIntervals.hpp
+ * \brief Interval type and test cases shared by the interval tree unit tests
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+#ifndef TESTINTERVALS_HPP_
+#define TESTINTERVALS_HPP_
+
+// stl includes
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+
+
+/**
+ * \brief a test class for use in testing the interval tree class
+ */
+class TestInterval {
+ public:
+  TestInterval(size_t start, size_t end) {
+    this->start = start; this->end = end;
+  }
+  const size_t getStart() const {return this->start;}
+  const size_t getEnd() const {return this->end;}
+  bool operator==(const TestInterval other) const {
+    return ((this->start == other.start) && (this->end == other.end));
+  }
+  bool operator!=(const TestInterval other) const {
+    return ((this->start != other.start) || (this->end != other.end));
+  }
+  bool operator<(const TestInterval &o) const {
+    return this->start < o.start;
+  }
+  static bool compare(TestInterval i1, TestInterval i2) {
+    if (i1.getStart() == i2.getStart()) return i1.getEnd() < i2.getEnd();
+    return i1.getStart() < i2.getStart();
+  }
+ private:
+  size_t start;
+  size_t end;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const TestInterval& t) {
+  os << "[" << t.getStart() << "," << t.getEnd() << "]";
+  return os;
+}
+
+// functions for extracting start and end indices from TestInterval objects
+inline size_t getStartTest(const TestInterval &i) { return i.getStart(); }
+inline size_t getEndTest(const TestInterval &i) { return i.getEnd(); }
+
+/**
+ * \brief a factory class for producing sets of intervals for testing the
+ *        interval tree class.
+ */
+class IntervalFactory {
+ public:
+  static const std::vector<TestInterval>& getTestCase(size_t n) {
+    static IntervalFactory ifactory;
+    return ifactory.cases[n];
+  }
+
+ private:
+  IntervalFactory() {
+    // test case 0 -- empty set
+    cases.push_back(std::vector<TestInterval>());
+
+    // test case 1 -- no overlapping intervals, intervals are in sorted order
+    //                final interval has same start and end.
+    cases.push_back(std::vector<TestInterval>());
+    cases.back().push_back(TestInterval(10, 20));
+    cases.back().push_back(TestInterval(40, 75));
+    cases.back().push_back(TestInterval(78, 85));
+    cases.back().push_back(TestInterval(89, 94));
+    cases.back().push_back(TestInterval(96, 97));
+    cases.back().push_back(TestInterval(99, 99));
+
+    // test case 2 -- some overlapping intervals, not in sorted order
+    cases.push_back(std::vector<TestInterval>());
+    cases.back().push_back(TestInterval(21, 28));
+    cases.back().push_back(TestInterval(10, 20));
+    cases.back().push_back(TestInterval(15, 20));
+    cases.back().push_back(TestInterval(11, 23));
+  }
+
+  std::vector< std::vector<TestInterval> > cases;
+};
+
+/**
+ * \brief generate <n> pseudo-random intervals with starts in [0, maxStart)
+ *        and lengths in [0, maxLen); deterministic for a given seed.
+ */
+inline std::vector<TestInterval> randomIntervals(size_t n, size_t maxStart,
+                                                 size_t maxLen,
+                                                 unsigned seed) {
+  srand(seed);
+  std::vector<TestInterval> res;
+  for (size_t i = 0; i < n; ++i) {
+    size_t s = rand() % maxStart;
+    res.push_back(TestInterval(s, s + (rand() % maxLen)));
+  }
+  return res;
+}
+
+/**
+ * \brief the intervals in <intervals> that intersect [start, end], found by
+ *        checking every one of them; used as the expected answer in tests.
+ */
+inline std::vector<TestInterval>
+bruteForceIntersecting(const std::vector<TestInterval> &intervals,
+                       size_t start, size_t end, bool openEnded = false) {
+  std::vector<TestInterval> res;
+  for (size_t i = 0; i < intervals.size(); ++i) {
+    size_t s = intervals[i].getStart(), e = intervals[i].getEnd();
+    if (openEnded) {
+      if (((s >= start) && (s < end)) || ((e > start) && (e < end)) ||
+          ((start >= s) && (start < e)) || ((end > s) && (end < e)))
+        res.push_back(intervals[i]);
+    } else {
+      if ((s <= end) && (e >= start)) res.push_back(intervals[i]);
+    }
+  }
+  return res;
+}
+
+/**
+ * \brief the intervals in <intervals> that intersect (start, end) when both
+ *        are read as open intervals (s, e), found by checking every one of
+ *        them; (p, p) asks for the intervals that contain p.
+ */
+inline std::vector<TestInterval>
+bruteForceIntersectingOpen(const std::vector<TestInterval> &intervals,
+                           size_t start, size_t end) {
+  std::vector<TestInterval> res;
+  for (size_t i = 0; i < intervals.size(); ++i) {
+    size_t s = intervals[i].getStart(), e = intervals[i].getEnd();
+    if ((s < end) && (start < e)) res.push_back(intervals[i]);
+  }
+  return res;
+}
+
+#endif  // TESTINTERVALS_HPP_
@@ -0,0 +1,248 @@
+/**
+ * \file  testCompactIntervalTree.cpp
+ * \brief Unit tests for the compressed read-only interval tree class
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+// stl includes
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdlib>
+#include <stdint.h>
+
+// TinyTest includes
+#include "TinyTest.hpp"
+
+// local includes
+#include "IntervalTree.hpp"
+#include "FlatIntervalTree.hpp"
+#include "CompactIntervalTree.hpp"
+#include "TestIntervals.hpp"
+
+// bring the following into the local name-space
+using std::vector;
+using std::pair;
+
+/**
+ * \brief Test that a compact tree gives the same answers as the pointer
+ *        based tree it was frozen from, for point and interval queries and
+ *        with both closed and open-ended intervals, for sparse and dense
+ *        sets of intervals.
+ */
+TEST(testCompactMatchesPointerTree) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  typedef CompactIntervalTree<TestInterval, size_t> CTree;
+  const size_t spans[] = {10000, 1000000};
+  const bool modes[] = {false, ITree::OPEN_ENDED};
+  for (size_t d = 0; d < 2; ++d) {
+    vector<TestInterval> intervals = randomIntervals(2000, spans[d], 300,
+                                                     d + 1);
+    for (size_t m = 0; m < 2; ++m) {
+      ITree t(intervals, &getStartTest, &getEndTest, modes[m]);
+      CTree c(t);
+      EXPECT_EQUAL(c.size(), 2000);
+      for (size_t p = 0; p < spans[d] + 500; p += spans[d] / 271) {
+        vector<TestInterval> exp = t.intersectingPoint(p);
+        vector<TestInterval> got = c.intersectingPoint(p);
+        sort(exp.begin(), exp.end(), TestInterval::compare);
+        sort(got.begin(), got.end(), TestInterval::compare);
+        EXPECT_EQUAL_STL_CONTAINER(got, exp);
+
+        exp = bruteForceIntersecting(intervals, p, p + 150, modes[m]);
+        got = c.intersectingInterval(p, p + 150);
+        sort(exp.begin(), exp.end(), TestInterval::compare);
+        sort(got.begin(), got.end(), TestInterval::compare);
+        EXPECT_EQUAL_STL_CONTAINER(got, exp);
+      }
+    }
+  }
+}
+
+// signed 64 bit intervals, for coordinates that need every packed width
+typedef pair<int64_t, int64_t> WideInterval;
+static int64_t getStartWide(const WideInterval &i) { return i.first; }
+static int64_t getEndWide(const WideInterval &i) { return i.second; }
+
+/**
+ * \brief Test coordinates that are negative, or far apart, so that blocks
+ *        are packed 1, 2, 4 and 8 bytes wide, against the pointer based tree
+ *        and a brute force search.
+ */
+TEST(testCompactWideCoordinates) {
+  typedef CompactIntervalTree<WideInterval, int64_t> CTree;
+  srand(7);
+  const int64_t lengths[] = {40, 10000, 600000000, 1LL << 40};
+  const int64_t offsets[] = {-100, 0, 1LL << 40, -(1LL << 62)};
+  for (size_t w = 0; w < 4; ++w) {
+    vector<WideInterval> intervals;
+    vector<int64_t> probes;
+    for (size_t i = 0; i < 300; ++i) {
+      const int64_t len = lengths[w] / (1 + rand() % 4);
+      const int64_t s = offsets[w] +
+                        (rand() % 64 - 32) * (lengths[w] / 16 + 1);
+      intervals.push_back(WideInterval(s, s + len));
+      probes.push_back(s + len / 2);
+      probes.push_back(s + len);
+    }
+    for (int open = 0; open < 2; ++open) {
+      const CTree::Tree t(intervals, &getStartWide, &getEndWide, open);
+      CTree c(t);
+      for (size_t p = 0; p < probes.size(); ++p) {
+        vector<WideInterval> exp = t.intersectingPoint(probes[p]);
+        vector<WideInterval> got = c.intersectingPoint(probes[p]);
+        sort(got.begin(), got.end());
+        sort(exp.begin(), exp.end());
+        EXPECT_EQUAL_STL_CONTAINER(got, exp);
+
+        const int64_t q = probes[p] + lengths[w] / 3;
+        exp.clear();
+        got = c.intersectingInterval(probes[p], q);
+        for (size_t i = 0; i < intervals.size(); ++i) {
+          if (intervalIntersects(intervals[i].first, intervals[i].second,
+                                 probes[p], q, open))
+            exp.push_back(intervals[i]);
+        }
+        sort(got.begin(), got.end());
+        sort(exp.begin(), exp.end());
+        EXPECT_EQUAL_STL_CONTAINER(got, exp);
+      }
+    }
+    // the narrower the intervals, the fewer bytes their coordinates take
+    CTree c(intervals, &getStartWide, &getEndWide);
+    EXPECT_EQUAL(c.coordinateBytes() <
+                 2 * sizeof(int64_t) * intervals.size(), w < 3);
+  }
+}
+
+/**
+ * \brief Test that dense intervals take much less room for their
+ *        coordinates than in a flat tree, and that an empty tree, the
+ *        end-point semantics and lambda accessors, including assigning trees
+ *        that have them, behave as for the other trees.
+ */
+TEST(testCompactSizeAndSemantics) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(20000, 1000000, 200, 3);
+  ITree t(intervals, &getStartTest, &getEndTest);
+  CompactIntervalTree<TestInterval, size_t> c(t);
+  EXPECT_EQUAL(c.squash().size(), 20000);
+  EXPECT_EQUAL(c.coordinateBytes() * 3 <
+               3 * sizeof(size_t) * intervals.size(), true);
+
+  CompactIntervalTree<TestInterval, size_t> e;
+  EXPECT_EQUAL(e.size(), 0);
+  EXPECT_EQUAL(e.intersectingPoint(10).size(), 0);
+  EXPECT_EQUAL(e.intersectingInterval(10, 20).size(), 0);
+
+  CompactIntervalTree<TestInterval, size_t>
+    o(IntervalFactory::getTestCase(1), &getStartTest, &getEndTest,
+      ITree::OPEN_ENDED);
+  CompactIntervalTree<TestInterval, size_t>
+    cl(IntervalFactory::getTestCase(1), &getStartTest, &getEndTest);
+  vector<TestInterval> expectedAns;
+  EXPECT_EQUAL_STL_CONTAINER(o.intersectingPoint(75), expectedAns);
+  expectedAns.push_back(TestInterval(40, 75));
+  EXPECT_EQUAL_STL_CONTAINER(cl.intersectingPoint(75), expectedAns);
+
+  auto gs = [](const TestInterval &i) { return i.getStart(); };
+  auto ge = [](const TestInterval &i) { return i.getEnd(); };
+  typedef CompactIntervalTree<TestInterval, size_t, decltype(gs),
+                              decltype(ge)> LTree;
+  LTree l(IntervalFactory::getTestCase(1), gs, ge);
+  LTree lt(LTree::Tree(IntervalFactory::getTestCase(1), gs, ge));
+  EXPECT_EQUAL_STL_CONTAINER(l.intersectingPoint(75), expectedAns);
+  EXPECT_EQUAL_STL_CONTAINER(lt.intersectingPoint(75), expectedAns);
+  LTree assigned;
+  assigned = l;
+  EXPECT_EQUAL_STL_CONTAINER(assigned.intersectingPoint(75), expectedAns);
+  assigned = std::move(lt);
+  EXPECT_EQUAL_STL_CONTAINER(assigned.intersectingPoint(75), expectedAns);
+}
+
+/**
+ * \brief Test that a compact tree built with open (s, e) endpoints answers
+ *        point and interval queries as a brute force search with that
+ *        convention, including points on node mids and on interval ends.
+ */
+TEST(testCompactOpenEndpoints) {
+  typedef CompactIntervalTree<TestInterval, size_t> CTree;
+  vector<TestInterval> intervals = randomIntervals(1000, 600, 30, 5);
+  intervals.push_back(TestInterval(300, 300));
+  CTree c(intervals, &getStartTest, &getEndTest, INTERVAL_OPEN);
+  EXPECT_EQUAL(c.endpointConvention(), INTERVAL_OPEN);
+  for (size_t p = 0; p < 650; ++p) {
+    vector<TestInterval> exp = bruteForceIntersectingOpen(intervals, p, p);
+    vector<TestInterval> got = c.intersectingPoint(p);
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    sort(got.begin(), got.end(), TestInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(got, exp);
+
+    exp = bruteForceIntersectingOpen(intervals, p, p + 9);
+    got = c.intersectingInterval(p, p + 9);
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    sort(got.begin(), got.end(), TestInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(got, exp);
+  }
+}
+
+/**
+ * \brief Test nodes that span several blocks, and need two bytes for their
+ *        order by end: many intervals sharing one point, queried on both
+ *        sides of it and on it, by each endpoint convention, against a brute
+ *        force search.
+ */
+TEST(testCompactLargeNodes) {
+  typedef CompactIntervalTree<TestInterval, size_t> CTree;
+  srand(11);
+  vector<TestInterval> intervals;
+  for (size_t i = 0; i < 700; ++i)
+    intervals.push_back(TestInterval(500 - rand() % 300, 500 + rand() % 300));
+  vector<TestInterval> small = randomIntervals(300, 1000, 20, 12);
+  intervals.insert(intervals.end(), small.begin(), small.end());
+  const IntervalEndpointConvention conventions[] = {INTERVAL_CLOSED,
+                                                    INTERVAL_HALF_OPEN,
+                                                    INTERVAL_OPEN};
+  for (size_t c = 0; c < 3; ++c) {
+    CTree t(intervals, &getStartTest, &getEndTest, conventions[c]);
+    for (size_t p = 150; p < 850; ++p) {
+      vector<TestInterval> exp = (conventions[c] == INTERVAL_OPEN) ?
+        bruteForceIntersectingOpen(intervals, p, p) :
+        bruteForceIntersecting(intervals, p, p,
+                               conventions[c] == INTERVAL_HALF_OPEN);
+      vector<TestInterval> got = t.intersectingPoint(p);
+      sort(exp.begin(), exp.end(), TestInterval::compare);
+      sort(got.begin(), got.end(), TestInterval::compare);
+      EXPECT_EQUAL_STL_CONTAINER(got, exp);
+
+      exp = (conventions[c] == INTERVAL_OPEN) ?
+        bruteForceIntersectingOpen(intervals, p, p + 3) :
+        bruteForceIntersecting(intervals, p, p + 3,
+                               conventions[c] == INTERVAL_HALF_OPEN);
+      got = t.intersectingInterval(p, p + 3);
+      sort(exp.begin(), exp.end(), TestInterval::compare);
+      sort(got.begin(), got.end(), TestInterval::compare);
+      EXPECT_EQUAL_STL_CONTAINER(got, exp);
+    }
+  }
+}
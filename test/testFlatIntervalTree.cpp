@@ -0,0 +1,193 @@
+/**
+ * \file  testFlatIntervalTree.cpp
+ * \brief Unit tests for the flattened (frozen) interval tree class
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+// stl includes
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+// TinyTest includes
+#include "TinyTest.hpp"
+
+// local includes
+#include "IntervalTree.hpp"
+#include "FlatIntervalTree.hpp"
+#include "IntervalTreeSimd.hpp"
+#include "TestIntervals.hpp"
+
+// bring the following into the local name-space
+using std::vector;
+
+/**
+ * \brief Test that a flattened tree gives the same answers as the pointer
+ *        based tree it was frozen from, for point and interval queries and
+ *        with closed, open-ended and open intervals; the open ones also from
+ *        a tree with the static open endpoint policy.
+ */
+TEST(testFlatMatchesPointerTree) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  typedef IntervalTree<TestInterval, size_t, size_t (*)(const TestInterval&),
+                       size_t (*)(const TestInterval&), IntervalTreeNoStats,
+                       IntervalOpenEndpoints> OTree;
+  typedef FlatIntervalTree<TestInterval, size_t> FTree;
+  vector<TestInterval> intervals = randomIntervals(500, 10000, 300, 1);
+  const IntervalEndpointConvention modes[] = {INTERVAL_CLOSED,
+                                              INTERVAL_HALF_OPEN,
+                                              INTERVAL_OPEN};
+  for (size_t m = 0; m < 4; ++m) {
+    const IntervalEndpointConvention mode = modes[std::min<size_t>(m, 2)];
+    ITree t(intervals, &getStartTest, &getEndTest, mode);
+    FTree f = (m < 3) ? FTree(t)
+                      : FTree(OTree(intervals, &getStartTest, &getEndTest));
+    EXPECT_EQUAL(f.size(), 500);
+    EXPECT_EQUAL(f.endpointConvention(), mode);
+    for (size_t p = 0; p < 10500; p += 37) {
+      vector<TestInterval> exp = t.intersectingPoint(p);
+      vector<TestInterval> got = f.intersectingPoint(p);
+      sort(exp.begin(), exp.end(), TestInterval::compare);
+      sort(got.begin(), got.end(), TestInterval::compare);
+      EXPECT_EQUAL_STL_CONTAINER(got, exp);
+
+      exp = (mode == INTERVAL_OPEN) ?
+        bruteForceIntersectingOpen(intervals, p, p + 150) :
+        bruteForceIntersecting(intervals, p, p + 150,
+                               mode == INTERVAL_HALF_OPEN);
+      got = f.intersectingInterval(p, p + 150);
+      sort(exp.begin(), exp.end(), TestInterval::compare);
+      sort(got.begin(), got.end(), TestInterval::compare);
+      EXPECT_EQUAL_STL_CONTAINER(got, exp);
+    }
+  }
+}
+
+/**
+ * \brief Test building a flat tree directly from a vector of intervals, and
+ *        that the end-point semantics follow the open-ended flag; and that
+ *        flat trees can be made with lambda accessors, built directly or
+ *        from a pointer-based tree, and assigned.
+ */
+TEST(testFlatDirectConstruction) {
+  typedef FlatIntervalTree<TestInterval, size_t> FTree;
+  FTree f(IntervalFactory::getTestCase(1), &getStartTest, &getEndTest);
+  vector<TestInterval> expectedAns;
+  expectedAns.push_back(TestInterval(40, 75));
+  EXPECT_EQUAL_STL_CONTAINER(f.intersectingPoint(75), expectedAns);
+  EXPECT_EQUAL(f.squash().size(), 6);
+
+  FTree o(IntervalFactory::getTestCase(1), &getStartTest, &getEndTest,
+          FTree::OPEN_ENDED);
+  EXPECT_EQUAL(o.intersectingPoint(75).size(), 0);
+
+  auto gs = [](const TestInterval &i) { return i.getStart(); };
+  auto ge = [](const TestInterval &i) { return i.getEnd(); };
+  typedef FlatIntervalTree<TestInterval, size_t, decltype(gs),
+                           decltype(ge)> LTree;
+  LTree l(IntervalFactory::getTestCase(1), gs, ge);
+  LTree lt(LTree::Tree(IntervalFactory::getTestCase(1), gs, ge));
+  EXPECT_EQUAL_STL_CONTAINER(l.intersectingPoint(75), expectedAns);
+  EXPECT_EQUAL_STL_CONTAINER(lt.intersectingPoint(75), expectedAns);
+  LTree assigned;
+  assigned = l;
+  EXPECT_EQUAL_STL_CONTAINER(assigned.intersectingPoint(75), expectedAns);
+  assigned = std::move(lt);
+  EXPECT_EQUAL_STL_CONTAINER(assigned.intersectingPoint(75), expectedAns);
+}
+
+/**
+ * \brief Test that a default constructed (empty) flat tree can be queried
+ */
+TEST(testFlatEmpty) {
+  FlatIntervalTree<TestInterval, size_t> f;
+  EXPECT_EQUAL(f.size(), 0);
+  EXPECT_EQUAL(f.intersectingPoint(10).size(), 0);
+  EXPECT_EQUAL(f.intersectingInterval(10, 20).size(), 0);
+}
+
+/**
+ * \brief run the node scan kernels for every instruction set up to the best
+ *        one this machine has on random columns of coordinates of type <R>
+ *        (starting at <base>), by each endpoint convention, and compare
+ *        them with the scalar kernels
+ * \return the number of disagreements
+ */
+template <class R>
+static size_t simdMismatches(const unsigned seed, const R base) {
+  srand(seed);
+  size_t bad = 0;
+  for (size_t trial = 0; trial < 200; ++trial) {
+    const size_t n = rand() % 70;
+    vector<R> s(n), e(n);
+    for (size_t i = 0; i < n; ++i) {
+      s[i] = base + static_cast<R>(rand() % 50);
+      e[i] = s[i] + static_cast<R>(rand() % 10);
+    }
+    vector<R> sorted(s);
+    sort(sorted.begin(), sorted.end());
+    for (size_t q = 0; q < 20; ++q) {
+      const R a = base + static_cast<R>(rand() % 60);
+      const R b = a + static_cast<R>(q % 3 == 0 ? 0 : rand() % 12);
+      for (int c = INTERVAL_CLOSED; c <= INTERVAL_OPEN; ++c) {
+        const IntervalEndpointConvention conv =
+          static_cast<IntervalEndpointConvention>(c);
+        const bool open = (conv != INTERVAL_CLOSED);
+        vector<uint32_t> expHits(n), hits(n);
+        const size_t expCount = simdIntersecting(s.data(), e.data(), n, a, b,
+                                                 conv, expHits.data(),
+                                                 INTERVAL_SIMD_SCALAR);
+        for (int l = INTERVAL_SIMD_NEON; l <= intervalSimdLevel(); ++l) {
+          const IntervalSimdLevel level = static_cast<IntervalSimdLevel>(l);
+          const size_t count = simdIntersecting(s.data(), e.data(), n, a, b,
+                                                conv, hits.data(), level);
+          if ((count != expCount) ||
+              !std::equal(hits.begin(), hits.begin() + count,
+                          expHits.begin()))
+            ++bad;
+          if (simdCountLeading(sorted.data(), n, a, open, level) !=
+              simdCountLeading(sorted.data(), n, a, open,
+                               INTERVAL_SIMD_SCALAR))
+            ++bad;
+        }
+      }
+    }
+  }
+  return bad;
+}
+
+/**
+ * \brief Test that the vectorised node scans agree with the scalar ones for
+ *        every coordinate type they handle, including negative values and
+ *        unsigned values with their top bit set.
+ */
+TEST(testSimdKernels) {
+  EXPECT_EQUAL(simdMismatches<int32_t>(1, -25), 0);
+  EXPECT_EQUAL(simdMismatches<uint32_t>(2, 0x7FFFFFE0u), 0);
+  EXPECT_EQUAL(simdMismatches<int64_t>(3, -25), 0);
+  EXPECT_EQUAL(simdMismatches<uint64_t>(4, 0x7FFFFFFFFFFFFFE0ull), 0);
+  EXPECT_EQUAL(simdMismatches<float>(5, -25.0f), 0);
+  EXPECT_EQUAL(simdMismatches<double>(6, -25.0), 0);
+  EXPECT_EQUAL(simdMismatches<short>(7, -25), 0);
+}
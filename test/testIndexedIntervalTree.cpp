@@ -0,0 +1,185 @@
+/**
+ * \file  testIndexedIntervalTree.cpp
+ * \brief Unit tests for the index-based interval tree class
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+// stl includes
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+// TinyTest includes
+#include "TinyTest.hpp"
+
+// local includes
+#include "IndexedIntervalTree.hpp"
+#include "TestIntervals.hpp"
+
+// bring the following into the local name-space
+using std::vector;
+
+/**
+ * \brief dereference the pointers returned by an IndexedIntervalTree query
+ *        and sort the result, so it can be compared with an expected answer.
+ */
+static vector<TestInterval> deref(const vector<const TestInterval*> &ptrs) {
+  vector<TestInterval> res;
+  for (size_t i = 0; i < ptrs.size(); ++i) res.push_back(*(ptrs[i]));
+  sort(res.begin(), res.end(), TestInterval::compare);
+  return res;
+}
+
+/**
+ * \brief Test that a tree over the caller's records answers point and
+ *        interval queries correctly, including points on node mids, and that
+ *        results point into the caller's vector rather than at copies.
+ */
+TEST(testIndexedViewOfRecords) {
+  typedef IndexedIntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(500, 10000, 300, 2);
+  const bool modes[] = {false, ITree::OPEN_ENDED};
+  for (size_t m = 0; m < 2; ++m) {
+    ITree t(&intervals, &getStartTest, &getEndTest, modes[m]);
+    EXPECT_EQUAL(t.size(), 500);
+    EXPECT_EQUAL(&(t.records()), &intervals);
+    for (size_t p = 0; p < 10500; p += 37) {
+      vector<TestInterval> exp = bruteForceIntersecting(intervals, p, p + 150,
+                                                        modes[m]);
+      sort(exp.begin(), exp.end(), TestInterval::compare);
+      vector<const TestInterval*> got = t.intersectingInterval(p, p + 150);
+      EXPECT_EQUAL_STL_CONTAINER(deref(got), exp);
+      for (size_t i = 0; i < got.size(); ++i) {
+        EXPECT_EQUAL(got[i] >= &intervals.front(), true);
+        EXPECT_EQUAL(got[i] <= &intervals.back(), true);
+      }
+    }
+
+    // densely packed intervals, so that points land on node mids
+    vector<TestInterval> dense = randomIntervals(400, 300, 20, 3);
+    ITree d(&dense, &getStartTest, &getEndTest, modes[m]);
+    for (size_t p = 0; p < 330; ++p) {
+      vector<TestInterval> exp = bruteForceIntersecting(dense, p, p,
+                                                        modes[m]);
+      sort(exp.begin(), exp.end(), TestInterval::compare);
+      EXPECT_EQUAL_STL_CONTAINER(deref(d.intersectingPoint(p)), exp);
+    }
+  }
+
+  vector<TestInterval> expectedAns;
+  expectedAns.push_back(TestInterval(40, 75));
+  const vector<TestInterval> &tc = IntervalFactory::getTestCase(1);
+  ITree c(&tc, &getStartTest, &getEndTest);
+  EXPECT_EQUAL_STL_CONTAINER(deref(c.intersectingPoint(75)), expectedAns);
+  ITree o(&tc, &getStartTest, &getEndTest, ITree::OPEN_ENDED);
+  EXPECT_EQUAL(o.intersectingPoint(75).size(), 0);
+}
+
+/**
+ * \brief Test that a tree can take ownership of its records, and that
+ *        copies and moves of such a tree keep pointing at valid records.
+ */
+TEST(testIndexedOwnedRecords) {
+  typedef IndexedIntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = IntervalFactory::getTestCase(2);
+  ITree t(std::move(intervals), &getStartTest, &getEndTest);
+  EXPECT_EQUAL(t.size(), 4);
+  EXPECT_EQUAL(t.records().size(), 4);
+
+  vector<TestInterval> expectedAns;
+  expectedAns.push_back(TestInterval(10, 20));
+  expectedAns.push_back(TestInterval(11, 23));
+  expectedAns.push_back(TestInterval(15, 20));
+  EXPECT_EQUAL_STL_CONTAINER(deref(t.intersectingPoint(17)), expectedAns);
+
+  ITree copy(t);
+  EXPECT_EQUAL(&(copy.records()) != &(t.records()), true);
+  ITree moved(std::move(copy));
+  EXPECT_EQUAL_STL_CONTAINER(deref(moved.intersectingPoint(17)), expectedAns);
+  ITree assigned;
+  assigned = moved;
+  EXPECT_EQUAL_STL_CONTAINER(deref(assigned.intersectingInterval(16, 17)),
+                             expectedAns);
+}
+
+/**
+ * \brief Test that a tree with functor or lambda accessors indexes the same
+ *        records as one with function pointers, and can be moved, assigned
+ *        and swapped.
+ */
+TEST(testIndexedFunctorAccessors) {
+  typedef IndexedIntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(500, 10000, 300, 6);
+  auto gs = [](const TestInterval &i) { return i.getStart(); };
+  auto ge = [](const TestInterval &i) { return i.getEnd(); };
+  typedef IndexedIntervalTree<TestInterval, size_t, decltype(gs),
+                              decltype(ge)> LTree;
+  typedef IndexedIntervalTree<TestInterval, size_t,
+                              IntervalStartMember<TestInterval, size_t>,
+                              IntervalEndMember<TestInterval, size_t> > MTree;
+  ITree ptrs(&intervals, &getStartTest, &getEndTest);
+  LTree lambdas(&intervals, gs, ge);
+  MTree members(&intervals, IntervalStartMember<TestInterval, size_t>(),
+                IntervalEndMember<TestInterval, size_t>());
+  LTree moved(std::move(lambdas));
+  EXPECT_EQUAL(lambdas.size(), 0);
+  EXPECT_EQUAL(moved.toString(), ptrs.toString());
+  lambdas = moved;
+  EXPECT_EQUAL(lambdas.toString(), ptrs.toString());
+  lambdas.swap(moved);
+  EXPECT_EQUAL(moved.toString(), ptrs.toString());
+  for (size_t p = 0; p < 10500; p += 37) {
+    EXPECT_EQUAL_STL_CONTAINER(moved.intersectingInterval(p, p + 150),
+                               ptrs.intersectingInterval(p, p + 150));
+    EXPECT_EQUAL_STL_CONTAINER(members.intersectingPoint(p),
+                               ptrs.intersectingPoint(p));
+  }
+}
+
+/**
+ * \brief Test that a tree built with open (s, e) endpoints answers point and
+ *        interval queries as a brute force search with that convention,
+ *        including points on node mids and on the ends of intervals.
+ */
+TEST(testIndexedOpenEndpoints) {
+  typedef IndexedIntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(400, 300, 20, 4);
+  intervals.push_back(TestInterval(150, 150));
+  ITree t(&intervals, &getStartTest, &getEndTest, INTERVAL_OPEN);
+  EXPECT_EQUAL(t.endpointConvention(), INTERVAL_OPEN);
+  for (size_t p = 0; p < 330; ++p) {
+    vector<TestInterval> exp = bruteForceIntersectingOpen(intervals, p, p);
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(deref(t.intersectingPoint(p)), exp);
+
+    exp = bruteForceIntersectingOpen(intervals, p, p + 7);
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(deref(t.intersectingInterval(p, p + 7)), exp);
+  }
+
+  const vector<TestInterval> &tc = IntervalFactory::getTestCase(1);
+  ITree o(&tc, &getStartTest, &getEndTest, INTERVAL_OPEN);
+  EXPECT_EQUAL(o.intersectingPoint(40).size(), 0);
+  EXPECT_EQUAL(o.intersectingPoint(75).size(), 0);
+}
@@ -0,0 +1,151 @@
+/**
+ * \file  testIntervalCoverage.cpp
+ * \brief Unit tests for IntervalCoverage
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+// stl includes
+#include <vector>
+
+// TinyTest includes
+#include "TinyTest.hpp"
+
+// local includes
+#include "IntervalTree.hpp"
+#include "IntervalCoverage.hpp"
+#include "TestIntervals.hpp"
+
+// bring the following into the local name-space
+using std::vector;
+
+typedef IntervalTree<TestInterval, size_t> ITree;
+typedef IntervalCoverageSegment<size_t> Segment;
+
+/**
+ * \brief Test that the depth at every point, the total depth over ranges and
+ *        the depth profile match what checking every interval gives, for
+ *        closed, open ended and open intervals, built from a tree or a
+ *        vector.
+ */
+TEST(testCoverageMatchesBruteForce) {
+  vector<TestInterval> intervals = randomIntervals(800, 3000, 60, 51);
+  intervals.push_back(TestInterval(100, 100));
+  intervals.push_back(TestInterval(200, 2600));
+  intervals.push_back(TestInterval(700, 700));
+  const IntervalEndpointConvention modes[] = {INTERVAL_CLOSED,
+                                              INTERVAL_HALF_OPEN,
+                                              INTERVAL_OPEN};
+  for (size_t m = 0; m < 3; ++m) {
+    const bool openStart = (modes[m] == INTERVAL_OPEN);
+    const bool openEnd = (modes[m] != INTERVAL_CLOSED);
+    ITree tree(intervals, &getStartTest, &getEndTest, modes[m]);
+    IntervalCoverage<size_t> cov(tree);
+    IntervalCoverage<size_t> fromVector(intervals.begin(), intervals.end(),
+                                        &getStartTest, &getEndTest, modes[m]);
+    EXPECT_EQUAL(cov.isOpenEnded(), openEnd);
+    EXPECT_EQUAL(cov.endpointConvention(), modes[m]);
+    EXPECT_EQUAL(cov.size(), fromVector.size());
+
+    vector<size_t> depth;
+    size_t deepest = 0;
+    for (size_t p = 0; p < 3200; ++p) {
+      depth.push_back(openStart ?
+                      bruteForceIntersectingOpen(intervals, p, p).size() :
+                      bruteForceIntersecting(intervals, p, p,
+                                             openEnd).size());
+      deepest = std::max(deepest, depth.back());
+      EXPECT_EQUAL(cov.depthAt(p), depth.back());
+      EXPECT_EQUAL(fromVector.depthAt(p), depth.back());
+    }
+    EXPECT_EQUAL(cov.maxDepth(), deepest);
+
+    for (size_t s = 0; s < 3100; s += 37) {
+      const size_t e = s + (s % 300);
+      const size_t first = openStart ? s + 1 : s;
+      const size_t last = openEnd ? e : e + 1;
+      size_t total = 0;
+      for (size_t p = first; p < last; ++p) total += depth[p];
+      EXPECT_EQUAL(cov.depthOver(s, e), total);
+
+      // the runs have to tile the range, and change depth from one to next
+      vector<Segment> runs = cov.profile(s, e);
+      EXPECT_EQUAL(runs.empty(), !(first < last));
+      size_t p = first;
+      for (size_t r = 0; r < runs.size(); ++r) {
+        EXPECT_EQUAL(openStart ? runs[r].start + 1 : runs[r].start, p);
+        if (r > 0) EXPECT_EQUAL(runs[r].depth != runs[r - 1].depth, true);
+        const size_t runEnd = openEnd ? runs[r].end : runs[r].end + 1;
+        for (; p < runEnd; ++p) EXPECT_EQUAL(runs[r].depth, depth[p]);
+      }
+      if (first < last) EXPECT_EQUAL(p, last);
+    }
+  }
+}
+
+/**
+ * \brief Test the coverage of a small hand-made set, of an empty one, and
+ *        that closed intervals with non-integer coordinates are refused.
+ */
+TEST(testCoverageSmallCases) {
+  vector<TestInterval> intervals;
+  intervals.push_back(TestInterval(10, 19));
+  intervals.push_back(TestInterval(15, 24));
+  intervals.push_back(TestInterval(25, 29));
+  IntervalCoverage<size_t> cov(ITree(intervals, &getStartTest, &getEndTest));
+  vector<Segment> exp;
+  exp.push_back(Segment(5, 9, 0));
+  exp.push_back(Segment(10, 14, 1));
+  exp.push_back(Segment(15, 19, 2));
+  exp.push_back(Segment(20, 29, 1));
+  exp.push_back(Segment(30, 40, 0));
+  EXPECT_EQUAL_STL_CONTAINER(cov.profile(5, 40), exp);
+  EXPECT_EQUAL(cov.depthOver(0, 100), 25);
+  EXPECT_EQUAL(cov.meanDepth(10, 19), 1.5);
+  EXPECT_EQUAL(cov.profile(12, 12).size(), 1);
+  EXPECT_EQUAL(cov.profile(12, 11).size(), 0);
+
+  IntervalCoverage<size_t> none;
+  EXPECT_EQUAL(none.depthAt(5), 0);
+  EXPECT_EQUAL(none.depthOver(0, 10), 0);
+  EXPECT_EQUAL(none.profile(0, 10).size(), 1);
+  EXPECT_EQUAL(IntervalCoverage<size_t>(ITree(&getStartTest, &getEndTest))
+               .maxDepth(), 0);
+
+  std::vector< std::pair<double, double> > reals;
+  reals.push_back(std::make_pair(0.5, 1.5));
+  double (*first)(const std::pair<double, double>&) =
+    [](const std::pair<double, double> &p) { return p.first; };
+  double (*second)(const std::pair<double, double>&) =
+    [](const std::pair<double, double> &p) { return p.second; };
+  IntervalCoverage<double> open(reals.begin(), reals.end(), first, second,
+                                true);
+  EXPECT_EQUAL(open.depthAt(1.0), 1);
+  EXPECT_EQUAL(open.depthOver(0, 10), 1.0);
+  bool thrown = false;
+  try {
+    IntervalCoverage<double> closed(reals.begin(), reals.end(), first, second);
+  } catch (const IntervalTreeError &e) {
+    thrown = true;
+  }
+  EXPECT_EQUAL(thrown, true);
+}
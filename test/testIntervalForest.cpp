@@ -0,0 +1,255 @@
+/**
+ * \file  testIntervalForest.cpp
+ * \brief Unit tests for IntervalForest and MappedIntervalForest
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+// stl includes
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// TinyTest includes
+#include "TinyTest.hpp"
+
+// local includes
+#include "IntervalTree.hpp"
+#include "IntervalForest.hpp"
+#include "TestIntervals.hpp"
+
+// bring the following into the local name-space
+using std::vector;
+using std::string;
+
+static const string TEST_FILE = "testIntervalForest.tmp";
+
+/**
+ * \brief An interval on a named chromosome; trivially copyable, so a forest
+ *        of them can be written to a file and mapped.
+ */
+struct ChromInterval {
+  ChromInterval(const char *c, size_t s, size_t e) : start(s), end(e) {
+    memset(this->chrom, 0, sizeof(this->chrom));
+    strncpy(this->chrom, c, sizeof(this->chrom) - 1);
+  }
+  bool operator==(const ChromInterval &o) const {
+    return (strcmp(this->chrom, o.chrom) == 0) && (this->start == o.start) &&
+           (this->end == o.end);
+  }
+  static bool compare(const ChromInterval &a, const ChromInterval &b) {
+    return (a.start < b.start) || ((a.start == b.start) && (a.end < b.end));
+  }
+  char chrom[8];
+  size_t start;
+  size_t end;
+};
+
+size_t getStartChrom(const ChromInterval &i) { return i.start; }
+size_t getEndChrom(const ChromInterval &i) { return i.end; }
+string getKeyChrom(const ChromInterval &i) { return i.chrom; }
+
+typedef IntervalForest<ChromInterval, size_t> Forest;
+
+/**
+ * \brief intervals on five chromosomes of quite different sizes
+ */
+static vector<ChromInterval> chromIntervals() {
+  const char *chroms[] = {"chr1", "chr2", "chrX", "chrM", "chr10"};
+  const size_t counts[] = {900, 400, 250, 3, 60};
+  vector<ChromInterval> res;
+  for (size_t c = 0; c < 5; ++c) {
+    vector<TestInterval> ivs = randomIntervals(counts[c], 2000, 80, 31 + c);
+    for (size_t i = 0; i < ivs.size(); ++i)
+      res.push_back(ChromInterval(chroms[c], ivs[i].getStart(),
+                                  ivs[i].getEnd()));
+  }
+  // interleave the chromosomes, as in an unsorted input file
+  for (size_t i = 0; i < res.size(); i += 7)
+    std::swap(res[i], res[res.size() - 1 - i]);
+  return res;
+}
+
+/**
+ * \brief the intervals on <chrom> that intersect [start, end], or if <open>
+ *        (start, end) with the intervals open too, by brute force
+ */
+static vector<ChromInterval> expected(const vector<ChromInterval> &all,
+                                      const string &chrom, size_t start,
+                                      size_t end, const bool open = false) {
+  vector<ChromInterval> res;
+  for (size_t i = 0; i < all.size(); ++i)
+    if ((chrom == all[i].chrom) &&
+        (open ? ((all[i].start < end) && (start < all[i].end))
+              : ((all[i].start <= end) && (all[i].end >= start))))
+      res.push_back(all[i]);
+  sort(res.begin(), res.end(), ChromInterval::compare);
+  return res;
+}
+
+/**
+ * \brief Test that a forest gives each key a dense id and answers queries by
+ *        key or by id exactly as a brute force scan of that key does, when
+ *        built with one thread or several and in an arena, with open (s, e)
+ *        intervals, and with lambda accessors.
+ */
+TEST(testForestQueries) {
+  const vector<ChromInterval> all = chromIntervals();
+  IntervalTreeArena arena;
+  const unsigned threads[] = {1, 4, 4};
+  for (size_t k = 0; k < 3; ++k) {
+    Forest f(all, &getKeyChrom, &getStartChrom, &getEndChrom, false,
+             threads[k], k == 2 ? &arena : NULL);
+    EXPECT_EQUAL(f.numKeys(), 5);
+    EXPECT_EQUAL(f.size(), static_cast<int>(all.size()));
+    EXPECT_EQUAL(f.key(f.id("chrM")), "chrM");
+    EXPECT_EQUAL(f.id("chr7"), Forest::NO_ID);
+    EXPECT_EQUAL(f.intersectingPoint("chr7", 10).size(), 0);
+    const char *chroms[] = {"chr1", "chr2", "chrX", "chrM", "chr10"};
+    for (size_t c = 0; c < 5; ++c) {
+      for (size_t s = 0; s < 2100; s += 41) {
+        vector<ChromInterval> got = f.intersectingInterval(chroms[c], s,
+                                                           s + 30);
+        sort(got.begin(), got.end(), ChromInterval::compare);
+        EXPECT_EQUAL_STL_CONTAINER(got, expected(all, chroms[c], s, s + 30));
+        got = f.intersectingPoint(f.id(chroms[c]), s);
+        sort(got.begin(), got.end(), ChromInterval::compare);
+        EXPECT_EQUAL_STL_CONTAINER(got, expected(all, chroms[c], s, s));
+      }
+    }
+  }
+  EXPECT_EQUAL(arena.bytesAllocated() > 0, true);
+
+  typedef size_t (*Accessor)(const ChromInterval&);
+  IntervalForest<ChromInterval, size_t, Accessor, Accessor,
+                 IntervalOpenEndpoints> open(all, &getKeyChrom,
+                                             &getStartChrom, &getEndChrom,
+                                             IntervalOpenEndpoints(), 4);
+  for (size_t s = 0; s < 2100; s += 7) {
+    vector<ChromInterval> got = open.intersectingInterval("chrX", s, s + 9);
+    sort(got.begin(), got.end(), ChromInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(got, expected(all, "chrX", s, s + 9, true));
+    got = open.intersectingPoint("chr1", s);
+    sort(got.begin(), got.end(), ChromInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(got, expected(all, "chr1", s, s, true));
+  }
+  // lambda accessors can't be default constructed or (before C++20)
+  // assigned, which building the forest mustn't need
+  auto gs = [](const ChromInterval &i) { return i.start; };
+  auto ge = [](const ChromInterval &i) { return i.end; };
+  IntervalForest<ChromInterval, size_t, decltype(gs), decltype(ge)>
+    lambdas(all, &getKeyChrom, gs, ge, false, 3);
+  EXPECT_EQUAL(lambdas.numKeys(), 5);
+  for (size_t s = 0; s < 2100; s += 41) {
+    vector<ChromInterval> got = lambdas.intersectingInterval("chr2", s,
+                                                             s + 30);
+    sort(got.begin(), got.end(), ChromInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(got, expected(all, "chr2", s, s + 30));
+  }
+}
+
+/**
+ * \brief Test that batch queries on a forest, serial and parallel, give
+ *        each query in order the hits its single query gives, including
+ *        queries with no tree.
+ */
+TEST(testForestBatchQueries) {
+  const vector<ChromInterval> all = chromIntervals();
+  Forest f(all, &getKeyChrom, &getStartChrom, &getEndChrom);
+  vector<Forest::Query> queries;
+  for (size_t i = 0; i < 600; ++i) {
+    const size_t id = (i % 11 == 10) ? Forest::NO_ID : (i * 7) % 5;
+    queries.push_back(Forest::Query(id, (i * 37) % 2000,
+                                    (i * 37) % 2000 + i % 50));
+  }
+  const IntervalTreeBatchResult<ChromInterval> results[] = {
+    f.intersectingIntervals(queries),
+    f.intersectingIntervalsParallel(queries, 3)};
+  const IntervalTreeBatchResult<ChromInterval> pointResults[] = {
+    f.intersectingPoints(queries), f.intersectingPointsParallel(queries, 3)};
+  for (size_t r = 0; r < 2; ++r) {
+    EXPECT_EQUAL(results[r].size(), queries.size());
+    EXPECT_EQUAL(pointResults[r].size(), queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+      const Forest::Query &q = queries[i];
+      vector<ChromInterval> exp = f.intersectingInterval(q.id, q.start,
+                                                         q.end);
+      vector<ChromInterval> got(
+        results[r].hits.begin() + results[r].offsets[i],
+        results[r].hits.begin() + results[r].offsets[i + 1]);
+      EXPECT_EQUAL_STL_CONTAINER(got, exp);
+      exp = f.intersectingPoint(q.id, q.start);
+      got = vector<ChromInterval>(
+        pointResults[r].hits.begin() + pointResults[r].offsets[i],
+        pointResults[r].hits.begin() + pointResults[r].offsets[i + 1]);
+      EXPECT_EQUAL_STL_CONTAINER(got, exp);
+    }
+  }
+}
+
+/**
+ * \brief Test writing a forest to a single file and querying it through
+ *        MappedIntervalForest, which must give the same ids and hits; and
+ *        that a file that isn't a forest is rejected.
+ */
+TEST(testMappedForest) {
+  typedef MappedIntervalForest<ChromInterval, size_t> Mapped;
+  const vector<ChromInterval> all = chromIntervals();
+  Forest f(all, &getKeyChrom, &getStartChrom, &getEndChrom);
+  f.write(TEST_FILE);
+  {
+    Mapped m(TEST_FILE, &getStartChrom, &getEndChrom);
+    Mapped moved(std::move(m));
+    EXPECT_EQUAL(moved.numKeys(), f.numKeys());
+    for (size_t id = 0; id < f.numKeys(); ++id) {
+      EXPECT_EQUAL(moved.id(f.key(id)), id);
+      for (size_t s = 0; s < 2100; s += 53) {
+        // the flattened trees may give the hits in a different order
+        vector<ChromInterval> got = moved.intersectingInterval(f.key(id), s,
+                                                               s + 20);
+        vector<ChromInterval> exp = f.intersectingInterval(id, s, s + 20);
+        sort(got.begin(), got.end(), ChromInterval::compare);
+        sort(exp.begin(), exp.end(), ChromInterval::compare);
+        EXPECT_EQUAL_STL_CONTAINER(got, exp);
+        got = moved.intersectingPoint(id, s);
+        exp = f.intersectingPoint(id, s);
+        sort(got.begin(), got.end(), ChromInterval::compare);
+        sort(exp.begin(), exp.end(), ChromInterval::compare);
+        EXPECT_EQUAL_STL_CONTAINER(got, exp);
+      }
+    }
+    EXPECT_EQUAL(moved.id("chr7"), Mapped::NO_ID);
+  }
+
+  MappedIntervalTree<ChromInterval, size_t>::write(
+    FlatIntervalTree<ChromInterval, size_t>(f.tree(0)), TEST_FILE);
+  bool exceptionHappened = false;
+  try {
+    Mapped m(TEST_FILE, &getStartChrom, &getEndChrom);
+  } catch (const IntervalTreeError &e) {
+    exceptionHappened = true;
+  }
+  EXPECT_EQUAL(exceptionHappened, true);
+  remove(TEST_FILE.c_str());
+}
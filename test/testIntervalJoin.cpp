@@ -0,0 +1,249 @@
+/**
+ * \file  testIntervalJoin.cpp
+ * \brief Unit tests for the interval joins
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+// stl includes
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+// TinyTest includes
+#include "TinyTest.hpp"
+
+// local includes
+#include "IntervalTree.hpp"
+#include "IntervalJoin.hpp"
+#include "TestIntervals.hpp"
+
+// bring the following into the local name-space
+using std::vector;
+using std::pair;
+using std::make_pair;
+
+typedef IntervalTree<TestInterval, size_t> ITree;
+typedef pair< pair<size_t, size_t>, pair<size_t, size_t> > JoinedPair;
+
+/**
+ * \brief A sink that keeps every pair it's given, as the coordinates of the
+ *        two intervals.
+ */
+struct PairCollector {
+  void operator()(const TestInterval &a, const TestInterval &b) {
+    this->pairs.push_back(make_pair(make_pair(a.getStart(), a.getEnd()),
+                                    make_pair(b.getStart(), b.getEnd())));
+  }
+  vector<JoinedPair> pairs;
+};
+
+/**
+ * \brief the pairs a join of <a> and <b> should give with the endpoint
+ *        convention <endpoints>, found by checking each interval of <a>
+ *        against all of <b>; sorted.
+ */
+static vector<JoinedPair>
+bruteForceJoin(const vector<TestInterval> &a, const vector<TestInterval> &b,
+               const IntervalRuntimeEndpoints endpoints) {
+  PairCollector res;
+  for (size_t i = 0; i < a.size(); ++i) {
+    const size_t s = a[i].getStart(), e = a[i].getEnd();
+    vector<TestInterval> hits =
+      endpoints.openStart() ? bruteForceIntersectingOpen(b, s, e)
+                            : bruteForceIntersecting(b, s, e,
+                                                     endpoints.openEnded());
+    for (size_t j = 0; j < hits.size(); ++j) res(a[i], hits[j]);
+  }
+  sort(res.pairs.begin(), res.pairs.end());
+  return res.pairs;
+}
+
+/**
+ * \brief all the pairs from the sinks returned by a parallel join, sorted.
+ */
+static vector<JoinedPair>
+mergeParts(const vector<PairCollector> &parts) {
+  vector<JoinedPair> res;
+  for (size_t i = 0; i < parts.size(); ++i)
+    res.insert(res.end(), parts[i].pairs.begin(), parts[i].pairs.end());
+  sort(res.begin(), res.end());
+  return res;
+}
+
+/**
+ * \brief two sets of random intervals, sorted by start; the second has a few
+ *        that are very long, so they stay open through much of the sweep.
+ */
+static pair< vector<TestInterval>, vector<TestInterval> >
+joinTestSets() {
+  vector<TestInterval> a = randomIntervals(1500, 10000, 40, 41);
+  vector<TestInterval> b = randomIntervals(1000, 10000, 80, 43);
+  b.push_back(TestInterval(0, 10100));
+  b.push_back(TestInterval(2500, 7000));
+  a.push_back(TestInterval(5000, 5000));
+  a.push_back(TestInterval(9000, 12000));
+  sort(a.begin(), a.end(), TestInterval::compare);
+  sort(b.begin(), b.end(), TestInterval::compare);
+  return make_pair(a, b);
+}
+
+/**
+ * \brief Test that joining two sorted ranges gives the same pairs as checking
+ *        every interval of one against every interval of the other, for
+ *        closed, open ended and open (s, e) intervals, and that unsorted
+ *        input and empty sets are handled.
+ */
+TEST(testJoinSortedRanges) {
+  pair< vector<TestInterval>, vector<TestInterval> > sets = joinTestSets();
+  const vector<TestInterval> &a = sets.first, &b = sets.second;
+  const bool modes[] = {false, ITree::OPEN_ENDED};
+  for (size_t m = 0; m < 2; ++m) {
+    PairCollector got = intervalJoin(a.begin(), a.end(), &getStartTest,
+                                     &getEndTest, b.begin(), b.end(),
+                                     &getStartTest, &getEndTest,
+                                     PairCollector(), modes[m]);
+    sort(got.pairs.begin(), got.pairs.end());
+    EXPECT_EQUAL(got.pairs.size() > a.size(), true);
+    EXPECT_EQUAL_STL_CONTAINER(got.pairs, bruteForceJoin(a, b, modes[m]));
+  }
+
+  // open (s, e) intervals, which no open-ended flag can ask for
+  PairCollector open = intervalJoin(a.begin(), a.end(), &getStartTest,
+                                    &getEndTest, b.begin(), b.end(),
+                                    &getStartTest, &getEndTest,
+                                    PairCollector(), INTERVAL_OPEN);
+  sort(open.pairs.begin(), open.pairs.end());
+  const vector<JoinedPair> exp = bruteForceJoin(a, b, INTERVAL_OPEN);
+  EXPECT_EQUAL_STL_CONTAINER(open.pairs, exp);
+  vector<PairCollector> parts =
+    intervalJoinParallel(a.begin(), a.end(), &getStartTest, &getEndTest,
+                         b.begin(), b.end(), &getStartTest, &getEndTest,
+                         PairCollector(), INTERVAL_OPEN, 3);
+  EXPECT_EQUAL_STL_CONTAINER(mergeParts(parts), exp);
+
+  vector<TestInterval> none;
+  PairCollector empty = intervalJoin(a.begin(), a.end(), &getStartTest,
+                                     &getEndTest, none.begin(), none.end(),
+                                     &getStartTest, &getEndTest,
+                                     PairCollector());
+  EXPECT_EQUAL(empty.pairs.size(), 0);
+
+  vector<TestInterval> unsorted(b);
+  std::swap(unsorted[10], unsorted[500]);
+  bool thrown = false;
+  try {
+    intervalJoin(a.begin(), a.end(), &getStartTest, &getEndTest,
+                 unsorted.begin(), unsorted.end(), &getStartTest,
+                 &getEndTest, PairCollector());
+  } catch (const IntervalTreeError &e) {
+    thrown = true;
+  }
+  EXPECT_EQUAL(thrown, true);
+}
+
+/**
+ * \brief Test that joining a range with a tree, and a tree with a tree,
+ *        gives the same pairs as joining the ranges they were built from,
+ *        for each endpoint convention, and that trees that disagree on their
+ *        convention can't be joined.
+ */
+TEST(testJoinTrees) {
+  pair< vector<TestInterval>, vector<TestInterval> > sets = joinTestSets();
+  const vector<TestInterval> &a = sets.first, &b = sets.second;
+  const IntervalEndpointConvention modes[] = {INTERVAL_CLOSED,
+                                              INTERVAL_HALF_OPEN,
+                                              INTERVAL_OPEN};
+  for (size_t m = 0; m < 3; ++m) {
+    const vector<JoinedPair> exp = bruteForceJoin(a, b, modes[m]);
+    ITree ta(a, &getStartTest, &getEndTest, modes[m]);
+    ITree tb(b, &getStartTest, &getEndTest, modes[m]);
+    PairCollector got = intervalJoin(a.begin(), a.end(), &getStartTest,
+                                     &getEndTest, tb, PairCollector());
+    sort(got.pairs.begin(), got.pairs.end());
+    EXPECT_EQUAL_STL_CONTAINER(got.pairs, exp);
+
+    PairCollector both = intervalJoin(ta, tb, PairCollector());
+    sort(both.pairs.begin(), both.pairs.end());
+    EXPECT_EQUAL_STL_CONTAINER(both.pairs, exp);
+  }
+
+  ITree closed(a, &getStartTest, &getEndTest);
+  ITree open(b, &getStartTest, &getEndTest, ITree::OPEN_ENDED);
+  bool thrown = false;
+  try {
+    intervalJoin(closed, open, PairCollector());
+  } catch (const IntervalTreeError &e) {
+    thrown = true;
+  }
+  EXPECT_EQUAL(thrown, true);
+  thrown = false;
+  try {
+    intervalJoin(ITree(a, &getStartTest, &getEndTest, INTERVAL_OPEN), open,
+                 PairCollector());
+  } catch (const IntervalTreeError &e) {
+    thrown = true;
+  }
+  EXPECT_EQUAL(thrown, true);
+  EXPECT_EQUAL(intervalJoin(closed, ITree(&getStartTest, &getEndTest),
+                            PairCollector()).pairs.size(), 0);
+}
+
+/**
+ * \brief Test that the parallel joins find all the same pairs as the serial
+ *        ones, each exactly once, however many blocks the coordinates are
+ *        cut into, including more blocks than intervals.
+ */
+TEST(testJoinParallel) {
+  pair< vector<TestInterval>, vector<TestInterval> > sets = joinTestSets();
+  const vector<TestInterval> &a = sets.first, &b = sets.second;
+  const unsigned threads[] = {1, 2, 3, 8};
+  const bool modes[] = {false, ITree::OPEN_ENDED};
+  for (size_t m = 0; m < 2; ++m) {
+    const vector<JoinedPair> exp = bruteForceJoin(a, b, modes[m]);
+    ITree ta(a, &getStartTest, &getEndTest, modes[m]);
+    ITree tb(b, &getStartTest, &getEndTest, modes[m]);
+    for (size_t t = 0; t < 4; ++t) {
+      vector<PairCollector> parts =
+        intervalJoinParallel(a.begin(), a.end(), &getStartTest, &getEndTest,
+                             b.begin(), b.end(), &getStartTest, &getEndTest,
+                             PairCollector(), modes[m], threads[t]);
+      EXPECT_EQUAL(parts.size(), threads[t]);
+      EXPECT_EQUAL_STL_CONTAINER(mergeParts(parts), exp);
+      EXPECT_EQUAL_STL_CONTAINER(
+          mergeParts(intervalJoinParallel(a.begin(), a.end(), &getStartTest,
+                                          &getEndTest, tb, PairCollector(),
+                                          threads[t])), exp);
+      EXPECT_EQUAL_STL_CONTAINER(
+          mergeParts(intervalJoinParallel(ta, tb, PairCollector(),
+                                          threads[t])), exp);
+    }
+  }
+
+  vector<TestInterval> few(a.begin(), a.begin() + 3);
+  vector<PairCollector> parts =
+    intervalJoinParallel(few.begin(), few.end(), &getStartTest, &getEndTest,
+                         b.begin(), b.end(), &getStartTest, &getEndTest,
+                         PairCollector(), false, 16);
+  EXPECT_EQUAL(parts.size(), 3);
+  EXPECT_EQUAL_STL_CONTAINER(mergeParts(parts), bruteForceJoin(few, b, false));
+}
@@ -30,12 +30,20 @@
 #include <iostream>
 #include <cassert>
 #include <unordered_map>
+#include <list>
+#include <iterator>
+#include <algorithm>
+#if __cplusplus >= 202002L
+#include <ranges>
+#endif
 
 // TinyTest includes
 #include "TinyTest.hpp"
 
 // local includes
 #include "IntervalTree.hpp"
+#include "IntervalTreeBuilder.hpp"
+#include "TestIntervals.hpp"
 
 // bring the following into the local name-space
 using std::cerr;
@@ -44,80 +52,6 @@ using std::string;
 using std::vector;
 using std::unordered_map;
 
-/**
- * \brief a test class for use in testing the interval tree class
- */
-class TestInterval {
- public:
-  TestInterval(size_t start, size_t end) {
-    this->start = start; this->end = end;
-  }
-  const size_t getStart() const {return this->start;}
-  const size_t getEnd() const {return this->end;}
-  bool operator==(const TestInterval other) const {
-    return ((this->start == other.start) && (this->end == other.end));
-  }
-  bool operator!=(const TestInterval other) const {
-    return ((this->start != other.start) || (this->end != other.end));
-  }
-  bool operator<(const TestInterval &o) const {
-    return this->start < o.start;
-  }
-  static bool compare(TestInterval i1, TestInterval i2) {
-    if (i1.getStart() == i2.getStart()) return i1.getEnd() < i2.getEnd();
-    return i1.getStart() < i2.getStart();
-  }
- private:
-  size_t start;
-  size_t end;
-};
-
-std::ostream& operator<<(std::ostream& os, const TestInterval& t) {
-  os << "[" << t.getStart() << "," << t.getEnd() << "]";
-  return os;
-}
-
-// functions for extracting start and end indices from TestInterval objects
-static size_t getStartTest(const TestInterval &i) { return i.getStart(); }
-static size_t getEndTest(const TestInterval &i) { return i.getEnd(); }
-
-/**
- * \brief a factory class for producing sets of intervals for testing the
- *        interval tree class.
- */
-class IntervalFactory {
- public:
-  static const vector<TestInterval>& getTestCase(size_t n) {
-    static IntervalFactory ifactory;
-    return ifactory.cases[n];
-  }
-
- private:
-  IntervalFactory() {
-    // test case 0 -- empty set
-    cases.push_back(vector<TestInterval>());
-
-    // test case 1 -- no overlapping intervals, intervals are in sorted order
-    //                final interval has same start and end.
-    cases.push_back(vector<TestInterval>());
-    cases.back().push_back(TestInterval(10, 20));
-    cases.back().push_back(TestInterval(40, 75));
-    cases.back().push_back(TestInterval(78, 85));
-    cases.back().push_back(TestInterval(89, 94));
-    cases.back().push_back(TestInterval(96, 97));
-    cases.back().push_back(TestInterval(99, 99));
-
-    // test case 2 -- some overlapping intervals, not in sorted order
-    cases.push_back(vector<TestInterval>());
-    cases.back().push_back(TestInterval(21, 28));
-    cases.back().push_back(TestInterval(10, 20));
-    cases.back().push_back(TestInterval(15, 20));
-    cases.back().push_back(TestInterval(11, 23));
-  }
-
-  vector< vector<TestInterval> > cases;
-};
-
 /**
  * \brief Test that attempted construction of an IntervalTree object with an
  *        empty set of intervals throws an IntervalTreeException
@@ -273,3 +207,1157 @@ TEST(testIntersectingPointEndSortOrder) {
   EXPECT_EQUAL(res.size(), 1);
   EXPECT_EQUAL(res[0], TestInterval(25, 60));
 }
+
+/**
+ * \brief functor used to test the visitor query interface; counts the
+ *        intervals it is called with and sums their lengths.
+ */
+class LengthSumVisitor {
+ public:
+  LengthSumVisitor() : count(0), total(0) {;}
+  void operator()(const TestInterval &i) {
+    this->count += 1;
+    this->total += i.getEnd() - i.getStart();
+  }
+  size_t count;
+  size_t total;
+};
+
+/**
+ * \brief Test the callback, output iterator and append-to-vector forms of
+ *        the point and interval queries against the vector-returning ones.
+ */
+TEST(testVisitorQueries) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(300, 5000, 200, 3);
+  ITree t(intervals, &getStartTest, &getEndTest);
+
+  vector<TestInterval> reused;
+  for (size_t p = 0; p < 5200; p += 53) {
+    vector<TestInterval> exp = t.intersectingInterval(p, p + 80);
+    size_t expTotal = 0;
+    for (size_t i = 0; i < exp.size(); ++i)
+      expTotal += exp[i].getEnd() - exp[i].getStart();
+
+    LengthSumVisitor v = t.visitIntersectingInterval(p, p + 80,
+                                                     LengthSumVisitor());
+    EXPECT_EQUAL(v.count, exp.size());
+    EXPECT_EQUAL(v.total, expTotal);
+
+    // appending to a reused vector leaves what was there already
+    reused.clear();
+    reused.push_back(TestInterval(0, 0));
+    t.intersectingInterval(p, p + 80, reused);
+    EXPECT_EQUAL(reused.size(), exp.size() + 1);
+    EXPECT_EQUAL_STL_CONTAINER(vector<TestInterval>(reused.begin() + 1,
+                                                    reused.end()), exp);
+
+    exp = t.intersectingPoint(p);
+    vector<TestInterval> got;
+    t.intersectingPoint(p, std::back_inserter(got));
+    EXPECT_EQUAL_STL_CONTAINER(got, exp);
+    size_t n = 0;
+    t.visitIntersectingPoint(p, [&n](const TestInterval &) { ++n; });
+    EXPECT_EQUAL(n, exp.size());
+  }
+}
+
+/**
+ * \brief Test that queries on an empty (default constructed) tree find
+ *        nothing rather than failing.
+ */
+TEST(testEmptyTreeQueries) {
+  IntervalTree<TestInterval, size_t> t;
+  EXPECT_EQUAL(t.intersectingPoint(10).size(), 0);
+  EXPECT_EQUAL(t.intersectingInterval(10, 20).size(), 0);
+  IntervalTree<TestInterval, size_t> o(true);
+  EXPECT_EQUAL(o.visitIntersectingInterval(10, 20, LengthSumVisitor()).count,
+               0);
+}
+
+/**
+ * \brief Test that the count and existence queries agree with the size of
+ *        the corresponding full queries, for closed and open-ended trees and
+ *        for empty queries (start == end). The intervals are short and packed
+ *        into a small range, so many query end-points land on node mids.
+ */
+TEST(testCountAndAnyQueries) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(400, 300, 20, 4);
+  const bool modes[] = {false, ITree::OPEN_ENDED};
+  for (size_t m = 0; m < 2; ++m) {
+    ITree t(intervals, &getStartTest, &getEndTest, modes[m]);
+    for (size_t s = 0; s < 330; ++s) {
+      size_t n = t.intersectingPoint(s).size();
+      EXPECT_EQUAL(t.countIntersectingPoint(s), n);
+      EXPECT_EQUAL(t.anyIntersecting(s), n > 0);
+      const size_t lens[] = {0, 1, 7};
+      for (size_t l = 0; l < 3; ++l) {
+        n = t.intersectingInterval(s, s + lens[l]).size();
+        EXPECT_EQUAL(t.countIntersectingInterval(s, s + lens[l]), n);
+        EXPECT_EQUAL(t.anyIntersecting(s, s + lens[l]), n > 0);
+      }
+    }
+  }
+
+  ITree t(IntervalFactory::getTestCase(1), &getStartTest, &getEndTest);
+  EXPECT_EQUAL(t.anyIntersecting(30), false);
+  EXPECT_EQUAL(t.anyIntersecting(21, 39), false);
+  EXPECT_EQUAL(t.countIntersectingInterval(0, 100), 6);
+  EXPECT_EQUAL(ITree().countIntersectingPoint(5), 0);
+}
+
+/**
+ * \brief Test interval and point queries against a brute-force scan on
+ *        densely packed intervals, so that queries start, end and lie on
+ *        node mids, with both closed and open-ended trees.
+ */
+TEST(testIntersectingIntervalBruteForce) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(400, 300, 20, 5);
+  const bool modes[] = {false, ITree::OPEN_ENDED};
+  for (size_t m = 0; m < 2; ++m) {
+    ITree t(intervals, &getStartTest, &getEndTest, modes[m]);
+    for (size_t s = 0; s < 330; ++s) {
+      const size_t lens[] = {0, 1, 7, 40};
+      for (size_t l = 0; l < 4; ++l) {
+        vector<TestInterval> exp = bruteForceIntersecting(intervals, s,
+                                                          s + lens[l],
+                                                          modes[m]);
+        vector<TestInterval> got = t.intersectingInterval(s, s + lens[l]);
+        sort(exp.begin(), exp.end(), TestInterval::compare);
+        sort(got.begin(), got.end(), TestInterval::compare);
+        EXPECT_EQUAL_STL_CONTAINER(got, exp);
+      }
+      // a point is the query [s, s], or [s, s) if open ended
+      vector<TestInterval> exp = bruteForceIntersecting(intervals, s, s,
+                                                        modes[m]);
+      vector<TestInterval> got = t.intersectingPoint(s);
+      sort(exp.begin(), exp.end(), TestInterval::compare);
+      sort(got.begin(), got.end(), TestInterval::compare);
+      EXPECT_EQUAL_STL_CONTAINER(got, exp);
+    }
+  }
+}
+
+/**
+ * \brief count the queries in a batch on <t> whose hits, in order, aren't
+ *        exactly what the single-query methods give.
+ */
+template <class Tree>
+static size_t
+batchMismatches(const Tree &t,
+                const vector< std::pair<size_t, size_t> > &queries,
+                const vector<size_t> &points) {
+  size_t bad = 0;
+  IntervalTreeBatchResult<TestInterval> r = t.intersectingIntervals(queries);
+  IntervalTreeBatchResult<TestInterval> p =
+    t.intersectingPoints(points.begin(), points.end());
+  if ((r.size() != queries.size()) || (p.size() != points.size())) ++bad;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    vector<TestInterval> got(r.hits.begin() + r.offsets[i],
+                             r.hits.begin() + r.offsets[i + 1]);
+    if (got != t.intersectingInterval(queries[i].first, queries[i].second))
+      ++bad;
+  }
+  for (size_t i = 0; i < points.size(); ++i) {
+    vector<TestInterval> got(p.hits.begin() + p.offsets[i],
+                             p.hits.begin() + p.offsets[i] + p.count(i));
+    if (got != t.intersectingPoint(points[i])) ++bad;
+  }
+  return bad;
+}
+
+/**
+ * \brief Test that batch queries give, for each query in the batch, exactly
+ *        what the single-query methods give, for sorted and unsorted batches
+ *        and every endpoint convention. Sorted batches carry state from one
+ *        query to the next, so they include runs of queries that share a
+ *        start but whose ends go down as well as up.
+ */
+TEST(testBatchQueries) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(400, 2000, 60, 6);
+  vector< std::pair<size_t, size_t> > queries;
+  vector<size_t> points;
+  for (size_t s = 0; s < 2100; s += 3) {
+    queries.push_back(std::make_pair(s, s + (s % 50)));
+    queries.push_back(std::make_pair(s, s + (s % 7)));
+    queries.push_back(std::make_pair(s, s + 40 - (s % 40)));
+    points.push_back(s);
+    points.push_back(s);
+    points.push_back(s + 1);
+  }
+  vector< std::pair<size_t, size_t> > mixed = queries;
+  vector<size_t> mixedPoints = points;
+  // and once more in an arbitrary order
+  for (size_t i = 0; i < 300; ++i) {
+    size_t s = (i * 7919) % 2100;
+    mixed.push_back(std::make_pair(s, s + (i % 13)));
+    mixedPoints.push_back(s);
+  }
+
+  const IntervalEndpointConvention modes[] = {
+    INTERVAL_CLOSED, INTERVAL_HALF_OPEN, INTERVAL_OPEN
+  };
+  for (size_t m = 0; m < 3; ++m) {
+    ITree t(intervals, &getStartTest, &getEndTest, modes[m]);
+    EXPECT_EQUAL(batchMismatches(t, queries, points), 0);
+    EXPECT_EQUAL(batchMismatches(t, mixed, mixedPoints), 0);
+  }
+
+  ITree empty;
+  EXPECT_EQUAL(empty.intersectingIntervals(queries).hits.size(), 0);
+  EXPECT_EQUAL(empty.intersectingIntervals(mixed).hits.size(), 0);
+  EXPECT_EQUAL(empty.intersectingPoints(vector<size_t>()).size(), 0);
+}
+
+/**
+ * \brief Test that parallel batch queries give exactly the same result as
+ *        the serial batch, whatever the number of threads.
+ */
+TEST(testParallelBatchQueries) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(1000, 5000, 80, 7);
+  ITree t(intervals, &getStartTest, &getEndTest);
+  vector< std::pair<size_t, size_t> > queries;
+  vector<size_t> points;
+  for (size_t s = 0; s < 5100; s += 2) {
+    queries.push_back(std::make_pair(s, s + (s % 30)));
+    points.push_back(s);
+  }
+
+  // the same again, with a tail out of order
+  vector< std::pair<size_t, size_t> > mixed(queries);
+  vector<size_t> mixedP(points);
+  for (size_t s = 0; s < 500; ++s) {
+    mixed.push_back(std::make_pair((s * 7919) % 5100, (s * 7919) % 5100 + 9));
+    mixedP.push_back((s * 7919) % 5100);
+  }
+
+  typedef IntervalTreeBatchResult<TestInterval> Result;
+  Result serial = t.intersectingIntervals(queries);
+  Result serialP = t.intersectingPoints(points);
+  Result serialM = t.intersectingIntervals(mixed);
+  Result serialMP = t.intersectingPoints(mixedP);
+  const unsigned threads[] = {0, 1, 3, 8};
+  for (size_t i = 0; i < 4; ++i) {
+    Result r = t.intersectingIntervalsParallel(queries, threads[i]);
+    EXPECT_EQUAL_STL_CONTAINER(r.offsets, serial.offsets);
+    EXPECT_EQUAL_STL_CONTAINER(r.hits, serial.hits);
+    r = t.intersectingPointsParallel(points, threads[i]);
+    EXPECT_EQUAL_STL_CONTAINER(r.offsets, serialP.offsets);
+    EXPECT_EQUAL_STL_CONTAINER(r.hits, serialP.hits);
+    r = t.intersectingIntervalsParallel(mixed, threads[i]);
+    EXPECT_EQUAL_STL_CONTAINER(r.offsets, serialM.offsets);
+    EXPECT_EQUAL_STL_CONTAINER(r.hits, serialM.hits);
+    r = t.intersectingPointsParallel(mixedP, threads[i]);
+    EXPECT_EQUAL_STL_CONTAINER(r.offsets, serialMP.offsets);
+    EXPECT_EQUAL_STL_CONTAINER(r.hits, serialMP.hits);
+  }
+  EXPECT_EQUAL(t.intersectingIntervalsParallel(
+                 vector< std::pair<size_t, size_t> >(), 4).size(), 0);
+}
+
+/**
+ * \brief Test that a tree large enough to be built in parallel has the same
+ *        shape, and gives the same answers, as one built in a single thread.
+ */
+TEST(testParallelBuild) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(100000, 1000000, 50, 8);
+  ITree serial(intervals, &getStartTest, &getEndTest, false, 1);
+  ITree parallel(intervals, &getStartTest, &getEndTest, false, 4);
+  EXPECT_EQUAL(parallel.size(), 100000);
+  EXPECT_EQUAL(parallel.toString() == serial.toString(), true);
+  for (size_t s = 0; s < 1000000; s += 9973) {
+    vector<TestInterval> exp = bruteForceIntersecting(intervals, s, s + 500);
+    vector<TestInterval> got = parallel.intersectingInterval(s, s + 500);
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    sort(got.begin(), got.end(), TestInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(got, exp);
+  }
+}
+
+/**
+ * \brief Test that trees whose accessors are functors or lambdas, rather
+ *        than function pointers, are built and queried the same way.
+ */
+TEST(testFunctorAccessors) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  typedef IntervalTree<TestInterval, size_t,
+                       IntervalStartMember<TestInterval, size_t>,
+                       IntervalEndMember<TestInterval, size_t> > MTree;
+  vector<TestInterval> intervals = randomIntervals(2000, 50000, 400, 9);
+  const bool modes[] = {false, ITree::OPEN_ENDED};
+  for (size_t m = 0; m < 2; ++m) {
+    ITree ptrs(intervals, &getStartTest, &getEndTest, modes[m]);
+    MTree members(intervals, modes[m]);
+    MTree copy(members);
+    auto gs = [](const TestInterval &i) { return i.getStart(); };
+    auto ge = [](const TestInterval &i) { return i.getEnd(); };
+    IntervalTree<TestInterval, size_t, decltype(gs), decltype(ge)>
+      lambdas(intervals, gs, ge, modes[m]);
+    EXPECT_EQUAL(members.toString() == ptrs.toString(), true);
+    EXPECT_EQUAL(lambdas.toString() == ptrs.toString(), true);
+    for (size_t s = 0; s < 50500; s += 211) {
+      vector<TestInterval> exp = ptrs.intersectingInterval(s, s + 300);
+      EXPECT_EQUAL_STL_CONTAINER(copy.intersectingInterval(s, s + 300), exp);
+      EXPECT_EQUAL_STL_CONTAINER(lambdas.intersectingInterval(s, s + 300),
+                                 exp);
+      EXPECT_EQUAL_STL_CONTAINER(members.intersectingPoint(s),
+                                 ptrs.intersectingPoint(s));
+      EXPECT_EQUAL(lambdas.countIntersectingPoint(s),
+                   ptrs.countIntersectingPoint(s));
+    }
+  }
+}
+
+/**
+ * \brief Test that a tree built up by insertions, and then cut down again by
+ *        erasures, gives the same answers as a brute force search over the
+ *        intervals it should hold. Half of the intervals are inserted in
+ *        sorted order, which would make a long chain without rebuilding.
+ */
+TEST(testInsertErase) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(3000, 20000, 60, 10);
+  sort(intervals.begin(), intervals.begin() + 1500, TestInterval::compare);
+  const bool modes[] = {false, ITree::OPEN_ENDED};
+  for (size_t m = 0; m < 2; ++m) {
+    ITree t(&getStartTest, &getEndTest, modes[m]);
+    vector<TestInterval> held;
+    for (size_t i = 0; i < intervals.size(); ++i) {
+      t.insert(intervals[i]);
+      held.push_back(intervals[i]);
+      if (i % 500 != 499) continue;
+      EXPECT_EQUAL(t.size(), static_cast<int>(held.size()));
+      for (size_t s = 0; s < 20100; s += 97) {
+        vector<TestInterval> exp =
+          bruteForceIntersecting(held, s, s + (s % 40), modes[m]);
+        vector<TestInterval> got = t.intersectingInterval(s, s + (s % 40));
+        sort(exp.begin(), exp.end(), TestInterval::compare);
+        sort(got.begin(), got.end(), TestInterval::compare);
+        EXPECT_EQUAL_STL_CONTAINER(got, exp);
+      }
+    }
+
+    EXPECT_EQUAL(t.erase(TestInterval(30000, 30001)), false);
+    for (size_t i = 0; i < intervals.size(); i += 2) {
+      EXPECT_EQUAL(t.erase(intervals[i]), true);
+      held.erase(std::find(held.begin(), held.end(), intervals[i]));
+    }
+    EXPECT_EQUAL(t.size(), static_cast<int>(held.size()));
+    for (size_t s = 0; s < 20100; s += 89) {
+      vector<TestInterval> exp =
+        bruteForceIntersecting(held, s, s + (s % 40), modes[m]);
+      vector<TestInterval> got = t.intersectingInterval(s, s + (s % 40));
+      sort(exp.begin(), exp.end(), TestInterval::compare);
+      sort(got.begin(), got.end(), TestInterval::compare);
+      EXPECT_EQUAL_STL_CONTAINER(got, exp);
+    }
+
+    for (size_t i = 1; i < intervals.size(); i += 2)
+      EXPECT_EQUAL(t.erase(intervals[i]), true);
+    EXPECT_EQUAL(t.size(), 0);
+    EXPECT_EQUAL(t.intersectingInterval(0, 20100).size(), 0);
+    t.insert(TestInterval(5, 10));
+    EXPECT_EQUAL(t.intersectingPoint(7).size(), 1);
+  }
+}
+
+/**
+ * \brief Test that a tree built in an arena, serially or in parallel, has the
+ *        same shape and answers as one built on the heap, that it can still
+ *        be updated, and that a copy of it doesn't depend on the arena.
+ */
+TEST(testArenaBuild) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(80000, 800000, 50, 11);
+  ITree heap(intervals, &getStartTest, &getEndTest, false, 1);
+  IntervalTreeArena arena(1 << 16);
+  ITree *copy = NULL;
+  {
+    ITree serial(intervals, &getStartTest, &getEndTest, false, 1, &arena);
+    ITree parallel(intervals, &getStartTest, &getEndTest, false, 4, &arena);
+    EXPECT_EQUAL(arena.bytesAllocated() > 0, true);
+    EXPECT_EQUAL(serial.toString() == heap.toString(), true);
+    EXPECT_EQUAL(parallel.toString() == heap.toString(), true);
+    for (size_t i = 0; i < 2000; ++i) {
+      serial.insert(TestInterval(i * 400, i * 400 + 10));
+      EXPECT_EQUAL(serial.erase(intervals[i]), true);
+    }
+    copy = new ITree(serial);
+  }
+  arena.release();
+  EXPECT_EQUAL(arena.bytesAllocated(), 0);
+  EXPECT_EQUAL(copy->size(), 80000);
+  vector<TestInterval> held(intervals.begin() + 2000, intervals.end());
+  for (size_t i = 0; i < 2000; ++i)
+    held.push_back(TestInterval(i * 400, i * 400 + 10));
+  for (size_t s = 0; s < 800000; s += 7919) {
+    vector<TestInterval> exp = bruteForceIntersecting(held, s, s + 300);
+    vector<TestInterval> got = copy->intersectingInterval(s, s + 300);
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    sort(got.begin(), got.end(), TestInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(got, exp);
+  }
+  delete copy;
+}
+
+/**
+ * \brief Accessor that counts how many copies of it are alive, to check
+ *        that trees destroy their accessors
+ */
+static int liveCountedAccessors = 0;
+struct CountedStartAccessor {
+  CountedStartAccessor() { ++liveCountedAccessors; }
+  CountedStartAccessor(const CountedStartAccessor&) {
+    ++liveCountedAccessors;
+  }
+  ~CountedStartAccessor() { --liveCountedAccessors; }
+  size_t operator()(const TestInterval &i) const { return i.getStart(); }
+};
+
+/**
+ * \brief Test that a tree in an arena whose accessors have destructors
+ *        still destroys them, even though it frees nothing.
+ */
+TEST(testArenaDestroysAccessors) {
+  typedef IntervalTree<TestInterval, size_t, CountedStartAccessor,
+                       size_t (*)(const TestInterval&)> CTree;
+  vector<TestInterval> intervals = randomIntervals(5000, 50000, 50, 13);
+  IntervalTreeArena arena(1 << 16);
+  {
+    CTree t(intervals, CountedStartAccessor(), &getEndTest, false, 1,
+            &arena);
+    EXPECT_EQUAL(liveCountedAccessors > 1, true);
+  }
+  EXPECT_EQUAL(liveCountedAccessors, 0);
+  arena.release();
+}
+
+/**
+ * \brief Test that trees can be built from, and moved into, containers
+ *        without being copied, that a tree moved from is left empty, and
+ *        that trees with lambda accessors can be assigned and swapped.
+ */
+TEST(testMoveSemantics) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  static_assert(std::is_nothrow_move_constructible<ITree>::value &&
+                std::is_nothrow_move_assignable<ITree>::value,
+                "IntervalTree moves must not throw");
+  vector<TestInterval> intervals = randomIntervals(3000, 30000, 100, 12);
+  const ITree ref(intervals, &getStartTest, &getEndTest);
+
+  vector<TestInterval> work(intervals);
+  ITree built(std::move(work), &getStartTest, &getEndTest);
+  EXPECT_EQUAL(work.empty(), true);
+  EXPECT_EQUAL(built.toString() == ref.toString(), true);
+
+  ITree moved(std::move(built));
+  EXPECT_EQUAL(built.size(), 0);
+  EXPECT_EQUAL(built.intersectingInterval(0, 30100).size(), 0);
+  ITree assigned;
+  assigned = std::move(moved);
+  EXPECT_EQUAL(moved.size(), 0);
+  EXPECT_EQUAL(assigned.toString() == ref.toString(), true);
+
+  unordered_map<string, ITree> byChrom;
+  vector<ITree> trees;
+  for (size_t i = 0; i < 8; ++i) {
+    vector<TestInterval> part(intervals.begin() + i * 375,
+                              intervals.begin() + (i + 1) * 375);
+    trees.push_back(ITree(std::move(part), &getStartTest, &getEndTest));
+  }
+  byChrom.insert(std::make_pair(string("chr1"), std::move(assigned)));
+  EXPECT_EQUAL(byChrom["chr1"].toString() == ref.toString(), true);
+  size_t total = 0;
+  for (size_t i = 0; i < trees.size(); ++i)
+    total += trees[i].countIntersectingInterval(0, 30100);
+  EXPECT_EQUAL(total, intervals.size());
+
+  auto gs = [](const TestInterval &i) { return i.getStart(); };
+  auto ge = [](const TestInterval &i) { return i.getEnd(); };
+  typedef IntervalTree<TestInterval, size_t, decltype(gs), decltype(ge)>
+    LTree;
+  LTree lambdas(intervals, gs, ge);
+  LTree lambdasMoved(std::move(lambdas));
+  EXPECT_EQUAL(lambdasMoved.toString() == ref.toString(), true);
+
+  // lambdas can't be assigned before C++20, but trees holding them can
+  lambdas = lambdasMoved;
+  EXPECT_EQUAL(lambdas.toString() == ref.toString(), true);
+  lambdasMoved = std::move(lambdas);
+  EXPECT_EQUAL(lambdas.size(), 0);
+  lambdas.swap(lambdasMoved);
+  EXPECT_EQUAL(lambdas.toString() == ref.toString(), true);
+  vector<LTree> ltrees(3, lambdas);
+  ltrees.erase(ltrees.begin());
+  EXPECT_EQUAL(ltrees.back().toString() == ref.toString(), true);
+}
+
+/**
+ * \brief Test that a tree with lambda accessors can be changed by
+ *        insertions and erasures, which rebuild and swap subtrees, and
+ *        still gives what a brute force search does.
+ */
+TEST(testLambdaAccessorMutation) {
+  auto gs = [](const TestInterval &i) { return i.getStart(); };
+  auto ge = [](const TestInterval &i) { return i.getEnd(); };
+  typedef IntervalTree<TestInterval, size_t, decltype(gs), decltype(ge)>
+    LTree;
+  vector<TestInterval> intervals = randomIntervals(1000, 5000, 60, 14);
+  vector<TestInterval> held(intervals.begin(), intervals.begin() + 500);
+  LTree t(held, gs, ge);
+  for (size_t i = 500; i < 1000; ++i) {
+    t.insert(intervals[i]);
+    held.push_back(intervals[i]);
+  }
+  for (size_t i = 0; i < 300; ++i) EXPECT_EQUAL(t.erase(intervals[i]), true);
+  held.erase(held.begin(), held.begin() + 300);
+
+  // a copy kept in a vector can be changed too
+  vector<LTree> trees(2, t);
+  trees.erase(trees.begin());
+  trees[0].insert(TestInterval(6000, 6010));
+  held.push_back(TestInterval(6000, 6010));
+  for (size_t p = 0; p < 6100; p += 13) {
+    vector<TestInterval> exp = bruteForceIntersecting(held, p, p + 20);
+    vector<TestInterval> got = trees[0].intersectingInterval(p, p + 20);
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    sort(got.begin(), got.end(), TestInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(got, exp);
+  }
+}
+
+/**
+ * \brief Test queries around the edges of the tree's extent, which are
+ *        answered from the bounds stored for each subtree; those bounds
+ *        must follow the intervals in the tree as they're inserted and
+ *        erased.
+ */
+TEST(testSubtreeBounds) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(500, 10000, 30, 13);
+  intervals.push_back(TestInterval(20000, 20010));
+  ITree t(intervals, &getStartTest, &getEndTest);
+  EXPECT_EQUAL(t.countIntersectingInterval(10100, 19999), 0);
+  EXPECT_EQUAL(t.countIntersectingInterval(20010, 30000), 1);
+  EXPECT_EQUAL(t.anyIntersecting(20011, 30000), false);
+  EXPECT_EQUAL(t.erase(TestInterval(20000, 20010)), true);
+  EXPECT_EQUAL(t.anyIntersecting(20010), false);
+  t.insert(TestInterval(40000, 40005));
+  EXPECT_EQUAL(t.intersectingPoint(40005).size(), 1);
+
+  vector<size_t> points;
+  points.push_back(40003);
+  points.push_back(20005);
+  points.push_back(0);
+  IntervalTreeBatchResult<TestInterval> r = t.intersectingPoints(points);
+  EXPECT_EQUAL(r.count(0), 1);
+  EXPECT_EQUAL(r.count(1), 0);
+  EXPECT_EQUAL(r.count(2), t.countIntersectingPoint(0));
+}
+
+/**
+ * \brief Test the traversals on a tree that is one long chain. Each level's
+ *        median interval is long enough that every other one ends before
+ *        its mid, so the build puts them all in the left subtree and the
+ *        tree is as deep as it has intervals. Also test that the traversal
+ *        stack keeps its order when it spills past its inline entries.
+ */
+TEST(testDeepTreeTraversal) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  const size_t levels = 44;
+  vector<size_t> order;
+  for (size_t k = levels; k-- > 0;)
+    order.insert(order.begin() + (order.size() + 1) / 2, k);
+  vector<TestInterval> intervals;
+  for (size_t p = 0; p < levels; ++p) {
+    intervals.push_back(TestInterval(100 + p,
+                                     (size_t(1) << (52 - order[p])) + 64));
+  }
+  ITree t(intervals, &getStartTest, &getEndTest);
+  ITree copy(t);
+  EXPECT_EQUAL(copy.toString() == t.toString(), true);
+  vector<TestInterval> all = copy.squash();
+  sort(all.begin(), all.end(), TestInterval::compare);
+  sort(intervals.begin(), intervals.end(), TestInterval::compare);
+  EXPECT_EQUAL_STL_CONTAINER(all, intervals);
+
+  for (size_t b = 6; b < 53; ++b) {
+    const size_t s = (size_t(1) << b) + 64, e = s + (size_t(1) << (b - 2));
+    vector<TestInterval> exp = bruteForceIntersecting(intervals, s, e);
+    vector<TestInterval> got = copy.intersectingInterval(s, e);
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    sort(got.begin(), got.end(), TestInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(got, exp);
+    EXPECT_EQUAL(copy.countIntersectingPoint(s),
+                 bruteForceIntersecting(intervals, s, s).size());
+    EXPECT_EQUAL(copy.anyIntersecting(s, e), !exp.empty());
+  }
+
+  IntervalTreeStack<size_t, 4> stack;
+  for (size_t i = 0; i < 10; ++i) stack.push(i);
+  bool lifo = true;
+  for (size_t i = 10; i-- > 0;) lifo = lifo && (stack.pop() == i);
+  EXPECT_EQUAL(lifo && stack.empty(), true);
+}
+
+/**
+ * \brief Test the split strategies on inputs that the default split handles
+ *        badly: the chain from testDeepTreeTraversal, and a cluster of
+ *        short intervals mixed with deeply nested ones. The median splits
+ *        must bound the depth, as the report shows, and every strategy must
+ *        still answer queries correctly, including after inserts.
+ */
+TEST(testSplitStrategies) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  const size_t levels = 44;
+  vector<size_t> order;
+  for (size_t k = levels; k-- > 0;)
+    order.insert(order.begin() + (order.size() + 1) / 2, k);
+  vector<TestInterval> chain;
+  for (size_t p = 0; p < levels; ++p) {
+    chain.push_back(TestInterval(100 + p,
+                                 (size_t(1) << (52 - order[p])) + 64));
+  }
+  ITree byMiddle(chain, &getStartTest, &getEndTest);
+  ITree byMedian(chain, &getStartTest, &getEndTest, false, 0, NULL,
+                 INTERVAL_SPLIT_MEDIAN);
+  IntervalTreeReport r = byMiddle.report();
+  EXPECT_EQUAL(r.depth, levels);
+  EXPECT_EQUAL(r.intervals, levels);
+  r = byMedian.report();
+  EXPECT_EQUAL(r.depth <= 6, true);
+  EXPECT_EQUAL(r.imbalance <= 0.5, true);
+  EXPECT_EQUAL(r.intervals, levels);
+
+  vector<TestInterval> intervals = randomIntervals(3000, 300, 5, 17);
+  for (size_t i = 0; i < 3000; ++i)
+    intervals.push_back(TestInterval(1000 + i, 100000 - 7 * i));
+  const IntervalSplitStrategy splits[] = {INTERVAL_SPLIT_MIDDLE_INTERVAL,
+                                          INTERVAL_SPLIT_MEDIAN,
+                                          INTERVAL_SPLIT_SAMPLED_MEDIAN};
+  const size_t maxDepth[] = {intervals.size(), 13, 31};
+  for (size_t k = 0; k < 3; ++k) {
+    ITree t(intervals, &getStartTest, &getEndTest, false, 0, NULL,
+            splits[k]);
+    r = t.report();
+    EXPECT_EQUAL(r.depth <= maxDepth[k], true);
+    EXPECT_EQUAL(r.intervals, intervals.size());
+    EXPECT_EQUAL(r.nodes >= r.depth, true);
+    EXPECT_EQUAL(r.maxNodeSize >= 1, true);
+
+    vector<TestInterval> held(intervals);
+    for (size_t i = 0; i < 500; ++i) {
+      TestInterval iv(50000 + 3 * i, 50000 + 3 * i + 2);
+      t.insert(iv);
+      held.push_back(iv);
+    }
+    EXPECT_EQUAL(t.report().intervals, held.size());
+    for (size_t s = 0; s < 110000; s += 997) {
+      vector<TestInterval> exp = bruteForceIntersecting(held, s, s + 50);
+      vector<TestInterval> got = t.intersectingInterval(s, s + 50);
+      sort(exp.begin(), exp.end(), TestInterval::compare);
+      sort(got.begin(), got.end(), TestInterval::compare);
+      EXPECT_EQUAL_STL_CONTAINER(got, exp);
+    }
+  }
+  EXPECT_EQUAL(ITree().report().nodes, 0);
+}
+
+/**
+ * \brief Test building from start-sorted intervals with IntervalTreeBuilder:
+ *        one at a time and through a (non-random-access) iterator range, the
+ *        tree must answer queries as the constructor's would, stay balanced,
+ *        hold back only the intervals still overlapping the last ones added,
+ *        and intervals given out of order must be refused.
+ */
+TEST(testSortedBuilder) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  typedef IntervalTreeBuilder<TestInterval, size_t> Builder;
+  IntervalTreeArena arena;
+  vector<TestInterval> intervals;
+  for (size_t i = 0; i < 2000; ++i)
+    intervals.push_back(TestInterval(3 * i, 3 * i + (i * 7919) % 50));
+  intervals.push_back(TestInterval(5999, 9000));
+  std::list<TestInterval> sorted(intervals.begin(), intervals.end());
+
+  Builder b(&getStartTest, &getEndTest);
+  size_t mostWaiting = 0;
+  for (std::list<TestInterval>::const_iterator it = sorted.begin();
+       it != sorted.end(); ++it) {
+    b.add(*it);
+    mostWaiting = std::max(mostWaiting, b.waiting());
+  }
+  EXPECT_EQUAL(mostWaiting <= 40, true);
+  EXPECT_EQUAL(b.size(), intervals.size());
+  ITree t = b.build();
+  EXPECT_EQUAL(b.size(), 0);
+  EXPECT_EQUAL(static_cast<size_t>(t.size()), intervals.size());
+  EXPECT_EQUAL(t.report().depth <= 2 * ITree(intervals, &getStartTest,
+                                             &getEndTest).report().depth,
+               true);
+  for (size_t s = 0; s < 9100; s += 7) {
+    vector<TestInterval> exp = bruteForceIntersecting(intervals, s, s + 20);
+    vector<TestInterval> got = t.intersectingInterval(s, s + 20);
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    sort(got.begin(), got.end(), TestInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(got, exp);
+    EXPECT_EQUAL(t.countIntersectingPoint(s),
+                 bruteForceIntersecting(intervals, s, s).size());
+  }
+
+  // dense, nested and repeated intervals, on an open-ended tree in an arena
+  vector<TestInterval> dense = randomIntervals(3000, 400, 60, 17);
+  dense.push_back(TestInterval(0, 500));
+  dense.push_back(TestInterval(200, 200));
+  dense.push_back(TestInterval(200, 200));
+  sort(dense.begin(), dense.end(), TestInterval::compare);
+  Builder one(&getStartTest, &getEndTest, ITree::OPEN_ENDED, &arena,
+              INTERVAL_SPLIT_MEDIAN);
+  one.add(dense.begin(), dense.end());
+  t = one.build();
+  EXPECT_EQUAL(static_cast<size_t>(t.size()), dense.size());
+  for (size_t s = 0; s < 520; ++s) {
+    vector<TestInterval> exp = bruteForceIntersecting(dense, s, s + 9,
+                                                      ITree::OPEN_ENDED);
+    vector<TestInterval> got = t.intersectingInterval(s, s + 9);
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    sort(got.begin(), got.end(), TestInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(got, exp);
+    EXPECT_EQUAL(t.intersectingPoint(s).size(),
+                 bruteForceIntersecting(dense, s, s,
+                                        ITree::OPEN_ENDED).size());
+  }
+  t.insert(TestInterval(4, 9));
+  EXPECT_EQUAL(static_cast<size_t>(t.size()), dense.size() + 1);
+
+  t = one.build();
+  EXPECT_EQUAL(t.size(), 0);
+  t.insert(TestInterval(4, 9));
+  EXPECT_EQUAL(t.countIntersectingPoint(5), 1);
+
+  bool exceptionHappened = false;
+  one.add(TestInterval(10, 20));
+  try {
+    one.add(TestInterval(9, 30));
+  } catch (const IntervalTreeError &e) {
+    exceptionHappened = true;
+  }
+  EXPECT_EQUAL(exceptionHappened, true);
+  EXPECT_EQUAL(one.size(), 1);
+}
+
+/**
+ * \brief Test the lazy query ranges: they must give the same hits, in the
+ *        same order, as the eager queries, for points and intervals on both
+ *        closed and open-ended trees, and be usable with the standard
+ *        algorithms (and, from C++20, views) to stop early.
+ */
+TEST(testQueryRanges) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  typedef IntervalTreeQueryRange<TestInterval, size_t,
+                                 size_t (*)(const TestInterval&),
+                                 size_t (*)(const TestInterval&)> Range;
+  vector<TestInterval> intervals = randomIntervals(1000, 500, 40, 23);
+  const bool modes[] = {false, ITree::OPEN_ENDED};
+  for (size_t m = 0; m < 2; ++m) {
+    ITree t(intervals, &getStartTest, &getEndTest, modes[m]);
+    for (size_t s = 0; s < 560; s += 7) {
+      Range r = t.intersectingIntervalRange(s, s + 13);
+      vector<TestInterval> got(r.begin(), r.end());
+      EXPECT_EQUAL_STL_CONTAINER(got, t.intersectingInterval(s, s + 13));
+      vector<TestInterval> pts;
+      for (const TestInterval &i : t.intersectingPointRange(s))
+        pts.push_back(i);
+      EXPECT_EQUAL_STL_CONTAINER(pts, t.intersectingPoint(s));
+      EXPECT_EQUAL(r.empty(), got.empty());
+    }
+  }
+
+  ITree t(intervals, &getStartTest, &getEndTest);
+  Range r = t.intersectingIntervalRange(100, 300);
+  vector<TestInterval> all = t.intersectingInterval(100, 300);
+  Range::iterator it = r.begin();
+  std::advance(it, 5);
+  Range::iterator again = it;
+  EXPECT_EQUAL(*it == all[5], true);
+  EXPECT_EQUAL((++again)->getStart(), all[6].getStart());
+  EXPECT_EQUAL(it != again, true);
+  Range::iterator longOne = std::find_if(r.begin(), r.end(),
+      [](const TestInterval &i) { return i.getEnd() - i.getStart() > 35; });
+  EXPECT_EQUAL(longOne != r.end(), true);
+  EXPECT_EQUAL(longOne->getEnd() - longOne->getStart() > 35, true);
+  EXPECT_EQUAL(static_cast<size_t>(std::distance(r.begin(), r.end())),
+               all.size());
+  EXPECT_EQUAL(t.intersectingIntervalRange(1000, 2000).empty(), true);
+  EXPECT_EQUAL(ITree().intersectingPointRange(5).empty(), true);
+
+#if defined(__cpp_lib_ranges)
+  size_t n = 0;
+  for (const TestInterval &i : t.intersectingIntervalRange(100, 300) |
+                               std::views::take(3)) {
+    EXPECT_EQUAL(i == all[n], true);
+    ++n;
+  }
+  EXPECT_EQUAL(n, 3);
+#endif
+}
+
+/**
+ * \brief Test that a tree gathering statistics counts its queries, hits and
+ *        rebuilds, that they can be reset and are carried along when the
+ *        tree is moved, that only the root stores them, and that the default
+ *        tree doesn't gather any, or pay to store them.
+ */
+TEST(testQueryStats) {
+  typedef size_t (*Accessor)(const TestInterval&);
+  typedef IntervalTree<TestInterval, size_t, Accessor, Accessor,
+                       IntervalTreeCountingStats> STree;
+  vector<TestInterval> intervals = randomIntervals(2000, 5000, 50, 31);
+  STree t(intervals, &getStartTest, &getEndTest);
+  IntervalTreeStats s = t.stats();
+  EXPECT_EQUAL(s.queries, 0);
+  EXPECT_EQUAL(s.elementsReturned, 0);
+
+  size_t returned = 0, queries = 0;
+  for (size_t p = 0; p < 5100; p += 13) {
+    returned += t.intersectingPoint(p).size();
+    returned += t.intersectingInterval(p, p + 20).size();
+    queries += 2;
+  }
+  s = t.stats();
+  EXPECT_EQUAL(s.queries, queries);
+  EXPECT_EQUAL(s.elementsReturned, returned);
+  EXPECT_EQUAL(s.elementsScanned >= s.elementsReturned, true);
+  EXPECT_EQUAL(s.nodesVisited >= s.queries, true);
+  EXPECT_EQUAL(s.maxDepth > 0, true);
+  EXPECT_EQUAL(s.maxDepth <= t.report().depth, true);
+  EXPECT_EQUAL(s.rebuilds, 0);
+
+  t.resetStats();
+  s = t.stats();
+  EXPECT_EQUAL(s.queries, 0);
+  EXPECT_EQUAL(s.nodesVisited, 0);
+  EXPECT_EQUAL(s.maxDepth, 0);
+
+  t.intersectingPoint(100);
+  STree moved(std::move(t));
+  EXPECT_EQUAL(moved.stats().queries, 1);
+  t.intersectingPoint(100);
+  EXPECT_EQUAL(t.stats().queries, 0);
+
+  STree grown(&getStartTest, &getEndTest);
+  for (size_t i = 0; i < 1000; ++i) grown.insert(TestInterval(i, i + 5));
+  EXPECT_EQUAL(grown.stats().rebuilds > 0, true);
+
+  sort(intervals.begin(), intervals.end(), TestInterval::compare);
+  IntervalTreeBuilder<TestInterval, size_t, Accessor, Accessor,
+                      IntervalTreeCountingStats> b(&getStartTest,
+                                                   &getEndTest);
+  b.add(intervals.begin(), intervals.end());
+  STree built = b.build();
+  STree builtMoved(std::move(built));
+  EXPECT_EQUAL(builtMoved.stats().buildNanos > 0, true);
+  b.add(intervals.begin(), intervals.end());
+  grown = b.build();
+  EXPECT_EQUAL(grown.stats().rebuilds, 0);
+  EXPECT_EQUAL(grown.stats().buildNanos > 0, true);
+
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  EXPECT_EQUAL(sizeof(STree) <= sizeof(ITree) + sizeof(void*), true);
+  ITree plain(intervals, &getStartTest, &getEndTest);
+  plain.intersectingInterval(100, 200);
+  EXPECT_EQUAL(plain.stats().queries, 0);
+  EXPECT_EQUAL(plain.stats().elementsReturned, 0);
+}
+
+/**
+ * \brief the distance from <p> to <i> for the nearest queries, or -1 if it
+ *        isn't in the direction asked for (0 any, 1 before, 2 after). For
+ *        nearest, it's twice the distance, plus one if <i> doesn't contain
+ *        <p>, so that an open ended interval ending at <p> ranks after those
+ *        containing it; with <openStart>, so does one starting at <p>.
+ */
+static long
+nearestDistanceTest(const TestInterval &i, const size_t p, const int dir,
+                    const bool openEnded, const bool openStart = false) {
+  const long s = i.getStart(), e = i.getEnd(), q = p;
+  if (dir == 1) return ((e < q) || (openEnded && (e == q))) ? q - e : -1;
+  if (dir == 2) return ((s > q) || (openStart && (s == q))) ? s - q : -1;
+  if ((q < s) || (openStart && (q == s))) return 2 * (s - q) + 1;
+  if ((e < q) || (openEnded && (e == q))) return 2 * (q - e) + 1;
+  return 0;
+}
+
+/**
+ * \brief Test that the nearest queries give the k closest intervals in each
+ *        direction, closest first, by comparing the distances they give
+ *        with those of every interval, before and after updates.
+ */
+TEST(testNearestQueries) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(600, 20000, 80, 61);
+  const bool modes[] = {false, ITree::OPEN_ENDED};
+  const size_t ks[] = {1, 3, 20};
+  for (size_t m = 0; m < 2; ++m) {
+    ITree t(intervals, &getStartTest, &getEndTest, modes[m]);
+    vector<TestInterval> held(intervals);
+    for (size_t round = 0; round < 2; ++round) {
+      for (size_t p = 0; p < 20200; p += 53) {
+        for (int dir = 0; dir < 3; ++dir) {
+          vector<long> all;
+          for (size_t i = 0; i < held.size(); ++i) {
+            const long d = nearestDistanceTest(held[i], p, dir, modes[m]);
+            if (d >= 0) all.push_back(d);
+          }
+          sort(all.begin(), all.end());
+          for (size_t k = 0; k < 3; ++k) {
+            const vector<TestInterval> got =
+              (dir == 0) ? t.nearest(p, ks[k])
+                         : ((dir == 1) ? t.nearestBefore(p, ks[k])
+                                       : t.nearestAfter(p, ks[k]));
+            vector<long> dists;
+            for (size_t i = 0; i < got.size(); ++i)
+              dists.push_back(nearestDistanceTest(got[i], p, dir, modes[m]));
+            vector<long> exp(all.begin(),
+                             all.begin() + std::min(ks[k], all.size()));
+            EXPECT_EQUAL_STL_CONTAINER(dists, exp);
+          }
+        }
+      }
+      // change the tree, and check again
+      for (size_t i = 0; i < 300; ++i) {
+        EXPECT_EQUAL(t.erase(held.back()), true);
+        held.pop_back();
+      }
+      for (size_t i = 0; i < 50; ++i) {
+        held.push_back(TestInterval(400 * i, 400 * i + (i % 7)));
+        t.insert(held.back());
+      }
+    }
+  }
+
+  ITree empty(&getStartTest, &getEndTest);
+  EXPECT_EQUAL(empty.nearest(10).size(), 0);
+  ITree one(vector<TestInterval>(1, TestInterval(10, 20)), &getStartTest,
+            &getEndTest);
+  EXPECT_EQUAL(one.nearest(15, 0).size(), 0);
+  EXPECT_EQUAL(one.nearestBefore(15).size(), 0);
+  EXPECT_EQUAL(one.nearestAfter(20).size(), 0);
+  EXPECT_EQUAL(one.nearestAfter(9).size(), 1);
+  EXPECT_EQUAL(one.nearestBefore(21).size(), 1);
+
+  // open ended, [10, 20) doesn't contain 20, so [15, 30) is nearer to it
+  vector<TestInterval> two;
+  two.push_back(TestInterval(10, 20));
+  two.push_back(TestInterval(15, 30));
+  for (size_t i = 0; i < 2; ++i) {
+    ITree open(two, &getStartTest, &getEndTest, ITree::OPEN_ENDED);
+    EXPECT_EQUAL(open.nearest(20)[0], TestInterval(15, 30));
+    EXPECT_EQUAL(open.nearestBefore(20)[0], TestInterval(10, 20));
+    std::swap(two[0], two[1]);
+  }
+}
+
+/**
+ * \brief Test that squash gives every interval in the tree exactly once,
+ *        and, when asked, in order of start, for trees that have been built
+ *        in several ways and then changed.
+ */
+TEST(testSquash) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> intervals = randomIntervals(3000, 10000, 300, 71);
+  const IntervalSplitStrategy splits[] = {INTERVAL_SPLIT_MIDDLE_INTERVAL,
+                                          INTERVAL_SPLIT_MEDIAN};
+  for (size_t i = 0; i < 2; ++i) {
+    ITree t(intervals, &getStartTest, &getEndTest, false, 1, NULL,
+            splits[i]);
+    vector<TestInterval> all = t.squash(), ordered = t.squash(true);
+    EXPECT_EQUAL(ordered.size(), intervals.size());
+    EXPECT_EQUAL(std::is_sorted(ordered.begin(), ordered.end()), true);
+    sort(all.begin(), all.end(), TestInterval::compare);
+    vector<TestInterval> exp(intervals);
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(all, exp);
+    sort(ordered.begin(), ordered.end(), TestInterval::compare);
+    EXPECT_EQUAL_STL_CONTAINER(ordered, exp);
+
+    for (size_t j = 0; j < 2000; ++j) {
+      t.insert(TestInterval(j * 5, j * 5 + 3));
+      if (j % 2 == 0) t.erase(intervals[j]);
+    }
+    ordered = t.squash(true);
+    EXPECT_EQUAL(static_cast<int>(ordered.size()), t.size());
+    EXPECT_EQUAL(std::is_sorted(ordered.begin(), ordered.end()), true);
+  }
+  EXPECT_EQUAL(ITree(&getStartTest, &getEndTest).squash(true).size(), 0);
+}
+
+/**
+ * \brief Test coordinates above 2^53, where neighbouring integers don't fit
+ *        in a double. The mid-points must be kept exactly, or queries go the
+ *        wrong way at nodes whose intervals are shorter than a double's
+ *        precision there.
+ */
+TEST(testWideIntegerMids) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  const size_t base = (size_t(1) << 62) + 1;
+  vector<TestInterval> intervals;
+  for (size_t k = 0; k < 500; ++k)
+    intervals.push_back(TestInterval(base + 3 * k, base + 3 * k + k % 3));
+  const bool modes[] = {false, ITree::OPEN_ENDED};
+  for (size_t m = 0; m < 2; ++m) {
+    ITree t(intervals, &getStartTest, &getEndTest, modes[m]);
+    for (size_t p = base - 2; p < base + 1505; ++p) {
+      vector<TestInterval> exp = bruteForceIntersecting(intervals, p, p + 1,
+                                                        modes[m]);
+      vector<TestInterval> got = t.intersectingInterval(p, p + 1);
+      sort(exp.begin(), exp.end(), TestInterval::compare);
+      sort(got.begin(), got.end(), TestInterval::compare);
+      EXPECT_EQUAL_STL_CONTAINER(got, exp);
+      if (!modes[m]) {
+        EXPECT_EQUAL(t.countIntersectingPoint(p),
+                     bruteForceIntersecting(intervals, p, p).size());
+      }
+    }
+  }
+}
+
+/**
+ * \brief Test that the endpoint conventions agree with intervalIntersects
+ *        for every interval and query over a small range that doesn't end
+ *        before it starts, and that the runtime one does for the rest too;
+ *        and that the open (s, e) convention, which intervalIntersects has
+ *        no flag for, meets exactly what it should.
+ */
+TEST(testEndpointPolicies) {
+  size_t bad = 0;
+  for (int s = -3; s < 4; ++s) for (int e = s; e < 4; ++e)
+  for (int a = -3; a < 4; ++a) for (int b = -3; b < 4; ++b) {
+    for (int open = 0; open < 2; ++open) {
+      const bool exp = intervalIntersects(s, e, a, b, open);
+      if (IntervalRuntimeEndpoints(open).intersects(s, e, a, b) != exp) ++bad;
+      if (b < a) continue;
+      if ((open ? IntervalHalfOpenEndpoints().intersects(s, e, a, b)
+                : IntervalClosedEndpoints().intersects(s, e, a, b)) != exp)
+        ++bad;
+      if ((a == b) && (s <= a) &&
+          (IntervalRuntimeEndpoints(open).reaches(e, a) != exp))
+        ++bad;
+    }
+    if (b < a) continue;
+    // open (s, e): (p, p) is the point p
+    const bool openExp = (s < b) && (a < e);
+    if (IntervalOpenEndpoints().intersects(s, e, a, b) != openExp) ++bad;
+    if ((a == b) && ((IntervalOpenEndpoints().begins(s, a) &&
+                      IntervalOpenEndpoints().reaches(e, a)) != openExp))
+      ++bad;
+    if ((a == b) && ((IntervalClosedEndpoints().begins(s, a) &&
+                      IntervalClosedEndpoints().reaches(e, a)) !=
+                     intervalIntersects(s, e, a, a, false)))
+      ++bad;
+  }
+  EXPECT_EQUAL(bad, 0);
+}
+
+/**
+ * \brief count the queries on <t>, a tree of open (s, e) intervals, that
+ *        don't give what a brute force search of <held> does: point,
+ *        interval and count queries, batches, query ranges and nearest
+ *        queries, over every point from 0 to <span>.
+ */
+template <class Tree>
+static size_t
+openTreeMismatches(const Tree &t, const vector<TestInterval> &held,
+                   const size_t span) {
+  size_t bad = 0;
+  vector< std::pair<size_t, size_t> > queries;
+  for (size_t p = 0; p < span; ++p) {
+    vector<TestInterval> exp = bruteForceIntersectingOpen(held, p, p);
+    vector<TestInterval> got = t.intersectingPoint(p);
+    vector<TestInterval> ranged;
+    for (const TestInterval &i : t.intersectingPointRange(p))
+      ranged.push_back(i);
+    if (ranged != got) ++bad;
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    sort(got.begin(), got.end(), TestInterval::compare);
+    if ((got != exp) || (t.countIntersectingPoint(p) != exp.size())) ++bad;
+
+    const size_t q = p + p % 9;
+    queries.push_back(std::make_pair(p, q));
+    exp = bruteForceIntersectingOpen(held, p, q);
+    got = t.intersectingInterval(p, q);
+    ranged.clear();
+    for (const TestInterval &i : t.intersectingIntervalRange(p, q))
+      ranged.push_back(i);
+    if (ranged != got) ++bad;
+    sort(exp.begin(), exp.end(), TestInterval::compare);
+    sort(got.begin(), got.end(), TestInterval::compare);
+    if ((got != exp) || (t.countIntersectingInterval(p, q) != exp.size()))
+      ++bad;
+
+    for (int dir = 0; dir < 3; ++dir) {
+      vector<long> all;
+      for (size_t i = 0; i < held.size(); ++i) {
+        const long d = nearestDistanceTest(held[i], p, dir, true, true);
+        if (d >= 0) all.push_back(d);
+      }
+      sort(all.begin(), all.end());
+      all.resize(std::min<size_t>(all.size(), 4));
+      const vector<TestInterval> near =
+        (dir == 0) ? t.nearest(p, 4)
+                   : ((dir == 1) ? t.nearestBefore(p, 4)
+                                 : t.nearestAfter(p, 4));
+      vector<long> dists;
+      for (size_t i = 0; i < near.size(); ++i)
+        dists.push_back(nearestDistanceTest(near[i], p, dir, true, true));
+      if (dists != all) ++bad;
+    }
+  }
+  IntervalTreeBatchResult<TestInterval> r = t.intersectingIntervals(queries);
+  for (size_t i = 0; i < queries.size(); ++i) {
+    vector<TestInterval> got(r.hits.begin() + r.offsets[i],
+                             r.hits.begin() + r.offsets[i + 1]);
+    if (got != t.intersectingInterval(queries[i].first, queries[i].second))
+      ++bad;
+  }
+  return bad;
+}
+
+/**
+ * \brief Test that trees of open (s, e) intervals, with the static policy
+ *        and with the runtime one, answer every kind of query as a brute
+ *        force search does, including points on node mids and on interval
+ *        ends, before and after updates.
+ */
+TEST(testOpenEndpointTrees) {
+  typedef size_t (*Accessor)(const TestInterval&);
+  typedef IntervalTree<TestInterval, size_t, Accessor, Accessor,
+                       IntervalTreeNoStats, IntervalOpenEndpoints> OTree;
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  vector<TestInterval> held = randomIntervals(800, 600, 30, 83);
+  held.push_back(TestInterval(300, 300));
+  OTree o(held, &getStartTest, &getEndTest);
+  ITree r(held, &getStartTest, &getEndTest, INTERVAL_OPEN);
+  EXPECT_EQUAL(o.endpointConvention(), INTERVAL_OPEN);
+  EXPECT_EQUAL(r.endpointConvention(), INTERVAL_OPEN);
+  for (size_t round = 0; round < 2; ++round) {
+    EXPECT_EQUAL(openTreeMismatches(o, held, 650), 0);
+    EXPECT_EQUAL(openTreeMismatches(r, held, 650), 0);
+    // change the trees, and check again
+    for (size_t i = 0; i < 300; ++i) {
+      EXPECT_EQUAL(o.erase(held.back()), true);
+      EXPECT_EQUAL(r.erase(held.back()), true);
+      held.pop_back();
+    }
+    for (size_t i = 0; i < 60; ++i) {
+      held.push_back(TestInterval(10 * i, 10 * i + (i % 4)));
+      o.insert(held.back());
+      r.insert(held.back());
+    }
+  }
+}
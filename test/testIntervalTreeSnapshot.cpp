@@ -0,0 +1,162 @@
+/**
+ * \file  testIntervalTreeSnapshot.cpp
+ * \brief Unit tests for IntervalTreeSnapshot
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+// stl includes
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+#include <chrono>
+
+// TinyTest includes
+#include "TinyTest.hpp"
+
+// local includes
+#include "IntervalTree.hpp"
+#include "IntervalTreeSnapshot.hpp"
+#include "TestIntervals.hpp"
+
+// bring the following into the local name-space
+using std::vector;
+
+typedef IntervalTree<TestInterval, size_t> ITree;
+typedef IntervalTreeSnapshot<ITree> Snapshot;
+
+/**
+ * \brief Test that publishing replaces the current version, that a version
+ *        a reader still holds stays intact after it's replaced, and that a
+ *        failed rebuild leaves the current version in place.
+ */
+TEST(testSnapshotVersions) {
+  const vector<TestInterval> first = randomIntervals(300, 2000, 50, 61);
+  const vector<TestInterval> second = randomIntervals(500, 2000, 50, 62);
+  Snapshot snap;
+  EXPECT_EQUAL(snap.current() == NULL, true);
+  EXPECT_EQUAL(snap.version(), 0);
+
+  snap.publish(ITree(first, &getStartTest, &getEndTest));
+  Snapshot::Pointer held = snap.current();
+  EXPECT_EQUAL(held->size(), 300);
+  EXPECT_EQUAL(snap.version(), 1);
+
+  IntervalTreeArena *used = NULL;
+  snap.rebuildInArena([&](IntervalTreeArena *arena) {
+    used = arena;
+    return ITree(second, &getStartTest, &getEndTest, false, 1, arena);
+  }).get();
+  EXPECT_EQUAL(used != NULL, true);
+  EXPECT_EQUAL(snap.current()->size(), 500);
+  EXPECT_EQUAL(snap.version(), 2);
+  // the replaced version is still whole for the reader that holds it
+  EXPECT_EQUAL(held->size(), 300);
+  EXPECT_EQUAL(held->countIntersectingInterval(0, 2100),
+               bruteForceIntersecting(first, 0, 2100, false).size());
+
+  std::future<void> failed = snap.rebuild([]() -> ITree {
+    throw std::runtime_error("build failed");
+  });
+  bool threw = false;
+  try { failed.get(); } catch (const std::runtime_error&) { threw = true; }
+  EXPECT_EQUAL(threw, true);
+  EXPECT_EQUAL(snap.current()->size(), 500);
+  EXPECT_EQUAL(snap.version(), 2);
+
+  Snapshot::Pointer old = snap.publish(Snapshot::Pointer());
+  EXPECT_EQUAL(old->size(), 500);
+  EXPECT_EQUAL(snap.current() == NULL, true);
+}
+
+/**
+ * \brief Test that readers querying continuously while new versions are
+ *        built and published in the background always see a whole version:
+ *        every query gives the answer for the version it was asked of.
+ */
+TEST(testSnapshotConcurrentReaders) {
+  const size_t VERSIONS = 12;
+  vector< vector<TestInterval> > sets;
+  vector<size_t> expected;
+  for (size_t i = 0; i < VERSIONS; ++i) {
+    // each version has a different number of intervals, to tell them apart
+    sets.push_back(randomIntervals(200 + 25 * i, 3000, 80, 70 + i));
+    expected.push_back(bruteForceIntersecting(sets[i], 1000, 1500,
+                                              false).size());
+  }
+
+  Snapshot snap(ITree(sets[0], &getStartTest, &getEndTest));
+  std::atomic<bool> done(false);
+  std::atomic<size_t> wrong(0), queries(0);
+  vector<std::thread> readers;
+  for (size_t r = 0; r < 4; ++r) {
+    readers.push_back(std::thread([&]() {
+      while (!done.load()) {
+        Snapshot::Pointer t = snap.current();
+        const size_t v = (t->size() - 200) / 25;
+        if (t->countIntersectingInterval(1000, 1500) != expected[v]) ++wrong;
+        ++queries;
+      }
+    }));
+  }
+  for (size_t i = 1; i < VERSIONS; ++i) {
+    const vector<TestInterval> &set = sets[i];
+    snap.rebuildInArena([&set](IntervalTreeArena *arena) {
+      return ITree(set, &getStartTest, &getEndTest, false, 2, arena);
+    }).get();
+  }
+  done.store(true);
+  for (size_t r = 0; r < readers.size(); ++r) readers[r].join();
+
+  EXPECT_EQUAL(wrong.load(), 0);
+  EXPECT_EQUAL(queries.load() > 0, true);
+  EXPECT_EQUAL(snap.version(), VERSIONS);
+  EXPECT_EQUAL(snap.current()->size(), 200 + 25 * (VERSIONS - 1));
+}
+
+/**
+ * \brief Test that a rebuild whose future is dropped runs in the
+ *        background rather than holding up the caller, and that destroying
+ *        the holder waits for it to finish.
+ */
+TEST(testSnapshotDroppedRebuild) {
+  const vector<TestInterval> set = randomIntervals(300, 2000, 50, 63);
+  std::atomic<bool> released(false), sawRelease(false), finished(false);
+  {
+    Snapshot snap;
+    snap.rebuild([&]() {
+      // wait (for a while) for the caller to get past the call
+      const std::chrono::steady_clock::time_point giveUp =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+      while (!released.load() && (std::chrono::steady_clock::now() < giveUp))
+        std::this_thread::yield();
+      sawRelease.store(released.load());
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      finished.store(true);
+      return ITree(set, &getStartTest, &getEndTest);
+    });
+    released.store(true);
+  }
+  EXPECT_EQUAL(sawRelease.load(), true);
+  EXPECT_EQUAL(finished.load(), true);
+}
@@ -0,0 +1,175 @@
+/**
+ * \file  testMappedIntervalTree.cpp
+ * \brief Unit tests for the memory mapped interval tree class
+ *
+ * \authors Philip J. Uren
+ *
+ * \section copyright Copyright Details
+ * Copyright (C) 2010-2014 University of Southern California and Philip J. Uren
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ */
+
+// stl includes
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+
+// TinyTest includes
+#include "TinyTest.hpp"
+
+// local includes
+#include "IntervalTree.hpp"
+#include "FlatIntervalTree.hpp"
+#include "MappedIntervalTree.hpp"
+#include "TestIntervals.hpp"
+
+// bring the following into the local name-space
+using std::vector;
+using std::string;
+
+static const string TEST_FILE = "testMappedIntervalTree.tmp";
+
+/**
+ * \brief try to map the tree in TEST_FILE, checking every node if
+ *        <validate> is set
+ * \return true if it was rejected with an IntervalTreeError, else false
+ */
+static bool rejected(const bool validate = false) {
+  try {
+    MappedIntervalTree<TestInterval, size_t> t(TEST_FILE, &getStartTest,
+                                               &getEndTest, validate);
+  } catch (const IntervalTreeError &e) {
+    return true;
+  }
+  return false;
+}
+
+/**
+ * \brief Test that a tree written to disk and mapped back in gives the same
+ *        answers as the flat tree it was written from, and keeps its
+ *        endpoint convention, for each convention.
+ */
+TEST(testMappedMatchesFlatTree) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  typedef FlatIntervalTree<TestInterval, size_t> FTree;
+  typedef MappedIntervalTree<TestInterval, size_t> MTree;
+  vector<TestInterval> intervals = randomIntervals(500, 10000, 300, 3);
+  const IntervalEndpointConvention modes[] = {INTERVAL_CLOSED,
+                                              INTERVAL_HALF_OPEN,
+                                              INTERVAL_OPEN};
+  for (size_t m = 0; m < 3; ++m) {
+    FTree f(ITree(intervals, &getStartTest, &getEndTest, modes[m]));
+    MTree::write(f, TEST_FILE);
+    MTree t(TEST_FILE, &getStartTest, &getEndTest);
+    EXPECT_EQUAL(t.size(), 500);
+    EXPECT_EQUAL(t.endpointConvention(), modes[m]);
+    EXPECT_EQUAL(t.toString(), f.toString());
+    for (size_t p = 0; p < 10500; p += 37) {
+      EXPECT_EQUAL_STL_CONTAINER(t.intersectingPoint(p),
+                                 f.intersectingPoint(p));
+      EXPECT_EQUAL_STL_CONTAINER(t.intersectingInterval(p, p + 150),
+                                 f.intersectingInterval(p, p + 150));
+    }
+
+    // the mapping moves with the tree
+    MTree moved(std::move(t));
+    EXPECT_EQUAL(moved.size(), 500);
+    EXPECT_EQUAL(t.size(), 0);
+    EXPECT_EQUAL_STL_CONTAINER(moved.squash(), f.squash());
+  }
+
+  // an empty tree round-trips too
+  MTree::write(FTree(), TEST_FILE);
+  MTree e(TEST_FILE, &getStartTest, &getEndTest);
+  EXPECT_EQUAL(e.size(), 0);
+  EXPECT_EQUAL(e.intersectingPoint(5).size(), 0);
+  remove(TEST_FILE.c_str());
+}
+
+/**
+ * \brief Test that files which are missing, truncated, not tree images,
+ *        written for a different version or with corrupt sizes are rejected
+ *        when opened, and that corrupt nodes are too when validation is
+ *        asked for.
+ */
+TEST(testMappedRejectsBadFiles) {
+  typedef IntervalTree<TestInterval, size_t> ITree;
+  typedef FlatIntervalTree<TestInterval, size_t> FTree;
+  typedef MappedIntervalTree<TestInterval, size_t> MTree;
+  remove(TEST_FILE.c_str());
+  EXPECT_EQUAL(rejected(), true);
+
+  // write a good image, then damage copies of it
+  FTree f(ITree(IntervalFactory::getTestCase(2), &getStartTest,
+                &getEndTest));
+  MTree::write(f, TEST_FILE);
+  EXPECT_EQUAL(rejected(), false);
+  EXPECT_EQUAL(rejected(true), false);
+  std::ifstream in(TEST_FILE.c_str(), std::ios::binary);
+  const string image((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+  in.close();
+
+  vector<string> bad;
+  bad.push_back(image.substr(0, image.size() - 1));
+  bad.push_back(image.substr(0, 10));
+  bad.push_back("X" + image.substr(1));
+  string version = image;
+  version[12] = static_cast<char>(version[12] + 1);
+  bad.push_back(version);
+
+  // a node count so big that the size of the nodes wraps around to less
+  // than one node
+  typedef FlatIntervalTreeNode<size_t> Node;
+  MappedIntervalTreeHeader h;
+  memcpy(&h, image.data(), sizeof(h));
+  string nodes = image;
+  const uint64_t huge = UINT64_MAX / sizeof(Node) + 1;
+  memcpy(&nodes[offsetof(MappedIntervalTreeHeader, numNodes)], &huge,
+         sizeof(huge));
+  bad.push_back(nodes);
+
+  for (size_t i = 0; i < bad.size(); ++i) {
+    std::ofstream out(TEST_FILE.c_str(), std::ios::binary | std::ios::trunc);
+    out << bad[i];
+    out.close();
+    EXPECT_EQUAL(rejected(), true);
+  }
+
+  // a root with children or intervals that aren't there, or that points
+  // back at itself; the nodes are only looked at if validation is asked for
+  const size_t fields[] = {offsetof(Node, left), offsetof(Node, right),
+                           offsetof(Node, count), offsetof(Node, offset),
+                           offsetof(Node, left)};
+  const uint32_t values[] = {0x7FFFFFF0, 0x7FFFFFF0, 0x7FFFFFF0,
+                             0x7FFFFFF0, 0};
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+    string node = image;
+    memcpy(&node[h.nodesOffset + fields[i]], &values[i], sizeof(values[i]));
+    std::ofstream out(TEST_FILE.c_str(), std::ios::binary | std::ios::trunc);
+    out << node;
+    out.close();
+    EXPECT_EQUAL(rejected(), false);
+    EXPECT_EQUAL(rejected(true), true);
+  }
+  remove(TEST_FILE.c_str());
+}